@@ -0,0 +1,366 @@
+/**************************************************************************//**
+* @file      Bench.c
+* @brief     On-device micro-benchmarks of the bus and stack hot paths, run from the "bench" CLI command
+* @details   See Bench.h
+* @date      2020-04-26
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "Bench/Bench.h"
+#include "RuntimeStats/RuntimeStats.h"
+#include "I2cDriver/I2cDriver.h"
+#include "SeesawDriver/Seesaw.h"
+#include "WifiHandlerThread/WifiHandler.h"
+#include "ff.h"
+#include "ASF/sam0/drivers/dsu/crc32/crc32.h"	//DSU CRC32. asf.h's <crc32.h> resolves to the common service
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static const char * const benchNames[N_BENCHES] = {"i2c", "winc", "sdwrite", "sdread", "mqtt", "crc", "dsucrc"};
+uint32_t benchSamples[BENCH_MAX_RUNS];	///<Duration of each run of the benchmark in progress, in us
+FIL benchFile;	///<Scratch file of the SD benchmarks
+uint8_t benchSector[512];	///<Sector written to and read from benchFile
+SemaphoreHandle_t benchWifiDone = NULL;	///<Given by BenchWifiDone when the WiFi task has the result the CLI waits for
+struct BenchResult benchWifiResult;	///<Result of the WiFi benchmark, copied by BenchWifiDone
+volatile bool benchWifiBusy = false;	///<A WiFi benchmark is queued or running. BenchRun is not reentrant
+volatile bool benchWifiWaiting = false;	///<The CLI still waits for the WiFi benchmark. Cleared on timeout
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static int32_t BenchI2cSeesaw(void *context);
+static int32_t BenchSdWrite(void *context);
+static int32_t BenchSdRead(void *context);
+static int32_t BenchSdOpen(void);
+static int32_t BenchCrcSoftware(void *context);
+static int32_t BenchCrcDsu(void *context);
+static int32_t BenchExecuteOnWifi(enum eBenchId id, uint16_t runs, struct BenchResult *result);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		const char *BenchGetName(enum eBenchId id)
+* @brief	Returns the name the "bench" command knows a benchmark by
+* @note
+*****************************************************************************/
+const char *BenchGetName(enum eBenchId id)
+{
+	return (id < N_BENCHES) ? benchNames[id] : "?";
+}
+
+/**************************************************************************//**
+* @fn		int32_t BenchFindByName(const char *name, size_t len, enum eBenchId *id)
+* @brief	Looks a benchmark up by name
+* @param[in]	name Name of the benchmark, not necessarily null terminated
+* @param[in]	len Length of name
+* @param[out]	id Benchmark found
+* @return	Returns ERROR_NONE if found, ERROR_NOT_FOUND otherwise
+* @note
+*****************************************************************************/
+int32_t BenchFindByName(const char *name, size_t len, enum eBenchId *id)
+{
+	for (uint8_t bench = 0; bench < N_BENCHES; bench++)
+	{
+		if (strlen(benchNames[bench]) == len && strncmp(benchNames[bench], name, len) == 0)
+		{
+			*id = (enum eBenchId)bench;
+			return ERROR_NONE;
+		}
+	}
+	return ERROR_NOT_FOUND;
+}
+
+/**************************************************************************//**
+* @fn		int32_t BenchRun(BenchFunction function, void *context, uint16_t runs, uint32_t bytesPerRun, struct BenchResult *result)
+* @brief	Times runs calls to function with the run time statistics counter
+* @details	Stops at the first run that fails. The statistics cover the runs that completed before it.
+* @param[in]	function Single run of the benchmark
+* @param[in]	context Passed to function
+* @param[in]	runs Number of runs, up to BENCH_MAX_RUNS
+* @param[in]	bytesPerRun Payload each run moves, for the throughput. 0 if none
+* @param[out]	result Latency and throughput of the runs
+* @return	Returns ERROR_NONE, or the error of the run that failed
+* @note		Not reentrant. The CLI waits for the WiFi task to finish before it starts another benchmark
+*****************************************************************************/
+int32_t BenchRun(BenchFunction function, void *context, uint16_t runs, uint32_t bytesPerRun, struct BenchResult *result)
+{
+	uint64_t totalUs = 0;
+
+	memset(result, 0, sizeof(*result));
+	if (runs > BENCH_MAX_RUNS) runs = BENCH_MAX_RUNS;
+
+	for (uint16_t run = 0; run < runs; run++)
+	{
+		uint32_t start = RuntimeStatsGetCounter();
+		int32_t error = function(context);
+		uint32_t elapsedUs = RuntimeStatsCountsToUs(RuntimeStatsGetCounter() - start);
+
+		if (error != ERROR_NONE)
+		{
+			result->error = error;
+			break;
+		}
+		benchSamples[run] = elapsedUs;
+		totalUs += elapsedUs;
+		result->runs++;
+	}
+
+	if (result->runs == 0) goto exit;
+
+	//Insertion sort: at most BENCH_MAX_RUNS samples
+	for (uint16_t i = 1; i < result->runs; i++)
+	{
+		uint32_t sample = benchSamples[i];
+		uint16_t j = i;
+		for (; j > 0 && benchSamples[j - 1] > sample; j--)
+		{
+			benchSamples[j] = benchSamples[j - 1];
+		}
+		benchSamples[j] = sample;
+	}
+
+	result->minUs = benchSamples[0];
+	result->avgUs = (uint32_t)(totalUs / result->runs);
+	result->p99Us = benchSamples[(result->runs * 99 + 99) / 100 - 1]; //Nearest rank
+	if (totalUs > 0)
+	{
+		result->bytesPerSecond = (uint32_t)(((uint64_t)bytesPerRun * result->runs * 1000000UL) / totalUs);
+	}
+
+exit:
+	return result->error;
+}
+
+/**************************************************************************//**
+* @fn		int32_t BenchExecute(enum eBenchId id, uint16_t runs, struct BenchResult *result)
+* @brief	Runs a benchmark by id
+* @details	The WINC SPI and MQTT benchmarks are handed to the WiFi task, and the caller sleeps until they are done.
+* @param[in]	id Benchmark to run
+* @param[in]	runs Number of runs, up to BENCH_MAX_RUNS
+* @param[out]	result Latency and throughput of the runs
+* @return	Returns ERROR_NONE, or the error of the benchmark. ERROR_TIMEOUT if the WiFi task did not answer
+* @note		Call from a task, not from an interrupt
+*****************************************************************************/
+int32_t BenchExecute(enum eBenchId id, uint16_t runs, struct BenchResult *result)
+{
+	int32_t error = ERROR_NONE;
+	uint32_t crc;
+
+	memset(result, 0, sizeof(*result));
+
+	switch (id)
+	{
+		case BENCH_I2C_SEESAW:
+			error = BenchRun(BenchI2cSeesaw, NULL, runs, 2 + 1, result);
+			break;
+
+		case BENCH_SD_WRITE:
+		case BENCH_SD_READ:
+			error = BenchSdOpen();
+			if (error != ERROR_NONE) break;
+			error = BenchRun((id == BENCH_SD_WRITE) ? BenchSdWrite : BenchSdRead, NULL, runs, sizeof(benchSector), result);
+			f_close(&benchFile);
+			break;
+
+		case BENCH_CRC_SW:
+			error = BenchRun(BenchCrcSoftware, &crc, runs, BENCH_CRC_SPAN, result);
+			break;
+
+		case BENCH_CRC_DSU:
+			dsu_crc32_init();
+			error = BenchRun(BenchCrcDsu, &crc, runs, BENCH_CRC_SPAN, result);
+			break;
+
+		case BENCH_WINC_SPI:
+		case BENCH_MQTT_PUBACK:
+			error = BenchExecuteOnWifi(id, runs, result);
+			break;
+
+		default:
+			error = ERROR_INVALID_ARG;
+			break;
+	}
+
+	if (result->error == ERROR_NONE) result->error = error;
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		void BenchWifiDone(const struct BenchResult *result)
+* @brief	Called by the WiFi task when it finished a benchmark queued by BenchExecute
+* @details	Hands the result to the CLI task if it still waits for it. A result that comes in after the CLI gave up
+*			is dropped, so the WiFi task never writes to a result the CLI no longer owns.
+* @param[in]	result Result of the benchmark
+* @note		Call from the WiFi task
+*****************************************************************************/
+void BenchWifiDone(const struct BenchResult *result)
+{
+	bool waiting;
+
+	taskENTER_CRITICAL();
+	waiting = benchWifiWaiting;
+	if (waiting) benchWifiResult = *result;
+	benchWifiWaiting = false;
+	benchWifiBusy = false;
+	taskEXIT_CRITICAL();
+
+	if (waiting) xSemaphoreGive(benchWifiDone);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static int32_t BenchExecuteOnWifi(enum eBenchId id, uint16_t runs, struct BenchResult *result)
+* @brief	Queues a WINC SPI or MQTT benchmark to the WiFi task and sleeps until BenchWifiDone hands the result over
+* @details	Waits on a semaphore of its own: the CLI task's notification value counts the received characters.
+*			Returns ERROR_BUSY while a benchmark that timed out is still running in the WiFi task.
+* @return	Returns ERROR_NONE, or the error of the benchmark. ERROR_TIMEOUT if the WiFi task did not answer
+* @note
+*****************************************************************************/
+static int32_t BenchExecuteOnWifi(enum eBenchId id, uint16_t runs, struct BenchResult *result)
+{
+	struct WifiBenchRequest request = {(uint8_t)id, runs};
+	bool busy, delivered;
+
+	if (benchWifiDone == NULL) benchWifiDone = xSemaphoreCreateBinary();
+	if (benchWifiDone == NULL) return ERROR_NO_MEMORY;
+
+	taskENTER_CRITICAL();
+	busy = benchWifiBusy;
+	if (!busy)
+	{
+		benchWifiBusy = true;
+		benchWifiWaiting = true;
+	}
+	taskEXIT_CRITICAL();
+	if (busy) return ERROR_BUSY;
+
+	if (WifiAddBenchRequest(&request) != pdTRUE)
+	{
+		benchWifiWaiting = false;
+		benchWifiBusy = false;
+		return ERROR_BUSY;
+	}
+
+	if (xSemaphoreTake(benchWifiDone, pdMS_TO_TICKS(BENCH_WIFI_TIMEOUT)) != pdTRUE)
+	{
+		//The WiFi task may have handed the result over between the timeout and here
+		taskENTER_CRITICAL();
+		delivered = !benchWifiWaiting;
+		benchWifiWaiting = false;
+		taskEXIT_CRITICAL();
+		if (!delivered) return ERROR_TIMEOUT;
+		xSemaphoreTake(benchWifiDone, portMAX_DELAY);	//Given right after, so the next request starts with it taken
+	}
+
+	*result = benchWifiResult;
+	return result->error;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchI2cSeesaw(void *context)
+* @brief	One Seesaw round trip: write the HW ID register address, read the ID back
+* @note
+*****************************************************************************/
+static int32_t BenchI2cSeesaw(void *context)
+{
+	static const uint8_t msgGetHwId[] = {SEESAW_STATUS_BASE, SEESAW_STATUS_HW_ID};
+	uint8_t hwId = 0;
+	I2C_Data data;
+
+	data.address = NEO_TRELLIS_ADDR;
+	data.msgOut = msgGetHwId;
+	data.lenOut = sizeof(msgGetHwId);
+	data.msgIn = &hwId;
+	data.lenIn = sizeof(hwId);
+
+	int32_t error = I2cReadDataWait(&data, 0, 100);
+	if (error == ERROR_NONE && hwId != SEESAW_HW_ID_CODE) error = ERROR_BAD_DATA;
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchSdOpen(void)
+* @brief	Opens the scratch file of the SD benchmarks, making sure it holds a whole sector to read
+* @return	Returns ERROR_NONE, ERROR_NOT_READY if no card is mounted, ERROR_IO on other FatFs errors
+* @note
+*****************************************************************************/
+static int32_t BenchSdOpen(void)
+{
+	UINT written;
+	FRESULT res = f_open(&benchFile, BENCH_SD_FILE, FA_OPEN_ALWAYS | FA_READ | FA_WRITE);
+	if (res == FR_NOT_ENABLED || res == FR_NOT_READY) return ERROR_NOT_READY;
+	if (res != FR_OK) return ERROR_IO;
+
+	if (benchFile.fsize < sizeof(benchSector))
+	{
+		for (uint16_t i = 0; i < sizeof(benchSector); i++) benchSector[i] = (uint8_t)i;
+		res = f_write(&benchFile, benchSector, sizeof(benchSector), &written);
+		if (res == FR_OK) res = f_sync(&benchFile);
+		if (res != FR_OK)
+		{
+			f_close(&benchFile);
+			return ERROR_IO;
+		}
+	}
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchSdWrite(void *context)
+* @brief	Writes the first sector of the scratch file. Sector aligned, so FatFs sends it straight to the card
+* @note
+*****************************************************************************/
+static int32_t BenchSdWrite(void *context)
+{
+	UINT written = 0;
+	FRESULT res = f_lseek(&benchFile, 0);
+	if (res == FR_OK) res = f_write(&benchFile, benchSector, sizeof(benchSector), &written);
+	return (res == FR_OK && written == sizeof(benchSector)) ? ERROR_NONE : ERROR_IO;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchSdRead(void *context)
+* @brief	Reads the first sector of the scratch file. Sector aligned, so FatFs reads it straight from the card
+* @note
+*****************************************************************************/
+static int32_t BenchSdRead(void *context)
+{
+	UINT read = 0;
+	FRESULT res = f_lseek(&benchFile, 0);
+	if (res == FR_OK) res = f_read(&benchFile, benchSector, sizeof(benchSector), &read);
+	return (res == FR_OK && read == sizeof(benchSector)) ? ERROR_NONE : ERROR_IO;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchCrcSoftware(void *context)
+* @brief	Software CRC32 (common service) over the start of the flash
+* @param[out]	context uint32_t receiving the CRC
+* @note
+*****************************************************************************/
+static int32_t BenchCrcSoftware(void *context)
+{
+	return (crc32_calculate((const void *)FLASH_ADDR, BENCH_CRC_SPAN, (crc32_t *)context) == STATUS_OK) ? ERROR_NONE : ERROR_FAILURE;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t BenchCrcDsu(void *context)
+* @brief	DSU hardware CRC32 over the start of the flash
+* @param[out]	context uint32_t receiving the CRC
+* @note		The DSU driver masks the interrupts during the calculation
+*****************************************************************************/
+static int32_t BenchCrcDsu(void *context)
+{
+	uint32_t *crc = (uint32_t *)context;
+	*crc = 0xFFFFFFFF;
+	return (dsu_crc32_cal(FLASH_ADDR, BENCH_CRC_SPAN, crc) == STATUS_OK) ? ERROR_NONE : ERROR_IO;
+}
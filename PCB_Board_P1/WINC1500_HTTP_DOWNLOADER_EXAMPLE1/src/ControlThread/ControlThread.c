@@ -14,7 +14,9 @@
 #include "WifiHandlerThread/WifiHandler.h"
 #include "UiHandlerThread/UiHandlerThread.h"
 #include "SeesawDriver/Seesaw.h"
+#include "LedAnimation/LedAnimation.h"
 #include "thumbstick/thumbstick.h"
+#include "SensorScheduler/SensorScheduler.h"
 #include <errno.h>
 #include <stdio.h>
 #include <time.h>
@@ -27,6 +29,7 @@
 /******************************************************************************
 * Defines
 ******************************************************************************/
+#define CONTROL_LED_FADE_MS		120	///<Fade out of the LED the player moves away from
 
 /******************************************************************************
 * Variables
@@ -41,6 +44,7 @@ int steps[6];		///< the steps player one has goes through
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static uint16_t ControlReadThumbstickX(void);
 
 /******************************************************************************
 * Callback Functions
@@ -85,11 +89,7 @@ void vControlHandlerTask( void *pvParameters )
 				SerialConsoleWriteString("Now are at the place of waiting for game start\r\n");
 				i++;
 
-				for(int j = 0; j < 15; j++)
-				{
-					SeesawSetLed(j,0,0,0); //Turn button 15 off
-					SeesawOrderLedUpdate();
-				}
+				LedAnimFill(0,0,0,0); //Turn every button off
 			}
 		
 		break;
@@ -106,8 +106,7 @@ void vControlHandlerTask( void *pvParameters )
 		steps[0] = location;
 		
 		//update the first led
-		SeesawSetLed(location-1, 90,0,200);
-		SeesawOrderLedUpdate();
+		LedAnimSetKey(location-1, 90,0,200,0);
 		SendRealTimeUserGameInput(1,location,1);
 		prev_led = location;
 		
@@ -116,11 +115,11 @@ void vControlHandlerTask( void *pvParameters )
 		{	
 			
 			//1.first step: read until joystick have a signal
-			raw_value = ts_read_x();
+			raw_value = ControlReadThumbstickX();
 			while(raw_value < TS_X_THRESHOLD_RIGHT && raw_value > TS_X_THRESHOLD_LEFT)
 			{
 				vTaskDelay(40);
-				raw_value = ts_read_x();
+				raw_value = ControlReadThumbstickX();
 			}
 			
 			//2.get the next location
@@ -145,21 +144,20 @@ void vControlHandlerTask( void *pvParameters )
 			vTaskDelay(400);
 			
 			//3.wait tail the joystick reach neutral position
-			raw_value = ts_read_x();
+			raw_value = ControlReadThumbstickX();
 			while(raw_value > TS_X_THRESHOLD_RIGHT || raw_value < TS_X_THRESHOLD_LEFT)
 			{	
 				vTaskDelay(40);
-				raw_value = ts_read_x();
+				raw_value = ControlReadThumbstickX();
 			}
 			
 			
 			//4.update led, send the real time signal
 
-			SeesawSetLed(prev_led-1,0,0,0);
-			SeesawSetLed(location-1, 90,0,200);
-			SeesawOrderLedUpdate();
+			//both start on the same animation frame, the new location last in case it did not change
+			LedAnimSetKey(prev_led-1,0,0,0,CONTROL_LED_FADE_MS);
+			LedAnimSetKey(location-1, 90,0,200,0);
 			prev_led = location;
-			vTaskDelay(40);
 			SendRealTimeUserGameInput(1,location,1);
 			
 			
@@ -232,3 +230,20 @@ void StartJXGame(void)
 	controlState = CONTROL_PLAYING_MOVE;
 	
 }
+
+
+
+/**************************************************************************//**
+static uint16_t ControlReadThumbstickX(void)
+* @brief	Returns the latest thumb stick X value sampled by the sensor task
+* @return	Raw X value. The neutral position until the first sample is in
+* @note     The ADC is only read by the sensor task
+*****************************************************************************/
+static uint16_t ControlReadThumbstickX(void)
+{
+	struct SensorSample sample;
+
+	if(SensorGetLatest(SENSOR_THUMBSTICK, &sample) != ERROR_NONE)
+		return (TS_X_THRESHOLD_LEFT + TS_X_THRESHOLD_RIGHT) / 2;
+	return (uint16_t)sample.value[0];
+}
@@ -5,6 +5,8 @@ In this mode, it will work with an UART driver. The MCU can send 0x55 and should
 If you send 0x50, it will return the temperature in Degrees C.
 
 This criver will be written compatible to be run from RTOS thread, with non-blocking commands in mind.
+In streaming mode (DistanceSensorStartStream) the USART callbacks send the next read command as soon as an answer is in,
+filter the readings (median, then EMA) and keep the latest result in a slot that DistanceSensorGetLatest reads without blocking.
 See https://www.bananarobotics.com/shop/US-100-Ultrasonic-Distance-Sensor-Module for more information
 * @author    Eduardo Garcia
 * @date      2020-04-08
@@ -29,9 +31,31 @@ See https://www.bananarobotics.com/shop/US-100-Ultrasonic-Distance-Sensor-Module
 #define DISTANCE_US_100_CMD_READ_DISTANCE		0x55 ///<Command to send to the US-100 to order a distance command
 #define DISTANCE_US_100_CMD_READ_TEMPERATURE	0x50 ///<Command to send to the US-100 to order a temperature command read
 
+#define DISTANCE_MIN_MM						20 ///<Shortest distance the US-100 measures. Shorter readings are discarded by the stream
+#define DISTANCE_MAX_MM						4500 ///<Longest distance the US-100 measures. Longer readings are discarded by the stream
+#define DISTANCE_MEDIAN_MAX					7 ///<Largest median window of the stream filter, in readings
+#define DISTANCE_EMA_MAX_SHIFT				4 ///<Largest EMA shift of the stream filter: a new reading weighs 1/16
+#define DISTANCE_DEFAULT_MEDIAN				5 ///<Median window at startup
+#define DISTANCE_DEFAULT_EMA_SHIFT			2 ///<EMA shift at startup: a new reading weighs 1/4
+#define DISTANCE_STREAM_TIMEOUT_MS			100 ///<Time without an answer after which DistanceSensorCheckStream restarts the stream
+
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
+///Latest filtered distance of the stream
+struct DistanceReading {
+	uint16_t distance;	///<Filtered distance, in mm
+	uint16_t raw;	///<Latest valid reading, in mm
+	TickType_t timestamp;	///<Tick count (ms) the latest valid reading came in at
+	uint32_t count;	///<Valid readings since the stream started
+};
+
+///Counters of the stream
+struct DistanceStreamStats {
+	uint32_t readings;	///<Answers received
+	uint32_t rejected;	///<Answers out of DISTANCE_MIN_MM to DISTANCE_MAX_MM, left out of the filter
+	uint32_t restarts;	///<Times the stream stalled and was restarted
+};
 
 /******************************************************************************
 * Global Function Declarations
@@ -46,6 +70,13 @@ void DeinitializeDistanceSerial(void);
 
 int32_t DistanceSensorGetDistance (uint16_t *distance, const TickType_t xMaxBlockTime);
 
+int32_t DistanceSensorStartStream(void);
+void DistanceSensorStopStream(void);
+int32_t DistanceSensorCheckStream(void);
+int32_t DistanceSensorSetFilter(uint8_t medianWindow, uint8_t emaShift);
+int32_t DistanceSensorGetLatest(struct DistanceReading *reading);
+void DistanceSensorGetStreamStats(struct DistanceStreamStats *stats);
+
 
 
 
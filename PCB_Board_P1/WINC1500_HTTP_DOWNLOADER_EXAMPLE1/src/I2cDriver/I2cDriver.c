@@ -11,6 +11,10 @@
 * Includes
 ******************************************************************************/
 #include "I2cDriver.h"
+#include "SeesawDriver/Seesaw.h"
+#include "IMU/lsm6ds_reg.h"
+#include "I2cDriver/shtc3.h"
+#include "RuntimeStats/RuntimeStats.h"
 
 /******************************************************************************
 * Defines
@@ -25,12 +29,61 @@ static volatile TaskHandle_t xTaskToNotifySensorDone = NULL; ///< Stores the han
 static uint8_t sensorTransmitError = false;					 ///<Flag used to indicate that there was an I2C transmission error on the SENSOR bus.
 
 struct i2c_master_module i2cSensorBusInstance;
+
+///Every device on the sensor bus. The bus runs at the fastest speed they all support
+static const struct I2cDeviceProfile i2cDeviceProfiles[] = {
+	{NEO_TRELLIS_ADDR, I2C_SPEED_FAST_KHZ, SEESAW_READ_DELAY},	//Seesaw (SAMD09 slave). Its firmware prepares the register after the write: never read with a repeated start
+	{LSM6DS3_I2C_ADD_L >> 1, I2C_SPEED_FAST_KHZ, 0},	//IMU
+	{SHTC3_ADDRESS, I2C_SPEED_FAST_PLUS_KHZ, 0},	//Temperature and humidity. Its wake-up and measurement times are given by the driver, per command
+};
+static uint16_t i2cBusSpeedKhz = I2C_SPEED_STANDARD_KHZ;	///<SCL frequency the sensor bus runs at
+
+static const char * const i2cPhaseNames[N_I2C_PHASES] = {"queue", "write", "delay", "read", "wr+rd"};
+static struct I2cDeviceStats i2cStats[I2C_STATS_MAX_DEVICES];	///<Written by the bus thread only
+static uint8_t i2cStatsDevices = 0;	///<Entries of i2cStats in use
+static volatile uint32_t i2cBusResets = 0;	///<Times the driver had to release the bus itself: forced STOP or cancelled job
 static I2C_Bus_State I2cSensorBusState;   ///<Structure that defines the I2C Bus used for the sensors.
 
 struct i2c_master_packet sensorPacketWrite;
+struct i2c_master_packet sensorPacketRead;	///<Read phase of a combined transfer, started from the write complete interrupt
+static I2C_Data * volatile sensorPendingRead = NULL;	///<Combined transfer waiting for its repeated start read. NULL if none
+
+#if I2C_SENSOR_DMA
+struct dma_resource sensorDmaTxResource;	///<DMA channel feeding the sensor bus DATA register
+struct dma_resource sensorDmaRxResource;	///<DMA channel draining the sensor bus DATA register
+COMPILER_ALIGNED(16) DmacDescriptor sensorDmaTxDescriptor SECTION_DMAC_DESCRIPTOR;	///<Reprogrammed for every DMA write
+COMPILER_ALIGNED(16) DmacDescriptor sensorDmaRxDescriptor SECTION_DMAC_DESCRIPTOR;	///<Reprogrammed for every DMA read
+static volatile bool sensorDmaActive = false;	///<The job in flight is a DMA transfer: the SERCOM interrupt does not signal its end
+#endif
+
+QueueHandle_t xQueueI2cRequests = NULL;	///<Requests waiting for the bus thread
+static TaskHandle_t i2cBusTaskHandle = NULL;	///<Bus thread: the only one starting transfers on the sensor bus
+static struct I2cRequest *i2cParked[I2C_BUS_MAX_PARKED];	///<Requests between their write and their read phase
+static struct I2cRequest *i2cHeld[I2C_BUS_MAX_HELD];	///<Requests that cannot start before a parked request is read, oldest first
+static uint8_t i2cHeldCount = 0;	///<Entries of i2cHeld in use
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
+static void vI2cBusTask(void *pvParameters);
+static int32_t I2cBusRunPhase(I2C_Data *data, int32_t (*start)(I2C_Data *data), enum eI2cPhase phase, TickType_t timeout);
+static void I2cBusStartRequest(struct I2cRequest *request);
+static void I2cBusFinishParked(uint8_t slot);
+static bool I2cBusCanStart(struct I2cRequest *request, uint8_t heldBefore);
+static bool I2cBusStartHeld(void);
+static void I2cBusComplete(struct I2cRequest *request, int32_t error);
+static int32_t I2cSubmitWait(struct I2cRequest *request);
+static uint16_t I2cGetCommonSpeedKhz(void);
+static TickType_t I2cGetDeviceMinDelay(uint8_t address);
+static struct I2cDeviceStats *I2cStatsFind(uint8_t address);
+static void I2cStatsRecord(uint8_t address, enum eI2cPhase phase, uint32_t start);
+#if I2C_SENSOR_DMA
+static void I2cDriverConfigureSensorDma(void);
+static bool I2cUseDma(uint16_t length);
+static enum status_code I2cStartDma(I2C_Data *data, enum i2c_transfer_direction direction);
+static int32_t I2cFinishDma(void);
+static void I2cAbortDma(void);
+static void I2cSensorsDmaDone(struct dma_resource *const resource);
+#endif
 static int32_t I2cDriverConfigureSensorBus(void)
 {
 	int32_t error = STATUS_OK;
@@ -39,6 +92,9 @@ static int32_t I2cDriverConfigureSensorBus(void)
 	struct i2c_master_config config_i2c_master;
 	i2c_master_get_config_defaults(&config_i2c_master);
 	
+	i2cBusSpeedKhz = I2cGetCommonSpeedKhz();
+	config_i2c_master.baud_rate = i2cBusSpeedKhz;
+	config_i2c_master.transfer_speed = (i2cBusSpeedKhz > I2C_SPEED_FAST_KHZ) ? I2C_MASTER_SPEED_FAST_MODE_PLUS : I2C_MASTER_SPEED_STANDARD_AND_FAST;
 	config_i2c_master.pinmux_pad0 = PINMUX_PA08C_SERCOM0_PAD0;
 	config_i2c_master.pinmux_pad1 = PINMUX_PA09C_SERCOM0_PAD1;
 	/* Change buffer timeout to something longer */
@@ -77,6 +133,29 @@ static int32_t I2cDriverConfigureSensorBus(void)
  *****************************************************************************/
 void I2cSensorsTxComplete(struct i2c_master_module *const module){
 	
+	I2C_Data *data = sensorPendingRead;
+
+	//Combined transfer: read with a repeated start, the task is woken when the read is done
+	if(NULL != data){
+		sensorPendingRead = NULL;
+#if I2C_SENSOR_DMA
+		if(I2cUseDma(data->lenIn)){
+			if(STATUS_OK == I2cStartDma(data, I2C_TRANSFER_READ)) return;
+		}else
+#endif
+		{
+			sensorPacketRead.address = data->address;
+			sensorPacketRead.data = data->msgIn;
+			sensorPacketRead.data_length = data->lenIn;
+			if(STATUS_OK == i2c_master_read_packet_job(module, &sensorPacketRead)) return;
+		}
+
+		i2c_master_send_stop(module);
+		i2cBusResets++;
+		I2cSensorsError(module);
+		return;
+	}
+
 	I2cSensorBusState.i2cState = I2C_BUS_READY;
 	I2cSensorBusState.rxDoneFlag = true;			
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
@@ -121,12 +200,19 @@ void I2cSensorsRxComplete(struct i2c_master_module *const module){
  *****************************************************************************/
 void I2cSensorsError(struct i2c_master_module *const module){
 	
+	//NACK during the write of a combined transfer: ASF did not release the bus
+	if(NULL != sensorPendingRead){
+		sensorPendingRead = NULL;
+		i2c_master_send_stop(module);
+		i2cBusResets++;
+	}
+
 	I2cSensorBusState.i2cState = I2C_BUS_READY;
 	I2cSensorBusState.txDoneFlag = true;
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	
+	sensorTransmitError = true;
 	xSemaphoreGiveFromISR( sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken );
-	sensorTransmitError = false;
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
@@ -161,6 +247,9 @@ void I2cDriverRegisterSensorBusCallbacks(void)
 	if(STATUS_OK != error) goto exit;
 	
 	I2cDriverRegisterSensorBusCallbacks();
+#if I2C_SENSOR_DMA
+	I2cDriverConfigureSensorDma();
+#endif
 	
 		
 	sensorI2cMutexHandle = xSemaphoreCreateMutex();
@@ -169,11 +258,18 @@ void I2cDriverRegisterSensorBusCallbacks(void)
 	//xSemaphoreGive(sensorI2cSemaphoreHandle);
 
 	
-	if(NULL == sensorI2cMutexHandle || NULL == sensorI2cSemaphoreHandle){
+	xQueueI2cRequests = xQueueCreate(I2C_REQUEST_QUEUE_LENGTH, sizeof(struct I2cRequest *));
+
+	if(NULL == sensorI2cMutexHandle || NULL == sensorI2cSemaphoreHandle || NULL == xQueueI2cRequests){
 		error = STATUS_SUSPEND;	//Could not initialize mutex!
 		goto exit;
 	}
 
+	if(xTaskCreate(vI2cBusTask, "I2C Bus", I2C_BUS_TASK_SIZE, NULL, I2C_BUS_TASK_PRIORITY, &i2cBusTaskHandle) != pdPASS){
+		error = STATUS_SUSPEND;
+		goto exit;
+	}
+
 	exit:
 	return error;		
 }
@@ -208,14 +304,20 @@ int32_t I2cWriteData(I2C_Data *data){
 		goto exit;
 	}
 
-	//Prepare to write
-	sensorPacketWrite.address = data->address;
-	sensorPacketWrite.data = (uint8_t*) data->msgOut;
-	sensorPacketWrite.data_length = data->lenOut;
-	
-	//Write
-
-	 hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+#if I2C_SENSOR_DMA
+	if(I2cUseDma(data->lenOut)){
+		hwError = I2cStartDma(data, I2C_TRANSFER_WRITE);
+	}else
+#endif
+	{
+		//Prepare to write
+		sensorPacketWrite.address = data->address;
+		sensorPacketWrite.data = (uint8_t*) data->msgOut;
+		sensorPacketWrite.data_length = data->lenOut;
+		
+		//Write
+		hwError = i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+	}
 	
 	if(STATUS_OK != hwError)
 	{
@@ -247,22 +349,71 @@ int32_t I2cReadData(I2C_Data *data){
 	
 	
 	//Check parameters
-	if(data == NULL || data->msgOut == NULL){
+	if(data == NULL || data->msgIn == NULL){
+		error = ERR_INVALID_ARG;
+		goto exit;
+	}
+
+#if I2C_SENSOR_DMA
+	if(I2cUseDma(data->lenIn)){
+		hwError = I2cStartDma(data, I2C_TRANSFER_READ);
+	}else
+#endif
+	{
+		//Prepare to read
+		sensorPacketWrite.address = data->address;
+		sensorPacketWrite.data = data->msgIn;
+		sensorPacketWrite.data_length = data->lenIn;
+		
+		//Read
+		hwError = i2c_master_read_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+	}
+	
+	if(STATUS_OK != hwError)
+	{
+		error = ERROR_IO;
+		goto exit;
+	}
+	
+	exit:
+	return error;
+}
+
+
+
+/**************************************************************************//**
+ * @fn    int32_t I2cWriteReadData(I2C_Data *data)
+ * @brief       Function call to write the bytes of data (e.g. a register address), then read the requested bytes, in a single transfer
+ * @details     The write ends without a STOP, and the write complete interrupt starts the read with a repeated start. The bus is not released between the two,
+				and the interrupt at the end of the read is the only one signaled to the task.
+ * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
+ * @return      Returns an error message in case of error. See ErrCodes.h
+ * @note        For devices that answer at once. A device that needs time between the write and the read needs a delay: see I2cReadDataWait
+ *****************************************************************************/
+int32_t I2cWriteReadData(I2C_Data *data){
+	
+	int32_t error = ERROR_NONE;
+	enum status_code hwError;
+	
+	//Check parameters
+	if(data == NULL || data->msgOut == NULL || data->msgIn == NULL){
 		error = ERR_INVALID_ARG;
 		goto exit;
 	}
 
-	//Prepare to read
+	//Prepare to write, then read from the interrupt
 	sensorPacketWrite.address = data->address;
-	sensorPacketWrite.data = data->msgIn;
-	sensorPacketWrite.data_length = data->lenIn;
+	sensorPacketWrite.data = (uint8_t*) data->msgOut;
+	sensorPacketWrite.data_length = data->lenOut;
+	sensorPendingRead = data;
 	
-	//Read
+	//Write
 
-	hwError = i2c_master_read_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+	hwError = i2c_master_write_packet_job_no_stop(&i2cSensorBusInstance, &sensorPacketWrite);
 	
 	if(STATUS_OK != hwError)
 	{
+		sensorPendingRead = NULL;
 		error = ERROR_IO;
 		goto exit;
 	}
@@ -310,12 +461,6 @@ int32_t I2cGetMutex(TickType_t waitTime){
 	return error;
 }
 
-static int32_t I2cGetSemaphoreHandle(SemaphoreHandle_t *handle){
-	int32_t error = ERROR_NONE;
-	*handle = sensorI2cSemaphoreHandle;
-	return error;
-}
-
 
 /**************************************************************************//**
  * @fn			static uint8_t I2cGetTaskErrorStatus(I2C_Data *data)
@@ -343,69 +488,122 @@ static int32_t I2cGetSemaphoreHandle(SemaphoreHandle_t *handle){
 
 
 /**************************************************************************//**
- * @fn			int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
- * @brief       This is the main function to use to write data from an I2C device on a given I2C Bus. This function is blocking.
- * @details     This function writes data from an I2C device, by writing the requested bytes.This function is blocking (bare-metal) or it
-				makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-				On FreeRtos, this function gets the mutex for the respective I2C bus.
- * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
- * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be 
-				the delay an I2C device needs to make a measurement.
- * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
- * @return      Returns an error message in case of error.
+ * @fn			int32_t I2cSubmit(struct I2cRequest *request, TickType_t waitTime)
+ * @brief       Queues a transaction for the bus thread and returns at once
+ * @details     The bus thread runs the requests back to back. While a request waits out its delay between the write and the read,
+				the requests for other devices use the bus. When the request is over, the bus thread sets its error and done fields,
+				calls its callback and notifies its notify task.
+ * @param[in]   request Transaction to run. It must stay valid, and must not be changed, until done is set
+ * @param[in]   waitTime Max time for the thread to wait for room in the queue
+ * @return      Returns ERROR_NONE if queued, ERROR_BUSY if the queue stayed full, ERROR_NOT_INITIALIZED before I2cInitializeDriver
  * @note        
  *****************************************************************************/
-int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime){
+int32_t I2cSubmit(struct I2cRequest *request, TickType_t waitTime){
 
-int32_t error = ERROR_NONE;
-SemaphoreHandle_t semHandle = NULL;
+	if(NULL == xQueueI2cRequests) return ERROR_NOT_INITIALIZED;
 
+	request->error = ERROR_NONE;
+	request->done = false;
+	request->phaseStart = RuntimeStatsGetCounter();
+	if(xQueueSend(xQueueI2cRequests, &request, waitTime) != pdPASS) return ERROR_BUSY;
+	return ERROR_NONE;
+}
 
-//---0. Get Mutex
-error = I2cGetMutex(WAIT_I2C_LINE_MS);
-if(ERROR_NONE != error) goto exit;
 
 
-//---1. Get Semaphore Handle
-error = I2cGetSemaphoreHandle(&semHandle);
-if(ERROR_NONE != error) goto exit;
+/**************************************************************************//**
+ * @fn			uint8_t I2cGetStats(const struct I2cDeviceStats **stats)
+ * @brief       Returns the latency and error statistics of every device the driver talked to since the start or the last I2cResetStats
+ * @param[out]  stats Set to the array of statistics, one entry per device address
+ * @return      Returns the number of entries in the array
+ * @note        The bus thread keeps updating the entries while they are read
+ *****************************************************************************/
+uint8_t I2cGetStats(const struct I2cDeviceStats **stats){
+	*stats = i2cStats;
+	return i2cStatsDevices;
+}
+
 
-//---2. Initiate sending data
 
-error = I2cWriteData(data);
-if (ERROR_NONE != error){
-	goto exitError0;
+/**************************************************************************//**
+ * @fn			uint32_t I2cGetBusResets(void)
+ * @brief       Returns the number of times the driver had to release the bus itself, with a forced STOP or by cancelling a job
+ * @note        
+ *****************************************************************************/
+uint32_t I2cGetBusResets(void){
+	return i2cBusResets;
 }
 
-//---2. Wait for binary semaphore to tell us that we are done!
-if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-	/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-	if(I2cGetTaskErrorStatus()){
-		I2cSetTaskErrorStatus(false);
-		if(error != ERROR_NONE){
-    		error = ERROR_I2C_HANG_RESET;
-    	}else{
-    		error = ERROR_ABORTED;
-		}
-		goto exitError0;
-	}
-}else{
-	/* The call to ulTaskNotifyTake() timed out. */
-	error = ERR_TIMEOUT;
-	goto exitError0;
+
+
+/**************************************************************************//**
+ * @fn			uint16_t I2cGetBusSpeedKhz(void)
+ * @brief       Returns the SCL frequency of the sensor bus, in kHz
+ * @note        
+ *****************************************************************************/
+uint16_t I2cGetBusSpeedKhz(void){
+	return i2cBusSpeedKhz;
 }
 
-//---8. Release Mutex
-error |= I2cFreeMutex();
-//xSemaphoreGive(semHandle);
-exit:
-return error;
 
-exitError0:
-error = I2cFreeMutex();
-//xSemaphoreGive(semHandle);
-return error;
 
+/**************************************************************************//**
+ * @fn			uint32_t I2cGetBucketLimitUs(uint8_t bucket)
+ * @brief       Returns the upper limit, in us, of a histogram bucket. The last bucket has none and returns 0
+ * @note        
+ *****************************************************************************/
+uint32_t I2cGetBucketLimitUs(uint8_t bucket){
+	return (bucket < I2C_STATS_BUCKETS - 1) ? (16UL << bucket) : 0;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			const char *I2cGetPhaseName(enum eI2cPhase phase)
+ * @brief       Returns the short name of a transaction phase
+ * @note        
+ *****************************************************************************/
+const char *I2cGetPhaseName(enum eI2cPhase phase){
+	return (phase < N_I2C_PHASES) ? i2cPhaseNames[phase] : "?";
+}
+
+
+
+/**************************************************************************//**
+ * @fn			void I2cResetStats(void)
+ * @brief       Clears the statistics of every device and the bus reset count
+ * @note        The scheduler is suspended meanwhile, so the bus thread does not update an entry being cleared
+ *****************************************************************************/
+void I2cResetStats(void){
+	vTaskSuspendAll();
+	memset(i2cStats, 0, sizeof(i2cStats));
+	i2cStatsDevices = 0;
+	i2cBusResets = 0;
+	xTaskResumeAll();
+}
+
+
+
+/**************************************************************************//**
+ * @fn			int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime)
+ * @brief       This is the main function to use to write data from an I2C device on a given I2C Bus. This function is blocking.
+ * @details     This function writes data from an I2C device, by writing the requested bytes. It submits the transaction to the bus thread
+				and makes the current thread sleep until it is over.
+ * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
+ * @param[in]   xMaxBlockTime Maximum time the transfer may take.
+ * @return      Returns an error message in case of error.
+ * @note        
+ *****************************************************************************/
+int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime){
+
+	struct I2cRequest request;
+	I2C_Data writeData = *data;
+
+	writeData.lenIn = 0;
+	request.data = &writeData;
+	request.delay = 0;
+	request.timeout = xMaxBlockTime;
+	return I2cSubmitWait(&request);
 }
 
 
@@ -413,81 +611,531 @@ return error;
 /**************************************************************************//**
  * @fn			int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime)
  * @brief       This is the main function to use to read data from an I2C device on a given I2C Bus. This function is blocking.
- * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes. This
-				function is blocking (bare-metal) or it makes the current thread sleep until the I2C bus has finished the transaction (FREERTOS version).
-				On FreeRtos, this function gets the mutex for the respective I2C bus.
+ * @details     This function reads data from an I2C device, by first writing to the address (I2C device address + register) and then reading the requested bytes.
+				It submits the transaction to the bus thread and makes the current thread sleep until it is over.
+				With no delay, the write and the read are a single transfer with a repeated start (I2cWriteReadData). The delay is
+				raised to the min delay of the device (i2cDeviceProfiles), so a device that needs a gap always gets write, STOP, delay, read.
  * @param[in]   data Pointer to I2C data structure which has all the information needed to send an I2C message
  * @param[in]   delay Delay that the I2C device needs to return the response. Can be 0 if the response is ready instantly. It can be the delay an I2C device needs to make a measurement.
- * @param[in]   xMaxBlockTime Maximum time for the thread to wait until the I2C mutex is free.
+				Other devices use the bus meanwhile.
+ * @param[in]   xMaxBlockTime Maximum time each of the write and the read may take.
  * @return      Returns an error message in case of error. See ErrCodes.h
- * @note        THIS IS THE FREERTOS VERSION! DO NOT Declare #define USE_FREERTOS if you wish to use the baremetal version!      
+ * @note        
  *****************************************************************************/
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime){
-	int32_t error = ERROR_NONE;
-	SemaphoreHandle_t semHandle = NULL;
-	
 
-	//---0. Get Mutex
-	error = I2cGetMutex( WAIT_I2C_LINE_MS);
-	if(ERROR_NONE != error) goto exit;
+	struct I2cRequest request;
 
+	request.data = data;
+	request.delay = delay;
+	request.timeout = xMaxBlockTime;
+	return I2cSubmitWait(&request);
+}
 
-	//---1. Get Semaphore Handle
-	error = I2cGetSemaphoreHandle( &semHandle);
-	if(ERROR_NONE != error) goto exit;
 
-	//---2. Initiate sending data
 
-	error = I2cWriteData(data);
-	if (ERROR_NONE != error){
-		goto exitError0;
+/**************************************************************************//**
+ * @fn			static int32_t I2cSubmitWait(struct I2cRequest *request)
+ * @brief       Submits a request and sleeps until the bus thread is done with it
+ * @details     The bus thread bounds every phase with the request timeout, so the request always completes and the wait has no timeout:
+				the request lives on the caller's stack.
+				Notifications the caller gets meanwhile for other reasons (e.g. the console RX wake-up of the CLI thread) are given back.
+ * @note        
+ *****************************************************************************/
+static int32_t I2cSubmitWait(struct I2cRequest *request){
+
+	UBaseType_t taken = 0;
+	int32_t error;
+
+	request->callback = NULL;
+	request->notify = xTaskGetCurrentTaskHandle();
+	error = I2cSubmit(request, WAIT_I2C_LINE_MS);
+	if(ERROR_NONE != error) return error;
+
+	while(!request->done){
+		ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+		taken++;
+	}
+	while(taken-- > 1){
+		xTaskNotifyGive(request->notify);
 	}
+	return request->error;
+}
+
+
 
-	//---2. Wait for binary semaphore to tell us that we are done!
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			error = ERROR_ABORTED;
-			goto exitError0;
+/**************************************************************************//**
+ * @fn			static void vI2cBusTask(void *pvParameters)
+ * @brief       Bus thread: owns the sensor bus and runs the submitted requests back to back
+ * @details     A request with a delay is parked after its write, and the next requests run while it waits. A parked request is read as
+				soon as its delay is over, and before any new request for the same device.
+				A request for a device with a parked request, or that needs a park slot while none is free, is held and started as soon as it
+				can. The other devices keep the bus meanwhile. With I2C_BUS_MAX_HELD requests held, the thread stops taking requests from the
+				queue until the next parked request is due: the queue fills up and I2cSubmit waits.
+ * @param[in]   pvParameters Unused
+ * @note        
+ *****************************************************************************/
+static void vI2cBusTask(void *pvParameters){
+
+	struct I2cRequest *request;
+
+	for(;;){
+		TickType_t now = xTaskGetTickCount();
+		TickType_t wait = portMAX_DELAY;
+		int8_t next = -1;
+
+		//Earliest parked request
+		for(uint8_t slot = 0; slot < I2C_BUS_MAX_PARKED; slot++){
+			if(NULL == i2cParked[slot]) continue;
+			int32_t remaining = (int32_t)(i2cParked[slot]->readTick - now);
+			if(remaining < 0) remaining = 0;
+			if(next < 0 || (TickType_t)remaining < wait){
+				next = slot;
+				wait = remaining;
+			}
 		}
-		vTaskDelay( delay );
-	}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
-	}
-	
-	//---6. Initiate Read data
-	error = I2cReadData(data);
-	if (ERROR_NONE != error){
-		goto exitError0;
-	}
-	//---7. Wait for notification
-	if( xSemaphoreTake( semHandle, xMaxBlockTime ) == pdTRUE ){
-		/* The transmission ended as expected. We now delay until the I2C sensor is finished */
-		if(I2cGetTaskErrorStatus()){
-			I2cSetTaskErrorStatus(false);
-			error = ERROR_ABORTED;
-			goto exitError0;
+
+		if(next >= 0 && wait == 0){
+			I2cBusFinishParked(next);
+			continue;
 		}
+
+		if(I2cBusStartHeld()) continue;
+
+		if(i2cHeldCount >= I2C_BUS_MAX_HELD){
+			vTaskDelay(wait); //Every held request waits for a parked one: nothing can start before it is due
+			continue;
+		}
+
+		if(xQueueReceive(xQueueI2cRequests, &request, wait) != pdPASS) continue; //A parked request is due
+
+		if(request->data->lenIn != 0 && request->delay < I2cGetDeviceMinDelay(request->data->address)){
+			request->delay = I2cGetDeviceMinDelay(request->data->address);
+		}
+
+		//A device must not see a new transaction before the read of its parked one
+		if(I2cBusCanStart(request, i2cHeldCount)){
+			I2cBusStartRequest(request);
 		}else{
-		/* The call to ulTaskNotifyTake() timed out. */
-		error = ERR_TIMEOUT;
-		goto exitError0;
+			i2cHeld[i2cHeldCount++] = request;
+		}
 	}
-	
-	//---8. Release Mutex
-	error = I2cFreeMutex();
-	//xSemaphoreGive(semHandle);
-	exit:
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static bool I2cBusCanStart(struct I2cRequest *request, uint8_t heldBefore)
+ * @brief       Tells whether a request can start now
+ * @details     It cannot while its device has a parked request or an older held one, nor when it has a delay and every park slot is taken
+ * @param[in]   heldBefore Number of entries of i2cHeld older than request
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static bool I2cBusCanStart(struct I2cRequest *request, uint8_t heldBefore){
+
+	bool freeSlot = false;
+
+	for(uint8_t slot = 0; slot < I2C_BUS_MAX_PARKED; slot++){
+		if(NULL == i2cParked[slot]){
+			freeSlot = true;
+		}else if(i2cParked[slot]->data->address == request->data->address){
+			return false;
+		}
+	}
+	for(uint8_t i = 0; i < heldBefore; i++){
+		if(i2cHeld[i]->data->address == request->data->address) return false;
+	}
+	return freeSlot || request->delay == 0;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static bool I2cBusStartHeld(void)
+ * @brief       Starts the oldest held request that can start now
+ * @return      Returns true if one was started
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static bool I2cBusStartHeld(void){
+
+	for(uint8_t i = 0; i < i2cHeldCount; i++){
+		struct I2cRequest *request = i2cHeld[i];
+		if(!I2cBusCanStart(request, i)) continue;
+
+		i2cHeldCount--;
+		memmove(&i2cHeld[i], &i2cHeld[i + 1], (i2cHeldCount - i) * sizeof(i2cHeld[0]));
+		I2cBusStartRequest(request);
+		return true;
+	}
+	return false;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static void I2cBusStartRequest(struct I2cRequest *request)
+ * @brief       Runs the write phase of a request, then its read phase or parks it until its delay is over
+ * @note        Runs on the bus thread. A request with a delay is only started when a park slot is free (I2cBusCanStart)
+ *****************************************************************************/
+static void I2cBusStartRequest(struct I2cRequest *request){
+
+	int32_t error = ERROR_NONE;
+	I2C_Data *data = request->data;
+
+	I2cStatsRecord(data->address, I2C_PHASE_QUEUE, request->phaseStart); //Time held included
+
+	//Register read: a single transfer with a repeated start. Only for devices with no min delay (I2cGetDeviceMinDelay)
+	if(data->lenOut != 0 && data->lenIn != 0 && request->delay == 0){
+		error = I2cBusRunPhase(data, I2cWriteReadData, I2C_PHASE_WRITE_READ, request->timeout);
+		goto exit;
+	}
+
+	if(data->lenOut != 0){
+		error = I2cBusRunPhase(data, I2cWriteData, I2C_PHASE_WRITE, request->timeout);
+		if(ERROR_NONE != error || (data->lenIn == 0 && request->delay == 0)) goto exit;
+	}
+
+	if(request->delay != 0){
+		request->phaseStart = RuntimeStatsGetCounter();
+		for(uint8_t slot = 0; slot < I2C_BUS_MAX_PARKED; slot++){
+			if(NULL == i2cParked[slot]){
+				request->readTick = xTaskGetTickCount() + request->delay;
+				i2cParked[slot] = request;
+				return;
+			}
+		}
+	}
+
+	if(data->lenIn != 0) error = I2cBusRunPhase(data, I2cReadData, I2C_PHASE_READ, request->timeout);
+
+exit:
+	I2cBusComplete(request, error);
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static void I2cBusFinishParked(uint8_t slot)
+ * @brief       Runs the read phase of a parked request, if it has one, and completes it
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static void I2cBusFinishParked(uint8_t slot){
+
+	struct I2cRequest *request = i2cParked[slot];
+	int32_t error = ERROR_NONE;
+
+	i2cParked[slot] = NULL;
+	I2cStatsRecord(request->data->address, I2C_PHASE_DELAY, request->phaseStart);
+	if(request->data->lenIn != 0) error = I2cBusRunPhase(request->data, I2cReadData, I2C_PHASE_READ, request->timeout);
+	I2cBusComplete(request, error);
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static int32_t I2cBusRunPhase(I2C_Data *data, int32_t (*start)(I2C_Data *data), enum eI2cPhase phase, TickType_t timeout)
+ * @brief       Starts a job (I2cWriteData, I2cReadData or I2cWriteReadData) and waits for the interrupt that ends it
+ * @details     The time the job took is added to the histogram of phase
+ * @return      Returns ERROR_NONE, ERROR_IO if the job could not start, ERROR_ABORTED on a bus error, ERROR_TIMEOUT if it did not end in time
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static int32_t I2cBusRunPhase(I2C_Data *data, int32_t (*start)(I2C_Data *data), enum eI2cPhase phase, TickType_t timeout){
+
+	uint32_t begin = RuntimeStatsGetCounter();
+	int32_t error;
+
+	//Drop the end of a job cancelled on timeout, if it came late
+	xSemaphoreTake(sensorI2cSemaphoreHandle, 0);
+	I2cSetTaskErrorStatus(false);
+
+	error = start(data);
+	if(ERROR_NONE != error) goto exit;
+
+	if(xSemaphoreTake(sensorI2cSemaphoreHandle, timeout) != pdTRUE){
+		sensorPendingRead = NULL;
+#if I2C_SENSOR_DMA
+		if(sensorDmaActive) I2cAbortDma(); //e.g. address NACK: the DMA never got a trigger
+#endif
+		i2c_master_cancel_job(&i2cSensorBusInstance);
+		i2cBusResets++;
+		error = ERROR_TIMEOUT;
+		goto exit;
+	}
+	if(I2cGetTaskErrorStatus()){
+		I2cSetTaskErrorStatus(false);
+		error = ERROR_ABORTED;
+		goto exit;
+	}
+#if I2C_SENSOR_DMA
+	if(sensorDmaActive) error = I2cFinishDma();
+#endif
+
+exit:
+	I2cStatsRecord(data->address, phase, begin);
 	return error;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static void I2cBusComplete(struct I2cRequest *request, int32_t error)
+ * @brief       Hands a finished request back to its submitter
+ * @note        The submitter may reuse the request as soon as done is set: nothing is read from it afterwards
+ *****************************************************************************/
+static void I2cBusComplete(struct I2cRequest *request, int32_t error){
+
+	TaskHandle_t notify = request->notify;
+	struct I2cDeviceStats *stats = I2cStatsFind(request->data->address);
+
+	if(NULL != stats){
+		stats->transactions++;
+		if(ERROR_NONE == error){
+			stats->bytesOut += request->data->lenOut;
+			stats->bytesIn += request->data->lenIn;
+		}
+		if(ERROR_TIMEOUT == error) stats->timeouts++;
+		else if(ERROR_ABORTED == error) stats->aborted++;
+		else if(ERROR_NONE != error) stats->errors++;
+	}
+
+	request->error = error;
+	if(NULL != request->callback) request->callback(request);
+	request->done = true;
+	if(NULL != notify) xTaskNotifyGive(notify);
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static uint16_t I2cGetCommonSpeedKhz(void)
+ * @brief       Returns the fastest SCL frequency every device of i2cDeviceProfiles supports
+ * @details     The bus is not retuned per device: a device must not see traffic faster than it supports, even when it is not addressed.
+				Fast-mode Plus is only used when every device allows it.
+ * @note        
+ *****************************************************************************/
+static uint16_t I2cGetCommonSpeedKhz(void){
+
+	uint16_t speed = I2C_SPEED_FAST_PLUS_KHZ;
+
+	for(uint8_t i = 0; i < sizeof(i2cDeviceProfiles) / sizeof(i2cDeviceProfiles[0]); i++){
+		if(i2cDeviceProfiles[i].maxSpeedKhz < speed) speed = i2cDeviceProfiles[i].maxSpeedKhz;
+	}
+	return speed;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static TickType_t I2cGetDeviceMinDelay(uint8_t address)
+ * @brief       Returns the min time the device at address needs between the write and the read of a request. 0 for a device with no profile
+ * @note        
+ *****************************************************************************/
+static TickType_t I2cGetDeviceMinDelay(uint8_t address){
+
+	for(uint8_t i = 0; i < sizeof(i2cDeviceProfiles) / sizeof(i2cDeviceProfiles[0]); i++){
+		if(i2cDeviceProfiles[i].address == address) return i2cDeviceProfiles[i].minDelay;
+	}
+	return 0;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static struct I2cDeviceStats *I2cStatsFind(uint8_t address)
+ * @brief       Returns the statistics of the device at address, taking a free entry the first time
+ * @return      Returns NULL once I2C_STATS_MAX_DEVICES devices have an entry: the others are not counted
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static struct I2cDeviceStats *I2cStatsFind(uint8_t address){
+
+	for(uint8_t i = 0; i < i2cStatsDevices; i++){
+		if(i2cStats[i].address == address) return &i2cStats[i];
+	}
+	if(i2cStatsDevices >= I2C_STATS_MAX_DEVICES) return NULL;
+
+	i2cStats[i2cStatsDevices].address = address;
+	return &i2cStats[i2cStatsDevices++];
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static void I2cStatsRecord(uint8_t address, enum eI2cPhase phase, uint32_t start)
+ * @brief       Adds the time since start to the histogram of a phase of the device at address
+ * @param[in]   start Run time counter (RuntimeStatsGetCounter) at the start of the phase
+ * @note        Runs on the bus thread. A few shifts per phase: cheap enough to stay on in production builds
+ *****************************************************************************/
+static void I2cStatsRecord(uint8_t address, enum eI2cPhase phase, uint32_t start){
+
+	struct I2cDeviceStats *stats = I2cStatsFind(address);
+	uint32_t us = RuntimeStatsCountsToUs(RuntimeStatsGetCounter() - start) >> 4;
+	uint8_t bucket = 0;
+
+	if(NULL == stats) return;
+
+	while(us != 0 && bucket < I2C_STATS_BUCKETS - 1){
+		us >>= 1;
+		bucket++;
+	}
+	if(stats->histogram[phase][bucket] != 0xFFFF) stats->histogram[phase][bucket]++;
+}
+
+
+
+#if I2C_SENSOR_DMA
+/**************************************************************************//**
+ * @fn			static void I2cDriverConfigureSensorDma(void)
+ * @brief       Allocates the DMA channels of the sensor bus and prepares their descriptors
+ * @details     The buffer and the length are set for every transfer by I2cStartDma. Both channels move one byte per SERCOM trigger.
+ * @note        
+ *****************************************************************************/
+static void I2cDriverConfigureSensorDma(void){
+
+	struct dma_resource_config config;
+	struct dma_descriptor_config descriptorConfig;
+
+	dma_get_config_defaults(&config);
+	config.peripheral_trigger = I2C_DMA_TX_TRIGGER;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+	dma_allocate(&sensorDmaTxResource, &config);
+
+	config.peripheral_trigger = I2C_DMA_RX_TRIGGER;
+	dma_allocate(&sensorDmaRxResource, &config);
+
+	dma_descriptor_get_config_defaults(&descriptorConfig);
+	descriptorConfig.beat_size = DMA_BEAT_SIZE_BYTE;
+	descriptorConfig.block_transfer_count = 1;
+	descriptorConfig.dst_increment_enable = false;
+	descriptorConfig.src_increment_enable = true;
+	descriptorConfig.destination_address = (uint32_t)(&i2cSensorBusInstance.hw->I2CM.DATA.reg);
+	dma_descriptor_create(&sensorDmaTxDescriptor, &descriptorConfig);
+	dma_add_descriptor(&sensorDmaTxResource, &sensorDmaTxDescriptor);
+
+	descriptorConfig.dst_increment_enable = true;
+	descriptorConfig.src_increment_enable = false;
+	descriptorConfig.source_address = (uint32_t)(&i2cSensorBusInstance.hw->I2CM.DATA.reg);
+	dma_descriptor_create(&sensorDmaRxDescriptor, &descriptorConfig);
+	dma_add_descriptor(&sensorDmaRxResource, &sensorDmaRxDescriptor);
+
+	dma_register_callback(&sensorDmaTxResource, I2cSensorsDmaDone, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&sensorDmaTxResource, DMA_CALLBACK_TRANSFER_DONE);
+	dma_register_callback(&sensorDmaRxResource, I2cSensorsDmaDone, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&sensorDmaRxResource, DMA_CALLBACK_TRANSFER_DONE);
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static bool I2cUseDma(uint16_t length)
+ * @brief       Tells whether a payload of the given length goes through DMA
+ * @note        Short payloads stay on the SERCOM interrupt: setting the DMA up costs more than a few byte interrupts
+ *****************************************************************************/
+static bool I2cUseDma(uint16_t length){
+	return length >= I2C_DMA_THRESHOLD && length <= 0xFF;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static enum status_code I2cStartDma(I2C_Data *data, enum i2c_transfer_direction direction)
+ * @brief       Starts a DMA transfer of the payload of data in the given direction
+ * @details     The SERCOM sends the address and counts the bytes itself (ADDR.LENEN). A read runs in smart mode, so every byte the DMA
+				takes from DATA is acknowledged, and the SERCOM ends it with NACK and STOP. The end of the DMA block is signaled through sensorI2cSemaphoreHandle.
+				When the bus is owned (repeated start of a combined transfer), writing ADDR sends a repeated start.
+ * @return      Returns STATUS_OK, or the error of the DMA driver
+ * @note        May be called from the write complete interrupt
+ *****************************************************************************/
+static enum status_code I2cStartDma(I2C_Data *data, enum i2c_transfer_direction direction){
+
+	SercomI2cm *const i2cModule = &(i2cSensorBusInstance.hw->I2CM);
+	enum status_code hwError;
 
-	exitError0:
-	error = I2cFreeMutex();
-	//xSemaphoreGive(semHandle);
+	//With address increment enabled, the DMAC expects the address of the end of the block
+	if(I2C_TRANSFER_WRITE == direction){
+		sensorDmaTxDescriptor.SRCADDR.reg = (uint32_t)(data->msgOut + data->lenOut);
+		sensorDmaTxDescriptor.BTCNT.reg = data->lenOut;
+		hwError = dma_start_transfer_job(&sensorDmaTxResource);
+	}else{
+		sensorDmaRxDescriptor.DSTADDR.reg = (uint32_t)(data->msgIn + data->lenIn);
+		sensorDmaRxDescriptor.BTCNT.reg = data->lenIn;
+		while(i2c_master_is_syncing(&i2cSensorBusInstance));
+		i2cModule->CTRLB.reg = (i2cModule->CTRLB.reg & ~SERCOM_I2CM_CTRLB_ACKACT) | SERCOM_I2CM_CTRLB_SMEN;
+		hwError = dma_start_transfer_job(&sensorDmaRxResource);
+	}
+	if(STATUS_OK != hwError) return hwError;
+
+	sensorDmaActive = true;
+	i2cModule->STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST; //Left over from an earlier transfer
+	while(i2c_master_is_syncing(&i2cSensorBusInstance));
+	i2c_master_dma_set_transfer(&i2cSensorBusInstance, data->address, (uint8_t)((I2C_TRANSFER_WRITE == direction) ? data->lenOut : data->lenIn), direction);
+	return STATUS_OK;
+}
+
+
+
+/**************************************************************************//**
+ * @fn			static int32_t I2cFinishDma(void)
+ * @brief       Waits for the bus to go idle after a DMA transfer and checks how it ended
+ * @details     At the end of a write block the DMA has only loaded the last byte into DATA: the SERCOM still has to send it and the STOP.
+ * @return      Returns ERROR_NONE, ERROR_ABORTED if a byte was not acknowledged or the bus failed, ERROR_TIMEOUT if the bus did not go idle
+ * @note        Runs on the bus thread
+ *****************************************************************************/
+static int32_t I2cFinishDma(void){
+
+	SercomI2cm *const i2cModule = &(i2cSensorBusInstance.hw->I2CM);
+	TickType_t start = xTaskGetTickCount();
+	int32_t error = ERROR_NONE;
+
+	while(SERCOM_I2CM_STATUS_BUSSTATE(1) != (i2cModule->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk)){
+		if(xTaskGetTickCount() - start > pdMS_TO_TICKS(I2C_DMA_IDLE_TIMEOUT_MS)){
+			error = ERROR_TIMEOUT;
+			break;
+		}
+	}
+	if(ERROR_NONE == error && (i2cModule->STATUS.reg & (SERCOM_I2CM_STATUS_RXNACK | SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST))){
+		error = ERROR_ABORTED;
+	}
+
+	I2cAbortDma();
 	return error;
+}
 
-	
+
+
+/**************************************************************************//**
+ * @fn			static void I2cAbortDma(void)
+ * @brief       Stops the DMA channels of the sensor bus and puts the SERCOM back in interrupt mode
+ * @note        
+ *****************************************************************************/
+static void I2cAbortDma(void){
+
+	SercomI2cm *const i2cModule = &(i2cSensorBusInstance.hw->I2CM);
+
+	dma_abort_job(&sensorDmaTxResource);
+	dma_abort_job(&sensorDmaRxResource);
+	while(i2c_master_is_syncing(&i2cSensorBusInstance));
+	i2cModule->CTRLB.reg &= ~SERCOM_I2CM_CTRLB_SMEN;
+	if(SERCOM_I2CM_STATUS_BUSSTATE(2) == (i2cModule->STATUS.reg & SERCOM_I2CM_STATUS_BUSSTATE_Msk)){
+		i2c_master_send_stop(&i2cSensorBusInstance); //Still owned: the transfer did not end
+		i2cBusResets++;
+	}
+	sensorDmaActive = false;
 }
 
+
+
+/**************************************************************************//**
+ * @fn			static void I2cSensorsDmaDone(struct dma_resource *const resource)
+ * @brief       Callback of both DMA channels at the end of their block: signals the end of the transfer like the SERCOM callbacks
+ * @note        Runs in the DMAC interrupt
+ *****************************************************************************/
+static void I2cSensorsDmaDone(struct dma_resource *const resource){
+
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	I2cSensorBusState.i2cState = I2C_BUS_READY;
+	I2cSensorBusState.rxDoneFlag = true;
+	xSemaphoreGiveFromISR( sensorI2cSemaphoreHandle, &xHigherPriorityTaskWoken );
+	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+#endif
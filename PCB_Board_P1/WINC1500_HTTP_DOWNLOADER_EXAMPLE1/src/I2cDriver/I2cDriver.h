@@ -27,6 +27,23 @@ extern "C" {
 
 #define I2C_INIT_ATTEMPTS 3
 #define WAIT_I2C_LINE_MS 300
+#define I2C_BUS_TASK_SIZE 128	///<Size of stack to assign to the bus thread. In words. Request callbacks run on it
+#define I2C_BUS_TASK_PRIORITY (configMAX_PRIORITIES - 1)	///<Highest: the bus thread only runs to start the next phase
+#define I2C_REQUEST_QUEUE_LENGTH 8	///<Max number of requests waiting for the bus
+#define I2C_BUS_MAX_PARKED 4	///<Max number of requests waiting out their delay between the write and the read
+#define I2C_BUS_MAX_HELD 4	///<Max number of requests taken from the queue and held until their device is read, or a park slot frees up
+#ifndef I2C_SENSOR_DMA
+#define I2C_SENSOR_DMA 1	///<Set to 1 to move bulk payloads through DMA channels, 0 to use the SERCOM interrupt for every byte
+#endif
+#define I2C_DMA_THRESHOLD 16	///<Payloads of at least this many bytes (and at most 255, the ADDR.LEN limit) go through DMA
+#define I2C_DMA_TX_TRIGGER SERCOM0_DMAC_ID_TX	///<DMA trigger of the sensor bus SERCOM, write direction
+#define I2C_DMA_RX_TRIGGER SERCOM0_DMAC_ID_RX	///<DMA trigger of the sensor bus SERCOM, read direction
+#define I2C_SPEED_STANDARD_KHZ 100	///<Standard-mode SCL frequency
+#define I2C_SPEED_FAST_KHZ 400	///<Fast-mode SCL frequency
+#define I2C_SPEED_FAST_PLUS_KHZ 1000	///<Fast-mode Plus SCL frequency
+#define I2C_STATS_MAX_DEVICES 4	///<Max number of device addresses with their own statistics
+#define I2C_STATS_BUCKETS 12	///<Histogram buckets: <16 us, then one per power of 2, up to >=16 ms
+#define I2C_DMA_IDLE_TIMEOUT_MS 2	///<Max time for the bus to go idle after the DMA hands over the last byte of a write
 
 
 #define ERROR_NONE                                 0
@@ -87,6 +104,58 @@ typedef struct I2C_Data
 }I2C_Data;
 
 
+///Bus requirements of a device on the sensor bus. See i2cDeviceProfiles in I2cDriver.c
+struct I2cDeviceProfile
+{
+	uint8_t address;	///<7-bit address of the device
+	uint16_t maxSpeedKhz;	///<Fastest SCL frequency the device supports, in kHz
+	TickType_t minDelay;	///<Min ticks the device needs between the write and the read of a request. 0 if it answers at once
+};
+
+
+struct I2cRequest;
+///Called by the bus thread when a request is over. Must not block
+typedef void (*I2cRequestCallback)(struct I2cRequest *request);
+
+///Asynchronous I2C transaction: a write, then after delay a read. Owned by the bus thread from I2cSubmit until done
+struct I2cRequest
+{
+	I2C_Data *data;	///<Device address and buffers. lenOut 0 skips the write, lenIn 0 skips the read
+	TickType_t delay;	///<Ticks between the end of the write and the start of the read. Other requests use the bus meanwhile. With lenIn 0, the device gets no other request until the delay is over, e.g. to wake up
+	TickType_t timeout;	///<Max ticks each phase may take
+	I2cRequestCallback callback;	///<Called by the bus thread when the request is over, or NULL
+	TaskHandle_t notify;	///<Task notified (xTaskNotifyGive) when the request is over, or NULL
+	void *context;	///<Free for the submitter
+	volatile int32_t error;	///<Result of the transaction. Valid once done is set
+	volatile bool done;	///<Set by the bus thread when the request is over
+	TickType_t readTick;	///<Used by the bus thread: tick the read phase is due at
+	uint32_t phaseStart;	///<Used by the bus thread: run time counter at the start of the current phase (RuntimeStats.h)
+};
+
+///Phases of a transaction timed by the statistics
+enum eI2cPhase
+{
+	I2C_PHASE_QUEUE = 0,	///<From I2cSubmit until the bus thread starts the request
+	I2C_PHASE_WRITE,	///<Write job
+	I2C_PHASE_DELAY,	///<From the end of the write until the start of the read
+	I2C_PHASE_READ,	///<Read job
+	I2C_PHASE_WRITE_READ,	///<Combined write and repeated start read job
+	N_I2C_PHASES	///<Number of phases
+};
+
+///Statistics of the transactions with a device
+struct I2cDeviceStats
+{
+	uint8_t address;	///<7-bit address of the device
+	uint32_t transactions;	///<Requests completed, with or without error
+	uint32_t bytesOut;	///<Payload bytes written, address bytes not included
+	uint32_t bytesIn;	///<Payload bytes read
+	uint16_t timeouts;	///<Requests ended by ERROR_TIMEOUT
+	uint16_t aborted;	///<Requests ended by ERROR_ABORTED (NACK, bus error)
+	uint16_t errors;	///<Requests ended by any other error
+	uint16_t histogram[N_I2C_PHASES][I2C_STATS_BUCKETS];	///<Duration of each phase, in us. Saturates at 0xFFFF
+};
+
 ///Structure that describes an I2C bus data, determining the bus and the flags
 typedef struct I2C_Bus_State
 {
@@ -99,13 +168,21 @@ typedef struct I2C_Bus_State
 	
 }I2C_Bus_State;
 
+int32_t I2cSubmit(struct I2cRequest *request, TickType_t waitTime);
 int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime);
 int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime);
 int32_t I2cGetMutex(TickType_t waitTime);
 int32_t I2cFreeMutex(void);
 int32_t I2cReadData(I2C_Data *data);
 int32_t I2cWriteData(I2C_Data *data);
+int32_t I2cWriteReadData(I2C_Data *data);
 int32_t I2cInitializeDriver(void);
+uint8_t I2cGetStats(const struct I2cDeviceStats **stats);
+uint32_t I2cGetBusResets(void);
+uint16_t I2cGetBusSpeedKhz(void);
+uint32_t I2cGetBucketLimitUs(uint8_t bucket);
+const char *I2cGetPhaseName(enum eI2cPhase phase);
+void I2cResetStats(void);
 void I2cDriverRegisterSensorBusCallbacks(void);
 void I2cSensorsError(struct i2c_master_module *const module);
 void I2cSensorsRxComplete(struct i2c_master_module *const module);
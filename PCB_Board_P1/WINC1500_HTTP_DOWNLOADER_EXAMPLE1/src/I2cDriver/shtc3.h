@@ -1,6 +1,9 @@
 /**************************************************************************//**
-* @file      sht3.h
-* @brief     Driver for the temperature sensor. Uses no clock stretching mode. 
+* @file      shtc3.h
+* @brief     Driver for the SHTC3 temperature and humidity sensor. Uses no clock stretching mode.
+* @details   A measurement is three requests on the I2C bus thread: wake-up, measure command then read after the
+*			 conversion time, sleep. The caller is never blocked meanwhile, and the bus serves the other devices
+*			 during the wake-up and conversion times. The result, CRC checked, is handed to a callback.
 * @author    Eduardo Garcia
 * @date      2021-03-18
 
@@ -19,57 +22,57 @@ extern "C" {
 /******************************************************************************
 * Defines
 ******************************************************************************/
-#define SHT3_LOW_ADDRESS    0x70    ///<I2C address
+#define SHTC3_ADDRESS			0x70	///<I2C address
+
+#define SHTC3_CMD_SLEEP			0xB098	///<Sleep command
+#define SHTC3_CMD_WAKEUP		0x3517	///<Wake-up command
+#define SHTC3_CMD_SOFT_RESET	0x805D	///<Software reset command
+#define SHTC3_CMD_READ_ID		0xEFC8	///<Read ID register command
+#define SHTC3_CMD_MEASURE_NM	0x7866	///<Command to measure temperature first, then RH, in normal power mode, no clock stretching
+#define SHTC3_CMD_MEASURE_LPM	0x609C	///<Command to measure temperature first, then RH, in low power mode, no clock stretching
+
+#define SHTC3_ID_MASK			0x083F	///<Bits of the ID register identifying an SHTC3
+#define SHTC3_ID_VALUE			0x0807	///<Value of the ID bits of an SHTC3
+#define SHTC3_CRC_POLYNOMIAL	0x31	///<CRC-8 polynomial: x^8 + x^5 + x^4 + 1
+#define SHTC3_CRC_INIT			0xFF	///<CRC-8 initial value
+
+#define SHTC3_WAKEUP_TICKS		2	///<Wake-up time, 240 us max. 2 ticks: a 1 tick delay may end at once
+#define SHTC3_MEASURE_NM_TICKS	14	///<Conversion time in normal mode, 12.1 ms max, plus one tick
+#define SHTC3_MEASURE_LPM_TICKS	2	///<Conversion time in low power mode, 0.8 ms max
+#define SHTC3_TIMEOUT_TICKS		10	///<Max ticks each bus phase may take
+#define SHTC3_MEASURE_WAIT_MS	50	///<Max time SHTC3_Measure waits for the result
 
-#define SHT3_SLEEP_COMMAND    0xB098    ///<Sleep command for the SHT3
-#define SHT3_LOW_ADDRESS      0x3517    ///<Sleep command for the SHT3
-
-#define SHT3_NORMAL_MODE_MEASURE_NM     0x7866 ///<Command to measure temperature first, then RH, in normal power mode, no clock streching
-#define SHT3_NORMAL_MODE_MEASURE_LPM     0x609C ///<Command to measure temperature first, then RH, in low power mode, no clock streching
-
-
-#define SHT3_OK         0   ///<Returns that the sensor had no error
-#define SHT3_COMM_ERROR 1   ///<SHT3 Communication error
 /******************************************************************************
 * Structures and Enumerations
 ******************************************************************************/
-
-
+///Measurement modes
+enum eShtc3Mode {
+	SHTC3_MODE_NORMAL = 0,	///<Normal power mode: 12.1 ms conversion
+	SHTC3_MODE_LOW_POWER,	///<Low power mode: 0.8 ms conversion, more noise
+};
+
+///Result of a measurement
+struct Shtc3Measurement {
+	TickType_t timestamp;	///<Tick count (ms) the result was read at
+	int16_t temperature;	///<Temperature, in hundredths of degree Celsius
+	uint16_t humidity;	///<Relative humidity, in hundredths of percent
+	int32_t error;	///<ERROR_NONE, ERROR_BAD_DATA on a CRC mismatch, or the error of the bus. The values are only valid with ERROR_NONE
+};
+
+///Called on the I2C bus thread when a measurement is over. Must not block
+typedef void (*Shtc3Callback)(const struct Shtc3Measurement *measurement, void *context);
 
 /******************************************************************************
 * Global Function Declaration
 ******************************************************************************/
-
-/**************************************************************************//**
-* @fn		int SHTC3_Init(void)
-* @brief	Function to initialize the SHTC3 sensor
-* @details 	Function to initialize the SHTC3 sensor. Will set the sensor in an On mode, ready for a measurement
-                				
-
-* @return		Returns SHT3_OK if initialized correctly
-* @note         
-*****************************************************************************/
-int SHTC3_Init(void);
-
-/**************************************************************************//**
-* @fn		int SHTC3_Measure(uint16_t *temperature, uint16_t *humidity);
-* @brief	Measures the temperature in humidity in normal power mode, non-clock blocking
-* @details 	Measures the temperature in humidity in normal power mode, non-clock blocking
-                				
-* @param[out]	temperature Pointer to where to write the read temperature
-* @param[out]	humidity Pointer to where to write the read humidity
-* @return		Returns SHT3_OK if the temperature was read correctly.
-* @note         
-*****************************************************************************/
-int SHTC3_Measure(uint16_t *temperature, uint16_t *humidity);
-
-int SHTC3_ReadSerialNumber(uint32_t *serial);
-
-
-
-
-
+int32_t SHTC3_Init(void);
+int32_t SHTC3_StartMeasurement(enum eShtc3Mode mode, Shtc3Callback callback, void *context);
+int32_t SHTC3_Measure(int16_t *temperature, uint16_t *humidity);
+int32_t SHTC3_ReadId(uint16_t *id);
+uint8_t SHTC3_Crc8(const uint8_t *data, uint8_t len);
+int16_t SHTC3_ConvertTemperature(uint16_t raw);
+uint16_t SHTC3_ConvertHumidity(uint16_t raw);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
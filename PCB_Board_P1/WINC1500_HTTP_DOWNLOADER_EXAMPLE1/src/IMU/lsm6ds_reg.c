@@ -16,8 +16,8 @@
  *
  ******************************************************************************
  */
-#include "IMU\lsm6ds_reg.h"
-#include "I2cDriver\I2cDriver.h"
+#include "IMU/lsm6ds_reg.h"
+#include "I2cDriver/I2cDriver.h"
 
 /**
   * @defgroup    LSM6DS3
@@ -36,6 +36,209 @@
   *
   */
 
+/*
+ * Register shadow. When ctx->shadow is set, the control registers read or
+ * written once are served from RAM, so the read-modify-write setters below
+ * only cost the write. Status, output and FIFO registers are never cached.
+ * While the embedded functions bank is selected, only FUNC_CFG_ACCESS (in
+ * both banks) goes through the shadow.
+ */
+#define LSM6DS3_SHADOW_BLOCK2           (LSM6DS3_MASTER_CONFIG - \
+                                         LSM6DS3_FUNC_CFG_ACCESS + 1U)
+#define LSM6DS3_SHADOW_TEST(map, i)     ((map)[(i) >> 3] & (1U << ((i) & 7U)))
+#define LSM6DS3_SHADOW_SET(map, i)      ((map)[(i) >> 3] |= (uint8_t)(1U << ((i) & 7U)))
+#define LSM6DS3_SHADOW_CLEAR(map, i)    ((map)[(i) >> 3] &= (uint8_t)~(1U << ((i) & 7U)))
+
+/**
+  * @brief  Index of a register in the shadow
+  *
+  * @param  reg   register address
+  * @retval       index, -1 if the register is not cached
+  *
+  */
+static int32_t lsm6ds3_shadow_index(uint8_t reg)
+{
+  switch (reg) {
+    case 0x02U:
+    case 0x03U:
+    case 0x05U:
+    case 0x0CU:
+      return -1; /* reserved */
+    default:
+      break;
+  }
+  if ((reg >= LSM6DS3_FUNC_CFG_ACCESS) && (reg <= LSM6DS3_MASTER_CONFIG)) {
+    return (int32_t)reg - LSM6DS3_FUNC_CFG_ACCESS;
+  }
+  if ((reg >= LSM6DS3_TAP_CFG) && (reg <= LSM6DS3_MD2_CFG)) {
+    return (int32_t)reg - LSM6DS3_TAP_CFG + LSM6DS3_SHADOW_BLOCK2;
+  }
+  return -1;
+}
+
+/**
+  * @brief  Register address of a shadow index
+  *
+  */
+static uint8_t lsm6ds3_shadow_reg(uint16_t i)
+{
+  if (i < LSM6DS3_SHADOW_BLOCK2) {
+    return (uint8_t)(LSM6DS3_FUNC_CFG_ACCESS + i);
+  }
+  return (uint8_t)(LSM6DS3_TAP_CFG + i - LSM6DS3_SHADOW_BLOCK2);
+}
+
+/**
+  * @brief  Checks whether len registers from reg can be served from the
+  *         shadow
+  *
+  */
+static uint8_t lsm6ds3_shadow_hit(lsm6ds3_shadow_t *shadow, uint8_t reg,
+                                  uint16_t len)
+{
+  int32_t i;
+  uint16_t n;
+
+  if ((shadow->embedded != 0U) &&
+      ((reg != LSM6DS3_FUNC_CFG_ACCESS) || (len != 1U))) {
+    return 0;
+  }
+  for (n = 0; n < len; n++) {
+    i = lsm6ds3_shadow_index((uint8_t)(reg + n));
+    if ((i < 0) || !LSM6DS3_SHADOW_TEST(shadow->valid, i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  Checks whether a write can be held back until the batch commit:
+  *         only plain control registers, no bank switch nor reset
+  *
+  */
+static uint8_t lsm6ds3_shadow_deferrable(lsm6ds3_shadow_t *shadow,
+                                         uint8_t reg, uint8_t *data,
+                                         uint16_t len)
+{
+  lsm6ds3_ctrl3_c_t *ctrl3_c;
+  uint8_t addr;
+  uint16_t n;
+
+  if (shadow->embedded != 0U) {
+    return 0;
+  }
+  for (n = 0; n < len; n++) {
+    addr = (uint8_t)(reg + n);
+    if ((lsm6ds3_shadow_index(addr) < 0) || (addr == LSM6DS3_WHO_AM_I) ||
+        (addr == LSM6DS3_FUNC_CFG_ACCESS)) {
+      return 0;
+    }
+    ctrl3_c = (lsm6ds3_ctrl3_c_t*)&data[n];
+    if ((addr == LSM6DS3_CTRL3_C) && ((ctrl3_c->sw_reset != 0U) ||
+                                      (ctrl3_c->boot != 0U))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  Updates the shadow with registers just read from or written to
+  *         the device. Registers held back by a batch keep their pending
+  *         value, which is also returned in data.
+  *
+  */
+static void lsm6ds3_shadow_store(lsm6ds3_shadow_t *shadow, uint8_t reg,
+                                 uint8_t *data, uint16_t len, uint8_t dirty)
+{
+  lsm6ds3_ctrl3_c_t *ctrl3_c;
+  uint8_t addr;
+  int32_t i;
+  uint16_t n;
+
+  for (n = 0; n < len; n++) {
+    addr = (uint8_t)(reg + n);
+    if (addr == LSM6DS3_FUNC_CFG_ACCESS) {
+      shadow->embedded =
+        ((lsm6ds3_func_cfg_access_t*)&data[n])->func_cfg_en;
+    }
+    else if (shadow->embedded != 0U) {
+      continue;
+    }
+    i = lsm6ds3_shadow_index(addr);
+    if (i < 0) {
+      continue;
+    }
+    if ((dirty == 0U) && LSM6DS3_SHADOW_TEST(shadow->dirty, i)) {
+      data[n] = shadow->value[i];
+      continue;
+    }
+    /* the reset bits clear themselves: read them from the device */
+    ctrl3_c = (lsm6ds3_ctrl3_c_t*)&data[n];
+    if ((addr == LSM6DS3_CTRL3_C) && ((ctrl3_c->sw_reset != 0U) ||
+                                      (ctrl3_c->boot != 0U))) {
+      LSM6DS3_SHADOW_CLEAR(shadow->valid, i);
+      continue;
+    }
+    shadow->value[i] = data[n];
+    LSM6DS3_SHADOW_SET(shadow->valid, i);
+    if (dirty != 0U) {
+      LSM6DS3_SHADOW_SET(shadow->dirty, i);
+    }
+  }
+}
+
+/**
+  * @brief  Writes the registers held back by a batch. Each run of adjacent
+  *         registers goes in one auto-increment transfer, also across
+  *         unchanged cached registers in between.
+  *
+  */
+static int32_t lsm6ds3_shadow_flush(stmdev_ctx_t *ctx)
+{
+  lsm6ds3_shadow_t *shadow = ctx->shadow;
+  uint16_t first;
+  uint16_t last;
+  uint16_t i;
+  uint16_t j;
+  int32_t ret = 0;
+
+  i = 0;
+  while (i < LSM6DS3_SHADOW_REGS) {
+    if (!LSM6DS3_SHADOW_TEST(shadow->dirty, i)) {
+      i++;
+      continue;
+    }
+    first = i;
+    last = i;
+    for (j = i + 1U; j < LSM6DS3_SHADOW_REGS; j++) {
+      if ((lsm6ds3_shadow_reg(j) != lsm6ds3_shadow_reg(j - 1U) + 1U) ||
+          (lsm6ds3_shadow_reg(j) == LSM6DS3_WHO_AM_I) ||
+          !LSM6DS3_SHADOW_TEST(shadow->valid, j)) {
+        break;
+      }
+      if (LSM6DS3_SHADOW_TEST(shadow->dirty, j)) {
+        last = j;
+      }
+    }
+
+    ret = ctx->write_reg(ctx->handle, lsm6ds3_shadow_reg(first),
+                         &shadow->value[first], last - first + 1U);
+    for (j = first; j <= last; j++) {
+      LSM6DS3_SHADOW_CLEAR(shadow->dirty, j);
+      if (ret != 0) {
+        LSM6DS3_SHADOW_CLEAR(shadow->valid, j);
+      }
+    }
+    if (ret != 0) {
+      break;
+    }
+    i = last + 1U;
+  }
+  return ret;
+}
+
 /**
   * @brief  Read generic device register
   *
@@ -49,8 +252,21 @@
 int32_t lsm6ds3_read_reg(stmdev_ctx_t* ctx, uint8_t reg, uint8_t* data,
                          uint16_t len)
 {
+  lsm6ds3_shadow_t *shadow = ctx->shadow;
   int32_t ret;
+  uint16_t n;
+
+  if ((shadow != NULL) && lsm6ds3_shadow_hit(shadow, reg, len)) {
+    for (n = 0; n < len; n++) {
+      data[n] = shadow->value[lsm6ds3_shadow_index((uint8_t)(reg + n))];
+    }
+    return 0;
+  }
+
   ret = ctx->read_reg(ctx->handle, reg, data, len);
+  if ((ret == 0) && (shadow != NULL)) {
+    lsm6ds3_shadow_store(shadow, reg, data, len, 0);
+  }
   return ret;
 }
 
@@ -67,11 +283,170 @@ int32_t lsm6ds3_read_reg(stmdev_ctx_t* ctx, uint8_t reg, uint8_t* data,
 int32_t lsm6ds3_write_reg(stmdev_ctx_t* ctx, uint8_t reg, uint8_t* data,
                           uint16_t len)
 {
+  lsm6ds3_shadow_t *shadow = ctx->shadow;
+  lsm6ds3_ctrl3_c_t *ctrl3_c;
   int32_t ret;
-  ret = ctx->write_reg(ctx->handle, reg, data, len);
+
+  if (shadow == NULL) {
+    return ctx->write_reg(ctx->handle, reg, data, len);
+  }
+
+  if ((shadow->batch != 0U) &&
+      lsm6ds3_shadow_deferrable(shadow, reg, data, len)) {
+    lsm6ds3_shadow_store(shadow, reg, data, len, 1);
+    return 0;
+  }
+
+  /* what a batch held back goes first, to keep the order of the writes */
+  ret = lsm6ds3_shadow_flush(ctx);
+  if (ret == 0) {
+    ret = ctx->write_reg(ctx->handle, reg, data, len);
+  }
+  if (ret != 0) {
+    lsm6ds3_shadow_invalidate(ctx, reg, len);
+    return ret;
+  }
+
+  if ((shadow->embedded == 0U) && (reg <= LSM6DS3_CTRL3_C) &&
+      (reg + len > LSM6DS3_CTRL3_C)) {
+    ctrl3_c = (lsm6ds3_ctrl3_c_t*)&data[LSM6DS3_CTRL3_C - reg];
+    if ((ctrl3_c->sw_reset != 0U) || (ctrl3_c->boot != 0U)) {
+      /* the device reloads its registers */
+      lsm6ds3_shadow_invalidate_all(ctx);
+      return ret;
+    }
+  }
+  lsm6ds3_shadow_store(shadow, reg, data, len, 0);
   return ret;
 }
 
+/**
+  * @brief  Attaches a register shadow to the interface, or detaches it.
+  *         The shadow starts empty.
+  *
+  * @param  ctx     read / write interface definitions(ptr)
+  * @param  shadow  shadow to attach, NULL to go straight to the device
+  * @retval         interface status of the writes a batch held back
+  *
+  */
+int32_t lsm6ds3_shadow_enable(stmdev_ctx_t *ctx, lsm6ds3_shadow_t *shadow)
+{
+  int32_t ret = 0;
+
+  if (ctx->shadow != NULL) {
+    ret = lsm6ds3_shadow_flush(ctx);
+  }
+  if (shadow != NULL) {
+    memset(shadow, 0, sizeof(lsm6ds3_shadow_t));
+  }
+  ctx->shadow = shadow;
+  return ret;
+}
+
+/**
+  * @brief  Loads every control register into the shadow with two burst
+  *         reads, e.g. after a reset, so the setters that follow do not
+  *         read the bus at all.
+  *
+  * @param  ctx   read / write interface definitions(ptr)
+  * @retval       interface status (MANDATORY: return 0 -> no Error)
+  *
+  */
+int32_t lsm6ds3_shadow_prefetch(stmdev_ctx_t *ctx)
+{
+  uint8_t buff[LSM6DS3_MASTER_CONFIG - LSM6DS3_FUNC_CFG_ACCESS + 1U];
+  int32_t ret;
+
+  if (ctx->shadow == NULL) {
+    return 0;
+  }
+  ret = lsm6ds3_read_reg(ctx, LSM6DS3_FUNC_CFG_ACCESS, buff,
+                         LSM6DS3_MASTER_CONFIG - LSM6DS3_FUNC_CFG_ACCESS + 1U);
+  if ((ret == 0) && (ctx->shadow->embedded == 0U)) {
+    ret = lsm6ds3_read_reg(ctx, LSM6DS3_TAP_CFG, buff,
+                           LSM6DS3_MD2_CFG - LSM6DS3_TAP_CFG + 1U);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Drops registers from the shadow, so they are read again from the
+  *         device. Needed when the device changes them on its own, e.g.
+  *         after a reboot, or when another master writes them.
+  *         A write held back by a batch for these registers is dropped.
+  *
+  * @param  ctx   read / write interface definitions(ptr)
+  * @param  reg   first register to drop
+  * @param  len   number of consecutive registers
+  *
+  */
+void lsm6ds3_shadow_invalidate(stmdev_ctx_t *ctx, uint8_t reg, uint16_t len)
+{
+  int32_t i;
+  uint16_t n;
+
+  if (ctx->shadow == NULL) {
+    return;
+  }
+  for (n = 0; n < len; n++) {
+    i = lsm6ds3_shadow_index((uint8_t)(reg + n));
+    if (i >= 0) {
+      LSM6DS3_SHADOW_CLEAR(ctx->shadow->valid, i);
+      LSM6DS3_SHADOW_CLEAR(ctx->shadow->dirty, i);
+    }
+  }
+}
+
+/**
+  * @brief  Drops every register from the shadow. The device is back in the
+  *         user bank, as after a reset.
+  *
+  * @param  ctx   read / write interface definitions(ptr)
+  *
+  */
+void lsm6ds3_shadow_invalidate_all(stmdev_ctx_t *ctx)
+{
+  if (ctx->shadow == NULL) {
+    return;
+  }
+  memset(ctx->shadow->valid, 0, sizeof(ctx->shadow->valid));
+  memset(ctx->shadow->dirty, 0, sizeof(ctx->shadow->dirty));
+  ctx->shadow->embedded = 0;
+}
+
+/**
+  * @brief  Starts holding back the writes to control registers: they only
+  *         update the shadow until lsm6ds3_shadow_batch_commit().
+  *         Any other write commits the batch first.
+  *
+  * @param  ctx   read / write interface definitions(ptr)
+  *
+  */
+void lsm6ds3_shadow_batch_begin(stmdev_ctx_t *ctx)
+{
+  if (ctx->shadow != NULL) {
+    ctx->shadow->batch = 1;
+  }
+}
+
+/**
+  * @brief  Writes the registers held back since lsm6ds3_shadow_batch_begin(),
+  *         in address order, adjacent registers in one transfer.
+  *         Only batch writes whose order does not matter.
+  *
+  * @param  ctx   read / write interface definitions(ptr)
+  * @retval       interface status (MANDATORY: return 0 -> no Error)
+  *
+  */
+int32_t lsm6ds3_shadow_batch_commit(stmdev_ctx_t *ctx)
+{
+  if (ctx->shadow == NULL) {
+    return 0;
+  }
+  ctx->shadow->batch = 0;
+  return lsm6ds3_shadow_flush(ctx);
+}
+
 /**
   * @}
   *
@@ -134,6 +509,201 @@ float_t lsm6ds3_from_lsb_to_celsius(int16_t lsb)
   return ((float_t)lsb / 16.0f + 25.0f );
 }
 
+/*
+ * Fixed-point versions of the functions above, without soft-float calls.
+ * The accelerometer sensitivities are all 61 ug/LSB times a power of 2:
+ * LSM6DS3_XL_SENS_Q12 with a shift per full scale for the _int functions.
+ * Its 16 bits are not enough for 1/256 mg at full scale, so the _q8
+ * functions multiply by the integer part of the Q8 sensitivity and by its
+ * fraction in Q16. Gyroscope and temperature sensitivities are exact in Q8.
+ * The _q8 functions return the value with 8 fractional bits, the _int
+ * functions round it to the nearest unit.
+ */
+
+int32_t lsm6ds3_from_fs2g_to_mg_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 15 + (((int32_t)lsb * 40370 + (1L << 15)) >> 16);
+}
+
+int32_t lsm6ds3_from_fs4g_to_mg_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 31 + (((int32_t)lsb * 15204 + (1L << 15)) >> 16);
+}
+
+int32_t lsm6ds3_from_fs8g_to_mg_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 62 + (((int32_t)lsb * 30409 + (1L << 15)) >> 16);
+}
+
+int32_t lsm6ds3_from_fs16g_to_mg_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 124 + (((int32_t)lsb * 60817 + (1L << 15)) >> 16);
+}
+
+int32_t lsm6ds3_from_fs125dps_to_mdps_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 1120;
+}
+
+int32_t lsm6ds3_from_fs250dps_to_mdps_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 2240;
+}
+
+int32_t lsm6ds3_from_fs500dps_to_mdps_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 4480;
+}
+
+int32_t lsm6ds3_from_fs1000dps_to_mdps_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 8960;
+}
+
+int32_t lsm6ds3_from_fs2000dps_to_mdps_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 17920;
+}
+
+int32_t lsm6ds3_from_lsb_to_celsius_q8(int16_t lsb)
+{
+  return (int32_t)lsb * 16 + (25L << 8);
+}
+
+int32_t lsm6ds3_from_fs2g_to_mg_int(int16_t lsb)
+{
+  return ((int32_t)lsb * LSM6DS3_XL_SENS_Q12 + (1L << 19)) >> 20;
+}
+
+int32_t lsm6ds3_from_fs4g_to_mg_int(int16_t lsb)
+{
+  return ((int32_t)lsb * LSM6DS3_XL_SENS_Q12 + (1L << 18)) >> 19;
+}
+
+int32_t lsm6ds3_from_fs8g_to_mg_int(int16_t lsb)
+{
+  return ((int32_t)lsb * LSM6DS3_XL_SENS_Q12 + (1L << 17)) >> 18;
+}
+
+int32_t lsm6ds3_from_fs16g_to_mg_int(int16_t lsb)
+{
+  return ((int32_t)lsb * LSM6DS3_XL_SENS_Q12 + (1L << 16)) >> 17;
+}
+
+int32_t lsm6ds3_from_fs125dps_to_mdps_int(int16_t lsb)
+{
+  return ((int32_t)lsb * 35 + 4) >> 3;
+}
+
+int32_t lsm6ds3_from_fs250dps_to_mdps_int(int16_t lsb)
+{
+  return ((int32_t)lsb * 35 + 2) >> 2;
+}
+
+int32_t lsm6ds3_from_fs500dps_to_mdps_int(int16_t lsb)
+{
+  return ((int32_t)lsb * 35 + 1) >> 1;
+}
+
+int32_t lsm6ds3_from_fs1000dps_to_mdps_int(int16_t lsb)
+{
+  return (int32_t)lsb * 35;
+}
+
+int32_t lsm6ds3_from_fs2000dps_to_mdps_int(int16_t lsb)
+{
+  return (int32_t)lsb * 70;
+}
+
+int32_t lsm6ds3_from_lsb_to_celsius_int(int16_t lsb)
+{
+  return (((int32_t)lsb + 8) >> 4) + 25;
+}
+
+/**
+  * @brief  Converts an array of raw accelerometer values to mg, rounded.
+  *
+  * @param  fs     full scale the values were taken at
+  * @param  lsb    raw values, e.g. a burst read from the FIFO
+  * @param  mg     converted values, may be the lsb array itself
+  * @param  len    number of values
+  * @retval        0 on success, -1 for an unknown full scale
+  *
+  */
+int32_t lsm6ds3_xl_block_to_mg(lsm6ds3_xl_fs_t fs, const int16_t *lsb,
+                               int16_t *mg, uint16_t len)
+{
+  uint8_t shift;
+  uint16_t i;
+
+  switch (fs) {
+    case LSM6DS3_2g:
+      shift = 20;
+      break;
+    case LSM6DS3_4g:
+      shift = 19;
+      break;
+    case LSM6DS3_8g:
+      shift = 18;
+      break;
+    case LSM6DS3_16g:
+      shift = 17;
+      break;
+    default:
+      return -1;
+  }
+
+  for (i = 0; i < len; i++) {
+    mg[i] = (int16_t)(((int32_t)lsb[i] * LSM6DS3_XL_SENS_Q12 +
+                       (1L << (shift - 1))) >> shift);
+  }
+  return 0;
+}
+
+/**
+  * @brief  Converts an array of raw gyroscope values to mdps, rounded.
+  *
+  * @param  fs     full scale the values were taken at
+  * @param  lsb    raw values, e.g. a burst read from the FIFO
+  * @param  mdps   converted values
+  * @param  len    number of values
+  * @retval        0 on success, -1 for an unknown full scale
+  *
+  */
+int32_t lsm6ds3_gy_block_to_mdps(lsm6ds3_fs_g_t fs, const int16_t *lsb,
+                                 int32_t *mdps, uint16_t len)
+{
+  int32_t mul = 35;
+  uint8_t shift;
+  uint16_t i;
+
+  switch (fs) {
+    case LSM6DS3_125dps:
+      shift = 3;
+      break;
+    case LSM6DS3_250dps:
+      shift = 2;
+      break;
+    case LSM6DS3_500dps:
+      shift = 1;
+      break;
+    case LSM6DS3_1000dps:
+      shift = 0;
+      break;
+    case LSM6DS3_2000dps:
+      mul = 70;
+      shift = 0;
+      break;
+    default:
+      return -1;
+  }
+
+  for (i = 0; i < len; i++) {
+    mdps[i] = ((int32_t)lsb[i] * mul + ((1L << shift) >> 1)) >> shift;
+  }
+  return 0;
+}
+
 /**
   * @}
   *
@@ -5906,7 +6476,9 @@ static int32_t platform_read(void *handle, uint8_t reg, uint8_t *bufp, uint16_t
 
 I2C_Data imuData; ///<Global variable to use for I2C communications with the Seesaw Device
 
-stmdev_ctx_t dev_ctx = {.write_reg = platform_write, .read_reg = platform_read};
+static lsm6ds3_shadow_t imuShadow; ///<Cached control registers of the IMU
+
+stmdev_ctx_t dev_ctx = {.write_reg = platform_write, .read_reg = platform_read, .shadow = &imuShadow};
 
 uint8_t msgOutImu[64];
 
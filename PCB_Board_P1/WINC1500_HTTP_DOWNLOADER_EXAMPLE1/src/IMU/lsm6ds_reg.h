@@ -68,12 +68,26 @@ typedef struct{
 typedef int32_t (*stmdev_write_ptr)(void *, uint8_t, uint8_t*, uint16_t);
 typedef int32_t (*stmdev_read_ptr) (void *, uint8_t, uint8_t*, uint16_t);
 
+/** Registers kept by the shadow: FUNC_CFG_ACCESS to MASTER_CONFIG, then
+  * TAP_CFG to MD2_CFG **/
+#define LSM6DS3_SHADOW_REGS             (34U)
+
+typedef struct {
+  uint8_t value[LSM6DS3_SHADOW_REGS];
+  uint8_t valid[(LSM6DS3_SHADOW_REGS + 7U) / 8U];
+  uint8_t dirty[(LSM6DS3_SHADOW_REGS + 7U) / 8U];
+  uint8_t batch;
+  uint8_t embedded;
+} lsm6ds3_shadow_t;
+
 typedef struct {
   /** Component mandatory fields **/
   stmdev_write_ptr  write_reg;
   stmdev_read_ptr   read_reg;
   /** Customizable optional pointer **/
   void *handle;
+  /** Optional write-through register shadow, NULL to disable **/
+  lsm6ds3_shadow_t *shadow;
 } stmdev_ctx_t;
 
 /**
@@ -928,6 +942,13 @@ int32_t lsm6ds3_read_reg(stmdev_ctx_t *ctx, uint8_t reg, uint8_t* data,
 int32_t lsm6ds3_write_reg(stmdev_ctx_t *ctx, uint8_t reg, uint8_t* data,
                           uint16_t len);
 
+int32_t lsm6ds3_shadow_enable(stmdev_ctx_t *ctx, lsm6ds3_shadow_t *shadow);
+int32_t lsm6ds3_shadow_prefetch(stmdev_ctx_t *ctx);
+void lsm6ds3_shadow_invalidate(stmdev_ctx_t *ctx, uint8_t reg, uint16_t len);
+void lsm6ds3_shadow_invalidate_all(stmdev_ctx_t *ctx);
+void lsm6ds3_shadow_batch_begin(stmdev_ctx_t *ctx);
+int32_t lsm6ds3_shadow_batch_commit(stmdev_ctx_t *ctx);
+
 extern float_t lsm6ds3_from_fs2g_to_mg(int16_t lsb);
 extern float_t lsm6ds3_from_fs4g_to_mg(int16_t lsb);
 extern float_t lsm6ds3_from_fs8g_to_mg(int16_t lsb);
@@ -941,6 +962,34 @@ extern float_t lsm6ds3_from_fs2000dps_to_mdps(int16_t lsb);
 
 extern float_t lsm6ds3_from_lsb_to_celsius(int16_t lsb);
 
+#define LSM6DS3_XL_SENS_Q12    63963  /* 61 ug/LSB: Q8 mg, scaled by 2^12 */
+
+int32_t lsm6ds3_from_fs2g_to_mg_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs4g_to_mg_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs8g_to_mg_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs16g_to_mg_q8(int16_t lsb);
+
+int32_t lsm6ds3_from_fs125dps_to_mdps_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs250dps_to_mdps_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs500dps_to_mdps_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs1000dps_to_mdps_q8(int16_t lsb);
+int32_t lsm6ds3_from_fs2000dps_to_mdps_q8(int16_t lsb);
+
+int32_t lsm6ds3_from_lsb_to_celsius_q8(int16_t lsb);
+
+int32_t lsm6ds3_from_fs2g_to_mg_int(int16_t lsb);
+int32_t lsm6ds3_from_fs4g_to_mg_int(int16_t lsb);
+int32_t lsm6ds3_from_fs8g_to_mg_int(int16_t lsb);
+int32_t lsm6ds3_from_fs16g_to_mg_int(int16_t lsb);
+
+int32_t lsm6ds3_from_fs125dps_to_mdps_int(int16_t lsb);
+int32_t lsm6ds3_from_fs250dps_to_mdps_int(int16_t lsb);
+int32_t lsm6ds3_from_fs500dps_to_mdps_int(int16_t lsb);
+int32_t lsm6ds3_from_fs1000dps_to_mdps_int(int16_t lsb);
+int32_t lsm6ds3_from_fs2000dps_to_mdps_int(int16_t lsb);
+
+int32_t lsm6ds3_from_lsb_to_celsius_int(int16_t lsb);
+
 typedef enum {
   LSM6DS3_GY_ORIENT_XYZ = 0,
   LSM6DS3_GY_ORIENT_XZY = 1,
@@ -1002,6 +1051,11 @@ typedef enum {
 int32_t lsm6ds3_gy_full_scale_set(stmdev_ctx_t *ctx, lsm6ds3_fs_g_t val);
 int32_t lsm6ds3_gy_full_scale_get(stmdev_ctx_t *ctx, lsm6ds3_fs_g_t *val);
 
+int32_t lsm6ds3_xl_block_to_mg(lsm6ds3_xl_fs_t fs, const int16_t *lsb,
+                               int16_t *mg, uint16_t len);
+int32_t lsm6ds3_gy_block_to_mdps(lsm6ds3_fs_g_t fs, const int16_t *lsb,
+                                 int32_t *mdps, uint16_t len);
+
 typedef enum {
   LSM6DS3_GY_ODR_OFF    = 0,
   LSM6DS3_GY_ODR_12Hz5  = 1,
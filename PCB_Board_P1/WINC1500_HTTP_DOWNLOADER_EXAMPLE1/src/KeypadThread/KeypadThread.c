@@ -0,0 +1,153 @@
+/**************************************************************************//**
+* @file      KeypadThread.c
+* @brief     Interrupt driven capture of the NeoTrellis key events
+* @details   See KeypadThread.h
+* @date      2020-04-28
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "KeypadThread/KeypadThread.h"
+#include "SeesawDriver/Seesaw.h"
+#include "SensorScheduler/SensorScheduler.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+QueueHandle_t xQueueKeypadEvents = NULL;	///<Key events waiting for the consumers
+static TaskHandle_t keypadTaskHandle = NULL;	///<Task woken by the Seesaw interrupt
+static volatile TickType_t keypadIrqTick = 0;	///<Tick of the last Seesaw interrupt
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void KeypadConfigureInterrupt(void);
+static void KeypadInterruptCallback(void);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vKeypadTask( void *pvParameters )
+* @brief	Waits for the Seesaw interrupt, drains the keypad FIFO and queues the key events
+* @details	The interrupt is level triggered and masked until the FIFO is drained: if events came in meanwhile,
+*			the line is still low and the interrupt fires again as soon as it is unmasked.
+*			Each event is also published as source SENSOR_KEYPAD of the sensor scheduler.
+* @param[in]	pvParameters Unused
+* @note		Create it before the tasks that consume the events, so the queue exists when they start
+*****************************************************************************/
+void vKeypadTask( void *pvParameters )
+{
+	uint8_t fifo[KEYPAD_FIFO_READ];
+	struct KeypadEvent event;
+	struct SensorSample sample = {0};
+
+	xQueueKeypadEvents = xQueueCreate(KEYPAD_EVENT_QUEUE_LENGTH, sizeof(struct KeypadEvent));
+	if (xQueueKeypadEvents == NULL)
+	{
+		SerialConsoleWriteString("ERROR Initializing keypad queue!\r\n");
+		vTaskSuspend(NULL);
+	}
+
+	keypadTaskHandle = xTaskGetCurrentTaskHandle();
+	KeypadConfigureInterrupt();
+
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		event.timestamp = keypadIrqTick;
+
+		uint8_t nEvents;
+		do
+		{
+			nEvents = 0;
+			if (SeesawReadKeypadFifo(fifo, sizeof(fifo)) != ERROR_NONE) break;
+
+			for (uint8_t i = 0; i < sizeof(fifo); i++)
+			{
+				if (fifo[i] == SEESAW_KEYPAD_FIFO_EMPTY) continue;
+				nEvents++;
+
+				union keyEventRaw raw;
+				raw.reg = fifo[i];
+				event.key = NEO_TRELLIS_SEESAW_KEY(raw.bit.NUM);
+				event.edge = raw.bit.EDGE;
+				xQueueSend(xQueueKeypadEvents, &event, 0); //Dropped if nobody reads the queue
+
+				sample.timestamp = event.timestamp;
+				sample.value[0] = event.key;
+				sample.value[1] = event.edge;
+				SensorPublish(SENSOR_KEYPAD, &sample);
+			}
+		} while (nEvents == sizeof(fifo));
+
+		extint_chan_enable_callback(KEYPAD_INT_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+	}
+}
+
+/**************************************************************************//**
+* @fn		int32_t KeypadGetEvent(struct KeypadEvent *event, TickType_t waitTime)
+* @brief	Returns the oldest key event
+* @param[out]	event Key event
+* @param[in]	waitTime Max time, in ticks, to wait for an event. 0 returns at once, portMAX_DELAY waits forever
+* @return	Returns ERROR_NONE, ERROR_TIMEOUT if no event came in time, ERROR_NOT_INITIALIZED if the keypad task is not running
+* @note
+*****************************************************************************/
+int32_t KeypadGetEvent(struct KeypadEvent *event, TickType_t waitTime)
+{
+	if (xQueueKeypadEvents == NULL) return ERROR_NOT_INITIALIZED;
+	return (xQueueReceive(xQueueKeypadEvents, event, waitTime) == pdPASS) ? ERROR_NONE : ERROR_TIMEOUT;
+}
+
+/**************************************************************************//**
+* @fn		void KeypadFlushEvents(void)
+* @brief	Discards the queued key events, e.g. presses made before a game starts
+* @note
+*****************************************************************************/
+void KeypadFlushEvents(void)
+{
+	if (xQueueKeypadEvents != NULL) xQueueReset(xQueueKeypadEvents);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void KeypadConfigureInterrupt(void)
+* @brief	Configures the EIC line of the Seesaw INT output: open drain, active low
+* @note
+*****************************************************************************/
+static void KeypadConfigureInterrupt(void)
+{
+	struct extint_chan_conf config_extint_chan;
+	extint_chan_get_config_defaults(&config_extint_chan);
+	config_extint_chan.gpio_pin           = KEYPAD_INT_PIN;
+	config_extint_chan.gpio_pin_mux       = KEYPAD_INT_MUX;
+	config_extint_chan.gpio_pin_pull      = EXTINT_PULL_UP;
+	config_extint_chan.detection_criteria = EXTINT_DETECT_LOW;
+	extint_chan_set_config(KEYPAD_INT_LINE, &config_extint_chan);
+
+	extint_register_callback(KeypadInterruptCallback, KEYPAD_INT_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+	extint_chan_enable_callback(KEYPAD_INT_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+}
+
+/**************************************************************************//**
+* @fn		static void KeypadInterruptCallback(void)
+* @brief	Masks the level interrupt of the Seesaw and wakes the keypad task to drain the FIFO
+* @note		Runs in the EIC interrupt
+*****************************************************************************/
+static void KeypadInterruptCallback(void)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	extint_chan_disable_callback(KEYPAD_INT_LINE, EXTINT_CALLBACK_TYPE_DETECT);
+	keypadIrqTick = xTaskGetTickCountFromISR();
+	vTaskNotifyGiveFromISR(keypadTaskHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
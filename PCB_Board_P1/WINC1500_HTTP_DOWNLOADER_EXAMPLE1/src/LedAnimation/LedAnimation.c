@@ -0,0 +1,290 @@
+/**************************************************************************//**
+* @file      LedAnimation.c
+* @brief     Fixed frame rate animations of the NeoTrellis LEDs
+* @details   See LedAnimation.h
+* @date      2020-05-04
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "LedAnimation/LedAnimation.h"
+#include "SeesawDriver/Seesaw.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LED_ANIM_FRAMES(ms)		(((ms) + LED_ANIM_FRAME_MS - 1) / LED_ANIM_FRAME_MS)	///<Frames that cover a time in ms, rounded up
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Fade state of a key
+struct LedPixel {
+	uint16_t color[3];	///<Current red, green, blue. 8.8 fixed point
+	int32_t step[3];	///<Change per frame of each color. 8.8 fixed point
+	uint8_t target[3];	///<Red, green, blue at the end of the fade
+	uint16_t framesLeft;	///<Frames to the end of the fade. 0 when the key is still
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+QueueHandle_t xQueueLedKeyframes = NULL;	///<Keyframes waiting to start
+static struct LedPixel ledPixels[NEO_TRELLIS_NUM_KEYS];	///<Fade state of each key, written by the animation task only
+static uint16_t ledHoldFrames = 0;	///<Frames before the next keyframe starts
+static volatile bool ledAnimActive = false;	///<A keyframe is holding or a key is fading
+static volatile bool ledAnimStopRequested = false;	///<Set by LedAnimStop, cleared by the animation task
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void LedAnimStartKeyframe(const struct LedKeyframe *frame);
+static void LedAnimStartFade(uint8_t key, const struct LedKeyframe *frame);
+static bool LedAnimRenderFrame(void);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vLedAnimationTask( void *pvParameters )
+* @brief	Starts the queued keyframes, advances the fades and flushes the LED frame every LED_ANIM_FRAME_MS
+* @details	The frames are paced with vTaskDelayUntil, so a slow flush does not stretch the animations. With nothing
+*			queued and nothing fading, the task waits on the queue and restarts the frame clock on the next keyframe.
+* @param[in]	pvParameters Unused
+* @note		Create it after InitializeSeesaw and before the tasks that queue animations, so the queue exists when they start
+*****************************************************************************/
+void vLedAnimationTask( void *pvParameters )
+{
+	struct LedKeyframe frame;
+	TickType_t lastWake;
+
+	xQueueLedKeyframes = xQueueCreate(LED_ANIM_QUEUE_LENGTH, sizeof(struct LedKeyframe));
+	if (xQueueLedKeyframes == NULL)
+	{
+		SerialConsoleWriteString("ERROR Initializing LED animation queue!\r\n");
+		vTaskSuspend(NULL);
+	}
+
+	for (uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		ledPixels[key].framesLeft = 0;
+	}
+	lastWake = xTaskGetTickCount();
+
+	for (;;)
+	{
+		if (!ledAnimActive)
+		{
+			xQueuePeek(xQueueLedKeyframes, &frame, portMAX_DELAY);
+			ledAnimActive = true; //Before the keyframe leaves the queue: LedAnimIsIdle always sees one or the other
+			lastWake = xTaskGetTickCount();
+		}
+		else
+		{
+			vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(LED_ANIM_FRAME_MS));
+		}
+
+		if (ledAnimStopRequested)
+		{
+			ledAnimStopRequested = false;
+			ledHoldFrames = 0;
+			for (uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+			{
+				ledPixels[key].framesLeft = 0;
+			}
+		}
+
+		if (ledHoldFrames > 0) ledHoldFrames--;
+		while (ledHoldFrames == 0 && xQueueReceive(xQueueLedKeyframes, &frame, 0) == pdPASS)
+		{
+			LedAnimStartKeyframe(&frame);
+		}
+
+		ledAnimActive = LedAnimRenderFrame() || ledHoldFrames > 0;
+		SeesawFrameFlush(); //No transaction if no pixel changed
+	}
+}
+
+/**************************************************************************//**
+* @fn		int32_t LedAnimPlay(const struct LedKeyframe *frames, uint8_t count)
+* @brief	Queues a sequence of keyframes after the ones already queued
+* @param[in]	frames Keyframes, in the order they start
+* @param[in]	count Number of keyframes
+* @return	Returns ERROR_NONE, ERROR_NO_MEMORY if the queue has no room for the whole sequence (nothing is queued),
+*			ERROR_NOT_INITIALIZED if the animation task is not running
+* @note		Never blocks. The sequences of two threads queued at the same time may interleave
+*****************************************************************************/
+int32_t LedAnimPlay(const struct LedKeyframe *frames, uint8_t count)
+{
+	if (xQueueLedKeyframes == NULL) return ERROR_NOT_INITIALIZED;
+	if (uxQueueSpacesAvailable(xQueueLedKeyframes) < count) return ERROR_NO_MEMORY;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (xQueueSend(xQueueLedKeyframes, &frames[i], 0) != pdPASS) return ERROR_NO_MEMORY;
+	}
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		int32_t LedAnimSetKey(uint8_t key, uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs)
+* @brief	Fades a key to a color, as soon as the keyframes queued before have started
+* @param[in] key  Key number (0 to 15)
+* @param[in] fadeMs Fade time. 0 sets the color on the next frame
+* @return	Returns the error of LedAnimPlay, ERROR_INVALID_ARG for a key out of range
+* @note
+*****************************************************************************/
+int32_t LedAnimSetKey(uint8_t key, uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs)
+{
+	struct LedKeyframe frame = {key, red, green, blue, fadeMs, 0};
+
+	if (key >= NEO_TRELLIS_NUM_KEYS) return ERROR_INVALID_ARG;
+	return LedAnimPlay(&frame, 1);
+}
+
+/**************************************************************************//**
+* @fn		int32_t LedAnimFill(uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs)
+* @brief	Fades every key to the same color, as soon as the keyframes queued before have started
+* @param[in] fadeMs Fade time. 0 sets the color on the next frame
+* @return	Returns the error of LedAnimPlay
+* @note
+*****************************************************************************/
+int32_t LedAnimFill(uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs)
+{
+	struct LedKeyframe frame = {LED_ANIM_ALL_KEYS, red, green, blue, fadeMs, 0};
+
+	return LedAnimPlay(&frame, 1);
+}
+
+/**************************************************************************//**
+* @fn		int32_t LedAnimShowMoves(const uint8_t *keys, uint8_t count, uint16_t speedMs, uint8_t red, uint8_t green, uint8_t blue)
+* @brief	Shows a list of moves: each key lights up, then goes dark, one key every speedMs
+* @details	Each move fades in over the first quarter of its time and out over the third quarter.
+* @param[in] keys Key numbers (0 to 15) of the moves, in order
+* @param[in] count Number of moves. At most LED_ANIM_QUEUE_LENGTH / 2
+* @param[in] speedMs Time of each move
+* @return	Returns the error of LedAnimPlay, ERROR_INVALID_ARG for a key out of range
+* @note		Returns at once. LedAnimIsIdle tells when the show is over
+*****************************************************************************/
+int32_t LedAnimShowMoves(const uint8_t *keys, uint8_t count, uint16_t speedMs, uint8_t red, uint8_t green, uint8_t blue)
+{
+	if (xQueueLedKeyframes == NULL) return ERROR_NOT_INITIALIZED;
+	if (uxQueueSpacesAvailable(xQueueLedKeyframes) < 2U * count) return ERROR_NO_MEMORY;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (keys[i] >= NEO_TRELLIS_NUM_KEYS) return ERROR_INVALID_ARG;
+	}
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		struct LedKeyframe move[2] = {
+			{keys[i], red, green, blue, speedMs / 4, speedMs / 2},
+			{keys[i], 0, 0, 0, speedMs / 4, speedMs - speedMs / 2},
+		};
+		xQueueSend(xQueueLedKeyframes, &move[0], 0);
+		xQueueSend(xQueueLedKeyframes, &move[1], 0);
+	}
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		void LedAnimStop(void)
+* @brief	Drops the queued keyframes and freezes the fades at their current colors
+* @note		Keyframes queued after the call play normally
+*****************************************************************************/
+void LedAnimStop(void)
+{
+	if (xQueueLedKeyframes == NULL) return;
+	xQueueReset(xQueueLedKeyframes);
+	ledAnimStopRequested = true;
+}
+
+/**************************************************************************//**
+* @fn		bool LedAnimIsIdle(void)
+* @brief	Returns true when no keyframe is queued, holding or fading
+* @note
+*****************************************************************************/
+bool LedAnimIsIdle(void)
+{
+	if (xQueueLedKeyframes == NULL) return true;
+	return !ledAnimActive && uxQueueMessagesWaiting(xQueueLedKeyframes) == 0;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void LedAnimStartKeyframe(const struct LedKeyframe *frame)
+* @brief	Starts the fade of a keyframe and its hold time
+* @note		Animation task only
+*****************************************************************************/
+static void LedAnimStartKeyframe(const struct LedKeyframe *frame)
+{
+	if (frame->key == LED_ANIM_ALL_KEYS)
+	{
+		for (uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+		{
+			LedAnimStartFade(key, frame);
+		}
+	}
+	else if (frame->key < NEO_TRELLIS_NUM_KEYS)
+	{
+		LedAnimStartFade(frame->key, frame);
+	}
+	ledHoldFrames = LED_ANIM_FRAMES(frame->holdMs);
+}
+
+/**************************************************************************//**
+* @fn		static void LedAnimStartFade(uint8_t key, const struct LedKeyframe *frame)
+* @brief	Starts the fade of a key from its current color to the color of a keyframe
+* @note		A fade of 0 ms takes one frame
+*****************************************************************************/
+static void LedAnimStartFade(uint8_t key, const struct LedKeyframe *frame)
+{
+	struct LedPixel *pixel = &ledPixels[key];
+	uint16_t frames = LED_ANIM_FRAMES(frame->fadeMs);
+
+	if (frames == 0) frames = 1;
+	pixel->target[0] = frame->red;
+	pixel->target[1] = frame->green;
+	pixel->target[2] = frame->blue;
+	for (uint8_t c = 0; c < 3; c++)
+	{
+		pixel->step[c] = (((int32_t)pixel->target[c] << 8) - (int32_t)pixel->color[c]) / frames;
+	}
+	pixel->framesLeft = frames;
+}
+
+/**************************************************************************//**
+* @fn		static bool LedAnimRenderFrame(void)
+* @brief	Advances every fade by one frame and writes the keys that moved into the Seesaw frame
+* @return	Returns true while a key is still fading
+* @note		The last frame of a fade lands exactly on its color
+*****************************************************************************/
+static bool LedAnimRenderFrame(void)
+{
+	bool fading = false;
+
+	for (uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		struct LedPixel *pixel = &ledPixels[key];
+		if (pixel->framesLeft == 0) continue;
+
+		pixel->framesLeft--;
+		for (uint8_t c = 0; c < 3; c++)
+		{
+			if (pixel->framesLeft == 0) pixel->color[c] = (uint16_t)pixel->target[c] << 8;
+			else pixel->color[c] = (uint16_t)((int32_t)pixel->color[c] + pixel->step[c]);
+		}
+		SeesawFrameSetLed(key, pixel->color[0] >> 8, pixel->color[1] >> 8, pixel->color[2] >> 8);
+		if (pixel->framesLeft > 0) fading = true;
+	}
+	return fading;
+}
@@ -0,0 +1,406 @@
+/**************************************************************************//**
+* @file      LoggerThread.c
+* @brief     Deferred (binary) logging for LogMessage and the low priority task that formats it
+* @details   See LoggerThread.h for the record layout.
+* @date      2020-04-20
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <ctype.h>
+#include "LoggerThread/LoggerThread.h"
+#include "LoggerThread/SdLogSink.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LOGGER_OUTPUT_SIZE	128	///<Size of the buffer a record is formatted into. Same as the LogMessage debugBuffer
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Type of the argument consumed by a conversion specification
+enum LogArgType {
+	LOG_ARG_NONE = 0,	///<No argument ("%%")
+	LOG_ARG_WORD,	///<32-bit argument (int, long, char, pointer, size_t)
+	LOG_ARG_LONG_LONG,	///<64-bit integer argument
+	LOG_ARG_DOUBLE,	///<Floating point argument, promoted to double
+	LOG_ARG_UNSUPPORTED	///<Argument that cannot be deferred ("%s", "%n") or malformed specification
+};
+
+///A conversion specification found in a format string
+struct LogConversion {
+	const char *start;	///<Points to the '%'
+	size_t len;	///<Length of the specification, '%' and conversion character included
+	uint8_t stars;	///<Number of '*' width/precision arguments
+	enum LogArgType type;	///<Type of the argument
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+uint8_t logRingBuffer[LOGGER_RING_SIZE];	///<Storage of the binary log ring
+cbuf_handle_t cbufLog = NULL;	///<Binary log ring. Producers: LogMessage callers. Consumer: logger task
+uint32_t loggerDroppedRecords = 0;	///<Number of records lost because the ring was full
+char loggerOutputBuffer[LOGGER_OUTPUT_SIZE];	///<Buffer the logger task formats records into
+TaskHandle_t loggerTask = NULL;	///<Logger task, notified each time a record is queued
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static bool LoggerQueueRecord(const struct LogRecordHeader *header, const uint8_t *data, size_t len);
+static const char *LoggerNextConversion(const char *format, struct LogConversion *conv);
+#if !LOGGER_BINARY_OUTPUT
+static void LoggerFormatRecord(const char *format, const uint32_t *words, char *out, size_t outLen);
+#endif
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void LoggerInitialize(void)
+* @brief	Creates the binary ring used by the deferred logging mode
+* @note		Call once from main, before the scheduler starts. Until then LogMessage formats in the caller
+*****************************************************************************/
+void LoggerInitialize(void)
+{
+	cbufLog = circular_buf_init(logRingBuffer, LOGGER_RING_SIZE);
+}
+
+/**************************************************************************//**
+* @fn		bool LoggerDeferMessage(enum eDebugLogLevels level, const char *format, va_list ap)
+* @brief	Records a log message in the binary ring for the logger task to format later
+* @details	Only the format address, a timestamp and the raw argument words are copied. The message cannot
+*			be deferred if the format is not in flash (it could change before it is formatted), uses "%s"
+*			(the string could change too) or needs more than LOGGER_MAX_ARG_WORDS words.
+* @param[in]	level Level of the message
+* @param[in]	format printf-like format string
+* @param[in]	ap Arguments of the format. Left untouched so the caller can still format it
+* @return	Returns true if the message was handled (queued, or dropped because the ring is full),
+*			false if the caller has to format it
+* @note		Safe to call from several tasks
+*****************************************************************************/
+bool LoggerDeferMessage(enum eDebugLogLevels level, const char *format, va_list ap)
+{
+	struct {
+		struct LogRecordHeader header;
+		uint32_t words[LOGGER_MAX_ARG_WORDS];
+	} record;
+	struct LogConversion conv;
+	const char *next = format;
+	uint8_t nWords = 0;
+	bool deferred = false;
+	va_list args;
+
+	if (cbufLog == NULL || (uint32_t)format >= HMCRAMC0_ADDR) return false;
+
+	va_copy(args, ap);
+	while ((next = LoggerNextConversion(next, &conv)) != NULL)
+	{
+		uint8_t needed = conv.stars + ((conv.type == LOG_ARG_WORD) ? 1 : (conv.type == LOG_ARG_NONE) ? 0 : 2);
+
+		if (conv.type == LOG_ARG_UNSUPPORTED || nWords + needed > LOGGER_MAX_ARG_WORDS) goto exit;
+
+		for (uint8_t star = 0; star < conv.stars; star++)
+		{
+			record.words[nWords++] = (uint32_t)va_arg(args, int);
+		}
+
+		if (conv.type == LOG_ARG_WORD)
+		{
+			record.words[nWords++] = va_arg(args, unsigned int);
+		}
+		else if (conv.type == LOG_ARG_LONG_LONG)
+		{
+			uint64_t value = va_arg(args, uint64_t);
+			memcpy(&record.words[nWords], &value, sizeof(value));
+			nWords += 2;
+		}
+		else if (conv.type == LOG_ARG_DOUBLE)
+		{
+			double value = va_arg(args, double);
+			memcpy(&record.words[nWords], &value, sizeof(value));
+			nWords += 2;
+		}
+	}
+
+	record.header.format = (uint32_t)format;
+	record.header.timestamp = xTaskGetTickCount();
+	record.header.sync = LOGGER_RECORD_SYNC;
+	record.header.level = (uint8_t)level;
+	record.header.nWords = nWords;
+	record.header.reserved = 0;
+
+	LoggerQueueRecord(&record.header, (const uint8_t *)record.words, nWords * sizeof(uint32_t));
+	deferred = true;
+
+exit:
+	va_end(args);
+	return deferred;
+}
+
+/**************************************************************************//**
+* @fn		bool LoggerDeferText(enum eDebugLogLevels level, const char *text)
+* @brief	Queues text already formatted by the caller behind the deferred records
+* @details	Used for the messages LoggerDeferMessage cannot defer, so they do not pass the records queued before them
+* @param[in]	level Level of the message
+* @param[in]	text Text to log. Truncated to LOGGER_RECORD_WORDS words, NUL terminator included
+* @return	Returns true if the text was handled (queued, or dropped because the ring is full),
+*			false if the caller has to send it
+* @note		Safe to call from several tasks
+*****************************************************************************/
+bool LoggerDeferText(enum eDebugLogLevels level, const char *text)
+{
+	struct LogRecordHeader header;
+	size_t len = strnlen(text, LOGGER_RECORD_WORDS * sizeof(uint32_t) - 1);
+
+	if (cbufLog == NULL) return false;
+
+	header.format = LOGGER_TEXT_RECORD;
+	header.timestamp = xTaskGetTickCount();
+	header.sync = LOGGER_RECORD_SYNC;
+	header.level = (uint8_t)level;
+	header.nWords = (uint8_t)(len / sizeof(uint32_t) + 1);	//At least one NUL after the text
+	header.reserved = 0;
+
+	LoggerQueueRecord(&header, (const uint8_t *)text, len);
+	return true;
+}
+
+/**************************************************************************//**
+* @fn		uint32_t LoggerGetDroppedRecords(void)
+* @brief	Returns the number of deferred log records lost because the binary ring was full
+* @note
+*****************************************************************************/
+uint32_t LoggerGetDroppedRecords(void)
+{
+	return loggerDroppedRecords;
+}
+
+/******************************************************************************
+* Task Function
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vLoggerTask( void *pvParameters )
+* @brief	Drains the binary log ring, formatting each record and sending it to the serial console
+* @details	With LOGGER_BINARY_OUTPUT the records are sent as they are, for a host tool to decode against the ELF.
+* @param[in]	pvParameters Unused
+* @note		Runs at the lowest application priority so the formatting cost is taken off the network and sensor paths
+*****************************************************************************/
+void vLoggerTask( void *pvParameters )
+{
+	struct LogRecordHeader header;
+	uint32_t words[LOGGER_RECORD_WORDS];
+
+	loggerTask = xTaskGetCurrentTaskHandle();
+
+	for (;;)
+	{
+		//Single consumer: a whole record is in the ring once its header is
+		if (circular_buf_get_range(cbufLog, (uint8_t *)&header, sizeof(header)) != sizeof(header))
+		{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY); //Given by every record queued
+			continue;
+		}
+		circular_buf_get_range(cbufLog, (uint8_t *)words, header.nWords * sizeof(uint32_t));
+
+#if LOGGER_BINARY_OUTPUT
+		SerialConsoleWriteBuffer((const uint8_t *)&header, sizeof(header));
+		SerialConsoleWriteBuffer((const uint8_t *)words, header.nWords * sizeof(uint32_t));
+		SdLogSinkWrite((const uint8_t *)&header, sizeof(header));
+		SdLogSinkWrite((const uint8_t *)words, header.nWords * sizeof(uint32_t));
+#else
+		const char *text = (const char *)words;
+		if (header.format != LOGGER_TEXT_RECORD)
+		{
+			LoggerFormatRecord((const char *)header.format, words, loggerOutputBuffer, LOGGER_OUTPUT_SIZE);
+			text = loggerOutputBuffer;
+		}
+		SerialConsoleWriteString(text);
+		SdLogSinkWrite((const uint8_t *)text, strlen(text));
+#endif
+	}
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static bool LoggerQueueRecord(const struct LogRecordHeader *header, const uint8_t *data, size_t len)
+* @brief	Puts a record in the binary ring and wakes up the logger task
+* @details	The words of the record past len bytes of data are filled with NULs. Header and words go in within
+*			one critical section, so the logger task never sees half a record.
+* @param[in]	header Header of the record. header->nWords words follow it
+* @param[in]	data Start of the words
+* @param[in]	len Bytes of data. At most header->nWords words
+* @return	Returns true if the record was queued, false if it was dropped because the ring is full
+*****************************************************************************/
+static bool LoggerQueueRecord(const struct LogRecordHeader *header, const uint8_t *data, size_t len)
+{
+	static const uint8_t padding[sizeof(uint32_t)] = {0};
+	size_t wordBytes = header->nWords * sizeof(uint32_t);
+	bool queued = false;
+
+	taskENTER_CRITICAL();
+	if (sizeof(*header) + wordBytes <= circular_buf_capacity(cbufLog) - circular_buf_size(cbufLog))
+	{
+		circular_buf_put2_range(cbufLog, (const uint8_t *)header, sizeof(*header));
+		circular_buf_put2_range(cbufLog, data, len);
+		circular_buf_put2_range(cbufLog, padding, wordBytes - len);
+		queued = true;
+	}
+	else
+	{
+		loggerDroppedRecords++;
+	}
+	taskEXIT_CRITICAL();
+
+	if (queued && loggerTask != NULL) xTaskNotifyGive(loggerTask);
+	return queued;
+}
+
+/**************************************************************************//**
+* @fn		static const char *LoggerNextConversion(const char *format, struct LogConversion *conv)
+* @brief	Finds the next conversion specification in a printf-like format string
+* @param[in]	format Format string to search, from the current position
+* @param[out]	conv Filled with the conversion found
+* @return	Returns a pointer to the character after the conversion, or NULL if there are no more conversions
+* @note		Shared by the producer (to collect the arguments) and the logger task (to format them back)
+*****************************************************************************/
+static const char *LoggerNextConversion(const char *format, struct LogConversion *conv)
+{
+	const char *p = strchr(format, '%');
+	bool longLong = false;
+
+	if (p == NULL) return NULL;
+
+	conv->start = p++;
+	conv->stars = 0;
+
+	while (*p != '\0' && strchr("-+ #0", *p) != NULL) p++;	//Flags
+	if (*p == '*') { conv->stars++; p++; }	//Width
+	while (isdigit((unsigned char)*p)) p++;
+	if (*p == '.')	//Precision
+	{
+		p++;
+		if (*p == '*') { conv->stars++; p++; }
+		while (isdigit((unsigned char)*p)) p++;
+	}
+	while (*p != '\0' && strchr("hljztL", *p) != NULL)	//Length modifiers. long and size_t are 32 bits
+	{
+		if ((*p == 'l' && p[1] == 'l') || *p == 'j') longLong = true;
+		p++;
+	}
+
+	switch (*p)
+	{
+		case '%':
+			conv->type = LOG_ARG_NONE;
+			break;
+		case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': case 'p':
+			conv->type = longLong ? LOG_ARG_LONG_LONG : LOG_ARG_WORD;
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			conv->type = LOG_ARG_DOUBLE;
+			break;
+		case '\0':
+			conv->type = LOG_ARG_UNSUPPORTED;
+			conv->len = p - conv->start;
+			return p;
+		default:
+			conv->type = LOG_ARG_UNSUPPORTED;
+			break;
+	}
+	p++;
+
+	conv->len = p - conv->start;
+	if (conv->len >= LOGGER_MAX_SPEC_LEN) conv->type = LOG_ARG_UNSUPPORTED;
+
+	return p;
+}
+
+#if !LOGGER_BINARY_OUTPUT
+/**************************************************************************//**
+* @fn		static void LoggerFormatRecord(const char *format, const uint32_t *words, char *out, size_t outLen)
+* @brief	Formats a deferred record back into text, one conversion at a time
+* @details	Each conversion is formatted with snprintf and its own properly typed argument, so the raw words
+*			never have to be turned back into a va_list. '*' values are written into the specification.
+* @param[in]	format Format string of the record
+* @param[in]	words Argument words of the record
+* @param[out]	out Buffer for the text. Always NULL terminated, truncated if needed
+* @param[in]	outLen Size of out
+*****************************************************************************/
+static void LoggerFormatRecord(const char *format, const uint32_t *words, char *out, size_t outLen)
+{
+	struct LogConversion conv;
+	char spec[LOGGER_MAX_SPEC_LEN + 2 * 11];	//Room for two '*' values written as decimals
+	const char *p = format;
+	const char *next;
+	size_t pos = 0;
+	uint8_t word = 0;
+
+	while (pos < outLen - 1)
+	{
+		next = LoggerNextConversion(p, &conv);
+
+		//Literal text up to the conversion
+		size_t literal = (next == NULL) ? strlen(p) : (size_t)(conv.start - p);
+		if (literal > outLen - 1 - pos) literal = outLen - 1 - pos;
+		memcpy(&out[pos], p, literal);
+		pos += literal;
+
+		if (next == NULL || pos >= outLen - 1) break;
+
+		//Copy the specification, replacing each '*' by its value
+		size_t specLen = 0;
+		for (size_t iter = 0; iter < conv.len; iter++)
+		{
+			if (conv.start[iter] == '*')
+			{
+				specLen += snprintf(&spec[specLen], sizeof(spec) - specLen, "%d", (int)words[word++]);
+			}
+			else
+			{
+				spec[specLen++] = conv.start[iter];
+			}
+		}
+		spec[specLen] = '\0';
+
+		int written = 0;
+		if (conv.type == LOG_ARG_WORD)
+		{
+			written = snprintf(&out[pos], outLen - pos, spec, words[word++]);
+		}
+		else if (conv.type == LOG_ARG_LONG_LONG)
+		{
+			uint64_t value;
+			memcpy(&value, &words[word], sizeof(value));
+			word += 2;
+			written = snprintf(&out[pos], outLen - pos, spec, value);
+		}
+		else if (conv.type == LOG_ARG_DOUBLE)
+		{
+			double value;
+			memcpy(&value, &words[word], sizeof(value));
+			word += 2;
+			written = snprintf(&out[pos], outLen - pos, spec, value);
+		}
+		else
+		{
+			out[pos] = '%';	//"%%". Unsupported conversions are never deferred
+			written = 1;
+		}
+
+		if (written > 0) pos += ((size_t)written < outLen - pos) ? (size_t)written : (outLen - 1 - pos);
+		p = next;
+	}
+
+	out[pos] = '\0';
+}
+#endif
@@ -0,0 +1,79 @@
+/**************************************************************************//**
+* @file      LoggerThread.h
+* @brief     Deferred (binary) logging for LogMessage and the low priority task that formats it
+* @details   In deferred mode LogMessage does not call vsnprintf. It stores the address of the format string,
+*			 a timestamp and the raw arguments in a binary ring, and the logger task formats the records later.
+*
+*			 Messages that cannot be deferred (see LoggerDeferMessage) are formatted in the caller and queued as
+*			 text records, so the log lines still come out in the order they were logged.
+*
+*			 Record layout in the ring (little endian), also used on the UART when LOGGER_BINARY_OUTPUT is 1:
+*			 --struct LogRecordHeader (12 bytes)
+*			 --nWords 32-bit argument words. 64-bit arguments (long long, double) take two words, low word first.
+*			   A '*' width or precision takes one word ahead of the argument it applies to.
+*			 'format' is the address of the format string in flash. tools/log_decoder.py resolves it against the
+*			 ELF of the firmware that produced the stream. A text record has format LOGGER_TEXT_RECORD and its
+*			 words hold the text, NUL terminated and padded with NULs.
+* @date      2020-04-20
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#ifndef LOGGER_DEFERRED_MODE
+///Set to 1 to defer the formatting of LogMessage to the logger task. 0 formats in the caller.
+///Log lines keep their order among themselves, but text written straight to the console (SerialConsoleWriteString,
+///CLI replies) is no longer in program order with them: it can pass log lines still waiting in the ring.
+#define LOGGER_DEFERRED_MODE	0
+#endif
+#ifndef LOGGER_BINARY_OUTPUT
+#define LOGGER_BINARY_OUTPUT	0	///<Set to 1 to send the raw records to the UART for tools/log_decoder.py instead of formatting them
+#endif
+
+#define LOGGER_TASK_SIZE		256	///<Size of stack to assign to the logger thread. In words. snprintf needs most of it
+#define LOGGER_TASK_PRIORITY	(configMAX_PRIORITIES - 4)	///<Lowest application priority: formatting only runs when nothing else does
+
+#define LOGGER_RING_SIZE		512	///<Size, in bytes, of the binary ring holding the deferred records
+#define LOGGER_MAX_ARG_WORDS	8	///<Max number of 32-bit argument words in a record. Longer messages are formatted in the caller
+#define LOGGER_MAX_SPEC_LEN		12	///<Max length of a single conversion specification (e.g. "%-08lX")
+#define LOGGER_RECORD_WORDS		32	///<Max number of words in a record: a text record of a full LogMessage line (128 bytes)
+#define LOGGER_RECORD_SYNC		0xA5	///<Value of the sync byte of every header, lets a host decoder find the records
+#define LOGGER_TEXT_RECORD		0	///<Format address of a record holding text formatted in the caller
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Header of a deferred log record. Followed by nWords 32-bit argument words
+struct LogRecordHeader {
+	uint32_t format;	///<Address of the format string
+	uint32_t timestamp;	///<Tick count (ms) when the message was logged
+	uint8_t sync;	///<Always LOGGER_RECORD_SYNC
+	uint8_t level;	///<enum eDebugLogLevels of the message
+	uint8_t nWords;	///<Number of argument words following the header
+	uint8_t reserved;	///<Padding, 0
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void LoggerInitialize(void);
+bool LoggerDeferMessage(enum eDebugLogLevels level, const char *format, va_list ap) __attribute__((format(printf, 2, 0)));
+bool LoggerDeferText(enum eDebugLogLevels level, const char *text);
+uint32_t LoggerGetDroppedRecords(void);
+void vLoggerTask( void *pvParameters );
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,69 @@
+/**************************************************************************//**
+* @file      SdLogSink.h
+* @brief     Optional sink that persists the log output to a rotating set of files on the SD card
+* @details   The log output is collected in a RAM double buffer of two sectors. A low priority task writes whole
+*			 512-byte sectors, at sector aligned offsets, to files preallocated once on the card. With _FS_TINY such
+*			 writes go straight to disk_write and never thrash the single sector window FatFs shares with the other
+*			 files. A partially filled sector is also written every SD_LOG_SINK_FLUSH_PERIOD, padded with '\0', and
+*			 rewritten in place once more data arrives.
+*
+*			 When a file is full the sink moves on to the next of SD_LOG_SINK_FILE_COUNT files and overwrites it.
+*			 The index of the file in use is kept in SD_LOG_SINK_INDEX_FILE, so every boot starts on the oldest file.
+*			 Sectors past the write offset of a reused file still hold the lines of its previous use.
+* @date      2020-04-22
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SD_LOG_SINK_ENABLED		0	///<Set to 1 to copy the log output to the SD card. Raise configTOTAL_HEAP_SIZE first: see its tally
+
+#define SD_LOG_SINK_TASK_SIZE		320	///<Size of stack to assign to the sink thread. In words. f_open keeps its LFN buffer on the stack
+#define SD_LOG_SINK_TASK_PRIORITY	(configMAX_PRIORITIES - 4)	///<Lowest application priority, same as the logger task
+#define SD_LOG_SINK_FLUSH_PERIOD	1000	///<Max time, in ms, log data waits in RAM before it is written to the card
+#define SD_LOG_SINK_RETRY_DELAY		2000	///<Time, in ms, between attempts to open the log file while the card is not mounted
+
+#define SD_LOG_SINK_SECTOR_SIZE		512	///<Size of a sector of the card. Unit of every write
+#define SD_LOG_SINK_FILE_SIZE		(64UL * 1024UL)	///<Size, in bytes, each log file is preallocated to. Multiple of SD_LOG_SINK_SECTOR_SIZE
+#define SD_LOG_SINK_FILE_COUNT		4	///<Number of log files written in turn. Max 10
+#define SD_LOG_SINK_FILE_NAME		"0:LOG%u.TXT"	///<Name of the log files. Formatted with the index of the file
+#define SD_LOG_SINK_INDEX_FILE		"0:LOGIDX.TXT"	///<File holding the index of the log file in use
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Statistics of the SD card log sink
+struct SdLogSinkStats {
+	uint32_t bytesLogged;	///<Bytes handed to the sink
+	uint32_t droppedBytes;	///<Bytes lost because both sector buffers were waiting for the card
+	uint32_t sectorsWritten;	///<Number of sector writes, partial sectors included
+	uint32_t writeErrors;	///<Number of FatFs errors. The file is reopened after each of them
+	uint32_t bytesPerSecond;	///<Bytes written to the card during the last second
+	uint16_t lastFlushMs;	///<Time, in ms, the last sector write took
+	uint16_t maxFlushMs;	///<Longest time, in ms, a sector write took
+	uint8_t fileIndex;	///<Index of the log file in use
+	bool fileOpen;	///<True once the card is mounted and the log file is open
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void SdLogSinkWrite(const uint8_t *data, size_t len);
+void SdLogSinkGetStats(struct SdLogSinkStats *stats);
+void vSdLogSinkTask( void *pvParameters );
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,161 @@
+/**************************************************************************//**
+* @file      RuntimeStats.c
+* @brief     Run time counter for the FreeRTOS task statistics (configGENERATE_RUN_TIME_STATS) and per task CPU usage
+* @details   See RuntimeStats.h
+* @date      2020-04-24
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "RuntimeStats/RuntimeStats.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct tc_module runtimeStatsTc;	///<Instance of the timer counter behind the run time counter
+volatile uint32_t runtimeStatsOverflows = 0;	///<Upper 16 bits of the run time counter
+uint32_t runtimeStatsHz = 0;	///<Frequency of the run time counter
+TaskStatus_t runtimeTaskStatus[RUNTIME_STATS_MAX_TASKS];	///<Kept off the stack of the calling task
+UBaseType_t runtimePrevNumber[RUNTIME_STATS_MAX_TASKS];	///<Task numbers of the previous sample
+uint32_t runtimePrevCounter[RUNTIME_STATS_MAX_TASKS];	///<Run time of each task at the previous sample
+UBaseType_t runtimePrevTasks = 0;	///<Number of tasks in the previous sample
+uint32_t runtimePrevTotal = 0;	///<Run time counter at the previous sample
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void RuntimeStatsOverflowCallback(struct tc_module *const module);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void RuntimeStatsConfigureTimer(void)
+* @brief	Starts the timer counter behind the run time counter
+* @note		Called by vTaskStartScheduler through portCONFIGURE_TIMER_FOR_RUN_TIME_STATS
+*****************************************************************************/
+void RuntimeStatsConfigureTimer(void)
+{
+	struct tc_config config;
+
+	tc_get_config_defaults(&config);
+	config.counter_size = TC_COUNTER_SIZE_16BIT;
+	config.clock_source = GCLK_GENERATOR_0;
+	config.clock_prescaler = RUNTIME_STATS_TC_PRESCALER;
+	config.wave_generation = TC_WAVE_GENERATION_NORMAL_FREQ;	//Free running up to 0xFFFF
+
+	if (tc_init(&runtimeStatsTc, RUNTIME_STATS_TC, &config) != STATUS_OK)
+	{
+		SerialConsoleWriteString("ERROR Initializing the run time counter!\r\n");
+		return; //The counter stays at 0: no CPU usage, and benchmarks time 0 us
+	}
+	tc_register_callback(&runtimeStatsTc, RuntimeStatsOverflowCallback, TC_CALLBACK_OVERFLOW);
+	tc_enable_callback(&runtimeStatsTc, TC_CALLBACK_OVERFLOW);
+
+	//Keep COUNT synchronized so reading it on every context switch does not stall on the clock domain crossing
+	RUNTIME_STATS_TC->COUNT16.READREQ.reg = TC_READREQ_RCONT | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+	tc_enable(&runtimeStatsTc);
+	runtimeStatsHz = system_gclk_gen_get_hz(GCLK_GENERATOR_0) / RUNTIME_STATS_PRESCALER_DIV;
+}
+
+/**************************************************************************//**
+* @fn		uint32_t RuntimeStatsGetCounter(void)
+* @brief	Returns the 32-bit run time counter
+* @note		Called by the kernel on every context switch through portGET_RUN_TIME_COUNTER_VALUE.
+*			Safe with interrupts masked: an overflow not yet served is accounted for.
+*****************************************************************************/
+uint32_t RuntimeStatsGetCounter(void)
+{
+	uint32_t overflows;
+	uint16_t count;
+	bool pending;
+
+	do
+	{
+		overflows = runtimeStatsOverflows;
+		count = RUNTIME_STATS_TC->COUNT16.COUNT.reg;
+		pending = (RUNTIME_STATS_TC->COUNT16.INTFLAG.reg & TC_INTFLAG_OVF) != 0;
+	} while (overflows != runtimeStatsOverflows);
+
+	if (pending && count < 0x8000) overflows++; //Wrapped, the interrupt has not run yet
+
+	return (overflows << 16) | count;
+}
+
+/**************************************************************************//**
+* @fn		uint32_t RuntimeStatsCountsToUs(uint32_t counts)
+* @brief	Converts a difference of two RuntimeStatsGetCounter values to microseconds
+* @note
+*****************************************************************************/
+uint32_t RuntimeStatsCountsToUs(uint32_t counts)
+{
+	if (runtimeStatsHz == 0) return 0; //Scheduler not started yet
+	return (uint32_t)(((uint64_t)counts * 1000000UL) / runtimeStatsHz);
+}
+
+/**************************************************************************//**
+* @fn		UBaseType_t RuntimeStatsSample(struct RuntimeTaskUsage *usage, UBaseType_t maxTasks)
+* @brief	Reports the state of every task and the share of the CPU it used since the previous call
+* @details	The first call reports the usage since the scheduler started.
+* @param[out]	usage Filled with one entry per task
+* @param[in]	maxTasks Number of entries in usage
+* @return	Returns the number of entries filled. 0 if there are more than RUNTIME_STATS_MAX_TASKS tasks
+* @note		Not reentrant: call from a single task (the CLI)
+*****************************************************************************/
+UBaseType_t RuntimeStatsSample(struct RuntimeTaskUsage *usage, UBaseType_t maxTasks)
+{
+	uint32_t total;
+	UBaseType_t nTasks = uxTaskGetSystemState(runtimeTaskStatus, RUNTIME_STATS_MAX_TASKS, &total);
+	uint32_t elapsed = total - runtimePrevTotal;
+	UBaseType_t filled = 0;
+
+	for (UBaseType_t i = 0; i < nTasks; i++)
+	{
+		TaskStatus_t *status = &runtimeTaskStatus[i];
+		uint32_t previous = 0;
+
+		for (UBaseType_t j = 0; j < runtimePrevTasks; j++)
+		{
+			if (runtimePrevNumber[j] == status->xTaskNumber) previous = runtimePrevCounter[j];
+		}
+
+		if (filled < maxTasks)
+		{
+			struct RuntimeTaskUsage *task = &usage[filled++];
+			strncpy(task->name, status->pcTaskName, configMAX_TASK_NAME_LEN - 1);
+			task->name[configMAX_TASK_NAME_LEN - 1] = 0;
+			task->state = status->eCurrentState;
+			task->priority = status->uxCurrentPriority;
+			task->stackFree = status->usStackHighWaterMark;
+			task->cpuPermille = (elapsed == 0) ? 0 : (uint16_t)(((uint64_t)(status->ulRunTimeCounter - previous) * 1000) / elapsed);
+		}
+	}
+
+	for (UBaseType_t i = 0; i < nTasks; i++)
+	{
+		runtimePrevNumber[i] = runtimeTaskStatus[i].xTaskNumber;
+		runtimePrevCounter[i] = runtimeTaskStatus[i].ulRunTimeCounter;
+	}
+	runtimePrevTasks = nTasks;
+	runtimePrevTotal = total;
+
+	return filled;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void RuntimeStatsOverflowCallback(struct tc_module *const module)
+* @brief	Counts the overflows of the 16-bit hardware counter, about every 87 ms
+*****************************************************************************/
+static void RuntimeStatsOverflowCallback(struct tc_module *const module)
+{
+	runtimeStatsOverflows++;
+}
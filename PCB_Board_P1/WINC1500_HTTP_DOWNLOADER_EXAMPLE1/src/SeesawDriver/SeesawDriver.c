@@ -24,6 +24,9 @@
 * Variables
 ******************************************************************************/
 I2C_Data seesawData; ///<Global variable to use for I2C communications with the Seesaw Device
+uint8_t seesawFrame[NEO_TRELLIS_FRAME_BYTES]; ///<Shadow of the Neopixel buffer of the Seesaw, in GRB order
+uint64_t seesawFrameDirty = 0; ///<Bit n set while byte n of seesawFrame differs from the Seesaw's copy
+uint8_t seesawFrameWrite[4 + SEESAW_NEOPIXEL_MAX_WRITE]; ///<SEESAW_NEOPIXEL_BUF write being sent by SeesawFrameFlush
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
@@ -113,6 +116,7 @@ int InitializeSeesaw(void)
 	}
 
 	SeesawTurnOnLedTest();
+	seesawFrameDirty = ((uint64_t)1 << NEO_TRELLIS_FRAME_BYTES) - 1; //Unknown content after an MCU only reset: the first flush sends it all
 
 
 	SeesawInitializeKeypad();
@@ -174,6 +178,30 @@ int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count)
 }
 
 
+/**************************************************************************//**
+* @fn		int32_t SeesawReadKeypadFifo(uint8_t *buffer, uint8_t size)
+* @brief	Reads the Seesaw keypad FIFO in a single transaction, without asking for the event count first
+* @param[out] buffer  Pointer to a buffer where the function will write the events in the seesaw buffer to.
+* @param[in]  size  Number of bytes to read. Bytes past the last event read as SEESAW_KEYPAD_FIFO_EMPTY
+                				
+* @return		Returns zero if no I2C errors occurred. Other number in case of error
+* @note         Does not use seesawData, so the keypad task can call it while another task updates the LEDs.
+*****************************************************************************/
+int32_t SeesawReadKeypadFifo(uint8_t *buffer, uint8_t size)
+{
+	static const uint8_t cmd[] = {SEESAW_KEYPAD_BASE, SEESAW_KEYPAD_FIFO};
+	I2C_Data fifoData;
+
+	fifoData.address = NEO_TRELLIS_ADDR;
+	fifoData.msgOut = &cmd;
+	fifoData.lenOut = sizeof(cmd);
+	fifoData.msgIn = buffer;
+	fifoData.lenIn = size;
+
+	return I2cReadDataWait(&fifoData, 0, 100);
+}
+
+
 /**************************************************************************//**
 int32_t SeesawActivateKey(uint8_t key, uint8_t edge, bool enable)
 * @brief	Activates a given key to react to a certain event. Will tell the Seesaw to add events to the FIFO buffer for that key/event pair.
@@ -221,9 +249,17 @@ int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
 	write_buffer1[2] = (offset >> 8);
 	write_buffer1[3] = (offset);
 
+	seesawData.address = NEO_TRELLIS_ADDR;
 	seesawData.msgOut = &write_buffer1;
 	seesawData.lenOut = sizeof(write_buffer1);
 	int error = I2cWriteDataWait(&seesawData, 100);
+
+	//Keep the frame shadow coherent with the Seesaw
+	if(ERROR_NONE == error && key < NEO_TRELLIS_NUM_KEYS)
+	{
+		memcpy(&seesawFrame[offset], &write_buffer1[4], 3);
+		seesawFrameDirty &= ~((uint64_t)7 << offset);
+	}
 	return error;
 
 }
@@ -241,6 +277,7 @@ int32_t SeesawOrderLedUpdate(void)
 {
 	uint8_t orderBuffer[2] = {SEESAW_NEOPIXEL_BASE, SEESAW_NEOPIXEL_SHOW};
 
+	seesawData.address = NEO_TRELLIS_ADDR;
 	seesawData.msgOut = &orderBuffer;
 	seesawData.lenOut = sizeof(orderBuffer);
 	int error = I2cWriteDataWait(&seesawData, 100);
@@ -248,6 +285,104 @@ int32_t SeesawOrderLedUpdate(void)
 }
 
 
+/**************************************************************************//**
+void SeesawFrameSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
+* @brief	Sets the color of a key in the local frame. No I2C transaction: use SeesawFrameFlush to send the frame.
+* @param[in] key  Key number (0 to 15)
+* @param[in] red Red color. 0 to 255.
+* @param[in] green Green color. 0 to 255.
+* @param[in] blue Blue color. 0 to 255.
+                				
+* @note         Only the bytes that change are marked to be sent.
+*****************************************************************************/
+void SeesawFrameSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue)
+{
+	const uint8_t grb[3] = {green, red, blue};
+	if(key >= NEO_TRELLIS_NUM_KEYS) return;
+
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		uint8_t index = 3 * key + i;
+		if(seesawFrame[index] != grb[i])
+		{
+			seesawFrame[index] = grb[i];
+			seesawFrameDirty |= ((uint64_t)1 << index);
+		}
+	}
+}
+
+
+/**************************************************************************//**
+void SeesawFrameFill(uint8_t red, uint8_t green, uint8_t blue)
+* @brief	Sets every key of the local frame to the same color. No I2C transaction: use SeesawFrameFlush to send the frame.
+* @param[in] red Red color. 0 to 255.
+* @param[in] green Green color. 0 to 255.
+* @param[in] blue Blue color. 0 to 255.
+                				
+* @note         FOR ESE516 Board, please do not turn ALL the LEDs to maximum brightness (255,255,255)!
+*****************************************************************************/
+void SeesawFrameFill(uint8_t red, uint8_t green, uint8_t blue)
+{
+	for(uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		SeesawFrameSetLed(key, red, green, blue);
+	}
+}
+
+
+/**************************************************************************//**
+int32_t SeesawFrameFlush(void)
+* @brief	Sends the bytes of the local frame that changed, then orders the Seesaw to update the LEDs.
+* @details	Each SEESAW_NEOPIXEL_BUF write starts at the first byte still to send and spans up to the last changed byte
+			within SEESAW_NEOPIXEL_MAX_WRITE bytes of it, which gives the fewest writes. Unchanged bytes in between are sent
+			again rather than split the write. A full pad takes 2 writes and the SHOW, instead of 16 writes and a SHOW per key.
+                				
+* @return		Returns zero if no I2C errors occurred, or if nothing changed (no transaction then). Other number in case of error
+* @note         On error the frame stays marked, so the next flush retries it.
+*****************************************************************************/
+int32_t SeesawFrameFlush(void)
+{
+	int32_t error = ERROR_NONE;
+	uint64_t pending = seesawFrameDirty;
+	uint8_t start = 0;
+
+	if(pending == 0) goto exit;
+
+	seesawData.address = NEO_TRELLIS_ADDR;
+	seesawData.msgOut = &seesawFrameWrite;
+	seesawData.lenIn = 0;
+
+	while(pending >> start)
+	{
+		while(!(pending & ((uint64_t)1 << start))) start++;
+
+		uint8_t end = start;
+		for(uint8_t i = start; i < start + SEESAW_NEOPIXEL_MAX_WRITE && i < NEO_TRELLIS_FRAME_BYTES; i++)
+		{
+			if(pending & ((uint64_t)1 << i)) end = i;
+		}
+		uint8_t len = end - start + 1;
+
+		seesawFrameWrite[0] = SEESAW_NEOPIXEL_BASE;
+		seesawFrameWrite[1] = SEESAW_NEOPIXEL_BUF;
+		seesawFrameWrite[2] = 0;
+		seesawFrameWrite[3] = start;
+		memcpy(&seesawFrameWrite[4], &seesawFrame[start], len);
+		seesawData.lenOut = 4 + len;
+
+		error = I2cWriteDataWait(&seesawData, 100);
+		if(ERROR_NONE != error) goto exit;
+		start = end + 1;
+	}
+
+	error = SeesawOrderLedUpdate();
+	if(ERROR_NONE == error) seesawFrameDirty &= ~pending;
+
+exit:
+	return error;
+}
+
+
 
 
 
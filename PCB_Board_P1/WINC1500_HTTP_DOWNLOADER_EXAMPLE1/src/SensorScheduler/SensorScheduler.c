@@ -0,0 +1,489 @@
+/**************************************************************************//**
+* @file      SensorScheduler.c
+* @brief     Fixed cadence sampling of every sensor of the board
+* @details   See SensorScheduler.h
+* @date      2020-05-02
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "SensorScheduler/SensorScheduler.h"
+#include "ImuThread/ImuThread.h"
+#include "I2cDriver/shtc3.h"
+#include "DistanceDriver/DistanceSensor.h"
+#include "thumbstick/thumbstick.h"
+#include "SerialConsole.h"
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Fixed description of a source
+struct SensorSource {
+	const char *name;	///<Name shown by the sensors command
+	uint16_t periodMs;	///<Period at startup. 0 for a source published by its own task
+	uint16_t deadlineMs;	///<Max time from a release to the end of its read
+	int32_t (*read)(void);	///<Takes the sample and publishes it. NULL for a source published by its own task
+	bool async;	///<The read only starts the measurement: SensorSourceDone ends it
+	struct SensorSample *ring;	///<Samples of the source
+	uint16_t ringSize;	///<Samples in ring. Power of 2
+};
+
+///Run time state of a source
+struct SensorState {
+	TickType_t release;	///<Tick of the next release
+	TickType_t runRelease;	///<Release of the async read in progress
+	volatile bool busy;	///<An async read is in progress
+	volatile uint32_t head;	///<Number of samples ever written into the ring
+	struct SensorStats stats;	///<Timing statistics
+};
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void SensorInitializeSources(void);
+static void SensorRunSource(enum eSensorSource source);
+static void SensorNoteJitter(struct SensorStats *stats, TickType_t jitter);
+static int32_t SensorReadImu(void);
+static int32_t SensorReadShtc3(void);
+static int32_t SensorReadDistance(void);
+static int32_t SensorReadThumbstick(void);
+static void SensorShtc3Callback(const struct Shtc3Measurement *measurement, void *context);
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct SensorSample imuSamples[IMU_RING_SAMPLES];	///<Ring of SENSOR_IMU
+static struct SensorSample shtc3Samples[SENSOR_RING_SAMPLES];	///<Ring of SENSOR_SHTC3
+static struct SensorSample distanceSamples[SENSOR_RING_SAMPLES];	///<Ring of SENSOR_DISTANCE
+static struct SensorSample thumbstickSamples[SENSOR_RING_SAMPLES];	///<Ring of SENSOR_THUMBSTICK
+static struct SensorSample keypadSamples[SENSOR_RING_SAMPLES];	///<Ring of SENSOR_KEYPAD
+
+///Source table, in the order of eSensorSource. The IMU period is updated from the output data rate
+static const struct SensorSource sensorSources[N_SENSOR_SOURCES] = {
+	{"imu", 0, SENSOR_IMU_DEADLINE_MS, SensorReadImu, false, imuSamples, IMU_RING_SAMPLES},
+	{"shtc3", SENSOR_SHTC3_PERIOD_MS, SENSOR_SHTC3_DEADLINE_MS, SensorReadShtc3, true, shtc3Samples, SENSOR_RING_SAMPLES},
+	{"distance", SENSOR_DISTANCE_PERIOD_MS, SENSOR_DISTANCE_DEADLINE_MS, SensorReadDistance, false, distanceSamples, SENSOR_RING_SAMPLES},
+	{"thumbstick", SENSOR_THUMBSTICK_PERIOD_MS, SENSOR_THUMBSTICK_DEADLINE_MS, SensorReadThumbstick, false, thumbstickSamples, SENSOR_RING_SAMPLES},
+	{"keypad", 0, 0, NULL, false, keypadSamples, SENSOR_RING_SAMPLES},
+};
+
+static struct SensorState sensorState[N_SENSOR_SOURCES];	///<Run time state of each source
+static uint32_t distanceLastCount = 0;	///<Readings of the US-100 stream already published
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vSensorSchedulerTask( void *pvParameters )
+* @brief	Runs the source table at the period of each source
+* @details	The task sleeps until the earliest release with vTaskDelayUntil, so the releases do not drift with the
+*			time the reads take. Every source released within SENSOR_MERGE_TICKS of it is run in the same pass,
+*			earliest absolute deadline first.
+* @param[in]	pvParameters Unused
+* @note		Create it after I2cInitializeDriver, initialize_thumbstick and InitializeDistanceSensor
+*****************************************************************************/
+void vSensorSchedulerTask( void *pvParameters )
+{
+	TickType_t lastWake;
+
+	SensorInitializeSources();
+	lastWake = xTaskGetTickCount();
+
+	for (;;)
+	{
+		TickType_t first = 0;
+		bool found = false;
+		uint8_t due = 0;
+
+		for (uint8_t i = 0; i < N_SENSOR_SOURCES; i++)
+		{
+			struct SensorState *state = &sensorState[i];
+			if (!state->stats.enabled || state->stats.periodMs == 0) continue;
+			if (!found || (int32_t)(state->release - first) < 0) first = state->release;
+			found = true;
+		}
+		if (!found) vTaskSuspend(NULL);
+
+		//Returns at once, without drifting, if the release is already past
+		if ((int32_t)(first - lastWake) > 0) vTaskDelayUntil(&lastWake, first - lastWake);
+
+		for (uint8_t i = 0; i < N_SENSOR_SOURCES; i++)
+		{
+			struct SensorState *state = &sensorState[i];
+			if (!state->stats.enabled || state->stats.periodMs == 0) continue;
+			if ((int32_t)(state->release - first) <= SENSOR_MERGE_TICKS) due |= 1 << i;
+		}
+
+		while (due != 0)
+		{
+			uint8_t next = 0;
+			TickType_t nextDeadline = 0;
+			bool picked = false;
+
+			for (uint8_t i = 0; i < N_SENSOR_SOURCES; i++)
+			{
+				if (!(due & (1 << i))) continue;
+				TickType_t deadline = sensorState[i].release + sensorSources[i].deadlineMs;
+				if (!picked || (int32_t)(deadline - nextDeadline) < 0)
+				{
+					next = i;
+					nextDeadline = deadline;
+					picked = true;
+				}
+			}
+			due &= ~(1 << next);
+			SensorRunSource((enum eSensorSource)next);
+		}
+	}
+}
+
+/**************************************************************************//**
+* @fn		void SensorPublish(enum eSensorSource source, const struct SensorSample *sample)
+* @brief	Writes a sample into the ring of the source, then makes it visible to the consumers by moving the head
+* @note		One writer per source: the sensor task, the bus thread for the SHTC3, the keypad task for the keypad
+*****************************************************************************/
+void SensorPublish(enum eSensorSource source, const struct SensorSample *sample)
+{
+	const struct SensorSource *src = &sensorSources[source];
+	struct SensorState *state = &sensorState[source];
+
+	src->ring[state->head & (src->ringSize - 1)] = *sample;
+	__DMB();
+	state->head++;
+	state->stats.samples++;
+}
+
+/**************************************************************************//**
+* @fn		void SensorSourceDone(enum eSensorSource source, int32_t error)
+* @brief	Ends the async read in progress of a source and checks it against its deadline
+* @param[in]	source Source whose read is over
+* @param[in]	error ERROR_NONE, or the error of the read
+* @note		From the task or callback that completes the read. Not from an interrupt
+*****************************************************************************/
+void SensorSourceDone(enum eSensorSource source, int32_t error)
+{
+	struct SensorState *state = &sensorState[source];
+
+	if (!state->busy) return;
+	if ((int32_t)(xTaskGetTickCount() - state->runRelease) > (int32_t)sensorSources[source].deadlineMs) state->stats.overruns++;
+	if (error != ERROR_NONE) state->stats.errors++;
+	state->busy = false;
+}
+
+/**************************************************************************//**
+* @fn		void SensorReaderInit(struct SensorReader *reader, enum eSensorSource source)
+* @brief	Starts a consumer of a source at the next sample to be published
+* @note
+*****************************************************************************/
+void SensorReaderInit(struct SensorReader *reader, enum eSensorSource source)
+{
+	reader->source = source;
+	reader->next = sensorState[source].head;
+	reader->dropped = 0;
+}
+
+/**************************************************************************//**
+* @fn		uint16_t SensorRead(struct SensorReader *reader, struct SensorSample *samples, uint16_t maxSamples)
+* @brief	Copies the samples of a source published since the last call, oldest first
+* @details	Lock free: the writer publishes a sample before moving the head, and a copy overwritten meanwhile
+*			is discarded. Samples the consumer was too slow to read are counted in reader->dropped.
+* @param[in,out]	reader Cursor of the consumer
+* @param[out]	samples Samples read
+* @param[in]	maxSamples Room in samples
+* @return	Returns the number of samples copied
+* @note		Any number of consumers, each with its own reader. Never blocks
+*****************************************************************************/
+uint16_t SensorRead(struct SensorReader *reader, struct SensorSample *samples, uint16_t maxSamples)
+{
+	const struct SensorSource *src = &sensorSources[reader->source];
+	struct SensorState *state = &sensorState[reader->source];
+	uint32_t head = state->head;
+	uint16_t count;
+	uint32_t lost;
+
+	__DMB();
+	if (head - reader->next > src->ringSize)
+	{
+		reader->dropped += head - reader->next - src->ringSize;
+		reader->next = head - src->ringSize;
+	}
+
+	count = (head - reader->next < maxSamples) ? (uint16_t)(head - reader->next) : maxSamples;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		samples[i] = src->ring[(reader->next + i) & (src->ringSize - 1)];
+	}
+
+	//The slot of sample n is rewritten while the head is at n + ringSize
+	__DMB();
+	head = state->head;
+	lost = (head - reader->next >= src->ringSize) ? head - reader->next - src->ringSize + 1 : 0;
+	if (lost > count) lost = count;
+	if (lost > 0)
+	{
+		count -= lost;
+		memmove(samples, &samples[lost], count * sizeof(samples[0]));
+		reader->dropped += lost;
+	}
+
+	reader->next += count + lost;
+	return count;
+}
+
+/**************************************************************************//**
+* @fn		int32_t SensorGetLatest(enum eSensorSource source, struct SensorSample *sample)
+* @brief	Returns the latest sample published by a source
+* @return	Returns ERROR_NONE, ERROR_NOT_READY if the source published no sample yet
+* @note		Never blocks
+*****************************************************************************/
+int32_t SensorGetLatest(enum eSensorSource source, struct SensorSample *sample)
+{
+	const struct SensorSource *src = &sensorSources[source];
+	struct SensorState *state = &sensorState[source];
+	uint32_t head;
+
+	do
+	{
+		head = state->head;
+		if (head == 0) return ERROR_NOT_READY;
+		__DMB();
+		*sample = src->ring[(head - 1) & (src->ringSize - 1)];
+		__DMB();
+	} while (state->head - head >= src->ringSize - 1U);
+
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		void SensorGetStats(enum eSensorSource source, struct SensorStats *stats)
+* @brief	Copies the timing statistics of a source
+* @note		The counters are read one by one: they may be one run apart
+*****************************************************************************/
+void SensorGetStats(enum eSensorSource source, struct SensorStats *stats)
+{
+	*stats = sensorState[source].stats;
+}
+
+/**************************************************************************//**
+* @fn		const char *SensorGetName(enum eSensorSource source)
+* @brief	Returns the name of a source
+* @note
+*****************************************************************************/
+const char *SensorGetName(enum eSensorSource source)
+{
+	return sensorSources[source].name;
+}
+
+/**************************************************************************//**
+* @fn		void SensorResetStats(void)
+* @brief	Clears the counters and the max jitter of every source
+* @note		A read in progress may still count into the cleared counters
+*****************************************************************************/
+void SensorResetStats(void)
+{
+	for (uint8_t i = 0; i < N_SENSOR_SOURCES; i++)
+	{
+		struct SensorStats *stats = &sensorState[i].stats;
+		stats->runs = 0;
+		stats->samples = 0;
+		stats->errors = 0;
+		stats->overruns = 0;
+		stats->skipped = 0;
+		stats->lastJitterMs = 0;
+		stats->maxJitterMs = 0;
+	}
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void SensorInitializeSources(void)
+* @brief	Starts the sensors that need it and releases every source now
+* @details	A sensor that does not answer is left out of the schedule.
+* @note
+*****************************************************************************/
+static void SensorInitializeSources(void)
+{
+	TickType_t now = xTaskGetTickCount();
+
+	for (uint8_t i = 0; i < N_SENSOR_SOURCES; i++)
+	{
+		sensorState[i].release = now;
+		sensorState[i].stats.periodMs = sensorSources[i].periodMs;
+		sensorState[i].stats.enabled = true;
+	}
+
+	if (ImuInitialize() != ERROR_NONE)
+	{
+		SerialConsoleWriteString("Could not initialize IMU\r\n");
+		sensorState[SENSOR_IMU].stats.enabled = false;
+	}
+	sensorState[SENSOR_IMU].stats.periodMs = ImuGetServicePeriodMs();
+
+	if (SHTC3_Init() != ERROR_NONE)
+	{
+		SerialConsoleWriteString("Could not initialize SHTC3\r\n");
+		sensorState[SENSOR_SHTC3].stats.enabled = false;
+	}
+
+	if (DistanceSensorStartStream() != ERROR_NONE)
+	{
+		SerialConsoleWriteString("Could not start the distance stream\r\n");
+		sensorState[SENSOR_DISTANCE].stats.enabled = false;
+	}
+}
+
+/**************************************************************************//**
+* @fn		static void SensorRunSource(enum eSensorSource source)
+* @brief	Runs the read of a released source and schedules its next release
+* @details	A release a whole period late or more is skipped, and the next one keeps the phase of the source.
+*			So is a release of an async source whose previous read is still in progress. The jitter is the time
+*			from the release to the start of the read (0 for a read merged ahead of its release), the deadline is
+*			checked at the end of the read.
+* @note
+*****************************************************************************/
+static void SensorRunSource(enum eSensorSource source)
+{
+	const struct SensorSource *src = &sensorSources[source];
+	struct SensorState *state = &sensorState[source];
+	TickType_t start = xTaskGetTickCount();
+	TickType_t release = state->release;
+	int32_t error;
+
+	state->release += state->stats.periodMs;
+	while ((int32_t)(start - state->release) >= 0)
+	{
+		state->release += state->stats.periodMs;
+		state->stats.skipped++;
+	}
+
+	if (src->async && state->busy)
+	{
+		state->stats.skipped++;
+		return;
+	}
+
+	SensorNoteJitter(&state->stats, ((int32_t)(start - release) > 0) ? start - release : 0);
+	state->stats.runs++;
+
+	if (src->async)
+	{
+		//The read may complete on a higher priority thread before it returns
+		state->runRelease = release;
+		state->busy = true;
+		error = src->read();
+		if (error != ERROR_NONE && state->busy)
+		{
+			state->stats.errors++;
+			state->busy = false;
+		}
+		return;
+	}
+
+	error = src->read();
+	if ((int32_t)(xTaskGetTickCount() - release) > (int32_t)src->deadlineMs) state->stats.overruns++;
+	if (error != ERROR_NONE) state->stats.errors++;
+}
+
+/**************************************************************************//**
+* @fn		static void SensorNoteJitter(struct SensorStats *stats, TickType_t jitter)
+* @brief	Records the release jitter of a read
+* @note
+*****************************************************************************/
+static void SensorNoteJitter(struct SensorStats *stats, TickType_t jitter)
+{
+	uint16_t jitterMs = (jitter > UINT16_MAX) ? UINT16_MAX : (uint16_t)jitter;
+
+	stats->lastJitterMs = jitterMs;
+	if (jitterMs > stats->maxJitterMs) stats->maxJitterMs = jitterMs;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t SensorReadImu(void)
+* @brief	Drains the FIFO of the IMU, then follows its output data rate
+* @return	Returns the error of ImuService
+* @note
+*****************************************************************************/
+static int32_t SensorReadImu(void)
+{
+	int32_t error = ImuService();
+
+	sensorState[SENSOR_IMU].stats.periodMs = ImuGetServicePeriodMs();
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t SensorReadShtc3(void)
+* @brief	Starts a normal mode measurement of the SHTC3. SensorShtc3Callback ends it
+* @return	Returns the error of SHTC3_StartMeasurement
+* @note
+*****************************************************************************/
+static int32_t SensorReadShtc3(void)
+{
+	return SHTC3_StartMeasurement(SHTC3_MODE_NORMAL, SensorShtc3Callback, NULL);
+}
+
+/**************************************************************************//**
+* @fn		static int32_t SensorReadDistance(void)
+* @brief	Publishes the latest filtered distance of the US-100 stream, if a reading came in since the last one
+* @return	Returns ERROR_NONE, ERROR_TIMEOUT if the stream had stalled and was restarted
+* @note		Never waits on the UART
+*****************************************************************************/
+static int32_t SensorReadDistance(void)
+{
+	struct SensorSample sample = {0};
+	struct DistanceReading reading;
+	int32_t error = DistanceSensorCheckStream();
+
+	if (error != ERROR_NONE) return error;
+	if (DistanceSensorGetLatest(&reading) != ERROR_NONE || reading.count == distanceLastCount) return ERROR_NONE;
+
+	distanceLastCount = reading.count;
+	sample.timestamp = reading.timestamp;
+	sample.value[0] = (int16_t)reading.distance;
+	sample.value[1] = (int16_t)reading.raw;
+	SensorPublish(SENSOR_DISTANCE, &sample);
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t SensorReadThumbstick(void)
+* @brief	Converts the X and Y axes of the thumbstick
+* @return	Returns ERROR_NONE
+* @note
+*****************************************************************************/
+static int32_t SensorReadThumbstick(void)
+{
+	struct SensorSample sample = {0};
+
+	sample.timestamp = xTaskGetTickCount();
+	sample.value[0] = (int16_t)ts_read_x();
+	sample.value[1] = (int16_t)tx_read_y();
+	SensorPublish(SENSOR_THUMBSTICK, &sample);
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		static void SensorShtc3Callback(const struct Shtc3Measurement *measurement, void *context)
+* @brief	Publishes an SHTC3 measurement and ends its read
+* @note		Runs on the I2C bus thread
+*****************************************************************************/
+static void SensorShtc3Callback(const struct Shtc3Measurement *measurement, void *context)
+{
+	struct SensorSample sample = {0};
+
+	if (measurement->error == ERROR_NONE)
+	{
+		sample.timestamp = measurement->timestamp;
+		sample.value[0] = measurement->temperature;
+		sample.value[1] = (int16_t)measurement->humidity;
+		SensorPublish(SENSOR_SHTC3, &sample);
+	}
+	SensorSourceDone(SENSOR_SHTC3, measurement->error);
+}
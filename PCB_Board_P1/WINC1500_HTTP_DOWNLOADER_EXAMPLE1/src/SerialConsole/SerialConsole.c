@@ -25,6 +25,8 @@
 * Includes
 ******************************************************************************/
 #include "SerialConsole.h"
+#include "LoggerThread/LoggerThread.h"
+#include "LoggerThread/SdLogSink.h"
 
 /******************************************************************************
 * Defines
@@ -41,27 +43,50 @@ cbuf_handle_t cbufRx;	///<Circular buffer handler for receiving characters from
 cbuf_handle_t cbufTx;	///<Circular buffer handler for transmitting characters from the Serial Interface
 
 char latestRx;	///< Holds the latest character that was received
-char latestTx;	///< Holds the latest character to be transmitted.
+volatile uint16_t txJobLength = 0;	///< Number of bytes of the TX ring in flight. 0 when the transmitter is idle
+struct SerialConsoleTxStats txStats;	///< Bytes and interrupts counters of the TX path
+TaskHandle_t rxNotifyTask = NULL;	///< Task notified each time a character is received. NULL if none
+struct SerialConsoleRingStats ringStats[N_SERIAL_RINGS];	///< Overflow counters of the TX and RX rings
+enum eSerialOverflowPolicy ringPolicy[N_SERIAL_RINGS] = {SERIAL_CONSOLE_TX_POLICY, SERIAL_CONSOLE_RX_POLICY};	///< Overflow policy of each ring
+TickType_t txBlockTimeout = pdMS_TO_TICKS(SERIAL_CONSOLE_TX_TIMEOUT);	///< Max time a write waits for room in the TX ring with SERIAL_OVERFLOW_BLOCK
+SemaphoreHandle_t txRoomSemaphore = NULL;	///< Given by the transmit interrupt when a span is sent and a write waits for room
+volatile uint8_t txRoomWaiters = 0;	///< Number of writes waiting for room in the TX ring
+#if SERIAL_CONSOLE_TRACE_LOCK
+traceString consoleTraceChannel = NULL;	///< Trace user event channel for the TX lock probe
+#endif
 
 /******************************************************************************
 *  Callback Declaration
 ******************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module);	//Callback for when we finish writing characters to UART
 void usart_read_callback(struct usart_module *const usart_module);	//Callback for when we finis reading characters from UART
+#if SERIAL_CONSOLE_TX_DMA
+void usart_dma_tx_callback(struct dma_resource* const resource);	//Callback for when the DMA finishes sending a span of the TX ring
+#endif
 
 /******************************************************************************
 * Local Function Declaration
 ******************************************************************************/
 static void configure_usart(void);
 static void configure_usart_callbacks(void);
+static void SerialConsoleStartTxJob(void);
+static void SerialConsoleTxJobDone(void);
+#if SERIAL_CONSOLE_TX_DMA
+static void configure_dma_tx(void);
+#endif
 
 /******************************************************************************
 * Global Local Variables
 ******************************************************************************/
 struct usart_module usart_instance;
+#if SERIAL_CONSOLE_TX_DMA
+struct dma_resource usart_dma_tx_resource;	///<DMA channel used to feed the console SERCOM
+COMPILER_ALIGNED(16) DmacDescriptor usart_dma_tx_descriptor SECTION_DMAC_DESCRIPTOR;	///<Descriptor reprogrammed for every span sent
+#endif
 char rxCharacterBuffer[RX_BUFFER_SIZE]; ///<Buffer to store received characters
 char txCharacterBuffer[TX_BUFFER_SIZE]; ///<Buffer to store characters to be sent
 enum eDebugLogLevels currentDebugLevel = LOG_INFO_LVL; ///<Variable that holds the level of debug log messages to show. Defaults to showing all debug values
+uint32_t logSuppressedTotal = 0; ///<Number of messages dropped by rate-limited log call sites
 
 
 /******************************************************************************
@@ -84,10 +109,14 @@ void InitializeSerialConsole(void)
 	//Initialize circular buffers for RX and TX
 	cbufRx = circular_buf_init((uint8_t*)rxCharacterBuffer, RX_BUFFER_SIZE);
 	cbufTx = circular_buf_init((uint8_t*)txCharacterBuffer, TX_BUFFER_SIZE);
+	txRoomSemaphore = xSemaphoreCreateBinary();
 
 	//Configure USART and Callbacks
 	configure_usart();
 	configure_usart_callbacks();
+#if SERIAL_CONSOLE_TX_DMA
+	configure_dma_tx();
+#endif
 	
 	
 	usart_read_buffer_job(&usart_instance, (uint8_t*) &latestRx, 1);	//Kicks off constant reading of characters
@@ -108,26 +137,118 @@ void DeinitializeSerialConsole(void)
 /**************************************************************************//**
 * @fn			void SerialConsoleWriteString(char * string)
 * @brief		Writes a string to be written to the uart. Copies the string to a ring buffer that is used to hold the text send to the uart
-* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'. Modified to be thread safe.
+* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'. See SerialConsoleWriteBuffer.
 * @note			Use to send a string of characters to the user via UART
 *****************************************************************************/
 void SerialConsoleWriteString(const char * string)
 {
-vTaskSuspendAll();
  	if(string != NULL)
 	{
-		for (size_t iter = 0; iter < strlen(string); iter++)
+		SerialConsoleWriteBuffer((const uint8_t*) string, strlen(string));
+	}
+}
+
+/**************************************************************************//**
+* @fn			void SerialConsoleWriteBuffer(const uint8_t * data, size_t len)
+* @brief		Writes len bytes to the uart. Copies them to the ring buffer that is used to hold the data sent to the uart
+* @details		Uses the ringbuffer 'cbufTx', which in turn uses the array 'txCharacterBuffer'. Thread safe:
+*				the ring is lock-free against the transmit interrupt, a short critical section serializes the writing tasks.
+*				Data that does not fit in the ring is handled by the TX overflow policy (see SerialConsoleSetOverflowPolicy).
+*				It is never allowed to overwrite the bytes being sent, which the transmitter reads in place.
+*				With SERIAL_OVERFLOW_BLOCK the writer sleeps on txRoomSemaphore, given by the transmit interrupt each
+*				time a span is sent. With SERIAL_OVERFLOW_DROP_OLDEST_LINE the scan for the end of a line holds the
+*				interrupts masked for at most SERIAL_CONSOLE_DROP_SCAN bytes at a time.
+* @param[in]	data Bytes to send. May contain '\0' (e.g. binary log records)
+* @param[in]	len Number of bytes to send
+* @note
+*****************************************************************************/
+void SerialConsoleWriteBuffer(const uint8_t * data, size_t len)
+{
+	struct SerialConsoleRingStats *stats = &ringStats[SERIAL_RING_TX];
+	size_t capacity = circular_buf_capacity(cbufTx);
+	size_t room, dropped = 0;
+	bool stalled = false, midLine = false;
+	TickType_t waitStart = 0, waited;
+	uint32_t lockStart;
+
+	taskENTER_CRITICAL(); //Several tasks share the TX side. Held for the copy into the ring and short line scans
+	lockStart = SysTick->VAL;
+	room = capacity - circular_buf_size(cbufTx) - txJobLength; //The span in flight is still read by the transmitter
+
+	while(room < len && ringPolicy[SERIAL_RING_TX] == SERIAL_OVERFLOW_BLOCK && len <= capacity
+		&& xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+	{
+		if(!stalled)
 		{
-			circular_buf_put(cbufTx, string[iter]);
+			stalled = true;
+			stats->stalls++;
+			waitStart = xTaskGetTickCount();
 		}
+		waited = xTaskGetTickCount() - waitStart;
+		if(waited >= txBlockTimeout) break; //Timed out: drop it
+
+		//A job is in flight (the ring is not empty), so its completion interrupt will give the semaphore
+		txRoomWaiters++;
+		taskEXIT_CRITICAL();
+		xSemaphoreTake(txRoomSemaphore, txBlockTimeout - waited);
+		taskENTER_CRITICAL();
+		txRoomWaiters--;
+		lockStart = SysTick->VAL;
+		room = capacity - circular_buf_size(cbufTx) - txJobLength;
+	}
 
-		if(usart_get_job_status(&usart_instance, USART_TRANSCEIVER_TX) == STATUS_OK)
+	if(room < len && ringPolicy[SERIAL_RING_TX] == SERIAL_OVERFLOW_DROP_OLDEST_LINE)
+	{
+		//Safe on the consumer side of the ring: the transmit interrupt is masked. The interrupts get a window
+		//every SERIAL_CONSOLE_DROP_SCAN bytes; the end of a longer line may be sent meanwhile
+		while((room < len || midLine) && !circular_buf_empty(cbufTx))
 		{
-			circular_buf_get(cbufTx, (uint8_t*) &latestTx); //Perform only if the SERCOM TX is free (not busy)
-			usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
+			bool lineEnd;
+			dropped += circular_buf_drop_line(cbufTx, SERIAL_CONSOLE_DROP_SCAN, &lineEnd);
+			midLine = !lineEnd;
+			if(midLine)
+			{
+				taskEXIT_CRITICAL();
+				taskENTER_CRITICAL();
+				lockStart = SysTick->VAL;
+			}
+			room = capacity - circular_buf_size(cbufTx) - txJobLength;
 		}
 	}
-xTaskResumeAll();
+
+	if(room >= len)
+	{
+		circular_buf_put2_range(cbufTx, data, len);
+	}
+	else
+	{
+		dropped += len; //Never overwrite the span in flight
+	}
+
+	if(dropped > 0)
+	{
+		stats->overflows++;
+		stats->droppedBytes += dropped;
+	}
+	size_t used = circular_buf_size(cbufTx) + txJobLength;
+	if(used > stats->highWater) stats->highWater = used;
+
+	if(txJobLength == 0)
+	{
+		SerialConsoleStartTxJob(); //Perform only if the transmitter is free (not busy)
+	}
+
+	uint32_t lockEnd = SysTick->VAL;
+	//SysTick counts down and may reload once while the interrupts are masked
+	uint32_t lockCycles = (lockStart >= lockEnd) ? (lockStart - lockEnd) : (lockStart + SysTick->LOAD + 1 - lockEnd);
+	txStats.lastLockCycles = lockCycles;
+	if(lockCycles > txStats.maxLockCycles) txStats.maxLockCycles = lockCycles;
+	taskEXIT_CRITICAL();
+
+#if SERIAL_CONSOLE_TRACE_LOCK
+	if(consoleTraceChannel == NULL) consoleTraceChannel = xTraceRegisterString("ConsoleTx");
+	vTracePrintF(consoleTraceChannel, "lock %d cycles, %d bytes", lockCycles, len);
+#endif
 }
 
 /**************************************************************************//**
@@ -142,11 +263,71 @@ xTaskResumeAll();
 *****************************************************************************/
 int SerialConsoleReadCharacter(uint8_t *rxChar)
 {
-	vTaskSuspendAll();
-	int a = circular_buf_get(cbufRx, (uint8_t*) rxChar);
-	xTaskResumeAll();
-	return a;
+	if(ringPolicy[SERIAL_RING_RX] != SERIAL_OVERFLOW_DROP_OLDEST_LINE)
+	{
+		return circular_buf_get(cbufRx, (uint8_t*) rxChar); //Lock-free: the RX interrupt is the only producer
+	}
 
+	//The RX interrupt also consumes from the ring when it drops the oldest line
+	taskENTER_CRITICAL();
+	int result = circular_buf_get(cbufRx, (uint8_t*) rxChar);
+	taskEXIT_CRITICAL();
+	return result;
+}
+
+
+/**************************************************************************//**
+* @fn			void SerialConsoleSetRxNotifyTask(TaskHandle_t task)
+* @brief		Sets the task that gets a notification (xTaskNotifyGive) for every character received
+* @details		The task can block in ulTaskNotifyTake until input arrives, then drain the RX buffer with
+*				SerialConsoleReadCharacter until it returns -1. Characters received meanwhile leave the
+*				notification pending, so none is missed.
+* @param[in]	task Task to notify. NULL to stop notifying
+* @note
+*****************************************************************************/
+void SerialConsoleSetRxNotifyTask(TaskHandle_t task)
+{
+	rxNotifyTask = task;
+}
+
+/**************************************************************************//**
+* @fn			void SerialConsoleSetOverflowPolicy(enum eSerialRing ring, enum eSerialOverflowPolicy policy, TickType_t timeout)
+* @brief		Sets what a console ring does with data that does not fit
+* @details		SERIAL_OVERFLOW_BLOCK only applies to the TX ring written from tasks. The RX ring is filled from
+*				the UART interrupt, which cannot wait, so it treats SERIAL_OVERFLOW_BLOCK as SERIAL_OVERFLOW_DROP_NEWEST.
+* @param[in]	ring Ring to configure
+* @param[in]	policy Overflow policy of the ring
+* @param[in]	timeout Max time, in ticks, a TX write waits for room with SERIAL_OVERFLOW_BLOCK. Ignored otherwise
+* @note
+*****************************************************************************/
+void SerialConsoleSetOverflowPolicy(enum eSerialRing ring, enum eSerialOverflowPolicy policy, TickType_t timeout)
+{
+	if(ring >= N_SERIAL_RINGS || policy >= N_SERIAL_OVERFLOW_POLICIES) return;
+
+	taskENTER_CRITICAL();
+	ringPolicy[ring] = policy;
+	if(ring == SERIAL_RING_TX) txBlockTimeout = timeout;
+	taskEXIT_CRITICAL();
+}
+
+/**************************************************************************//**
+* @fn			void SerialConsoleGetRingStats(enum eSerialRing ring, struct SerialConsoleRingStats *stats)
+* @brief		Copies the overflow statistics of a console ring
+* @param[in]	ring Ring to query
+* @param[out]	stats Filled with the counters, the current fill level and the policy of the ring
+* @note			The TX fill level includes the span being sent
+*****************************************************************************/
+void SerialConsoleGetRingStats(enum eSerialRing ring, struct SerialConsoleRingStats *stats)
+{
+	if(ring >= N_SERIAL_RINGS || stats == NULL) return;
+	cbuf_handle_t cbuf = (ring == SERIAL_RING_TX) ? cbufTx : cbufRx;
+
+	taskENTER_CRITICAL();
+	*stats = ringStats[ring];
+	stats->size = circular_buf_size(cbuf) + ((ring == SERIAL_RING_TX) ? txJobLength : 0);
+	stats->capacity = circular_buf_capacity(cbuf);
+	stats->policy = ringPolicy[ring];
+	taskEXIT_CRITICAL();
 }
 
 
@@ -181,34 +362,118 @@ currentDebugLevel = debugLevel;
 
 
 /**************************************************************************//**
-* @fn			LogMessage (Students to fill out this)
-* @brief
+* @fn			void LogMessage(enum eDebugLogLevels level, const char *format, ...)
+* @brief		Prints a printf-like message to the console if its level is at or above the current debug level
+* @details		Prefer the LOG_* macros, which skip the call (and the evaluation of its arguments) for filtered levels
+* @param[in]	level Level of the message
+* @param[in]	format printf-like format string, followed by its arguments
 * @note
 *****************************************************************************/
 void LogMessage(enum eDebugLogLevels level, const char *format, ...)
 {
-
-if(getLogLevel() <= level){
 	va_list ap;
 	va_start(ap, format);
+	LogMessageV(level, format, ap);
+	va_end(ap);
+};
+
+/**************************************************************************//**
+* @fn			void LogMessageV(enum eDebugLogLevels level, const char *format, va_list ap)
+* @brief		va_list version of LogMessage
+* @note
+*****************************************************************************/
+void LogMessageV(enum eDebugLogLevels level, const char *format, va_list ap)
+{
+
+if(getLogLevel() <= level){
+#if LOGGER_DEFERRED_MODE
+	if(LoggerDeferMessage(level, format, ap)) return; //Formatted later by the logger task when possible
+#endif
 	vsnprintf(debugBuffer, 127, format, ap);
+#if LOGGER_DEFERRED_MODE
+	if(LoggerDeferText(level, debugBuffer)) return; //Sent after the records queued before it
+#endif
 	SerialConsoleWriteString(debugBuffer);
-	va_end(ap);
+	SdLogSinkWrite((const uint8_t *)debugBuffer, strlen(debugBuffer));
 }
 };
 
 
 /**************************************************************************//**
-* @fn			LogMessage Debug(Students to fill out this)
-* @brief
+* @fn			void LogMessageDebug(const char *format, ...)
+* @brief		Logs a message at LOG_DEBUG_LVL. Function version of LOG_DEBUG, for hooks that need a function
 * @note
 *****************************************************************************/
 void LogMessageDebug(const char *format, ...)
 {
+	va_list ap;
+	va_start(ap, format);
+	LogMessageV(LOG_DEBUG_LVL, format, ap);
+	va_end(ap);
+};
 
-LogMessage(LOG_DEBUG_LVL, format);
+/**************************************************************************//**
+* @fn			bool LogRateLimitAllow(struct LogRateLimit *limit, uint16_t perSecond, enum eDebugLogLevels level)
+* @brief		Decides if a rate-limited call site may print, allowing perSecond messages per one second window
+* @details		When a new window starts and messages were dropped in the previous ones, their count is printed first.
+* @param[in]	limit State of the call site
+* @param[in]	perSecond Max number of messages per second
+* @param[in]	level Level used to report the dropped messages
+* @return		Returns true if the message may be printed
+* @note			Called by LOG_RATELIMITED
+*****************************************************************************/
+bool LogRateLimitAllow(struct LogRateLimit *limit, uint16_t perSecond, enum eDebugLogLevels level)
+{
+	TickType_t now = xTaskGetTickCount();
+	bool allow = false;
 
-};
+	if(now - limit->windowStart >= pdMS_TO_TICKS(1000))
+	{
+		if(limit->suppressed > 0)
+		{
+			LogMessage(level, "(%u messages suppressed)\r\n", (unsigned int)limit->suppressed);
+		}
+		limit->windowStart = now;
+		limit->count = 0;
+		limit->suppressed = 0;
+	}
+
+	if(limit->count < perSecond)
+	{
+		limit->count++;
+		allow = true;
+	}
+	else
+	{
+		if(limit->suppressed < UINT16_MAX) limit->suppressed++;
+		logSuppressedTotal++;
+	}
+
+	return allow;
+}
+
+/**************************************************************************//**
+* @fn			uint32_t LogGetSuppressedCount(void)
+* @brief		Returns the total number of messages dropped by rate-limited log call sites
+* @note
+*****************************************************************************/
+uint32_t LogGetSuppressedCount(void)
+{
+	return logSuppressedTotal;
+}
+
+/**************************************************************************//**
+* @fn			void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats)
+* @brief		Copies the counters of the transmit path into the given structure
+* @param[out]	stats Structure filled with the current TX statistics
+* @note			bytesSent / txInterrupts gives the average number of bytes sent per interrupt
+*****************************************************************************/
+void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats)
+{
+	taskENTER_CRITICAL();
+	*stats = txStats;
+	taskEXIT_CRITICAL();
+}
 
 /*
 COMMAND LINE INTERFACE COMMANDS
@@ -256,14 +521,100 @@ static void configure_usart(void)
 *****************************************************************************/
 static void configure_usart_callbacks(void)
 {
+#if !SERIAL_CONSOLE_TX_DMA
 	usart_register_callback(&usart_instance,
 	usart_write_callback, USART_CALLBACK_BUFFER_TRANSMITTED);
+	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_TRANSMITTED);
+#endif
 	usart_register_callback(&usart_instance,
 	usart_read_callback, USART_CALLBACK_BUFFER_RECEIVED);
-	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_TRANSMITTED);
 	usart_enable_callback(&usart_instance, USART_CALLBACK_BUFFER_RECEIVED);
 }
 
+#if SERIAL_CONSOLE_TX_DMA
+/**************************************************************************//**
+* @fn			static void configure_dma_tx(void)
+* @brief		Allocates a DMA channel triggered by the console SERCOM TX and prepares its descriptor
+* @details		Source and length are set for every span by SerialConsoleStartTxJob. The destination is
+*				always the USART DATA register, one byte per beat.
+* @note
+*****************************************************************************/
+static void configure_dma_tx(void)
+{
+	struct dma_resource_config config;
+	dma_get_config_defaults(&config);
+	config.peripheral_trigger = SERIAL_CONSOLE_TX_DMA_TRIGGER;
+	config.trigger_action = DMA_TRIGGER_ACTION_BEAT;
+	dma_allocate(&usart_dma_tx_resource, &config);
+
+	struct dma_descriptor_config descriptor_config;
+	dma_descriptor_get_config_defaults(&descriptor_config);
+	descriptor_config.beat_size = DMA_BEAT_SIZE_BYTE;
+	descriptor_config.dst_increment_enable = false;
+	descriptor_config.src_increment_enable = true;
+	descriptor_config.block_transfer_count = 1;
+	descriptor_config.source_address = (uint32_t)txCharacterBuffer;
+	descriptor_config.destination_address = (uint32_t)(&usart_instance.hw->USART.DATA.reg);
+	dma_descriptor_create(&usart_dma_tx_descriptor, &descriptor_config);
+	dma_add_descriptor(&usart_dma_tx_resource, &usart_dma_tx_descriptor);
+
+	dma_register_callback(&usart_dma_tx_resource, usart_dma_tx_callback, DMA_CALLBACK_TRANSFER_DONE);
+	dma_enable_callback(&usart_dma_tx_resource, DMA_CALLBACK_TRANSFER_DONE);
+}
+#endif
+
+/**************************************************************************//**
+* @fn			static void SerialConsoleStartTxJob(void)
+* @brief		Starts sending the largest contiguous span at the tail of the TX ring
+* @details		The span stops at the end of the storage array when the data wraps around. The remaining
+*				bytes are sent by the next job, started from the completion callback.
+* @note			Call with interrupts masked (critical section or ISR) and only when no job is in flight
+*****************************************************************************/
+static void SerialConsoleStartTxJob(void)
+{
+	uint8_t *span;
+	size_t len = circular_buf_peek_span(cbufTx, &span);
+
+	//Claim the span now: writers count it as used through txJobLength and drop-oldest-line cannot discard it
+	circular_buf_consume(cbufTx, len);
+	txJobLength = len;
+	if(len == 0) return;
+
+#if SERIAL_CONSOLE_TX_DMA
+	//With source increment enabled, the DMAC expects the address of the end of the block
+	usart_dma_tx_descriptor.SRCADDR.reg = (uint32_t)(span + len);
+	usart_dma_tx_descriptor.BTCNT.reg = len;
+	dma_start_transfer_job(&usart_dma_tx_resource);
+#else
+	usart_write_buffer_job(&usart_instance, span, len);
+#endif
+}
+
+/**************************************************************************//**
+* @fn			static void SerialConsoleTxJobDone(void)
+* @brief		Releases the span that was just sent, updates the statistics and re-arms the transmitter
+* @note			Called from the transfer complete interrupt
+*****************************************************************************/
+static void SerialConsoleTxJobDone(void)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	uint16_t sent = txJobLength;
+
+	txJobLength = 0;	//The span was already taken off the ring when the job started
+	txStats.bytesSent += sent;
+	txStats.txInterrupts++;
+	txStats.lastSpan = sent;
+	if(sent > txStats.maxSpan) txStats.maxSpan = sent;
+
+	SerialConsoleStartTxJob(); //Picks up the wrapped part of the ring or anything written meanwhile
+
+	if(txRoomWaiters > 0)
+	{
+		xSemaphoreGiveFromISR(txRoomSemaphore, &xHigherPriorityTaskWoken); //The span sent is room for a blocked writer
+	}
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
 
 
 
@@ -281,9 +632,33 @@ static void configure_usart_callbacks(void)
 void usart_read_callback(struct usart_module *const usart_module)
 {
 
-	circular_buf_put(cbufRx, (uint8_t) latestRx); //Add the latest read character into the RX circular Buffer
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+	struct SerialConsoleRingStats *stats = &ringStats[SERIAL_RING_RX];
+
+	if(circular_buf_put2(cbufRx, (uint8_t) latestRx) != 0) //Add the latest read character into the RX circular Buffer
+	{
+		stats->overflows++;
+		if(ringPolicy[SERIAL_RING_RX] == SERIAL_OVERFLOW_DROP_OLDEST_LINE)
+		{
+			stats->droppedBytes += circular_buf_drop_line(cbufRx, RX_BUFFER_SIZE, NULL);
+			circular_buf_put2(cbufRx, (uint8_t) latestRx);
+		}
+		else
+		{
+			stats->droppedBytes++; //Drop the newest. The interrupt cannot wait for room
+		}
+	}
+	size_t used = circular_buf_size(cbufRx);
+	if(used > stats->highWater) stats->highWater = used;
+
 	usart_read_buffer_job(&usart_instance, (uint8_t*) &latestRx, 1);	//Order the MCU to keep reading
-	
+
+	if(rxNotifyTask != NULL)
+	{
+		vTaskNotifyGiveFromISR(rxNotifyTask, &xHigherPriorityTaskWoken); //Wake up the reader
+	}
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 
@@ -294,12 +669,20 @@ void usart_read_callback(struct usart_module *const usart_module)
 *****************************************************************************/
 void usart_write_callback(struct usart_module *const usart_module)
 {
-	if(circular_buf_get(cbufTx, (uint8_t*) &latestTx) != -1) //Only continue if there are more characters to send
-	{
-		usart_write_buffer_job(&usart_instance, (uint8_t*) &latestTx, 1);
-	}
-	
+	SerialConsoleTxJobDone(); //Only continues if there are more characters to send
+}
+
+#if SERIAL_CONSOLE_TX_DMA
+/**************************************************************************//**
+* @fn			void usart_dma_tx_callback(struct dma_resource* const resource)
+* @brief		Callback called when the DMA finishes sending a span of the TX ring to the UART
+* @note
+*****************************************************************************/
+void usart_dma_tx_callback(struct dma_resource* const resource)
+{
+	SerialConsoleTxJobDone();
 }
+#endif
 
 
 
@@ -19,7 +19,7 @@
 #include "WifiHandlerThread/WifiHandler.h"
 #include "SerialConsole.h"
 #include "main.h"
-#include "SeesawDriver/Seesaw.h"
+#include "LedAnimation/LedAnimation.h"
 #include "gfx_mono.h"
 
 /******************************************************************************
@@ -106,17 +106,10 @@ while(1)
 			//After you finish showing the move should go to state UI_STATE_HANDLE_BUTTONS
 			
 			
-			//In the beginner example we turn LED0 and LED15 will turn on for 500 ms then we go to UI_STATE_HANDLE_BUTTONS
-			SeesawSetLed(0, red, green, blue); //Turn button 1 on
-			SeesawOrderLedUpdate();
-			vTaskDelay(1000);
-			SeesawSetLed(0, 0, 0, 0); //Turn button 1 off
-			SeesawSetLed(15, red, green, blue); // Turn button 15 on
-			SeesawOrderLedUpdate();
-			vTaskDelay(1000);
-			SeesawSetLed(15,0,0,0); //Turn button 15 off
-			SeesawOrderLedUpdate();
-			vTaskDelay(1000);
+			//In the beginner example LED0 then LED15 light up for 1 s each. The animation task plays them: we return at once
+			//and wait in UI_STATE_HANDLE_BUTTONS until LedAnimIsIdle() before accepting presses
+			const uint8_t exampleMoves[] = {0, 15};
+			LedAnimShowMoves(exampleMoves, sizeof(exampleMoves), 1000, red, green, blue);
 			uiState = UI_STATE_HANDLE_BUTTONS;
 			*/		
 			break;
@@ -148,17 +141,16 @@ while(1)
 				uint8_t actionButton = buttons[iter] & 0x03;
 				if(actionButton == 0x03) 
 				{
-					SeesawSetLed(keynum, red, green, blue);
+					LedAnimSetKey(keynum, red, green, blue, 0);
 				}
 				else
 				{
-					SeesawSetLed(keynum, 0, 0, 0);
+					LedAnimSetKey(keynum, 0, 0, 0, 0);
 					//Button released! Count this into the buttons pressed by user.
 					gamePacketOut.game[pressedKeys] = keynum;
 					pressedKeys++;
 				}
 			}
-			SeesawOrderLedUpdate();
 		}
 
 		//Check if we are done!
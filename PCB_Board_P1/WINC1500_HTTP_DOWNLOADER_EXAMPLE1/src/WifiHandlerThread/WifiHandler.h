@@ -46,6 +46,8 @@
 #define MAIN_MAX_FILE_NAME_LENGTH            (64)
 /** Maximum file extension length. */
 #define MAIN_MAX_FILE_EXT_LENGTH             (8)
+/** Max number of download progress messages per second. Every received packet reports progress */
+#define WIFI_LOG_PROGRESS_PER_SECOND         (2)
 /** Output format with '0'. */
 #define MAIN_ZERO_FMT(SZ)                    (SZ == 4) ? "%04d" : (SZ == 3) ? "%03d" : (SZ == 2) ? "%02d" : "%d"
 #define GAME_SIZE		20 ///<Number of plays in game
@@ -83,6 +85,13 @@ struct RgbColorPacket
 	uint8_t blue;
 };
 
+//Structure to hold a benchmark the WiFi task runs for another task (Bench.h)
+struct WifiBenchRequest
+{
+	uint8_t id;	///<enum eBenchId of the benchmark: BENCH_WINC_SPI or BENCH_MQTT_PUBACK
+	uint16_t runs;	///<Number of runs. The WiFi task hands the result to BenchWifiDone
+};
+
 
 /* Max size of UART buffer. */
 #define MAIN_CHAT_BUFFER_SIZE 64
@@ -159,6 +168,7 @@ void WifiHandlerSetState(uint8_t state);
 int WifiAddDistanceDataToQueue(uint16_t *distance);
 int WifiAddImuDataToQueue(struct ImuDataPacket* imuPacket);
 int WifiAddGameDataToQueue(struct GameDataPacket *game);
+int WifiAddBenchRequest(struct WifiBenchRequest *request);
 void SendRealTimeUserGameInput(int usr, int led, int act);
 void SendAnswerKey(int steps[6]);
 
@@ -55,7 +55,16 @@ void assert_triggered( const char * file, uint32_t line );
 #define configMAX_PRIORITIES                    ( 5 )
 #define configMINIMAL_STACK_SIZE                ( ( unsigned short ) 100)
 /* configTOTAL_HEAP_SIZE is not used when heap_3.c is used. */
-#define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 12000 ) )
+/* heap_1 never frees, so the heap holds everything created from boot on. Each block is rounded
+   to 8 bytes; a TCB takes 88 bytes and a queue header 84:
+   - Before StartTasks: serial TX semaphore, idle task, timer queue and task, I2C driver
+     (mutex, semaphore, request queue, bus task), distance sensor semaphores: 2392 bytes
+   - StartTasks: CLI 1112, WiFi 4088, keypad 600, sensor 728, LED 600, control 2136: 9264 bytes
+   - Created later: keypad and LED queues, WiFi queues, bench semaphore, CLI commands,
+     FatFs mutex (on the WiFi task's f_mount): 1440 bytes
+   - Logger task, with LOGGER_DEFERRED_MODE: 1112 bytes
+   14208 bytes, plus 8 lost to alignment. SD_LOG_SINK_ENABLED needs 1368 bytes more. */
+#define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 14800 ) )
 #define configMAX_TASK_NAME_LEN                 ( 8 )
 #define configUSE_TRACE_FACILITY                1
 #define configUSE_16_BIT_TICKS                  0
@@ -67,7 +76,7 @@ void assert_triggered( const char * file, uint32_t line );
 #define configUSE_MALLOC_FAILED_HOOK            1
 #define configUSE_COUNTING_SEMAPHORES           1
 #define configUSE_QUEUE_SETS                    1
-#define configGENERATE_RUN_TIME_STATS           0
+#define configGENERATE_RUN_TIME_STATS           1	// Per task CPU time, clocked by RuntimeStats/RuntimeStats.c (TC3). See the "top" CLI command
 #define configENABLE_BACKWARD_COMPATIBILITY     1
 #define configUSE_DAEMON_TASK_STARTUP_HOOK		1	// Ported from FreeRToS 9.0.0
 
@@ -110,6 +119,14 @@ standard names - or at least those used in the unmodified vector table. */
 #define xPortPendSVHandler                      PendSV_Handler
 #define xPortSysTickHandler                     SysTick_Handler
 
+/* Run time statistics counter. */
+#if defined (__GNUC__) || defined (__ICCARM__)
+void RuntimeStatsConfigureTimer(void);
+uint32_t RuntimeStatsGetCounter(void);
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	RuntimeStatsConfigureTimer()
+#define portGET_RUN_TIME_COUNTER_VALUE()			RuntimeStatsGetCounter()
+
 #define configCOMMAND_INT_MAX_OUTPUT_SIZE 32
 #include "trcRecorder.h"
 #endif /* FREERTOS_CONFIG_H */
@@ -18,8 +18,7 @@
 /******************************************************************************
 * Define
 ******************************************************************************/
-struct adc_module adc_instance;
-struct adc_module adc_instance2;
+struct adc_module adc_instance; //!< the single ADC, switched between the X and Y pins for each conversion
 /**************************************************************************//**
 void initialize_thumbstick(void)
 * @brief:	Initialize the ADC drive for thumb stick
@@ -59,21 +58,27 @@ void initialize_thumbstick(void)
 
 	adc_init(&adc_instance, ADC, &config_adc);
 	adc_enable(&adc_instance);
-	
-	
-	struct adc_config config_adc2;
-
-	adc_get_config_defaults(&config_adc2);
-	config_adc2.reference = ADC_REFERENCE_INTVCC1;
-	config_adc2.positive_input = ADC_POSITIVE_INPUT_PIN19;
-	config_adc2.negative_input = ADC_NEGATIVE_INPUT_GND;
-
-
-	adc_init(&adc_instance2, ADC, &config_adc2);
-	adc_enable(&adc_instance2);
+}
 
+/**************************************************************************//**
+static uint16_t ts_read_pin(enum adc_positive_input pin)
+* @brief	select the ADC input and read one conversion
+* @return	uint16_t Reading result
+* @note     There is one ADC: a second adc_init on it would only change the settings of the first
+*****************************************************************************/
+static uint16_t ts_read_pin(enum adc_positive_input pin)
+{
+	uint16_t result;
+	enum status_code stat;
+	adc_set_positive_input(&adc_instance, pin);
+	adc_start_conversion(&adc_instance);
+	do {
+		/* Wait for conversion to be done and read out result */
 
+		stat = adc_read(&adc_instance, &result);
+	} while (stat == STATUS_BUSY);
 
+	return result;
 }
 
 
@@ -85,29 +90,16 @@ uint16_t ts_read_x(void)
 *****************************************************************************/
 uint16_t ts_read_x(void)
 {
-	uint16_t result;
-	enum status_code stat; 
-	 adc_start_conversion(&adc_instance);
-	 do {
-		 /* Wait for conversion to be done and read out result */
-	 
-		 stat = adc_read(&adc_instance, &result);
-	 } while (stat == STATUS_BUSY);
-	
-	return result;
+	return ts_read_pin(ADC_POSITIVE_INPUT_PIN6);
 }
 
+/**************************************************************************//**
+uint16_t tx_read_y(void)
+* @brief	read the Y axis ADC raw value from the thumb stick
+* @return	uint16_t Reading result
+* @note     Polling method of reading
+*****************************************************************************/
 uint16_t tx_read_y(void)
 {
-	uint16_t result;
-	enum status_code stat; 
-	 adc_start_conversion(&adc_instance2);
-	 do {
-		 /* Wait for conversion to be done and read out result */
-	 
-		 stat = adc_read(&adc_instance2, &result);
-	 } while (stat == STATUS_BUSY);
-	
-	return result;
-	
+	return ts_read_pin(ADC_POSITIVE_INPUT_PIN19);
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+/**************************************************************************//**
+* @file      Bench.h
+* @brief     On-device micro-benchmarks of the bus and stack hot paths, run from the "bench" CLI command
+* @details   Every benchmark is timed with the run time statistics counter (RuntimeStats.h, 1.33 us per count),
+*			 so results can be compared across firmware revisions. Each run of a benchmark is timed on its own,
+*			 and the runs give the min, average and 99th percentile latency and the throughput.
+*			 The WINC SPI and MQTT benchmarks run in the WiFi task, the only one allowed to use the WINC driver.
+* @date      2020-04-26
+
+******************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <asf.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define BENCH_MAX_RUNS			100	///<Max number of runs of a benchmark. Bounds the buffer the percentiles are taken from
+#define BENCH_DEFAULT_RUNS		20	///<Number of runs when the command gives none
+#define BENCH_CRC_SPAN			4096	///<Bytes of flash, from address 0, each CRC32 run covers
+#define BENCH_SD_FILE			"0:BENCH.BIN"	///<Scratch file of one sector for the SD benchmarks
+#define BENCH_MQTT_TOPIC		"ESE516_BENCH"	///<Topic the MQTT benchmark publishes to, with QoS 1
+#define BENCH_WIFI_TIMEOUT		30000	///<Max time, in ms, to wait for the WiFi task to run a benchmark
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Available benchmarks
+enum eBenchId {
+	BENCH_I2C_SEESAW = 0,	//Seesaw HW ID register read (I2cReadDataWait)
+	BENCH_WINC_SPI,	//WINC chip ID register read over SPI
+	BENCH_SD_WRITE,	//One sector write to BENCH_SD_FILE
+	BENCH_SD_READ,	//One sector read from BENCH_SD_FILE
+	BENCH_MQTT_PUBACK,	//QoS 1 publish, until the broker's PUBACK
+	BENCH_CRC_SW,	//Software CRC32 over BENCH_CRC_SPAN bytes of flash
+	BENCH_CRC_DSU,	//DSU (hardware) CRC32 over BENCH_CRC_SPAN bytes of flash
+	N_BENCHES	//Max number of benchmarks
+};
+
+///Result of a benchmark
+struct BenchResult {
+	int32_t error;	///<ERROR_NONE, or the error of the first run that failed
+	uint16_t runs;	///<Number of runs timed
+	uint32_t minUs;	///<Fastest run, in us
+	uint32_t avgUs;	///<Average run, in us
+	uint32_t p99Us;	///<99th percentile run, in us
+	uint32_t bytesPerSecond;	///<Payload bytes per second over all the runs. 0 if the benchmark moves no payload
+};
+
+///A single run of a benchmark. Returns ERROR_NONE on success
+typedef int32_t (*BenchFunction)(void *context);
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+const char *BenchGetName(enum eBenchId id);
+int32_t BenchFindByName(const char *name, size_t len, enum eBenchId *id);
+int32_t BenchRun(BenchFunction function, void *context, uint16_t runs, uint32_t bytesPerRun, struct BenchResult *result);
+int32_t BenchExecute(enum eBenchId id, uint16_t runs, struct BenchResult *result);
+void BenchWifiDone(const struct BenchResult *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*BENCH_H*/
@@ -15,6 +15,13 @@
 #include "SeesawDriver/Seesaw.h"
 #include "WifiHandlerThread/WifiHandler.h"
 #include "DistanceDriver/DistanceSensor.h"
+#include "LoggerThread/LoggerThread.h"
+#include "LoggerThread/SdLogSink.h"
+#include "RuntimeStats/RuntimeStats.h"
+#include "Bench/Bench.h"
+#include "KeypadThread/KeypadThread.h"
+#include "ImuThread/ImuThread.h"
+#include "SensorScheduler/SensorScheduler.h"
 
 /******************************************************************************
 * Defines
@@ -31,9 +38,9 @@ static  int8_t * const pcWelcomeMessage =
 static const CLI_Command_Definition_t xImuGetCommand =
 {
 	"imu",
-	"imu: Returns a value from the IMU\r\n",
+	"imu [hz]: Returns the latest sample of the IMU, or sets its output data rate (104, 208, 416 or 833 Hz)\r\n",
 	(const pdCOMMAND_LINE_CALLBACK)CLI_GetImuData,
-	0
+	-1
 };
 
 static const CLI_Command_Definition_t xOTAUCommand =
@@ -71,9 +78,9 @@ static const CLI_Command_Definition_t xNeotrellisProcessButtonCommand =
 static const CLI_Command_Definition_t xDistanceSensorGetDistance =
 {
 	"getdistance",
-	"getdistance: Returns the distance from the US-100 Sensor.\r\n",
+	"getdistance [median ema]: Returns the filtered distance from the US-100 Sensor, or sets its median window (1 to 7) and EMA shift (0 to 4)\r\n",
 	(const pdCOMMAND_LINE_CALLBACK)CLI_DistanceSensorGetDistance,
-	0
+	-1
 };
 
 
@@ -85,6 +92,46 @@ static const CLI_Command_Definition_t xSendDummyGameData =
  0
 };
 
+static const CLI_Command_Definition_t xSerialStatsCommand =
+{
+	"serial",
+	"serial: Prints the overflow and throughput statistics of the console\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_SerialStats,
+	0
+};
+
+static const CLI_Command_Definition_t xTopCommand =
+{
+	"top",
+	"top [s]: Prints the CPU use, state, priority and free stack of each task every [s] (2) seconds. Any key stops it\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_Top,
+	-1
+};
+
+static const CLI_Command_Definition_t xBenchCommand =
+{
+	"bench",
+	"bench [name|all|list] [runs]: Times [runs] (20) runs of a benchmark. Prints min/avg/p99 latency and throughput\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_Bench,
+	-1
+};
+
+static const CLI_Command_Definition_t xI2cStatsCommand =
+{
+	"i2cstats",
+	"i2cstats [reset]: Prints the I2C phase latency histograms and error counters of each device, or clears them\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_I2cStats,
+	-1
+};
+
+static const CLI_Command_Definition_t xSensorsCommand =
+{
+	"sensors",
+	"sensors [reset]: Prints the period, latest sample, jitter, deadline overruns and skipped releases of each sensor, or clears them\r\n",
+	(const pdCOMMAND_LINE_CALLBACK)CLI_Sensors,
+	-1
+};
+
 //Clear screen command
 const CLI_Command_Definition_t xClearScreen =
 {
@@ -119,6 +166,11 @@ FreeRTOS_CLIRegisterCommand( &xNeotrellisTurnLEDCommand );
 FreeRTOS_CLIRegisterCommand( &xNeotrellisProcessButtonCommand );
 FreeRTOS_CLIRegisterCommand( &xDistanceSensorGetDistance);
 FreeRTOS_CLIRegisterCommand( &xSendDummyGameData);
+FreeRTOS_CLIRegisterCommand( &xSerialStatsCommand);
+FreeRTOS_CLIRegisterCommand( &xTopCommand);
+FreeRTOS_CLIRegisterCommand( &xBenchCommand);
+FreeRTOS_CLIRegisterCommand( &xI2cStatsCommand);
+FreeRTOS_CLIRegisterCommand( &xSensorsCommand);
 
 uint8_t cRxedChar[2], cInputIndex = 0;
 BaseType_t xMoreDataToFollow;
@@ -136,14 +188,17 @@ static uint8_t pcEscapeCodePos = 0;
     /* Send a welcome message to the user knows they are connected. */
     SerialConsoleWriteString( pcWelcomeMessage);
 
+    /* Get woken up by the UART RX interrupt instead of polling the RX buffer. */
+    SerialConsoleSetRxNotifyTask(xTaskGetCurrentTaskHandle());
+
     for( ;; )
     {
-        /* This implementation reads a single character at a time.  Wait in the
-        Blocked state until a character is received. */
+        /* This implementation reads a single character at a time, until the
+        buffer is empty.  Then wait in the Blocked state until a character is received. */
         int recv = SerialConsoleReadCharacter(&cRxedChar);
-		if(recv == -1) //If no characters in the buffer, thread goes to sleep for a while
+		if(recv == -1) //If no characters in the buffer, thread sleeps until the RX interrupt notifies it
 		{
-			vTaskDelay( CLI_TASK_DELAY);
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 		}else if( cRxedChar[0] == '\n' || cRxedChar[0] == '\r'  )
         {
             /* A newline character was received, so the input command string is
@@ -269,37 +324,43 @@ static uint8_t pcEscapeCodePos = 0;
 /******************************************************************************
 * CLI Functions - Define here
 ******************************************************************************/
-//Example CLI Command. Reads from the IMU and returns data.
+//Example CLI Command. Returns the latest IMU sample, or sets the IMU output data rate.
 BaseType_t CLI_GetImuData( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
 {
-static axis3bit16_t data_raw_acceleration;
-static axis3bit16_t data_raw_angular_rate;
-static float acceleration_mg[3];
-uint8_t reg;
-
-lsm6ds3_xl_flag_data_ready_get(GetImuStruct(), &reg);
-if(reg){
-	memset(data_raw_acceleration.u8bit, 0x00, 3 * sizeof(int16_t));
-	lsm6ds3_acceleration_raw_get(GetImuStruct(), data_raw_acceleration.u8bit);
-	acceleration_mg[0] =
-	lsm6ds3_from_fs2g_to_mg(data_raw_acceleration.i16bit[0]);
-	acceleration_mg[1] =
-	lsm6ds3_from_fs2g_to_mg(data_raw_acceleration.i16bit[1]);
-	acceleration_mg[2] =
-	lsm6ds3_from_fs2g_to_mg(data_raw_acceleration.i16bit[2]);
-
-snprintf(pcWriteBuffer,xWriteBufferLen, "Acceleration [mg]:X %d\tY %d\t%Z %d\r\n",
-(int)acceleration_mg[0], (int)acceleration_mg[1], (int)acceleration_mg[2]);
-}else
+struct SensorSample sample;
+enum eImuOdr odr;
+BaseType_t paramLen;
+const char *param = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &paramLen);
+
+if(param != NULL)
+{
+	if(ImuOdrFromHz(atoi(param), &odr) != ERROR_NONE || ImuSetOdr(odr) != ERROR_NONE)
+	{
+		snprintf(pcWriteBuffer,xWriteBufferLen, "ODR must be 104, 208, 416 or 833 Hz\r\n");
+	}
+	else
+	{
+		snprintf(pcWriteBuffer,xWriteBufferLen, "IMU ODR set to %d Hz\r\n", atoi(param));
+	}
+	return pdFALSE;
+}
+
+//The sensor task keeps the latest samples: no bus transaction here
+if(SensorGetLatest(SENSOR_IMU, &sample) != ERROR_NONE)
 {
 	snprintf(pcWriteBuffer,xWriteBufferLen, "No data ready! \r\n");
+	return pdFALSE;
 }
 
 struct ImuDataPacket imuPacketTemp;
 
-imuPacketTemp.xmg = (int16_t)acceleration_mg[0];
-imuPacketTemp.ymg = (int16_t)acceleration_mg[1];
-imuPacketTemp.zmg = (int16_t)acceleration_mg[2];
+imuPacketTemp.xmg = (int16_t)lsm6ds3_from_fs2g_to_mg_int(sample.value[0]);
+imuPacketTemp.ymg = (int16_t)lsm6ds3_from_fs2g_to_mg_int(sample.value[1]);
+imuPacketTemp.zmg = (int16_t)lsm6ds3_from_fs2g_to_mg_int(sample.value[2]);
+
+snprintf(pcWriteBuffer,xWriteBufferLen, "Acceleration [mg]:X %d\tY %d\tZ %d (%u Hz, %lu overruns)\r\n",
+imuPacketTemp.xmg, imuPacketTemp.ymg, imuPacketTemp.zmg, ImuGetOdrHz(), (unsigned long)ImuGetOverruns());
+
 int error = WifiAddImuDataToQueue(&imuPacketTemp);
 if(error == pdTRUE)
 {
@@ -390,50 +451,26 @@ Example 3
 BaseType_t CLI_NeotrellProcessButtonBuffer( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
 {
 
-	//See functions SeesawGetKeypadCount and SeesawReadKeypad
-	//Returns the number of key events currently on the Seesaw Keypad
-	
-	//Returns the number of requested events in the Seesaw FIFO buffer into the buffer variable
-	
-	//	NEO_TRELLIS_SEESAW_KEY(number) ;
-	//snprintf(pcWriteBuffer,xWriteBufferLen, "count: %d\num_req_eve:%d\t\n",count,num_req_eve);
-	//Print to pcWriteBuffer in order.
-	//If the string is too long to print, print what you can.
-	//The function you write will be useful in the future.
-	uint8_t buffer[64];
-	uint8_t count = SeesawGetKeypadCount();
-	if(count >= 1)
+	//The keypad task drains the Seesaw FIFO on its interrupt: print one of its queued events per call
+	struct KeypadEvent event;
+	if(KeypadGetEvent(&event, 0) == ERROR_NONE)
 	{
-	int32_t res = SeesawReadKeypad(buffer,1);
-	if(res==0)
-		{
-			uint8_t pos,press;
-			press = buffer[0] & 0x3;
-			pos =  buffer[0]>>2;
-			int num = NEO_TRELLIS_SEESAW_KEY(pos);
-			if(press == 0x2){
-				snprintf( pcWriteBuffer, xWriteBufferLen, "Button #%d is released\r\n",NEO_TRELLIS_SEESAW_KEY(num));
-			}
-			else if(press == 0x3){
-				snprintf( pcWriteBuffer, xWriteBufferLen, "Button #%d is pressed\r\n",NEO_TRELLIS_SEESAW_KEY(num));
-			}
-		}
+		snprintf( pcWriteBuffer, xWriteBufferLen, "Button #%d is %s (%lu ms)\r\n", event.key,
+			(event.edge == SEESAW_KEYPAD_EDGE_RISING) ? "pressed" : "released", (unsigned long)event.timestamp);
 		return pdTRUE;
 	}
 	else
 	{
-	pcWriteBuffer = 0;
+		pcWriteBuffer[0] = 0;
 		return pdFALSE;
 	}
-	
-
 }
 
 
 
 /**************************************************************************//**
 BaseType_t CLI_DistanceSensorGetDistance( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
-* @brief	Returns distance in mm
+* @brief	Returns the latest filtered distance in mm, or sets the filter of the distance stream
 * @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
 * @param[in] xWriteBufferLen. How much we can write into the buffer
 * @param[in] *pcCommandString. Buffer that contains the complete input. You will find the additional arguments, if needed. Please see 
@@ -448,15 +485,39 @@ Example 3
 BaseType_t CLI_DistanceSensorGetDistance( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
 {
 
+	//The US-100 streams on its own: no UART transfer here
+	struct DistanceReading reading;
+	struct DistanceStreamStats stats;
 	uint16_t distance = 0;
-	int error = DistanceSensorGetDistance(&distance, 100);
+	BaseType_t medianLen, emaLen;
+	const char *median = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &medianLen);
+	const char *ema = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &emaLen);
+	int error;
+
+	if (median != NULL)
+	{
+		if (ema == NULL || DistanceSensorSetFilter(atoi(median), atoi(ema)) != ERROR_NONE)
+		{
+			snprintf(pcWriteBuffer,xWriteBufferLen, "Median window must be 1 to %d, EMA shift 0 to %d\r\n", DISTANCE_MEDIAN_MAX, DISTANCE_EMA_MAX_SHIFT);
+		}
+		else
+		{
+			snprintf(pcWriteBuffer,xWriteBufferLen, "Distance filter: median of %d, EMA shift %d\r\n", atoi(median), atoi(ema));
+		}
+		return pdFALSE;
+	}
+
+	error = DistanceSensorGetLatest(&reading);
 	if (0 != error )
 	{
 		snprintf(pcWriteBuffer,xWriteBufferLen, "Sensor Error %d!\r\n", error);
 	}
 	else
 	{
-		snprintf(pcWriteBuffer,xWriteBufferLen, "Distance: %d mm\r\n", distance);
+		DistanceSensorGetStreamStats(&stats);
+		distance = reading.distance;
+		snprintf(pcWriteBuffer,xWriteBufferLen, "Distance: %d mm (raw %d mm at %lu ms, %lu readings, %lu rejected, %lu restarts)\r\n", distance, reading.raw,
+			(unsigned long)reading.timestamp, (unsigned long)stats.readings, (unsigned long)stats.rejected, (unsigned long)stats.restarts);
 	}
 
 	error = WifiAddDistanceDataToQueue(&distance);
@@ -506,3 +567,350 @@ gamevar.game[10] = 0xFF;
 	}
 	return pdFALSE;
 }
+
+
+
+/**************************************************************************//**
+BaseType_t CLI_SerialStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	Prints the statistics of the console, one line per call: the overflow counters of the TX and RX rings,
+			the transmitter throughput, the SD card log sink and the messages lost by the logger
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input. Not used
+                				
+* @return		Returns pdTRUE while there are more lines to print, pdFALSE after the last one.
+* @note         
+
+*****************************************************************************/
+BaseType_t CLI_SerialStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+static const char * const policyNames[N_SERIAL_OVERFLOW_POLICIES] = {"drop newest", "drop oldest line", "block"};
+static const char * const ringNames[N_SERIAL_RINGS] = {"TX", "RX"};
+static uint8_t line = 0;
+struct SerialConsoleRingStats ring;
+struct SerialConsoleTxStats tx;
+#if SD_LOG_SINK_ENABLED
+struct SdLogSinkStats sd;
+#endif
+
+	switch(line)
+	{
+		case SERIAL_RING_TX:
+		case SERIAL_RING_RX:
+			SerialConsoleGetRingStats((enum eSerialRing)line, &ring);
+			snprintf(pcWriteBuffer, xWriteBufferLen, "%s: %u/%u B, peak %u, lost %lu B in %lu, %lu stalls, %s\r\n",
+				ringNames[line], ring.size, ring.capacity, ring.highWater, (unsigned long)ring.droppedBytes,
+				(unsigned long)ring.overflows, (unsigned long)ring.stalls, policyNames[ring.policy]);
+			break;
+
+		case N_SERIAL_RINGS:
+			SerialConsoleGetTxStats(&tx);
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Sent %lu B in %lu irqs, max span %u B, max lock %lu cycles\r\n",
+				(unsigned long)tx.bytesSent, (unsigned long)tx.txInterrupts, tx.maxSpan, (unsigned long)tx.maxLockCycles);
+			break;
+
+#if SD_LOG_SINK_ENABLED
+		case N_SERIAL_RINGS + 1:
+			SdLogSinkGetStats(&sd);
+			snprintf(pcWriteBuffer, xWriteBufferLen, "SD log %u: %lu B/s, flush %u ms (max %u), lost %lu B, %lu errors\r\n",
+				sd.fileIndex, (unsigned long)sd.bytesPerSecond, sd.lastFlushMs, sd.maxFlushMs,
+				(unsigned long)sd.droppedBytes, (unsigned long)sd.writeErrors);
+			break;
+#endif
+
+		default:
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Log: %lu records dropped, %lu rate limited\r\n",
+				(unsigned long)LoggerGetDroppedRecords(), (unsigned long)LogGetSuppressedCount());
+			line = 0;
+			return pdFALSE;
+	}
+
+	line++;
+	return pdTRUE;
+}
+
+
+
+/**************************************************************************//**
+BaseType_t CLI_Top( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	Prints, every few seconds, the share of the CPU each task used since the previous refresh, its state
+			(X running, R ready, B blocked, S suspended, D deleted), its priority and the lowest free stack it had
+			(in words), followed by the free heap. The first refresh covers the time since the scheduler started.
+			Keeps refreshing until a key is pressed.
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input. Optional parameter: seconds between refreshes
+                				
+* @return		Returns pdTRUE while refreshing, pdFALSE once a key stopped it.
+* @note         Runs in the CLI task: it sleeps between refreshes
+
+*****************************************************************************/
+BaseType_t CLI_Top( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+static const char taskStates[] = {'X', 'R', 'B', 'S', 'D'};
+static struct RuntimeTaskUsage usage[RUNTIME_STATS_MAX_TASKS];
+static UBaseType_t nTasks = 0;
+static UBaseType_t line = 0;	//0: sample and print the header, 1 to nTasks: print task line - 1, then the footer
+static bool running = false;
+static uint8_t period = CLI_TOP_DEFAULT_PERIOD;
+BaseType_t paramLen;
+uint8_t key;
+
+	if (!running)
+	{
+		const char *param = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &paramLen);
+		int seconds = (param != NULL) ? atoi(param) : CLI_TOP_DEFAULT_PERIOD;
+		period = (seconds < 1) ? 1 : (seconds > CLI_TOP_MAX_PERIOD) ? CLI_TOP_MAX_PERIOD : seconds;
+		running = true;
+		line = 0;
+	}
+	else if (line == 0)
+	{
+		//Sleep until the next refresh, in short steps so a key press stops it quickly
+		for (uint16_t waited = 0; waited < period * 1000; waited += 100)
+		{
+			if (SerialConsoleReadCharacter(&key) != -1)
+			{
+				running = false;
+				snprintf(pcWriteBuffer, xWriteBufferLen, "\r\n");
+				return pdFALSE;
+			}
+			vTaskDelay(pdMS_TO_TICKS(100));
+		}
+	}
+
+	if (line == 0)
+	{
+		nTasks = RuntimeStatsSample(usage, RUNTIME_STATS_MAX_TASKS);
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%c[2J%c[HTask     S Pri Stack  CPU%%\r\n", ASCII_ESC, ASCII_ESC);
+		line = 1;
+	}
+	else if (line <= nTasks)
+	{
+		struct RuntimeTaskUsage *task = &usage[line++ - 1];
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%-8s %c %3u %5u %3u.%u\r\n", task->name,
+			(task->state < sizeof(taskStates)) ? taskStates[task->state] : '?', (unsigned)task->priority,
+			task->stackFree, task->cpuPermille / 10, task->cpuPermille % 10);
+	}
+	else
+	{
+		snprintf(pcWriteBuffer, xWriteBufferLen, "Free heap %u B. Every %u s, any key to stop\r\n",
+			(unsigned)xPortGetFreeHeapSize(), period);
+		line = 0;
+	}
+	return pdTRUE;
+}
+
+
+
+/**************************************************************************//**
+BaseType_t CLI_Bench( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	Runs a named micro-benchmark (see "bench list"), or all of them, and prints one line per benchmark:
+			the number of runs, the min, average and 99th percentile latency in us, and the throughput.
+			All the benchmarks are timed with the run time statistics counter, so results compare across firmware revisions.
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input. Parameters: benchmark name, "all" or "list"; number of runs
+                				
+* @return		Returns pdTRUE while more benchmarks are to be printed, pdFALSE after the last one.
+* @note         Runs in the CLI task. The WINC and MQTT benchmarks run in the WiFi task, the CLI task sleeps meanwhile
+
+*****************************************************************************/
+BaseType_t CLI_Bench( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+static uint8_t next = N_BENCHES;
+static uint8_t last = 0;
+static uint16_t runs = BENCH_DEFAULT_RUNS;
+static bool listing = false;
+struct BenchResult result;
+enum eBenchId id;
+BaseType_t paramLen;
+
+	if (next >= N_BENCHES)
+	{
+		const char *param = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 2, &paramLen);
+		int runsAsked = (param != NULL) ? atoi(param) : BENCH_DEFAULT_RUNS;
+		runs = (runsAsked < 1) ? 1 : (runsAsked > BENCH_MAX_RUNS) ? BENCH_MAX_RUNS : runsAsked;
+		const char *name = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &paramLen);
+
+		listing = (name == NULL || (paramLen == 4 && strncmp(name, "list", 4) == 0));
+		if (listing || (paramLen == 3 && strncmp(name, "all", 3) == 0))
+		{
+			next = 0;
+			last = N_BENCHES - 1;
+		}
+		else if (BenchFindByName(name, paramLen, &id) == ERROR_NONE)
+		{
+			next = id;
+			last = id;
+		}
+		else
+		{
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Unknown benchmark. \"bench list\" shows them\r\n");
+			return pdFALSE;
+		}
+	}
+
+	id = (enum eBenchId)next;
+	if (listing)
+	{
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%s\r\n", BenchGetName(id));
+	}
+	else if (BenchExecute(id, runs, &result) != ERROR_NONE && result.runs == 0)
+	{
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%-7s error %ld\r\n", BenchGetName(id), (long)result.error);
+	}
+	else
+	{
+		snprintf(pcWriteBuffer, xWriteBufferLen, "%-7s %3u runs min %lu avg %lu p99 %lu us %lu B/s%s\r\n", BenchGetName(id),
+			result.runs, (unsigned long)result.minUs, (unsigned long)result.avgUs, (unsigned long)result.p99Us,
+			(unsigned long)result.bytesPerSecond, (result.error != ERROR_NONE) ? " (stopped on error)" : "");
+	}
+
+	if (next++ < last) return pdTRUE;
+	next = N_BENCHES;
+	return pdFALSE;
+}
+
+
+
+
+/**************************************************************************//**
+BaseType_t CLI_I2cStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	Prints the statistics of the sensor bus, one line per call: the bus speed and resets, then for each device
+			its transaction, traffic and error counters followed by the histogram of each phase (queue wait, write, delay, read,
+			combined write and read). Each histogram column counts the phases shorter than the limit on top of it.
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input. Optional parameter: "reset" clears the statistics
+                				
+* @return		Returns pdTRUE while there are more lines to print, pdFALSE after the last one.
+* @note         
+
+*****************************************************************************/
+BaseType_t CLI_I2cStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+static int8_t device = -2;
+static uint8_t phase = 0;
+const struct I2cDeviceStats *stats;
+uint8_t nDevices = I2cGetStats(&stats);
+BaseType_t paramLen;
+int written;
+
+	if (device == -2)
+	{
+		const char *param = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &paramLen);
+		if (param != NULL && paramLen == 5 && strncmp(param, "reset", 5) == 0)
+		{
+			I2cResetStats();
+			snprintf(pcWriteBuffer, xWriteBufferLen, "I2C statistics cleared\r\n");
+			return pdFALSE;
+		}
+		snprintf(pcWriteBuffer, xWriteBufferLen, "I2C %u kHz, %lu bus resets\r\n", I2cGetBusSpeedKhz(), (unsigned long)I2cGetBusResets());
+		if (nDevices == 0) return pdFALSE;
+		device = -1;
+		return pdTRUE;
+	}
+
+	if (device == -1)
+	{
+		written = snprintf(pcWriteBuffer, xWriteBufferLen, "us     ");
+		for (uint8_t bucket = 0; bucket < I2C_STATS_BUCKETS && written < (int)xWriteBufferLen; bucket++)
+		{
+			uint32_t limit = I2cGetBucketLimitUs(bucket);
+			if (limit == 0) written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, " more");
+			else if (limit < 1000) written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, " <%3lu", (unsigned long)limit);
+			else written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, " <%2luk", (unsigned long)(limit / 1000));
+		}
+		if (written < (int)xWriteBufferLen) snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "\r\n");
+		device = 0;
+		phase = N_I2C_PHASES;
+		return pdTRUE;
+	}
+
+	const struct I2cDeviceStats *entry = &stats[device];
+	if (phase >= N_I2C_PHASES)
+	{
+		snprintf(pcWriteBuffer, xWriteBufferLen, "0x%02X %lu done, %lu B out, %lu B in, %u timeouts, %u aborted, %u errors\r\n", entry->address,
+			(unsigned long)entry->transactions, (unsigned long)entry->bytesOut, (unsigned long)entry->bytesIn,
+			entry->timeouts, entry->aborted, entry->errors);
+		phase = 0;
+		return pdTRUE;
+	}
+
+	written = snprintf(pcWriteBuffer, xWriteBufferLen, " %-6s", I2cGetPhaseName((enum eI2cPhase)phase));
+	for (uint8_t bucket = 0; bucket < I2C_STATS_BUCKETS && written < (int)xWriteBufferLen; bucket++)
+	{
+		written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, " %4u", entry->histogram[phase][bucket]);
+	}
+	if (written < (int)xWriteBufferLen) snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "\r\n");
+
+	if (++phase < N_I2C_PHASES) return pdTRUE;
+	if (++device < nDevices)
+	{
+		phase = N_I2C_PHASES;
+		return pdTRUE;
+	}
+	device = -2;
+	return pdFALSE;
+}
+
+
+
+
+/**************************************************************************//**
+BaseType_t CLI_Sensors( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+* @brief	Prints the state of the sensor scheduler, one source per call: its period and latest sample, then its run, error,
+			deadline overrun and skipped release counters and its last and max release jitter.
+* @param[out] *pcWriteBuffer. Buffer we can use to write the CLI command response to! See other CLI examples on how we use this to write back!
+* @param[in] xWriteBufferLen. How much we can write into the buffer
+* @param[in] *pcCommandString. Buffer that contains the complete input. Optional parameter: "reset" clears the statistics
+                				
+* @return		Returns pdTRUE while there are more lines to print, pdFALSE after the last one.
+* @note         
+
+*****************************************************************************/
+BaseType_t CLI_Sensors( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString )
+{
+static int8_t source = -1;
+struct SensorStats stats;
+struct SensorSample sample;
+BaseType_t paramLen;
+int written;
+
+	if (source == -1)
+	{
+		const char *param = (const char *)FreeRTOS_CLIGetParameter(pcCommandString, 1, &paramLen);
+		if (param != NULL && paramLen == 5 && strncmp(param, "reset", 5) == 0)
+		{
+			SensorResetStats();
+			snprintf(pcWriteBuffer, xWriteBufferLen, "Sensor statistics cleared\r\n");
+			return pdFALSE;
+		}
+		snprintf(pcWriteBuffer, xWriteBufferLen, "source     period   runs  samples err  late skip jitter/max ms  latest\r\n");
+		source = 0;
+		return pdTRUE;
+	}
+
+	SensorGetStats((enum eSensorSource)source, &stats);
+	written = snprintf(pcWriteBuffer, xWriteBufferLen, "%-10s ", SensorGetName((enum eSensorSource)source));
+	if (!stats.enabled) written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "   off ");
+	else if (stats.periodMs == 0) written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, " event ");
+	else written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "%4ums ", stats.periodMs);
+
+	if (written < (int)xWriteBufferLen)
+	{
+		written += snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "%6lu %8lu %3lu %5lu %4lu %6u/%-5u ",
+			(unsigned long)stats.runs, (unsigned long)stats.samples, (unsigned long)stats.errors,
+			(unsigned long)stats.overruns, (unsigned long)stats.skipped, stats.lastJitterMs, stats.maxJitterMs);
+	}
+	if (written < (int)xWriteBufferLen)
+	{
+		if (SensorGetLatest((enum eSensorSource)source, &sample) != ERROR_NONE) snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "-\r\n");
+		else snprintf(pcWriteBuffer + written, xWriteBufferLen - written, "%d %d %d\r\n", sample.value[0], sample.value[1], sample.value[2]);
+	}
+
+	if (++source < N_SENSOR_SOURCES) return pdTRUE;
+	source = -1;
+	return pdFALSE;
+}
@@ -15,10 +15,11 @@
 
 #define CLI_TASK_SIZE	256		///<STUDENT FILL
 #define CLI_PRIORITY (configMAX_PRIORITIES - 1) ///<STUDENT FILL
-#define CLI_TASK_DELAY 150	///STUDENT FILL
 
 #define MAX_INPUT_LENGTH_CLI    50	//STUDENT FILL
 #define MAX_OUTPUT_LENGTH_CLI   130	//STUDENT FILL
+#define CLI_TOP_DEFAULT_PERIOD	2	///<Seconds between two refreshes of the "top" command when none is given
+#define CLI_TOP_MAX_PERIOD		60	///<Max seconds between two refreshes of the "top" command
 
 #define CLI_MSG_LEN						16
 #define CLI_PC_ESCAPE_CODE_SIZE			4
@@ -47,4 +48,9 @@ BaseType_t CLI_NeotrellisSetLed( int8_t *pcWriteBuffer,size_t xWriteBufferLen,co
 BaseType_t CLI_NeotrellProcessButtonBuffer( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_DistanceSensorGetDistance( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
 BaseType_t CLI_ResetDevice( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
-BaseType_t CLI_SendDummyGameData( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
\ No newline at end of file
+BaseType_t CLI_SendDummyGameData( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_SerialStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_Top( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_Bench( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_I2cStats( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
+BaseType_t CLI_Sensors( int8_t *pcWriteBuffer,size_t xWriteBufferLen,const int8_t *pcCommandString );
\ No newline at end of file
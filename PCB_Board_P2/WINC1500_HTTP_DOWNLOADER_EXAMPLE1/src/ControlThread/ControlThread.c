@@ -14,6 +14,8 @@
 #include "WifiHandlerThread/WifiHandler.h"
 #include "UiHandlerThread/UiHandlerThread.h"
 #include "SeesawDriver/Seesaw.h"
+#include "LedAnimation/LedAnimation.h"
+#include "KeypadThread/KeypadThread.h"
 #include "thumbstick/thumbstick.h"
 #include <errno.h>
 #include <stdio.h>
@@ -27,6 +29,7 @@
 /******************************************************************************
 * Defines
 ******************************************************************************/
+#define CONTROL_LED_FADE_MS		120	///<Fade out of a released key
 
 /******************************************************************************
 * Variables
@@ -39,11 +42,10 @@ char buffer[64];
 uint16_t raw_value;
 int steps[6];
 char usr2_ans[64];
-int numEvent;
-int ledNum, temp_act ;
+int ledNum;
 int total_input;
 int i;
-uint8_t eventBuffer[8];	
+struct KeypadEvent keyEvent; ///<Key event from the keypad task
 /******************************************************************************
 * Forward Declarations
 ******************************************************************************/
@@ -98,15 +100,10 @@ while(1)
 			i++;
 			
 
-			for(int j = 0; j < 15; j++)
-			{
-				SeesawSetLed(j,0,0,0); //Turn button 15 off
-				SeesawOrderLedUpdate();
-			}
+			LedAnimFill(0,0,0,0); //Turn every button off
 			
 			//Clear the buffer
-			numEvent = SeesawGetKeypadCount();
-			SeesawReadKeypad(NULL, numEvent);
+			KeypadFlushEvents();
 		}
 
 		break;
@@ -119,56 +116,39 @@ while(1)
 		//while loop for read six input from keypad
 		while(total_input < 6)
 		{
-			numEvent = SeesawGetKeypadCount();
+			//sleep until the keypad task has a key event
+			if(KeypadGetEvent(&keyEvent, portMAX_DELAY) != ERROR_NONE)
+			{
+				vTaskDelay(40);
+				continue;
+			}
+			ledNum = keyEvent.key;
 			
-			if(numEvent != 0)
+			//if detect action release button:
+			if(keyEvent.edge == SEESAW_KEYPAD_EDGE_FALLING)
 			{
-				//load the events of keypad
-				SeesawReadKeypad(&eventBuffer, numEvent);
-				for(i = 0;i < numEvent; i++)
-				{
-					ledNum = NEO_TRELLIS_SEESAW_KEY(eventBuffer[i]>>2);
-					//using mask to get the last two bits
-					temp_act = (eventBuffer[i] & 0x03);
-					
-					
-					//if detect action release button:
-					if(temp_act == 2)
-					{
-						SeesawSetLed(ledNum, 0, 0, 0);
-						SeesawOrderLedUpdate();
-						
-					}
-					//if detect action button presseed
-					else if(temp_act == 3)
-					{	
-						//loght up the led
-						SeesawSetLed(ledNum, 50, 60, 170);
-						SeesawOrderLedUpdate();
-						
-						vTaskDelay(40);
-						snprintf(buffer,63, "current input is %d\r\n", ledNum+1);
-						SerialConsoleWriteString(buffer);
-						SendRealTimeUserGameInput(2, ledNum+1, 1);
-						vTaskDelay(40);
-						
-						//mark down the steps 
-						steps[total_input] = ledNum + 1;
-						total_input += 1;
-						
-					}
-					else continue;
-				}
+				LedAnimSetKey(ledNum, 0, 0, 0, CONTROL_LED_FADE_MS);
+				
+			}
+			//if detect action button presseed
+			else if(keyEvent.edge == SEESAW_KEYPAD_EDGE_RISING)
+			{	
+				//loght up the led
+				LedAnimSetKey(ledNum, 50, 60, 170, 0);
+				
+				snprintf(buffer,63, "current input is %d\r\n", ledNum+1);
+				SerialConsoleWriteString(buffer);
+				SendRealTimeUserGameInput(2, ledNum+1, 1);
+				vTaskDelay(40);
 				
+				//mark down the steps 
+				steps[total_input] = ledNum + 1;
+				total_input += 1;
 				
 			}
-			
-
 		}
 		//turn off the last LED that has been turned on
-		SeesawSetLed(ledNum, 0, 0, 0);
-		SeesawOrderLedUpdate();
-		vTaskDelay(40);
+		LedAnimSetKey(ledNum, 0, 0, 0, CONTROL_LED_FADE_MS);
 		
 		//print out the LED
 		snprintf(buffer,63,"%d,%d,%d,%d,%d,%d", steps[0], steps[1],steps[2],steps[3],steps[4],steps[5]);
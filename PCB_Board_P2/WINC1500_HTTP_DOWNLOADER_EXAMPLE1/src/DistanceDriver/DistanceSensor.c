@@ -34,6 +34,30 @@ SemaphoreHandle_t sensorDistanceSemaphoreHandle;		///<Binary semaphore to notify
 ******************************************************************************/
 uint8_t distTx;
 uint8_t latestRxDistance[2];
+
+static volatile bool distanceStreaming = false;	///<The callbacks chain the read commands
+static volatile TickType_t distanceLastCommandTick = 0;	///<Tick the last stream command was sent at
+static uint8_t distanceMedianWindow = DISTANCE_DEFAULT_MEDIAN;	///<Readings in the median. 1 disables it
+static uint8_t distanceEmaShift = DISTANCE_DEFAULT_EMA_SHIFT;	///<A new median weighs 1 / 2^distanceEmaShift in the EMA. 0 disables it
+static uint16_t distanceWindow[DISTANCE_MEDIAN_MAX];	///<Latest valid readings, for the median
+static uint8_t distanceWindowFill = 0;	///<Readings in distanceWindow
+static uint8_t distanceWindowNext = 0;	///<Slot of distanceWindow the next reading goes into
+static int32_t distanceEma = 0;	///<EMA of the medians, in mm. 8 fractional bits
+static bool distanceEmaSeeded = false;	///<distanceEma holds a value
+static struct DistanceReading distanceSlot;	///<Latest filtered distance. Written in the USART interrupt only
+static volatile uint32_t distanceSlotSeq = 0;	///<Odd while distanceSlot is being written
+static struct DistanceStreamStats distanceStats;	///<Counters of the stream
+
+/******************************************************************************
+* Local Function Declaration
+******************************************************************************/
+static void configure_usart(void);
+static void configure_usart_callbacks(void);
+static int32_t DistanceSensorFreeMutex(void);
+static int32_t DistanceSensorGetMutex(TickType_t waitTime);
+static void DistanceStreamSendCommand(TickType_t tick);
+static void DistanceStreamAddReading(uint16_t raw, TickType_t tick);
+static uint16_t DistanceStreamFilter(uint16_t raw);
 /******************************************************************************
 *  Callback Declaration
 ******************************************************************************/
@@ -42,6 +66,12 @@ void distUsartWritecallback(struct usart_module *const usart_module)
 {
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	
+	if(distanceStreaming)
+	{
+		//The command is out: read the answer
+		usart_read_buffer_job(&usart_instance_dist, (uint8_t*) &latestRxDistance, 2);
+		return;
+	}
 	xSemaphoreGiveFromISR( sensorDistanceSemaphoreHandle, &xHigherPriorityTaskWoken );
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
@@ -51,17 +81,17 @@ void distUsartReadcallback(struct usart_module *const usart_module)
 {
 	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
 	
+	if(distanceStreaming)
+	{
+		//Answer in: filter it and order the next reading right away
+		DistanceStreamAddReading((latestRxDistance[0] << 8) + latestRxDistance[1], xTaskGetTickCountFromISR());
+		DistanceStreamSendCommand(xTaskGetTickCountFromISR());
+		return;
+	}
 	xSemaphoreGiveFromISR( sensorDistanceSemaphoreHandle, &xHigherPriorityTaskWoken );
 	portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
 }
 
-/******************************************************************************
-* Local Function Declaration
-******************************************************************************/
-static void configure_usart(void);
-static void configure_usart_callbacks(void);
-static int32_t DistanceSensorFreeMutex(void);
-static int32_t DistanceSensorGetMutex(TickType_t waitTime);
 /******************************************************************************
 * Global Local Variables
 ******************************************************************************/
@@ -109,7 +139,8 @@ void DeinitializeDistanceSerial(void)
 /**************************************************************************//**
 * @fn			int32_t DistanceSensorGetDistance (uint16_t *distance)
 * @brief		Gets the distance from the distance sensor.
-* @note			Returns 0 if successful. -1 if an error occurred
+* @note			Returns 0 if successful. -1 if an error occurred. While streaming, returns the latest filtered distance
+*				at once, or ERROR_NOT_READY if there is none yet
 *****************************************************************************/
 int32_t DistanceSensorGetDistance (uint16_t *distance, const TickType_t xMaxBlockTime)
 {
@@ -118,12 +149,22 @@ int error = ERROR_NONE;
 
 //1. Get MUTEX. DistanceSensorGetMutex. If we cant get it, goto
 error = DistanceSensorGetMutex(WAIT_I2C_LINE_MS);
-if(ERROR_NONE != error) goto exitf;
+if(ERROR_NONE != error) return error;
+
+//The callbacks own the UART while streaming
+if(distanceStreaming)
+{
+	struct DistanceReading reading;
+	error = DistanceSensorGetLatest(&reading);
+	if(ERROR_NONE == error) *distance = reading.distance;
+	goto exitf;
+}
 
 //---2. Initiate sending data. First populate TX with the distance command. Use usart_write_buffer_job to transmit 1 character
 distTx = DISTANCE_US_100_CMD_READ_DISTANCE;
 if (STATUS_OK != usart_write_buffer_job(&usart_instance_dist, (uint8_t*) &distTx, 1))
 {
+	error = ERROR_IO;
 	goto exitf;
 }
 
@@ -159,6 +200,129 @@ return error;
 }
 
 
+/**************************************************************************//**
+* @fn			int32_t DistanceSensorStartStream(void)
+* @brief		Starts streaming: the USART callbacks send a read command as soon as the previous answer is in
+* @return		Returns ERROR_NONE, ERROR_NOT_READY if a blocking read did not end in time
+* @note			Call DistanceSensorCheckStream periodically: it restarts the stream if an answer or a command is lost
+*****************************************************************************/
+int32_t DistanceSensorStartStream(void)
+{
+	int32_t error = DistanceSensorGetMutex(WAIT_I2C_LINE_MS);
+	if(ERROR_NONE != error) return error;
+
+	if(!distanceStreaming)
+	{
+		taskENTER_CRITICAL();
+		distanceWindowFill = 0;
+		distanceWindowNext = 0;
+		distanceEmaSeeded = false;
+		distanceStreaming = true;
+		DistanceStreamSendCommand(xTaskGetTickCount());
+		taskEXIT_CRITICAL();
+	}
+
+	DistanceSensorFreeMutex();
+	return error;
+}
+
+
+/**************************************************************************//**
+* @fn			void DistanceSensorStopStream(void)
+* @brief		Stops streaming. The latest filtered distance stays readable
+* @note			An answer still on its way is dropped
+*****************************************************************************/
+void DistanceSensorStopStream(void)
+{
+	taskENTER_CRITICAL();
+	distanceStreaming = false;
+	usart_abort_job(&usart_instance_dist, USART_TRANSCEIVER_TX);
+	usart_abort_job(&usart_instance_dist, USART_TRANSCEIVER_RX);
+	taskEXIT_CRITICAL();
+}
+
+
+/**************************************************************************//**
+* @fn			int32_t DistanceSensorCheckStream(void)
+* @brief		Restarts the stream if no answer came for DISTANCE_STREAM_TIMEOUT_MS, e.g. after a lost byte
+* @return		Returns ERROR_NONE, ERROR_TIMEOUT if the stream had stalled and was restarted
+* @note			From a task. Does nothing when not streaming
+*****************************************************************************/
+int32_t DistanceSensorCheckStream(void)
+{
+	int32_t error = ERROR_NONE;
+
+	taskENTER_CRITICAL();
+	if(distanceStreaming && (xTaskGetTickCount() - distanceLastCommandTick) > pdMS_TO_TICKS(DISTANCE_STREAM_TIMEOUT_MS))
+	{
+		usart_abort_job(&usart_instance_dist, USART_TRANSCEIVER_TX);
+		usart_abort_job(&usart_instance_dist, USART_TRANSCEIVER_RX);
+		DistanceStreamSendCommand(xTaskGetTickCount());
+		distanceStats.restarts++;
+		error = ERROR_TIMEOUT;
+	}
+	taskEXIT_CRITICAL();
+	return error;
+}
+
+
+/**************************************************************************//**
+* @fn			int32_t DistanceSensorSetFilter(uint8_t medianWindow, uint8_t emaShift)
+* @brief		Sets the stream filter: the median of the last medianWindow readings, then an EMA in which each median weighs 1 / 2^emaShift
+* @param[in]	medianWindow Readings in the median, 1 to DISTANCE_MEDIAN_MAX. 1 disables the median
+* @param[in]	emaShift 0 to DISTANCE_EMA_MAX_SHIFT. 0 disables the EMA
+* @return		Returns ERROR_NONE, ERROR_INVALID_ARG for a value out of range
+* @note			Restarts the filter from the next reading
+*****************************************************************************/
+int32_t DistanceSensorSetFilter(uint8_t medianWindow, uint8_t emaShift)
+{
+	if(medianWindow < 1 || medianWindow > DISTANCE_MEDIAN_MAX || emaShift > DISTANCE_EMA_MAX_SHIFT) return ERROR_INVALID_ARG;
+
+	taskENTER_CRITICAL();
+	distanceMedianWindow = medianWindow;
+	distanceEmaShift = emaShift;
+	distanceWindowFill = 0;
+	distanceWindowNext = 0;
+	distanceEmaSeeded = false;
+	taskEXIT_CRITICAL();
+	return ERROR_NONE;
+}
+
+
+/**************************************************************************//**
+* @fn			int32_t DistanceSensorGetLatest(struct DistanceReading *reading)
+* @brief		Returns the latest filtered distance of the stream
+* @details		Lock free: the interrupt makes distanceSlotSeq odd while it writes the slot, and a copy taken meanwhile is discarded
+* @return		Returns ERROR_NONE, ERROR_NOT_READY if no valid reading came in yet
+* @note			Never blocks. Any task
+*****************************************************************************/
+int32_t DistanceSensorGetLatest(struct DistanceReading *reading)
+{
+	uint32_t seq;
+
+	do
+	{
+		seq = distanceSlotSeq;
+		__DMB();
+		*reading = distanceSlot;
+		__DMB();
+	} while ((seq & 1) || distanceSlotSeq != seq);
+
+	return (reading->count == 0) ? ERROR_NOT_READY : ERROR_NONE;
+}
+
+
+/**************************************************************************//**
+* @fn			void DistanceSensorGetStreamStats(struct DistanceStreamStats *stats)
+* @brief		Copies the counters of the stream
+* @note			The counters are read one by one: they may be one reading apart
+*****************************************************************************/
+void DistanceSensorGetStreamStats(struct DistanceStreamStats *stats)
+{
+	*stats = distanceStats;
+}
+
+
 
 /**************************************************************************//**
 * @fn			static void configure_usart(void)
@@ -238,4 +402,85 @@ static int32_t DistanceSensorGetMutex(TickType_t waitTime){
 		error = ERROR_NOT_READY;
 	}
 	return error;
-}
\ No newline at end of file
+}
+
+
+/**************************************************************************//**
+ * @fn			static void DistanceStreamSendCommand(TickType_t tick)
+ * @brief       Sends the next read command of the stream
+ * @param[in]   tick Current tick count, for the stall check of DistanceSensorCheckStream
+ * @note        From the USART interrupt, or from a task in a critical section
+ *****************************************************************************/
+static void DistanceStreamSendCommand(TickType_t tick)
+{
+	distTx = DISTANCE_US_100_CMD_READ_DISTANCE;
+	distanceLastCommandTick = tick;
+	usart_write_buffer_job(&usart_instance_dist, (uint8_t*) &distTx, 1); //Retried by DistanceSensorCheckStream if it fails
+}
+
+
+/**************************************************************************//**
+ * @fn			static void DistanceStreamAddReading(uint16_t raw, TickType_t tick)
+ * @brief       Filters a reading of the stream and publishes the result in distanceSlot
+ * @details     Readings out of DISTANCE_MIN_MM to DISTANCE_MAX_MM (no echo, or too close) are only counted.
+ * @note        USART interrupt only: single writer of distanceSlot
+ *****************************************************************************/
+static void DistanceStreamAddReading(uint16_t raw, TickType_t tick)
+{
+	uint16_t filtered;
+
+	distanceStats.readings++;
+	if(raw < DISTANCE_MIN_MM || raw > DISTANCE_MAX_MM)
+	{
+		distanceStats.rejected++;
+		return;
+	}
+	filtered = DistanceStreamFilter(raw);
+
+	distanceSlotSeq++;
+	__DMB();
+	distanceSlot.distance = filtered;
+	distanceSlot.raw = raw;
+	distanceSlot.timestamp = tick;
+	distanceSlot.count++;
+	__DMB();
+	distanceSlotSeq++;
+}
+
+
+/**************************************************************************//**
+ * @fn			static uint16_t DistanceStreamFilter(uint16_t raw)
+ * @brief       Runs a valid reading through the median, then the EMA
+ * @details     The median is taken over the readings in the window so far: the filter answers from the first reading on,
+ *				which also seeds the EMA. The window is at most DISTANCE_MEDIAN_MAX readings, sorted by insertion.
+ * @return      Filtered distance, in mm
+ * @note        USART interrupt only
+ *****************************************************************************/
+static uint16_t DistanceStreamFilter(uint16_t raw)
+{
+	uint16_t sorted[DISTANCE_MEDIAN_MAX];
+	uint16_t median;
+
+	distanceWindow[distanceWindowNext] = raw;
+	distanceWindowNext = (distanceWindowNext + 1) % distanceMedianWindow;
+	if(distanceWindowFill < distanceMedianWindow) distanceWindowFill++;
+
+	for(uint8_t n = 0; n < distanceWindowFill; n++)
+	{
+		uint16_t value = distanceWindow[n];
+		int8_t j = n - 1;
+		while(j >= 0 && sorted[j] > value)
+		{
+			sorted[j + 1] = sorted[j];
+			j--;
+		}
+		sorted[j + 1] = value;
+	}
+	median = sorted[distanceWindowFill / 2];
+
+	if(!distanceEmaSeeded || distanceEmaShift == 0) distanceEma = (int32_t)median << 8;
+	else distanceEma += (((int32_t)median << 8) - distanceEma) / (1 << distanceEmaShift);
+
+	distanceEmaSeeded = true;
+	return (uint16_t)((distanceEma + 128) >> 8);
+}
@@ -1,6 +1,7 @@
 /**************************************************************************//**
-* @file      sht3.c
-* @brief     Driver for the temperature sensor. Uses no clock stretching mode. 
+* @file      shtc3.c
+* @brief     Driver for the SHTC3 temperature and humidity sensor. Uses no clock stretching mode.
+* @details   See shtc3.h
 * @author    Eduardo Garcia
 * @date      2021-03-18
 
@@ -11,45 +12,387 @@
 * Includes
 ******************************************************************************/
 #include "shtc3.h"
-#include "stdint.h"
-#include "i2c_master.h"
-#include "i2c_master_interrupt.h"
 
-struct i2c_master_module i2cSensorBusInstance;
-static const uint16_t SHT3_wakeup_cmd = SHT3_SLEEP_COMMAND; //Why am I used here?
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SHTC3_WORD_BYTES	3	///<Every word read from the SHTC3: MSB, LSB, CRC
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Caller of SHTC3_Measure waiting for the result
+struct Shtc3Wait {
+	struct Shtc3Measurement *result;	///<Where to copy the result
+	TaskHandle_t task;	///<Task to notify
+	volatile bool done;	///<Set once result is written
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static const uint8_t shtc3CmdWakeup[] = {SHTC3_CMD_WAKEUP >> 8, SHTC3_CMD_WAKEUP & 0xFF};
+static const uint8_t shtc3CmdSleep[] = {SHTC3_CMD_SLEEP >> 8, SHTC3_CMD_SLEEP & 0xFF};
+static const uint8_t shtc3CmdReadId[] = {SHTC3_CMD_READ_ID >> 8, SHTC3_CMD_READ_ID & 0xFF};
+static const uint8_t shtc3CmdMeasure[][2] = {
+	{SHTC3_CMD_MEASURE_NM >> 8, SHTC3_CMD_MEASURE_NM & 0xFF},	//SHTC3_MODE_NORMAL
+	{SHTC3_CMD_MEASURE_LPM >> 8, SHTC3_CMD_MEASURE_LPM & 0xFF},	//SHTC3_MODE_LOW_POWER
+};
+static const TickType_t shtc3MeasureTicks[] = {SHTC3_MEASURE_NM_TICKS, SHTC3_MEASURE_LPM_TICKS};
+
+static volatile bool shtc3Busy = false;	///<A measurement or an ID read is in progress
+static enum eShtc3Mode shtc3Mode;	///<Mode of the measurement in progress
+static Shtc3Callback shtc3Callback = NULL;	///<Callback of the measurement in progress
+static void *shtc3Context = NULL;	///<Context of the measurement in progress
+static struct Shtc3Measurement shtc3Result;	///<Result of the measurement in progress
+static uint8_t shtc3Raw[2 * SHTC3_WORD_BYTES];	///<Temperature and humidity words, with their CRC
+
+static I2C_Data shtc3WakeupData;	///<Wake-up command of the measurement in progress
+static I2C_Data shtc3MeasureData;	///<Measure command and result read
+static I2C_Data shtc3SleepData;	///<Sleep command
+static struct I2cRequest shtc3WakeupRequest;	///<One request per step: the next step is submitted before the bus thread is done with the previous one
+static struct I2cRequest shtc3MeasureRequest;
+static struct I2cRequest shtc3SleepRequest;
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static void SHTC3_WakeupDone(struct I2cRequest *request);
+static void SHTC3_MeasureDone(struct I2cRequest *request);
+static void SHTC3_SleepDone(struct I2cRequest *request);
+static void SHTC3_Finish(void);
+static void SHTC3_MeasureWaitCallback(const struct Shtc3Measurement *measurement, void *context);
+static bool SHTC3_Claim(void);
+static int32_t SHTC3_SubmitStep(struct I2cRequest *request, I2C_Data *data, const uint8_t *cmd, uint8_t *in, uint16_t lenIn, TickType_t delay, I2cRequestCallback callback);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
 
-static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size); //Why am I here? What am I?
 /**************************************************************************//**
-* @fn		int SHTC3_Init(void)
-* @brief	Function to initialize the SHTC3 sensor
-* @details 	Function to initialize the SHTC3 sensor. Will set the sensor in an On mode, ready for a measurement
-                				
+* @fn		int32_t SHTC3_Init(void)
+* @brief	Checks that an SHTC3 answers on the sensor bus and leaves it asleep
+* @return	Returns ERROR_NONE, ERROR_NOT_FOUND if the ID is not the one of an SHTC3, or the error of the bus
+* @note		Blocking: call from a task, after I2cInitializeDriver
+*****************************************************************************/
+int32_t SHTC3_Init(void)
+{
+	uint16_t id;
+	int32_t error = SHTC3_ReadId(&id);
+
+	if (error == ERROR_NONE && (id & SHTC3_ID_MASK) != SHTC3_ID_VALUE) error = ERROR_NOT_FOUND;
+	return error;
+}
 
-* @return		Returns SHT3_OK if initialized correctly
-* @note         
+/**************************************************************************//**
+* @fn		int32_t SHTC3_StartMeasurement(enum eShtc3Mode mode, Shtc3Callback callback, void *context)
+* @brief	Starts a measurement: wake-up, measure, read, sleep. Returns at once
+* @details	The read is scheduled after the conversion time of the mode: the bus thread parks the request meanwhile
+*			and serves the other devices. The sensor goes back to sleep before the callback is called, with the
+*			result or the error of the first step that failed.
+* @param[in]	mode Normal or low power measurement
+* @param[in]	callback Called on the bus thread when the measurement is over. Must not block
+* @param[in]	context Passed to callback
+* @return	Returns ERROR_NONE if started, ERROR_BUSY if a measurement is in progress, ERROR_INVALID_ARG for an unknown
+*			mode, or the error of I2cSubmit. The callback is only called if started
+* @note		Not from an interrupt
 *****************************************************************************/
-int SHTC3_Init(void)
+int32_t SHTC3_StartMeasurement(enum eShtc3Mode mode, Shtc3Callback callback, void *context)
 {
-    return SHTC3_SendI2cCommand(SHT3_wakeup_cmd, sizeof(SHT3_wakeup_cmd));
+	int32_t error;
+
+	if (mode > SHTC3_MODE_LOW_POWER || callback == NULL) return ERROR_INVALID_ARG;
+	if (!SHTC3_Claim()) return ERROR_BUSY;
+
+	shtc3Mode = mode;
+	shtc3Callback = callback;
+	shtc3Context = context;
+	shtc3Result.error = ERROR_NONE;
+
+	//The delay holds the sensor for its wake-up time: the measure command is only sent after it
+	error = SHTC3_SubmitStep(&shtc3WakeupRequest, &shtc3WakeupData, shtc3CmdWakeup, NULL, 0, SHTC3_WAKEUP_TICKS, SHTC3_WakeupDone);
+	if (error != ERROR_NONE) shtc3Busy = false;
+	return error;
 }
+
 /**************************************************************************//**
-* @fn		static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size)
-* @brief	Static interface function use to send an I2C command
-* @param[in]	buf Pointer to a data buffer to send
-* @param[in]	size Ammount of bytes to send
-* @return		Returns SHT3_OK if initialized correctly
-* @note         
+* @fn		int32_t SHTC3_Measure(int16_t *temperature, uint16_t *humidity)
+* @brief	Measures the temperature and humidity in normal power mode, and waits for the result
+* @param[out]	temperature Temperature, in hundredths of degree Celsius
+* @param[out]	humidity Relative humidity, in hundredths of percent
+* @return	Returns ERROR_NONE if the temperature was read correctly, ERROR_TIMEOUT if the result did not come in
+*			SHTC3_MEASURE_WAIT_MS, or the error of the measurement
+* @note		Blocking: call from a task. Use SHTC3_StartMeasurement to sample at a fixed rate
 *****************************************************************************/
-static int SHTC3_SendI2cCommand(uint8_t *buf, uint8_t size)
+int32_t SHTC3_Measure(int16_t *temperature, uint16_t *humidity)
 {
-    //Write WAKE command to the device address
-    struct i2c_master_packet sensorPacketWrite;
+	struct Shtc3Measurement result;
+	struct Shtc3Wait wait = {&result, xTaskGetCurrentTaskHandle(), false};
+	TickType_t start;
+	TickType_t elapsed;
+	UBaseType_t taken = 0;
+	bool pending;
+	int32_t error;
+
+	result.error = ERROR_TIMEOUT;
+	error = SHTC3_StartMeasurement(SHTC3_MODE_NORMAL, SHTC3_MeasureWaitCallback, &wait);
+	if (error != ERROR_NONE) return error;
 
-    //Prepare to write
-	sensorPacketWrite.address = SHT3_LOW_ADDRESS;   //Address to send to
-	sensorPacketWrite.data = (uint8_t*)SHT3_wakeup_cmd; //Requires a pointer to the data to send. Why dont we put a #define here?
-	sensorPacketWrite.data_length = sizeof(SHT3_wakeup_cmd); //Length to send.
+	//Notifications the task gets for other reasons (e.g. the console RX wake-up of the CLI thread) do not end the wait
+	start = xTaskGetTickCount();
+	while (!wait.done)
+	{
+		elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= pdMS_TO_TICKS(SHTC3_MEASURE_WAIT_MS)) break;
+		if (ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(SHTC3_MEASURE_WAIT_MS) - elapsed) != 0) taken++;
+	}
 
-    return i2c_master_write_packet_job(&i2cSensorBusInstance, &sensorPacketWrite);
+	if (!wait.done)
+	{
+		//The callback must not write to the stack of a caller that gave up
+		taskENTER_CRITICAL();
+		pending = (shtc3Callback == SHTC3_MeasureWaitCallback);
+		if (pending) shtc3Callback = NULL;
+		taskEXIT_CRITICAL();
+
+		//Already taken by SHTC3_Finish: it is about to run
+		while (!pending && !wait.done)
+		{
+			if (ulTaskNotifyTake(pdFALSE, portMAX_DELAY) != 0) taken++;
+		}
+	}
+
+	//Give back the notifications that were not the callback's
+	if (wait.done && taken > 0) taken--;
+	while (taken-- > 0) xTaskNotifyGive(wait.task);
+
+	if (result.error == ERROR_NONE)
+	{
+		*temperature = result.temperature;
+		*humidity = result.humidity;
+	}
+	return result.error;
+}
+
+/**************************************************************************//**
+* @fn		int32_t SHTC3_ReadId(uint16_t *id)
+* @brief	Wakes the sensor up, reads its ID register and puts it back to sleep
+* @param[out]	id ID register. SHTC3_ID_MASK bits are SHTC3_ID_VALUE on an SHTC3
+* @return	Returns ERROR_NONE, ERROR_BUSY if a measurement is in progress, ERROR_BAD_DATA on a CRC mismatch,
+*			or the error of the bus
+* @note		Blocking: call from a task
+*****************************************************************************/
+int32_t SHTC3_ReadId(uint16_t *id)
+{
+	uint8_t raw[SHTC3_WORD_BYTES];
+	I2C_Data data;
+	int32_t error;
+
+	if (!SHTC3_Claim()) return ERROR_BUSY;
+
+	data.address = SHTC3_ADDRESS;
+	data.msgOut = shtc3CmdWakeup;
+	data.lenOut = sizeof(shtc3CmdWakeup);
+	data.msgIn = NULL;
+	data.lenIn = 0;
+	error = I2cWriteDataWait(&data, SHTC3_TIMEOUT_TICKS);
+	if (error != ERROR_NONE) goto exit;
+	vTaskDelay(SHTC3_WAKEUP_TICKS);
+
+	data.msgOut = shtc3CmdReadId;
+	data.lenOut = sizeof(shtc3CmdReadId);
+	data.msgIn = raw;
+	data.lenIn = sizeof(raw);
+	error = I2cReadDataWait(&data, 0, SHTC3_TIMEOUT_TICKS);
+	if (error == ERROR_NONE)
+	{
+		if (SHTC3_Crc8(raw, 2) != raw[2]) error = ERROR_BAD_DATA;
+		*id = ((uint16_t)raw[0] << 8) | raw[1];
+	}
+
+	data.msgOut = shtc3CmdSleep;
+	data.lenOut = sizeof(shtc3CmdSleep);
+	data.msgIn = NULL;
+	data.lenIn = 0;
+	if (I2cWriteDataWait(&data, SHTC3_TIMEOUT_TICKS) != ERROR_NONE && error == ERROR_NONE) error = ERROR_IO;
+
+exit:
+	shtc3Busy = false;
+	return error;
+}
+
+/**************************************************************************//**
+* @fn		uint8_t SHTC3_Crc8(const uint8_t *data, uint8_t len)
+* @brief	Returns the CRC-8 the SHTC3 appends to every word it sends
+* @note
+*****************************************************************************/
+uint8_t SHTC3_Crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = SHTC3_CRC_INIT;
+
+	for (uint8_t i = 0; i < len; i++)
+	{
+		crc ^= data[i];
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ SHTC3_CRC_POLYNOMIAL) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+/**************************************************************************//**
+* @fn		int16_t SHTC3_ConvertTemperature(uint16_t raw)
+* @brief	Converts a raw temperature to hundredths of degree Celsius: T = -45 + 175 * raw / 2^16, rounded
+* @note
+*****************************************************************************/
+int16_t SHTC3_ConvertTemperature(uint16_t raw)
+{
+	return (int16_t)((((int32_t)raw * 17500 + (1 << 15)) >> 16) - 4500);
+}
 
-}
\ No newline at end of file
+/**************************************************************************//**
+* @fn		uint16_t SHTC3_ConvertHumidity(uint16_t raw)
+* @brief	Converts a raw relative humidity to hundredths of percent: RH = 100 * raw / 2^16, rounded
+* @note
+*****************************************************************************/
+uint16_t SHTC3_ConvertHumidity(uint16_t raw)
+{
+	return (uint16_t)(((uint32_t)raw * 10000 + (1 << 15)) >> 16);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void SHTC3_WakeupDone(struct I2cRequest *request)
+* @brief	The sensor is awake: sends the measure command. The read is scheduled after the conversion time
+* @note		Runs on the bus thread
+*****************************************************************************/
+static void SHTC3_WakeupDone(struct I2cRequest *request)
+{
+	if (request->error != ERROR_NONE)
+	{
+		shtc3Result.error = request->error; //Asleep, or not there
+		SHTC3_Finish();
+		return;
+	}
+
+	shtc3Result.error = SHTC3_SubmitStep(&shtc3MeasureRequest, &shtc3MeasureData, shtc3CmdMeasure[shtc3Mode], shtc3Raw, sizeof(shtc3Raw),
+										 shtc3MeasureTicks[shtc3Mode], SHTC3_MeasureDone);
+	if (shtc3Result.error != ERROR_NONE) SHTC3_Finish(); //Bus queue full. The next measurement puts the sensor back to sleep
+}
+
+/**************************************************************************//**
+* @fn		static void SHTC3_MeasureDone(struct I2cRequest *request)
+* @brief	Checks and converts the result, then puts the sensor back to sleep
+* @note		Runs on the bus thread
+*****************************************************************************/
+static void SHTC3_MeasureDone(struct I2cRequest *request)
+{
+	shtc3Result.error = request->error;
+	shtc3Result.timestamp = xTaskGetTickCount();
+
+	if (shtc3Result.error == ERROR_NONE)
+	{
+		if (SHTC3_Crc8(&shtc3Raw[0], 2) != shtc3Raw[2] || SHTC3_Crc8(&shtc3Raw[SHTC3_WORD_BYTES], 2) != shtc3Raw[SHTC3_WORD_BYTES + 2])
+		{
+			shtc3Result.error = ERROR_BAD_DATA;
+		}
+		else
+		{
+			shtc3Result.temperature = SHTC3_ConvertTemperature(((uint16_t)shtc3Raw[0] << 8) | shtc3Raw[1]);
+			shtc3Result.humidity = SHTC3_ConvertHumidity(((uint16_t)shtc3Raw[SHTC3_WORD_BYTES] << 8) | shtc3Raw[SHTC3_WORD_BYTES + 1]);
+		}
+	}
+
+	if (SHTC3_SubmitStep(&shtc3SleepRequest, &shtc3SleepData, shtc3CmdSleep, NULL, 0, 0, SHTC3_SleepDone) != ERROR_NONE) SHTC3_Finish();
+}
+
+/**************************************************************************//**
+* @fn		static void SHTC3_SleepDone(struct I2cRequest *request)
+* @brief	The sensor is asleep: the measurement is over
+* @note		Runs on the bus thread. A failed sleep command costs power, not the result
+*****************************************************************************/
+static void SHTC3_SleepDone(struct I2cRequest *request)
+{
+	SHTC3_Finish();
+}
+
+/**************************************************************************//**
+* @fn		static void SHTC3_Finish(void)
+* @brief	Ends the measurement in progress and hands its result to the callback
+* @note		Runs on the bus thread
+*****************************************************************************/
+static void SHTC3_Finish(void)
+{
+	Shtc3Callback callback;
+	void *context;
+	struct Shtc3Measurement result = shtc3Result;
+
+	taskENTER_CRITICAL();
+	callback = shtc3Callback;
+	context = shtc3Context;
+	shtc3Callback = NULL;
+	taskEXIT_CRITICAL();
+
+	shtc3Busy = false; //A new measurement may start from the callback
+	if (callback != NULL) callback(&result, context);
+}
+
+/**************************************************************************//**
+* @fn		static void SHTC3_MeasureWaitCallback(const struct Shtc3Measurement *measurement, void *context)
+* @brief	Copies the result for SHTC3_Measure and wakes its caller up
+* @note		Runs on the bus thread
+*****************************************************************************/
+static void SHTC3_MeasureWaitCallback(const struct Shtc3Measurement *measurement, void *context)
+{
+	struct Shtc3Wait *wait = (struct Shtc3Wait *)context;
+
+	*wait->result = *measurement;
+	wait->done = true;
+	xTaskNotifyGive(wait->task);
+}
+
+/**************************************************************************//**
+* @fn		static bool SHTC3_Claim(void)
+* @brief	Marks the sensor busy
+* @return	Returns true if it was free
+* @note
+*****************************************************************************/
+static bool SHTC3_Claim(void)
+{
+	bool claimed = false;
+
+	taskENTER_CRITICAL();
+	if (!shtc3Busy)
+	{
+		shtc3Busy = true;
+		claimed = true;
+	}
+	taskEXIT_CRITICAL();
+	return claimed;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t SHTC3_SubmitStep(struct I2cRequest *request, I2C_Data *data, const uint8_t *cmd, uint8_t *in, uint16_t lenIn, TickType_t delay, I2cRequestCallback callback)
+* @brief	Submits one step of a measurement: a 2 byte command, then after delay an optional read
+* @return	Returns the error of I2cSubmit. Never waits for room in the bus queue
+* @note
+*****************************************************************************/
+static int32_t SHTC3_SubmitStep(struct I2cRequest *request, I2C_Data *data, const uint8_t *cmd, uint8_t *in, uint16_t lenIn, TickType_t delay, I2cRequestCallback callback)
+{
+	data->address = SHTC3_ADDRESS;
+	data->msgOut = cmd;
+	data->lenOut = 2;
+	data->msgIn = in;
+	data->lenIn = lenIn;
+	request->data = data;
+	request->delay = delay;
+	request->timeout = SHTC3_TIMEOUT_TICKS;
+	request->callback = callback;
+	request->notify = NULL;
+
+	return I2cSubmit(request, 0);
+}
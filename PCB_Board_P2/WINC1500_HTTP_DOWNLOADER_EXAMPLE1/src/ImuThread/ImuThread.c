@@ -0,0 +1,274 @@
+/**************************************************************************//**
+* @file      ImuThread.c
+* @brief     Continuous acquisition of the LSM6DS3 accelerometer through its FIFO
+* @details   See ImuThread.h
+* @date      2020-04-30
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "ImuThread/ImuThread.h"
+#include "IMU/lsm6ds_reg.h"
+#include "I2cDriver/I2cDriver.h"
+#include "SensorScheduler/SensorScheduler.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define IMU_FIFO_WORDS_PER_SAMPLE	3	///<X, Y and Z: only the accelerometer is batched in the FIFO
+#define IMU_RESET_ATTEMPTS			10	///<Max ms to wait for the software reset of the LSM6DS3
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static const uint16_t imuOdrHz[] = {104, 208, 416, 833};	///<Rate of each eImuOdr, from IMU_ODR_104HZ
+static enum eImuOdr imuOdr = IMU_DEFAULT_ODR;	///<Rate the LSM6DS3 runs at
+static volatile enum eImuOdr imuRequestedOdr = IMU_DEFAULT_ODR;	///<Rate set by ImuSetOdr, applied by ImuService
+static volatile uint32_t imuOverruns = 0;	///<Times the FIFO filled up before it was drained
+static uint8_t imuFifoBuffer[IMU_FIFO_BURST * IMU_FIFO_WORDS_PER_SAMPLE * 2];	///<Burst read from the FIFO. Kept off the task stack
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+static int32_t ImuConfigure(void);
+static int32_t ImuApplyOdr(enum eImuOdr odr);
+static int32_t ImuRestartFifo(void);
+static int32_t ImuDrainFifo(void);
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		int32_t ImuInitialize(void)
+* @brief	Resets the LSM6DS3 and starts the accelerometer and its FIFO at IMU_DEFAULT_ODR
+* @return	Returns ERROR_NONE, ERROR_NOT_FOUND if no LSM6DS3 answers, ERROR_IO on a bus error
+* @note		Sensor task only, like ImuService
+*****************************************************************************/
+int32_t ImuInitialize(void)
+{
+	return ImuConfigure();
+}
+
+/**************************************************************************//**
+* @fn		int32_t ImuService(void)
+* @brief	Applies a rate set by ImuSetOdr, or else drains the FIFO and publishes its samples
+* @details	Run by the sensor task every ImuGetServicePeriodMs, the time the FIFO takes to reach its watermark:
+*			one status read, then one burst read of every complete sample.
+* @return	Returns ERROR_NONE, ERROR_IO on a bus error
+* @note
+*****************************************************************************/
+int32_t ImuService(void)
+{
+	if (imuRequestedOdr != imuOdr)
+	{
+		if (ImuApplyOdr(imuRequestedOdr) != ERROR_NONE) return ERROR_IO;
+		imuOdr = imuRequestedOdr;
+		return ERROR_NONE;
+	}
+	return ImuDrainFifo();
+}
+
+/**************************************************************************//**
+* @fn		int32_t ImuSetOdr(enum eImuOdr odr)
+* @brief	Changes the output data rate. The next ImuService applies it and restarts the FIFO
+* @return	Returns ERROR_NONE, ERROR_INVALID_ARG for a rate not in eImuOdr
+* @note
+*****************************************************************************/
+int32_t ImuSetOdr(enum eImuOdr odr)
+{
+	if (odr < IMU_ODR_104HZ || odr > IMU_ODR_833HZ) return ERROR_INVALID_ARG;
+
+	imuRequestedOdr = odr;
+	return ERROR_NONE;
+}
+
+/**************************************************************************//**
+* @fn		int32_t ImuOdrFromHz(uint16_t hz, enum eImuOdr *odr)
+* @brief	Returns the output data rate of the given frequency
+* @return	Returns ERROR_NONE, ERROR_NOT_FOUND if hz is not one of 104, 208, 416 or 833
+* @note
+*****************************************************************************/
+int32_t ImuOdrFromHz(uint16_t hz, enum eImuOdr *odr)
+{
+	for (uint8_t i = 0; i < sizeof(imuOdrHz) / sizeof(imuOdrHz[0]); i++)
+	{
+		if (imuOdrHz[i] == hz)
+		{
+			*odr = (enum eImuOdr)(IMU_ODR_104HZ + i);
+			return ERROR_NONE;
+		}
+	}
+	return ERROR_NOT_FOUND;
+}
+
+/**************************************************************************//**
+* @fn		uint16_t ImuGetOdrHz(void)
+* @brief	Returns the output data rate the LSM6DS3 runs at, in Hz
+* @note
+*****************************************************************************/
+uint16_t ImuGetOdrHz(void)
+{
+	return imuOdrHz[imuOdr - IMU_ODR_104HZ];
+}
+
+/**************************************************************************//**
+* @fn		uint32_t ImuGetOverruns(void)
+* @brief	Returns the number of times the FIFO filled up before it was drained. Samples were lost each time
+* @note
+*****************************************************************************/
+uint32_t ImuGetOverruns(void)
+{
+	return imuOverruns;
+}
+
+/**************************************************************************//**
+* @fn		uint16_t ImuGetServicePeriodMs(void)
+* @brief	Returns the time the FIFO takes to fill up to its watermark at the current rate, in ms
+* @note
+*****************************************************************************/
+uint16_t ImuGetServicePeriodMs(void)
+{
+	return (uint16_t)((IMU_FIFO_WATERMARK * 1000UL) / ImuGetOdrHz());
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static int32_t ImuConfigure(void)
+* @brief	Resets the LSM6DS3 and starts the accelerometer (+/-2 g) and its FIFO, in stream mode, at imuOdr
+* @details	The gyroscope stays off and out of the FIFO, so every FIFO sample is three words: X, Y, Z.
+*			After the reset, the control registers are read once into the register shadow of the driver.
+* @return	Returns ERROR_NONE, ERROR_NOT_FOUND if no LSM6DS3 answers, ERROR_IO on a bus error
+* @note
+*****************************************************************************/
+static int32_t ImuConfigure(void)
+{
+	stmdev_ctx_t *ctx = GetImuStruct();
+	uint8_t whoamI = 0;
+	uint8_t rst = 1;
+	int32_t error;
+
+	if (lsm6ds3_device_id_get(ctx, &whoamI) != 0 || whoamI != LSM6DS3_ID) return ERROR_NOT_FOUND;
+
+	error = lsm6ds3_reset_set(ctx, PROPERTY_ENABLE);
+	for (uint8_t i = 0; i < IMU_RESET_ATTEMPTS && rst && error == 0; i++)
+	{
+		vTaskDelay(1);
+		error = lsm6ds3_reset_get(ctx, &rst);
+	}
+
+	//The setters below patch the register shadow, then the changes go out in two writes
+	if (error == 0 && !rst) error = lsm6ds3_shadow_prefetch(ctx);
+	lsm6ds3_shadow_batch_begin(ctx);
+	error |= lsm6ds3_block_data_update_set(ctx, PROPERTY_ENABLE);
+	error |= lsm6ds3_xl_full_scale_set(ctx, LSM6DS3_2g);
+	error |= lsm6ds3_gy_data_rate_set(ctx, LSM6DS3_GY_ODR_OFF);
+	error |= lsm6ds3_fifo_xl_batch_set(ctx, LSM6DS3_FIFO_XL_NO_DEC);
+	error |= lsm6ds3_fifo_gy_batch_set(ctx, LSM6DS3_FIFO_GY_DISABLE);
+	error |= lsm6ds3_fifo_watermark_set(ctx, IMU_FIFO_WATERMARK * IMU_FIFO_WORDS_PER_SAMPLE);
+	error |= lsm6ds3_shadow_batch_commit(ctx);
+	if (error != 0 || rst) return ERROR_IO;
+
+	return ImuApplyOdr(imuOdr);
+}
+
+/**************************************************************************//**
+* @fn		static int32_t ImuApplyOdr(enum eImuOdr odr)
+* @brief	Sets the output data rate of the accelerometer and of its FIFO, then restarts the FIFO
+* @return	Returns ERROR_NONE, ERROR_IO on a bus error
+* @note
+*****************************************************************************/
+static int32_t ImuApplyOdr(enum eImuOdr odr)
+{
+	stmdev_ctx_t *ctx = GetImuStruct();
+	int32_t error;
+
+	error = lsm6ds3_xl_data_rate_set(ctx, (lsm6ds3_odr_xl_t)odr);
+	error |= lsm6ds3_fifo_data_rate_set(ctx, (lsm6ds3_odr_fifo_t)odr);
+	if (error != 0) return ERROR_IO;
+
+	return ImuRestartFifo();
+}
+
+/**************************************************************************//**
+* @fn		static int32_t ImuRestartFifo(void)
+* @brief	Empties the FIFO (bypass mode) and restarts it in stream mode, where the newest samples overwrite the oldest
+* @return	Returns ERROR_NONE, ERROR_IO on a bus error
+* @note
+*****************************************************************************/
+static int32_t ImuRestartFifo(void)
+{
+	stmdev_ctx_t *ctx = GetImuStruct();
+	int32_t error;
+
+	error = lsm6ds3_fifo_mode_set(ctx, LSM6DS3_BYPASS_MODE);
+	error |= lsm6ds3_fifo_mode_set(ctx, LSM6DS3_STREAM_MODE);
+	return (error == 0) ? ERROR_NONE : ERROR_IO;
+}
+
+/**************************************************************************//**
+* @fn		static int32_t ImuDrainFifo(void)
+* @brief	Reads every complete sample in the FIFO and publishes them to the sensor scheduler
+* @details	FIFO_STATUS1 to 4 come in one read: level, overrun flag and pattern (the axis the next word belongs to).
+*			If the FIFO does not start on an X word, the words before the next X are discarded. The samples are
+*			then read in bursts of up to IMU_FIFO_BURST and timestamped back from the newest. Each offset is computed
+*			from the sample count, rounded to the tick, so a period that is not a whole number of ms does not drift.
+* @return	Returns ERROR_NONE, ERROR_IO on a bus error
+* @note		After an overrun the FIFO is restarted: the samples it holds are not contiguous
+*****************************************************************************/
+static int32_t ImuDrainFifo(void)
+{
+	stmdev_ctx_t *ctx = GetImuStruct();
+	uint8_t status[4];
+	lsm6ds3_fifo_status2_t *status2 = (lsm6ds3_fifo_status2_t *)&status[1];
+	struct SensorSample sample = {0};
+	TickType_t now;
+	uint16_t words;
+	uint16_t pattern;
+	uint16_t samples;
+	uint16_t odrHz = ImuGetOdrHz();
+
+	if (lsm6ds3_read_reg(ctx, LSM6DS3_FIFO_STATUS1, status, sizeof(status)) != 0) return ERROR_IO;
+	now = xTaskGetTickCount();
+
+	if (status2->fifo_over_run)
+	{
+		imuOverruns++;
+		return ImuRestartFifo();
+	}
+
+	words = status[0] | ((uint16_t)status2->diff_fifo << 8);
+	pattern = status[2] | ((uint16_t)(status[3] & 0x03) << 8);
+	if (pattern != 0)
+	{
+		uint8_t skip = IMU_FIFO_WORDS_PER_SAMPLE - pattern;
+		if (words < skip) return ERROR_NONE;
+		if (lsm6ds3_fifo_raw_data_get(ctx, imuFifoBuffer, skip * 2) != 0) return ERROR_IO;
+		words -= skip;
+	}
+
+	samples = words / IMU_FIFO_WORDS_PER_SAMPLE;
+	while (samples > 0)
+	{
+		uint16_t burst = (samples < IMU_FIFO_BURST) ? samples : IMU_FIFO_BURST;
+		if (lsm6ds3_fifo_raw_data_get(ctx, imuFifoBuffer, burst * IMU_FIFO_WORDS_PER_SAMPLE * 2) != 0) return ERROR_IO;
+
+		for (uint16_t i = 0; i < burst; i++)
+		{
+			uint8_t *raw = &imuFifoBuffer[i * IMU_FIFO_WORDS_PER_SAMPLE * 2];
+			sample.timestamp = now - (TickType_t)(((uint32_t)(samples - 1 - i) * 1000UL + odrHz / 2) / odrHz);
+			sample.value[0] = (int16_t)(raw[0] | (raw[1] << 8));
+			sample.value[1] = (int16_t)(raw[2] | (raw[3] << 8));
+			sample.value[2] = (int16_t)(raw[4] | (raw[5] << 8));
+			SensorPublish(SENSOR_IMU, &sample);
+		}
+		samples -= burst;
+	}
+	return ERROR_NONE;
+}
@@ -0,0 +1,53 @@
+/**************************************************************************//**
+* @file      ImuThread.h
+* @brief     Continuous acquisition of the LSM6DS3 accelerometer through its FIFO
+* @details   The accelerometer and its FIFO run at the selected output data rate. Each time the FIFO reaches its
+*			 watermark, the sensor task drains it with one burst read and publishes the samples as source SENSOR_IMU.
+*			 Consumers read them through SensorRead or SensorGetLatest, without touching the I2C bus.
+* @date      2020-04-30
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define IMU_DEFAULT_ODR			IMU_ODR_104HZ	///<Output data rate at startup
+#define IMU_FIFO_WATERMARK		16	///<Samples in the FIFO that trigger a drain
+#define IMU_FIFO_BURST			32	///<Max samples per burst read. 6 bytes each: at most 255 bytes per read
+#define IMU_RING_SAMPLES		64	///<Samples of the SENSOR_IMU ring. Power of 2
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Output data rates of the accelerometer and its FIFO. Same codes as lsm6ds3_odr_xl_t and lsm6ds3_odr_fifo_t
+enum eImuOdr {
+	IMU_ODR_104HZ = 4,	///<104 Hz
+	IMU_ODR_208HZ = 5,	///<208 Hz
+	IMU_ODR_416HZ = 6,	///<416 Hz
+	IMU_ODR_833HZ = 7,	///<833 Hz
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+int32_t ImuInitialize(void);
+int32_t ImuService(void);
+int32_t ImuSetOdr(enum eImuOdr odr);
+int32_t ImuOdrFromHz(uint16_t hz, enum eImuOdr *odr);
+uint16_t ImuGetOdrHz(void);
+uint16_t ImuGetServicePeriodMs(void);
+uint32_t ImuGetOverruns(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,54 @@
+/**************************************************************************//**
+* @file      KeypadThread.h
+* @brief     Interrupt driven capture of the NeoTrellis key events
+* @details   The Seesaw pulls its INT line low while its keypad FIFO holds events (SEESAW_KEYPAD_INTENSET). The line is
+*			 wired to the EXT1 IRQ pin (PA20, EXTINT4). Its interrupt wakes the keypad task, which drains the FIFO with
+*			 one read and queues the events, timestamped with the tick of the interrupt. Nothing is sent on the I2C bus
+*			 while no key is touched.
+* @date      2020-04-28
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define KEYPAD_TASK_SIZE		128	///<Size of stack to assign to the keypad thread. In words
+#define KEYPAD_TASK_PRIORITY	(configMAX_PRIORITIES - 1)	///<Highest: it only runs for a FIFO read after a key event
+
+#define KEYPAD_INT_PIN			EXT1_IRQ_PIN	///<EIC pin wired to the INT output of the Seesaw
+#define KEYPAD_INT_MUX			EXT1_IRQ_MUX	///<Mux setting of KEYPAD_INT_PIN
+#define KEYPAD_INT_LINE			EXT1_IRQ_INPUT	///<EIC line of KEYPAD_INT_PIN
+
+#define KEYPAD_EVENT_QUEUE_LENGTH	8	///<Number of key events queued for the consumers
+#define KEYPAD_FIFO_READ		8	///<Bytes read from the Seesaw FIFO per transaction. A full read is followed by another
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///A key press or release
+struct KeypadEvent {
+	TickType_t timestamp;	///<Tick count (ms) of the interrupt that signaled the event
+	uint8_t key;	///<Key number (0 to 15)
+	uint8_t edge;	///<SEESAW_KEYPAD_EDGE_RISING when pressed, SEESAW_KEYPAD_EDGE_FALLING when released
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void vKeypadTask( void *pvParameters );
+int32_t KeypadGetEvent(struct KeypadEvent *event, TickType_t waitTime);
+void KeypadFlushEvents(void);
+
+#ifdef __cplusplus
+}
+#endif
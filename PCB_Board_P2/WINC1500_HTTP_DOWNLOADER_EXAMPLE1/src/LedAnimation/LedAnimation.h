@@ -0,0 +1,58 @@
+/**************************************************************************//**
+* @file      LedAnimation.h
+* @brief     Fixed frame rate animations of the NeoTrellis LEDs
+* @details   The animation task owns the Seesaw LED frame. Other threads queue keyframes and return at once: each
+*			 keyframe fades one key (or all of them) to a color, then holds for a time before the next keyframe starts.
+*			 Every LED_ANIM_FRAME_MS the task advances the fades, renders them into the Seesaw frame and flushes it,
+*			 which only sends the pixels that changed. The task sleeps while nothing is queued or fading.
+* @date      2020-05-04
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define LED_ANIM_TASK_SIZE			128	///<Size of stack to assign to the animation thread. In words
+#define LED_ANIM_TASK_PRIORITY		(configMAX_PRIORITIES - 2)	///<Same as the sensor task: both run on a fixed cadence
+
+#define LED_ANIM_FRAME_MS			20	///<Frame period: 50 frames per second
+#define LED_ANIM_QUEUE_LENGTH		48	///<Keyframes waiting to start: a show of a full game (two per move) and a few more
+#define LED_ANIM_ALL_KEYS			0xFF	///<Key of a keyframe that applies to every key
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///A step of an animation
+struct LedKeyframe {
+	uint8_t key;	///<Key number (0 to 15), or LED_ANIM_ALL_KEYS
+	uint8_t red;	///<Red color to reach. 0 to 255
+	uint8_t green;	///<Green color to reach. 0 to 255
+	uint8_t blue;	///<Blue color to reach. 0 to 255
+	uint16_t fadeMs;	///<Time to fade from the current color. 0 sets the color on the next frame
+	uint16_t holdMs;	///<Time from the start of this keyframe to the start of the next one. 0 starts it in the same frame
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void vLedAnimationTask( void *pvParameters );
+int32_t LedAnimPlay(const struct LedKeyframe *frames, uint8_t count);
+int32_t LedAnimSetKey(uint8_t key, uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs);
+int32_t LedAnimFill(uint8_t red, uint8_t green, uint8_t blue, uint16_t fadeMs);
+int32_t LedAnimShowMoves(const uint8_t *keys, uint8_t count, uint16_t speedMs, uint8_t red, uint8_t green, uint8_t blue);
+void LedAnimStop(void);
+bool LedAnimIsIdle(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,389 @@
+/**************************************************************************//**
+* @file      SdLogSink.c
+* @brief     Optional sink that persists the log output to a rotating set of files on the SD card
+* @details   See SdLogSink.h. Also provides the FatFs synchronization hooks (_FS_REENTRANT), since the sink task
+*			 and the WiFi task share the card.
+* @date      2020-04-22
+
+******************************************************************************/
+
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "LoggerThread/SdLogSink.h"
+#include "ff.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+#if SD_LOG_SINK_ENABLED
+uint8_t sinkSector[2][SD_LOG_SINK_SECTOR_SIZE];	///<Double buffer. One sector is filled while the other is written to the card
+uint8_t sinkFillIndex = 0;	///<Sector buffer being filled
+volatile uint16_t sinkFill = 0;	///<Bytes in the sector buffer being filled
+volatile bool sinkBusy = false;	///<True while the other sector buffer belongs to the sink task
+volatile bool sinkFullPending = false;	///<True if the other sector buffer holds a full sector to write
+uint32_t sinkSectorSequence = 0;	///<Incremented each time a full sector is handed to the sink task
+uint16_t sinkFlushedFill = 0;	///<Bytes of the sector being filled that are already on the card
+TaskHandle_t sinkTaskHandle = NULL;	///<Sink task, notified when a full sector is ready
+
+FIL sinkFile;	///<Log file in use
+DWORD sinkOffset = 0;	///<Offset, in the log file, of the sector being filled
+struct SdLogSinkStats sinkStats;	///<Counters reported by SdLogSinkGetStats
+uint32_t sinkWindowBytes = 0;	///<Bytes written to the card in the current one second window
+TickType_t sinkWindowStart = 0;	///<Start of the current one second window
+#endif
+
+/******************************************************************************
+* Forward Declarations
+******************************************************************************/
+#if SD_LOG_SINK_ENABLED
+static bool SdLogSinkHandOverLocked(void);
+static FRESULT SdLogSinkFlush(void);
+static FRESULT SdLogSinkOpenNextFile(void);
+static FRESULT SdLogSinkWriteSector(const uint8_t *sector);
+#endif
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void SdLogSinkWrite(const uint8_t *data, size_t len)
+* @brief	Copies log output into the sector buffer being filled
+* @details	Full sectors are handed to the sink task. If the task still holds the other buffer, the rest
+*			of the data is dropped.
+* @param[in]	data Log output, text or binary records
+* @param[in]	len Number of bytes
+* @note		Safe to call from several tasks. Does nothing unless SD_LOG_SINK_ENABLED
+*****************************************************************************/
+void SdLogSinkWrite(const uint8_t *data, size_t len)
+{
+#if SD_LOG_SINK_ENABLED
+	bool notify = false;
+
+	taskENTER_CRITICAL();
+	sinkStats.bytesLogged += len;
+	while (len > 0)
+	{
+		if (sinkFill == SD_LOG_SINK_SECTOR_SIZE)
+		{
+			if (!SdLogSinkHandOverLocked())
+			{
+				sinkStats.droppedBytes += len;
+				break;
+			}
+			notify = true;
+		}
+
+		size_t chunk = SD_LOG_SINK_SECTOR_SIZE - sinkFill;
+		if (chunk > len) chunk = len;
+		memcpy(&sinkSector[sinkFillIndex][sinkFill], data, chunk);
+		sinkFill += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	taskEXIT_CRITICAL();
+
+	if (notify && sinkTaskHandle != NULL) xTaskNotifyGive(sinkTaskHandle);
+#else
+	(void)data;
+	(void)len;
+#endif
+}
+
+/**************************************************************************//**
+* @fn		void SdLogSinkGetStats(struct SdLogSinkStats *stats)
+* @brief	Copies the statistics of the SD card log sink
+* @param[out]	stats Filled with the counters of the sink. All zero unless SD_LOG_SINK_ENABLED
+* @note
+*****************************************************************************/
+void SdLogSinkGetStats(struct SdLogSinkStats *stats)
+{
+	if (stats == NULL) return;
+#if SD_LOG_SINK_ENABLED
+	taskENTER_CRITICAL();
+	*stats = sinkStats;
+	taskEXIT_CRITICAL();
+#else
+	memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+/******************************************************************************
+* Task Function
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void vSdLogSinkTask( void *pvParameters )
+* @brief	Writes the sectors filled by SdLogSinkWrite to the log file on the SD card
+* @details	Waits for the WiFi task to mount the card, then writes each full sector as soon as it is handed
+*			over, and the partially filled one every SD_LOG_SINK_FLUSH_PERIOD.
+* @param[in]	pvParameters Unused
+* @note		Only created when SD_LOG_SINK_ENABLED
+*****************************************************************************/
+void vSdLogSinkTask( void *pvParameters )
+{
+#if SD_LOG_SINK_ENABLED
+	sinkTaskHandle = xTaskGetCurrentTaskHandle();
+	sinkWindowStart = xTaskGetTickCount();
+
+	for (;;)
+	{
+		if (!sinkStats.fileOpen && SdLogSinkOpenNextFile() != FR_OK)
+		{
+			vTaskDelay(SD_LOG_SINK_RETRY_DELAY); //Card not mounted yet
+			continue;
+		}
+
+		if (!sinkFullPending) ulTaskNotifyTake(pdTRUE, SD_LOG_SINK_FLUSH_PERIOD); //Woken up early by a full sector
+
+		if (SdLogSinkFlush() != FR_OK)
+		{
+			sinkStats.writeErrors++;
+			f_close(&sinkFile);
+			sinkStats.fileOpen = false;
+		}
+		else if (sinkOffset >= SD_LOG_SINK_FILE_SIZE)
+		{
+			f_close(&sinkFile); //Full: the next one is opened on the next pass
+			sinkStats.fileOpen = false;
+		}
+
+		if (xTaskGetTickCount() - sinkWindowStart >= pdMS_TO_TICKS(1000))
+		{
+			sinkStats.bytesPerSecond = sinkWindowBytes;
+			sinkWindowBytes = 0;
+			sinkWindowStart = xTaskGetTickCount();
+		}
+	}
+#else
+	vTaskDelete(NULL);
+#endif
+}
+
+/******************************************************************************
+* FatFs synchronization hooks (_FS_REENTRANT)
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+* @brief	Returns the mutex FatFs takes around every access to a volume. Called by f_mount
+* @details	All volumes share one mutex, created on the first mount. They all sit on the same SPI bus anyway
+* @return	Returns 1 on success, 0 if there is no heap left for the mutex
+*****************************************************************************/
+int ff_cre_syncobj(BYTE vol, _SYNC_t *sobj)
+{
+	static SemaphoreHandle_t fatFsMutex = NULL;
+
+	(void)vol;
+	if (fatFsMutex == NULL) fatFsMutex = xSemaphoreCreateMutex();
+	*sobj = fatFsMutex;
+	return (fatFsMutex != NULL);
+}
+
+/**************************************************************************//**
+* @fn		int ff_del_syncobj(_SYNC_t sobj)
+* @brief	Called by f_mount when a volume is unmounted or remounted
+* @details	Keeps the mutex for the next mount: heap_1 cannot free memory
+* @return	Returns 1
+*****************************************************************************/
+int ff_del_syncobj(_SYNC_t sobj)
+{
+	(void)sobj;
+	return 1;
+}
+
+/**************************************************************************//**
+* @fn		int ff_req_grant(_SYNC_t sobj)
+* @brief	Takes the mutex of a volume, waiting up to _FS_TIMEOUT ticks
+* @return	Returns 1 if the mutex was taken, 0 on timeout (the FatFs call fails with FR_TIMEOUT)
+*****************************************************************************/
+int ff_req_grant(_SYNC_t sobj)
+{
+	return (xSemaphoreTake(sobj, _FS_TIMEOUT) == pdTRUE);
+}
+
+/**************************************************************************//**
+* @fn		void ff_rel_grant(_SYNC_t sobj)
+* @brief	Gives back the mutex of a volume
+*****************************************************************************/
+void ff_rel_grant(_SYNC_t sobj)
+{
+	xSemaphoreGive(sobj);
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+#if SD_LOG_SINK_ENABLED
+
+/**************************************************************************//**
+* @fn		static bool SdLogSinkHandOverLocked(void)
+* @brief	Hands the full sector being filled to the sink task and starts filling the other buffer
+* @return	Returns false if the sink task still holds the other buffer
+* @note		Call inside a critical section
+*****************************************************************************/
+static bool SdLogSinkHandOverLocked(void)
+{
+	if (sinkBusy || sinkFullPending) return false;
+
+	sinkFillIndex ^= 1;
+	sinkFill = 0;
+	sinkFlushedFill = 0;
+	sinkFullPending = true;
+	sinkSectorSequence++;
+	return true;
+}
+
+/**************************************************************************//**
+* @fn		static FRESULT SdLogSinkFlush(void)
+* @brief	Writes the full sector handed over by SdLogSinkWrite, or else the new data of the sector being filled
+* @details	A full sector advances sinkOffset. A partial one is padded with '\0' and written at sinkOffset,
+*			where it is rewritten until the sector is full.
+* @return	Returns FR_OK on success or if there was nothing to write, or the FatFs error
+* @note
+*****************************************************************************/
+static FRESULT SdLogSinkFlush(void)
+{
+	uint8_t *sector;
+	uint32_t sequence;
+	uint16_t partialFill = 0;
+	bool full;
+	FRESULT res = FR_OK;
+
+	taskENTER_CRITICAL();
+	sector = sinkSector[sinkFillIndex ^ 1];
+	full = sinkFullPending;
+	sequence = sinkSectorSequence;
+	if (!full && sinkFill > sinkFlushedFill)
+	{
+		//Snapshot of the sector being filled, so SdLogSinkWrite can keep appending to it
+		partialFill = sinkFill;
+		memcpy(sector, sinkSector[sinkFillIndex], partialFill);
+		sinkBusy = true;
+	}
+	taskEXIT_CRITICAL();
+
+	if (!full && partialFill == 0) goto exit;
+
+	if (!full)
+	{
+		memset(sector + partialFill, 0, SD_LOG_SINK_SECTOR_SIZE - partialFill);
+	}
+	res = SdLogSinkWriteSector(sector);
+
+	taskENTER_CRITICAL();
+	if (full)
+	{
+		sinkFullPending = false;
+	}
+	else if (res == FR_OK && sequence == sinkSectorSequence)
+	{
+		sinkFlushedFill = partialFill;
+	}
+	sinkBusy = false;
+	if (sinkFill == SD_LOG_SINK_SECTOR_SIZE) SdLogSinkHandOverLocked(); //Filled up while the other buffer was busy
+	taskEXIT_CRITICAL();
+
+	if (full) sinkOffset += SD_LOG_SINK_SECTOR_SIZE;
+
+exit:
+	return res;
+}
+
+/**************************************************************************//**
+* @fn		static FRESULT SdLogSinkOpenNextFile(void)
+* @brief	Opens the next log file, preallocating it the first time, and records its index on the card
+* @details	The first call after boot continues from the index stored in SD_LOG_SINK_INDEX_FILE, so the log
+*			of the previous boot is kept.
+* @return	Returns FR_OK on success, or the FatFs error. FR_NOT_ENABLED while the card is not mounted
+* @note
+*****************************************************************************/
+static FRESULT SdLogSinkOpenNextFile(void)
+{
+	static bool indexLoaded = false;
+	char name[16];
+	char index = '0';
+	UINT count;
+	FRESULT res;
+
+	if (!indexLoaded)
+	{
+		//Continue after the file the previous boot was writing
+		res = f_open(&sinkFile, SD_LOG_SINK_INDEX_FILE, FA_OPEN_EXISTING | FA_READ);
+		if (res == FR_OK)
+		{
+			if (f_read(&sinkFile, &index, 1, &count) == FR_OK && count == 1 && index >= '0' && index <= '9')
+			{
+				sinkStats.fileIndex = index - '0';
+			}
+			f_close(&sinkFile);
+		}
+		else if (res != FR_NO_FILE)
+		{
+			goto exit;
+		}
+		indexLoaded = true;
+	}
+	sinkStats.fileIndex = (sinkStats.fileIndex + 1) % SD_LOG_SINK_FILE_COUNT;
+
+	index = '0' + sinkStats.fileIndex;
+	res = f_open(&sinkFile, SD_LOG_SINK_INDEX_FILE, FA_CREATE_ALWAYS | FA_WRITE);
+	if (res != FR_OK) goto exit;
+	res = f_write(&sinkFile, &index, 1, &count);
+	f_close(&sinkFile);
+	if (res != FR_OK) goto exit;
+
+	snprintf(name, sizeof(name), SD_LOG_SINK_FILE_NAME, sinkStats.fileIndex);
+	res = f_open(&sinkFile, name, FA_OPEN_ALWAYS | FA_WRITE);
+	if (res != FR_OK) goto exit;
+
+	if (sinkFile.fsize < SD_LOG_SINK_FILE_SIZE)
+	{
+		//Seeking past the end allocates the cluster chain once, so sector writes never touch the FAT
+		res = f_lseek(&sinkFile, SD_LOG_SINK_FILE_SIZE);
+		if (res == FR_OK && sinkFile.fsize < SD_LOG_SINK_FILE_SIZE) res = FR_DENIED; //Card full
+		if (res == FR_OK) res = f_sync(&sinkFile);
+		if (res != FR_OK)
+		{
+			f_close(&sinkFile);
+			goto exit;
+		}
+	}
+
+	sinkOffset = 0;
+	sinkStats.fileOpen = true;
+
+exit:
+	return res;
+}
+
+/**************************************************************************//**
+* @fn		static FRESULT SdLogSinkWriteSector(const uint8_t *sector)
+* @brief	Writes a sector buffer at sinkOffset of the log file and updates the flush statistics
+* @param[in]	sector SD_LOG_SINK_SECTOR_SIZE bytes to write
+* @return	Returns FR_OK on success, or the FatFs error
+* @note
+*****************************************************************************/
+static FRESULT SdLogSinkWriteSector(const uint8_t *sector)
+{
+	TickType_t start = xTaskGetTickCount();
+	UINT written = 0;
+
+	FRESULT res = f_lseek(&sinkFile, sinkOffset);
+	if (res == FR_OK) res = f_write(&sinkFile, sector, SD_LOG_SINK_SECTOR_SIZE, &written);
+	if (res == FR_OK && written != SD_LOG_SINK_SECTOR_SIZE) res = FR_DENIED;
+
+	uint16_t elapsed = (uint16_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS);
+	taskENTER_CRITICAL();
+	sinkStats.sectorsWritten++;
+	sinkStats.lastFlushMs = elapsed;
+	if (elapsed > sinkStats.maxFlushMs) sinkStats.maxFlushMs = elapsed;
+	taskEXIT_CRITICAL();
+	sinkWindowBytes += written;
+
+	return res;
+}
+
+#endif
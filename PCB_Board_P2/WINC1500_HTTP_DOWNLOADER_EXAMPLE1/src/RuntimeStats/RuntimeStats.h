@@ -0,0 +1,55 @@
+/**************************************************************************//**
+* @file      RuntimeStats.h
+* @brief     Run time counter for the FreeRTOS task statistics (configGENERATE_RUN_TIME_STATS) and per task CPU usage
+* @details   The counter is TC3 running from GCLK0 (48 MHz) divided by 64: 750 kHz, 1.33 us per count. The 16-bit
+*			 hardware count is extended to 32 bits by the overflow interrupt, so it wraps after about 95 minutes.
+*			 CPU usage is always computed between two samples, which makes it immune to that wrap.
+*			 The same counter times the "bench" CLI benchmarks, so their results stay comparable.
+* @date      2020-04-24
+
+******************************************************************************/
+
+#ifndef RUNTIME_STATS_H
+#define RUNTIME_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <asf.h>
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define RUNTIME_STATS_TC			TC3	///<Timer counter clocking the run time statistics. TCC0 belongs to the IoT sw_timer
+#define RUNTIME_STATS_TC_PRESCALER	TC_CLOCK_PRESCALER_DIV64	///<750 kHz from the 48 MHz GCLK0
+#define RUNTIME_STATS_PRESCALER_DIV	64	///<Division factor of RUNTIME_STATS_TC_PRESCALER
+#define RUNTIME_STATS_MAX_TASKS		12	///<Max number of tasks reported by RuntimeStatsSample
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///CPU usage of a task between two calls to RuntimeStatsSample
+struct RuntimeTaskUsage {
+	char name[configMAX_TASK_NAME_LEN];	///<Name of the task
+	eTaskState state;	///<State of the task when sampled
+	UBaseType_t priority;	///<Current priority of the task
+	uint16_t stackFree;	///<Lowest amount of free stack the task ever had. In words
+	uint16_t cpuPermille;	///<Share of the CPU the task used since the previous sample. In 0.1 %
+};
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+//RuntimeStatsConfigureTimer and RuntimeStatsGetCounter are declared in FreeRTOSConfig.h, for the kernel
+uint32_t RuntimeStatsCountsToUs(uint32_t counts);
+UBaseType_t RuntimeStatsSample(struct RuntimeTaskUsage *usage, UBaseType_t maxTasks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*RUNTIME_STATS_H*/
@@ -20,6 +20,7 @@
 #define NEO_TRELLIS_NUM_ROWS 4
 #define NEO_TRELLIS_NUM_COLS 4
 #define NEO_TRELLIS_NUM_KEYS (NEO_TRELLIS_NUM_ROWS * NEO_TRELLIS_NUM_COLS)
+#define NEO_TRELLIS_FRAME_BYTES (NEO_TRELLIS_NUM_KEYS * 3) ///<Bytes of the Neopixel buffer of the pad: one GRB triplet per key
 
 #define NEO_TRELLIS_MAX_CALLBACKS 32
 
@@ -103,6 +104,11 @@
 
 
 #define SEESAW_HW_ID_CODE 0x55 ///< seesaw HW ID code
+///Ticks between a register write and its read. The Seesaw needs ~125 us, and ~1 ms before a keypad FIFO read.
+///A delay of n ticks can end right after the n-1 th tick boundary: 2 ticks make at least 1 ms
+#define SEESAW_READ_DELAY 2
+#define SEESAW_KEYPAD_FIFO_EMPTY 0xFF ///<Value of the FIFO bytes read past the last keypad event
+#define SEESAW_NEOPIXEL_MAX_WRITE 28 ///<Max pixel bytes per SEESAW_NEOPIXEL_BUF write. The seesaw receives at most 32 bytes, 4 go to the header and offset
 
 enum {
   SEESAW_STATUS_BASE = 0x00,
@@ -269,6 +275,10 @@ union keyState {
 int InitializeSeesaw(void);
 uint8_t SeesawGetKeypadCount(void);
 int32_t SeesawReadKeypad(uint8_t *buffer, uint8_t count);
+int32_t SeesawReadKeypadFifo(uint8_t *buffer, uint8_t size);
 int32_t SeesawSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue);
 int32_t SeesawOrderLedUpdate(void);
+void SeesawFrameSetLed(uint8_t key, uint8_t red, uint8_t green, uint8_t blue);
+void SeesawFrameFill(uint8_t red, uint8_t green, uint8_t blue);
+int32_t SeesawFrameFlush(void);
 #endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**************************************************************************//**
+* @file      SensorScheduler.h
+* @brief     Fixed cadence sampling of every sensor of the board
+* @details   The sensor task runs a table of sources, each with a period and a deadline. It sleeps until the next
+*			 release (vTaskDelayUntil, no drift), then runs every source due within SENSOR_MERGE_TICKS, earliest deadline
+*			 first, so their bus transactions go back to back. Each source publishes its samples into its own ring.
+*			 Consumers read the rings with their own cursor, without locking and without touching the sensors.
+*			 Sources with no period (the keypad) are published by their own interrupt driven task.
+* @date      2020-05-02
+
+******************************************************************************/
+
+#pragma once
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "asf.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SENSOR_TASK_SIZE			160	///<Size of stack to assign to the sensor thread. In words
+#define SENSOR_TASK_PRIORITY		(configMAX_PRIORITIES - 2)	///<Below the bus and keypad threads, above the UI
+
+#define SENSOR_MERGE_TICKS			2	///<Sources due within this many ticks of the first one run in the same pass
+#define SENSOR_RING_SAMPLES			8	///<Samples kept per source, except the IMU (IMU_RING_SAMPLES). Power of 2
+
+#define SENSOR_SHTC3_PERIOD_MS		1000	///<Temperature and humidity
+#define SENSOR_SHTC3_DEADLINE_MS	30	///<Wake-up, normal mode conversion (12.1 ms) and sleep, with other traffic on the bus
+#define SENSOR_DISTANCE_PERIOD_MS	100	///<US-100 distance. The sensor streams on its own: this is the publication rate
+#define SENSOR_DISTANCE_DEADLINE_MS	2	///<Stall check and copy of the latest filtered distance
+#define SENSOR_THUMBSTICK_PERIOD_MS	20	///<Thumbstick X and Y
+#define SENSOR_THUMBSTICK_DEADLINE_MS	5	///<Two ADC conversions
+#define SENSOR_IMU_DEADLINE_MS		10	///<FIFO status and burst read. The period follows the output data rate
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Sensor sources, in the order of the source table
+enum eSensorSource {
+	SENSOR_IMU = 0,	///<Accelerometer: raw X, Y, Z at +/-2 g (lsm6ds3_from_fs2g_to_mg_int)
+	SENSOR_SHTC3,	///<Temperature (hundredths of degree C), relative humidity (hundredths of %)
+	SENSOR_DISTANCE,	///<Filtered distance, latest raw reading. In mm
+	SENSOR_THUMBSTICK,	///<Raw 12-bit X, Y
+	SENSOR_KEYPAD,	///<Key number, SEESAW_KEYPAD_EDGE_RISING or SEESAW_KEYPAD_EDGE_FALLING
+	N_SENSOR_SOURCES	///<Number of sources
+};
+
+///A sample of any source. See eSensorSource for the meaning of the values
+struct SensorSample {
+	TickType_t timestamp;	///<Tick count (ms) the sample was taken at
+	int16_t value[3];	///<Values, unused ones are 0
+};
+
+///Read cursor of a consumer of a source
+struct SensorReader {
+	enum eSensorSource source;	///<Source read
+	uint32_t next;	///<Index of the next sample to read
+	uint32_t dropped;	///<Samples overwritten before this consumer read them
+};
+
+///Timing statistics of a source
+struct SensorStats {
+	uint32_t runs;	///<Reads started
+	uint32_t samples;	///<Samples published
+	uint32_t errors;	///<Reads that failed
+	uint32_t overruns;	///<Reads that ended after their deadline
+	uint32_t skipped;	///<Releases dropped: the previous read was still running, or the task was a whole period late
+	uint16_t lastJitterMs;	///<Delay between the release and the start of the last read
+	uint16_t maxJitterMs;	///<Largest delay between a release and the start of its read
+	uint16_t periodMs;	///<Current period. 0 for a source published by its own task
+	bool enabled;	///<False if the sensor did not answer at startup
+};
+
+/******************************************************************************
+* Global Function Declaration
+******************************************************************************/
+void vSensorSchedulerTask( void *pvParameters );
+void SensorPublish(enum eSensorSource source, const struct SensorSample *sample);
+void SensorSourceDone(enum eSensorSource source, int32_t error);
+void SensorReaderInit(struct SensorReader *reader, enum eSensorSource source);
+uint16_t SensorRead(struct SensorReader *reader, struct SensorSample *samples, uint16_t maxSamples);
+int32_t SensorGetLatest(enum eSensorSource source, struct SensorSample *sample);
+void SensorGetStats(enum eSensorSource source, struct SensorStats *stats);
+const char *SensorGetName(enum eSensorSource source);
+void SensorResetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
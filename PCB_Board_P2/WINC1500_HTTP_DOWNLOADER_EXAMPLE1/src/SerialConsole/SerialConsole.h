@@ -38,7 +38,40 @@ extern "C" {
 /******************************************************************************
 * Defines
 ******************************************************************************/
+#define SERIAL_CONSOLE_TX_DMA	1	///<Set to 1 to send the TX ring through a DMA channel, 0 to use the USART interrupt driver
+#define SERIAL_CONSOLE_TX_DMA_TRIGGER	SERCOM4_DMAC_ID_TX	///<DMA trigger of the console SERCOM (EDBG_CDC_MODULE)
+#define SERIAL_CONSOLE_TRACE_LOCK	0	///<Set to 1 to record, as a trace user event, the CPU cycles each write holds the TX critical section
+#define SERIAL_CONSOLE_TX_POLICY	SERIAL_OVERFLOW_DROP_NEWEST	///<What the TX ring does when a write does not fit. See eSerialOverflowPolicy
+#define SERIAL_CONSOLE_TX_TIMEOUT	10	///<Max time, in ms, a write waits for room with SERIAL_OVERFLOW_BLOCK
+#define SERIAL_CONSOLE_RX_POLICY	SERIAL_OVERFLOW_DROP_NEWEST	///<What the RX ring does when a character does not fit
+#define SERIAL_CONSOLE_DROP_SCAN	128	///<Max bytes of the TX ring scanned for the end of a line with the interrupts masked. A LogMessage line (formatted in the 128-byte debugBuffer) fits in one scan
 
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL	LOG_WARNING_LVL	///<Release build: INFO and DEBUG log macros compile to nothing
+#else
+#define LOG_COMPILE_LEVEL	LOG_INFO_LVL	///<Lowest level the log macros compile in. Calls below it are removed, argument evaluation included
+#endif
+#endif
+
+///True if a message of the given level would be printed. Constant-folds to false below LOG_COMPILE_LEVEL
+#define LOG_ENABLED(level)	((level) >= LOG_COMPILE_LEVEL && getLogLevel() <= (level))
+
+///Logs a message. Arguments are only evaluated if the level passes the build-time and run-time thresholds
+#define LOG_AT(level, ...)	do { if (LOG_ENABLED(level)) LogMessage((level), __VA_ARGS__); } while (0)
+#define LOG_INFO(...)		LOG_AT(LOG_INFO_LVL, __VA_ARGS__)
+#define LOG_DEBUG(...)		LOG_AT(LOG_DEBUG_LVL, __VA_ARGS__)
+#define LOG_WARNING(...)	LOG_AT(LOG_WARNING_LVL, __VA_ARGS__)
+#define LOG_ERROR(...)		LOG_AT(LOG_ERROR_LVL, __VA_ARGS__)
+#define LOG_FATAL(...)		LOG_AT(LOG_FATAL_LVL, __VA_ARGS__)
+
+///Logs at most perSecond messages per second from this call site. The number of messages dropped is reported
+///before the next message the call site gets to print
+#define LOG_RATELIMITED(level, perSecond, ...)	do { \
+	static struct LogRateLimit logRateLimit; \
+	if (LOG_ENABLED(level) && LogRateLimitAllow(&logRateLimit, (perSecond), (level))) LogMessage((level), __VA_ARGS__); \
+} while (0)
+#define LOG_DEBUG_RATELIMITED(perSecond, ...)	LOG_RATELIMITED(LOG_DEBUG_LVL, (perSecond), __VA_ARGS__)
 
 /******************************************************************************
 * Structures and Enumerations
@@ -53,6 +86,49 @@ enum eDebugLogLevels {
 	N_DEBUG_LEVELS = 6	//Max number of log levels
 };
 
+///Statistics of the console transmit path. Each transfer job sends one contiguous span of the TX ring
+struct SerialConsoleTxStats {
+	uint32_t bytesSent;	///<Total number of bytes sent to the UART
+	uint32_t txInterrupts;	///<Number of transfer complete interrupts (one per span sent)
+	uint16_t lastSpan;	///<Size, in bytes, of the last span sent
+	uint16_t maxSpan;	///<Largest span sent in a single transfer job
+	uint32_t lastLockCycles;	///<CPU cycles the last SerialConsoleWriteString spent with interrupts masked
+	uint32_t maxLockCycles;	///<Longest time, in CPU cycles, a SerialConsoleWriteString spent with interrupts masked
+};
+
+///What a console ring does with data that does not fit
+enum eSerialOverflowPolicy {
+	SERIAL_OVERFLOW_DROP_NEWEST = 0,	//Drops the data being written. Never waits
+	SERIAL_OVERFLOW_DROP_OLDEST_LINE = 1,	//Discards the oldest whole lines not yet sent until the data fits
+	SERIAL_OVERFLOW_BLOCK = 2,	//Waits up to the timeout for room, then drops the newest data. Same as DROP_NEWEST from an interrupt
+	N_SERIAL_OVERFLOW_POLICIES = 3	//Max number of policies
+};
+
+///Console rings
+enum eSerialRing {
+	SERIAL_RING_TX = 0,	//Characters to send to the terminal
+	SERIAL_RING_RX = 1,	//Characters received from the terminal
+	N_SERIAL_RINGS = 2	//Max number of rings
+};
+
+///Overflow statistics of a console ring
+struct SerialConsoleRingStats {
+	uint32_t droppedBytes;	///<Bytes lost, new ones rejected and old ones discarded
+	uint32_t overflows;	///<Number of writes that did not fit when they were made
+	uint32_t stalls;	///<Number of writes that had to wait for room (SERIAL_OVERFLOW_BLOCK)
+	uint16_t highWater;	///<Max number of bytes the ring held
+	uint16_t size;	///<Number of bytes the ring holds now
+	uint16_t capacity;	///<Size of the ring
+	uint8_t policy;	///<enum eSerialOverflowPolicy of the ring
+};
+
+///State of a rate-limited log call site. See LOG_RATELIMITED
+struct LogRateLimit {
+	TickType_t windowStart;	///<Start of the current one second window
+	uint16_t count;	///<Messages printed in the current window
+	uint16_t suppressed;	///<Messages dropped since the last one printed
+};
+
 
 
 /******************************************************************************
@@ -61,12 +137,20 @@ enum eDebugLogLevels {
 void InitializeSerialConsole(void);
 void DeinitializeSerialConsole(void);
 void SerialConsoleWriteString(const char * string);
+void SerialConsoleWriteBuffer(const uint8_t * data, size_t len);
 int SerialConsoleReadCharacter(uint8_t *rxChar);
-void LogMessage(enum eDebugLogLevels level, const char *format, ...);
+void SerialConsoleSetRxNotifyTask(TaskHandle_t task);
+void LogMessage(enum eDebugLogLevels level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void LogMessageV(enum eDebugLogLevels level, const char *format, va_list ap) __attribute__((format(printf, 2, 0)));
+bool LogRateLimitAllow(struct LogRateLimit *limit, uint16_t perSecond, enum eDebugLogLevels level);
+uint32_t LogGetSuppressedCount(void);
 void setLogLevel(enum eDebugLogLevels debugLevel);
 enum eDebugLogLevels getLogLevel(void);
 struct usart_module* GetUsartModule(void);
-void LogMessageDebug(const char *format, ...);
+void LogMessageDebug(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void SerialConsoleGetTxStats(struct SerialConsoleTxStats *stats);
+void SerialConsoleSetOverflowPolicy(enum eSerialRing ring, enum eSerialOverflowPolicy policy, TickType_t timeout);
+void SerialConsoleGetRingStats(enum eSerialRing ring, struct SerialConsoleRingStats *stats);
 
 /******************************************************************************
 * Local Functions
@@ -6,6 +6,10 @@
 *				Author: Phillips Johnston
 * @details     Please refer to the github code above and to "https://embeddedartistry.com/blog/2017/4/6/circular-buffers-in-cc" for more information
 *
+*				head and tail run over twice the capacity instead of using a 'full' flag, so the producer only writes head
+*				and the consumer only writes tail. With one producer and one consumer (e.g. a task and an ISR) the
+*				buffer needs no lock. The overwriting put functions move tail and are not safe in that case.
+*
 *				See "https://github.com/embeddedartistry/embedded-resources/blob/master/examples/c/circular_buffer_test.c" for examples on how to use the buffer
 *
 * @copyright
@@ -20,6 +24,7 @@
  #include <stddef.h>
  #include <stdbool.h>
  #include <assert.h>
+ #include <string.h>
 
  #include "circular_buffer.h"
 
@@ -27,35 +32,51 @@
  // The definition of our circular buffer structure is hidden from the user
  struct circular_buf_t {
 	 uint8_t * buffer;
-	 size_t head;
-	 size_t tail;
+	 volatile size_t head; // Written by the producer only. Runs over [0, 2 * max)
+	 volatile size_t tail; // Written by the consumer only. Runs over [0, 2 * max)
 	 size_t max; //of the buffer
-	 bool full;
  };
 
+ // Data must be in memory before the index that publishes it is stored
+ #define publish_barrier()	__sync_synchronize()
+
  #pragma mark - Private Functions -
 
- static void advance_pointer(cbuf_handle_t cbuf)
+ // Move a head or tail index forward by len <= max elements
+ static size_t advance_index(cbuf_handle_t cbuf, size_t index, size_t len)
  {
-	 //assert(cbuf);
+	 index += len;
 
-	 if(cbuf->full)
+	 if(index >= 2 * cbuf->max)
 	 {
-		 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+		 index -= 2 * cbuf->max;
 	 }
 
-	 cbuf->head = (cbuf->head + 1) % cbuf->max;
+	 return index;
+ }
 
-	 // We mark full because we will advance tail on the next time around
-	 cbuf->full = (cbuf->head == cbuf->tail);
+ // Position in the storage buffer of a head or tail index
+ static size_t buffer_offset(cbuf_handle_t cbuf, size_t index)
+ {
+	 return (index < cbuf->max) ? index : (index - cbuf->max);
  }
 
- static void retreat_pointer(cbuf_handle_t cbuf)
+ // Copy len elements at head, splitting the copy in two when the range wraps around the end of the storage
+ static void copy_in(cbuf_handle_t cbuf, const uint8_t * data, size_t len)
  {
-	 //assert(cbuf);
+	 size_t offset = buffer_offset(cbuf, cbuf->head);
+	 size_t first = cbuf->max - offset;
 
-	 cbuf->full = false;
-	 cbuf->tail = (cbuf->tail + 1) % cbuf->max;
+	 if(first > len)
+	 {
+		 first = len;
+	 }
+
+	 memcpy(&cbuf->buffer[offset], data, first);
+	 memcpy(cbuf->buffer, &data[first], len - first);
+
+	 publish_barrier();
+	 cbuf->head = advance_index(cbuf, cbuf->head, len);
  }
 
  #pragma mark - APIs -
@@ -88,26 +109,23 @@
 
 	 cbuf->head = 0;
 	 cbuf->tail = 0;
-	 cbuf->full = false;
  }
 
  size_t circular_buf_size(cbuf_handle_t cbuf)
  {
 	// assert(cbuf);
 
-	 size_t size = cbuf->max;
+	 size_t head = cbuf->head;
+	 size_t tail = cbuf->tail;
+	 size_t size;
 
-	 if(!cbuf->full)
+	 if(head >= tail)
 	 {
-		 if(cbuf->head >= cbuf->tail)
-		 {
-			 size = (cbuf->head - cbuf->tail);
-		 }
-		 else
-		 {
-			 size = (cbuf->max + cbuf->head - cbuf->tail);
-		 }
-
+		 size = (head - tail);
+	 }
+	 else
+	 {
+		 size = (2 * cbuf->max + head - tail);
 	 }
 
 	 return size;
@@ -124,9 +142,14 @@
  {
 	 //assert(cbuf && cbuf->buffer);
 
-	 cbuf->buffer[cbuf->head] = data;
+	 if(circular_buf_full(cbuf))
+	 {
+		 cbuf->tail = advance_index(cbuf, cbuf->tail, 1);
+	 }
 
-	 advance_pointer(cbuf);
+	 cbuf->buffer[buffer_offset(cbuf, cbuf->head)] = data;
+	 publish_barrier();
+	 cbuf->head = advance_index(cbuf, cbuf->head, 1);
  }
 
  int circular_buf_put2(cbuf_handle_t cbuf, uint8_t data)
@@ -137,8 +160,9 @@
 
 	 if(!circular_buf_full(cbuf))
 	 {
-		 cbuf->buffer[cbuf->head] = data;
-		 advance_pointer(cbuf);
+		 cbuf->buffer[buffer_offset(cbuf, cbuf->head)] = data;
+		 publish_barrier();
+		 cbuf->head = advance_index(cbuf, cbuf->head, 1);
 		 r = 0;
 	 }
 
@@ -153,25 +177,160 @@
 
 	 if(!circular_buf_empty(cbuf))
 	 {
-		 *data = cbuf->buffer[cbuf->tail];
-		 retreat_pointer(cbuf);
+		 *data = cbuf->buffer[buffer_offset(cbuf, cbuf->tail)];
+		 publish_barrier();
+		 cbuf->tail = advance_index(cbuf, cbuf->tail, 1);
+
+		 r = 0;
+	 }
+
+	 return r;
+ }
+
+ void circular_buf_put_range(cbuf_handle_t cbuf, const uint8_t * data, size_t len)
+ {
+	 //assert(cbuf && data && cbuf->buffer);
+
+	 if(len > cbuf->max)
+	 {
+		 // Only the newest elements survive anyway
+		 data += len - cbuf->max;
+		 len = cbuf->max;
+	 }
+
+	 size_t free_space = cbuf->max - circular_buf_size(cbuf);
 
+	 if(len > free_space)
+	 {
+		 // Drop the oldest elements to make room
+		 cbuf->tail = advance_index(cbuf, cbuf->tail, len - free_space);
+	 }
+
+	 if(len > 0)
+	 {
+		 copy_in(cbuf, data, len);
+	 }
+ }
+
+ int circular_buf_put2_range(cbuf_handle_t cbuf, const uint8_t * data, size_t len)
+ {
+	 int r = -1;
+
+	 //assert(cbuf && data && cbuf->buffer);
+
+	 if(len <= cbuf->max - circular_buf_size(cbuf))
+	 {
+		 if(len > 0)
+		 {
+			 copy_in(cbuf, data, len);
+		 }
 		 r = 0;
 	 }
 
 	 return r;
  }
 
+ size_t circular_buf_get_range(cbuf_handle_t cbuf, uint8_t * data, size_t len)
+ {
+	 //assert(cbuf && data && cbuf->buffer);
+
+	 size_t count = circular_buf_size(cbuf);
+
+	 if(count > len)
+	 {
+		 count = len;
+	 }
+
+	 size_t offset = buffer_offset(cbuf, cbuf->tail);
+	 size_t first = cbuf->max - offset;
+
+	 if(first > count)
+	 {
+		 first = count;
+	 }
+
+	 memcpy(data, &cbuf->buffer[offset], first);
+	 memcpy(&data[first], cbuf->buffer, count - first);
+
+	 circular_buf_consume(cbuf, count);
+
+	 return count;
+ }
+
  bool circular_buf_empty(cbuf_handle_t cbuf)
  {
 	 //assert(cbuf);
 
-	 return (!cbuf->full && (cbuf->head == cbuf->tail));
+	 return (cbuf->head == cbuf->tail);
  }
 
  bool circular_buf_full(cbuf_handle_t cbuf)
  {
 	// assert(cbuf);
 
-	 return cbuf->full;
- }
\ No newline at end of file
+	 return (circular_buf_size(cbuf) == cbuf->max);
+ }
+
+ size_t circular_buf_peek_span(cbuf_handle_t cbuf, uint8_t **data)
+ {
+	 //assert(cbuf && data && cbuf->buffer);
+
+	 size_t span = circular_buf_size(cbuf);
+
+	 if(span > 0)
+	 {
+		 size_t offset = buffer_offset(cbuf, cbuf->tail);
+
+		 *data = &cbuf->buffer[offset];
+
+		 if(span > cbuf->max - offset)
+		 {
+			 span = cbuf->max - offset; //Data wraps around: stop at the end of the storage
+		 }
+	 }
+
+	 return span;
+ }
+
+ void circular_buf_consume(cbuf_handle_t cbuf, size_t len)
+ {
+	 //assert(cbuf && len <= circular_buf_size(cbuf));
+
+	 if(len > 0)
+	 {
+		 publish_barrier();
+		 cbuf->tail = advance_index(cbuf, cbuf->tail, len);
+	 }
+ }
+
+ size_t circular_buf_drop_line(cbuf_handle_t cbuf, size_t max, bool * line_end)
+ {
+	 //assert(cbuf && cbuf->buffer);
+
+	 size_t size = circular_buf_size(cbuf);
+	 size_t offset = buffer_offset(cbuf, cbuf->tail);
+	 size_t count = 0;
+	 bool found = false;
+
+	 if(size > max)
+	 {
+		 size = max;
+	 }
+
+	 while(count < size && !found)
+	 {
+		 found = (cbuf->buffer[offset] == '\n');
+
+		 count++;
+		 offset = (offset + 1 == cbuf->max) ? 0 : (offset + 1);
+	 }
+
+	 circular_buf_consume(cbuf, count);
+
+	 if(line_end)
+	 {
+		 *line_end = found;
+	 }
+
+	 return count;
+ }
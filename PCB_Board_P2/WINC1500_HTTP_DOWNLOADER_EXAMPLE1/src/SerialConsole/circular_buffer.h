@@ -18,6 +18,7 @@
 #define CIRCULAR_BUFFER_H_
 
 /// Opaque circular buffer structure
+/// Safe without locks for one producer (put2, put2_range) and one consumer (get, get_range, peek_span, consume)
 typedef struct circular_buf_t circular_buf_t;
 
 /// Handle type, the way users interact with the API
@@ -38,7 +39,7 @@ void circular_buf_free(cbuf_handle_t cbuf);
 void circular_buf_reset(cbuf_handle_t cbuf);
 
 /// Put version 1 continues to add data if the buffer is full
-/// Old data is overwritten
+/// Old data is overwritten. Moves tail, so it is not lock-free against a concurrent consumer
 /// Requires: cbuf is valid and created by circular_buf_init
 void circular_buf_put(cbuf_handle_t cbuf, uint8_t data);
 
@@ -52,6 +53,22 @@ int circular_buf_put2(cbuf_handle_t cbuf, uint8_t data);
 /// Returns 0 on success, -1 if the buffer is empty
 int circular_buf_get(cbuf_handle_t cbuf, uint8_t * data);
 
+/// Put version 1 of a range of data. Continues to add data if the buffer is full
+/// Old data is overwritten. If len is larger than the capacity only the last elements are kept
+/// Moves tail, so it is not lock-free against a concurrent consumer
+/// Requires: cbuf is valid and created by circular_buf_init, data is not NULL
+void circular_buf_put_range(cbuf_handle_t cbuf, const uint8_t * data, size_t len);
+
+/// Put version 2 of a range of data. Rejects the whole range if it does not fit in the free space
+/// Requires: cbuf is valid and created by circular_buf_init, data is not NULL
+/// Returns 0 on success, -1 if there is not enough room for len elements
+int circular_buf_put2_range(cbuf_handle_t cbuf, const uint8_t * data, size_t len);
+
+/// Retrieve up to len values from the buffer
+/// Requires: cbuf is valid and created by circular_buf_init, data is not NULL
+/// Returns the number of elements copied into data, 0 if the buffer is empty
+size_t circular_buf_get_range(cbuf_handle_t cbuf, uint8_t * data, size_t len);
+
 /// CHecks if the buffer is empty
 /// Requires: cbuf is valid and created by circular_buf_init
 /// Returns true if the buffer is empty
@@ -72,7 +89,19 @@ size_t circular_buf_capacity(cbuf_handle_t cbuf);
 /// Returns the current number of elements in the buffer
 size_t circular_buf_size(cbuf_handle_t cbuf);
 
-//TODO: int circular_buf_get_range(circular_buf_t cbuf, uint8_t *data, size_t len);
-//TODO: int circular_buf_put_range(circular_buf_t cbuf, uint8_t * data, size_t len);
+/// Get a pointer to the oldest element and the number of elements stored contiguously from it
+/// Requires: cbuf is valid and created by circular_buf_init, data is not NULL
+/// Returns the length of the span, which stops at head or at the end of the storage buffer. 0 if empty
+size_t circular_buf_peek_span(cbuf_handle_t cbuf, uint8_t **data);
+
+/// Discard len elements from the tail, typically once a span from circular_buf_peek_span was consumed
+/// Requires: cbuf is valid and created by circular_buf_init, len <= circular_buf_size(cbuf)
+void circular_buf_consume(cbuf_handle_t cbuf, size_t len);
+
+/// Discard the oldest elements up to and including the first '\n' among the first max elements.
+/// Discards max elements (or all of them, if fewer) if there is no '\n' among them
+/// Requires: cbuf is valid and created by circular_buf_init. Consumer side operation
+/// Returns the number of elements discarded. line_end (if not NULL) is set to true if a '\n' was discarded
+size_t circular_buf_drop_line(cbuf_handle_t cbuf, size_t max, bool * line_end);
 
 #endif //CIRCULAR_BUFFER_H_
\ No newline at end of file
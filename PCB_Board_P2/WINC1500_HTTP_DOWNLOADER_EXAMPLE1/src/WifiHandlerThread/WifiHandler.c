@@ -16,6 +16,9 @@
 #include "main.h"
 #include "stdio_serial.h"
 #include "driver/include/m2m_wifi.h"
+#include "driver/source/m2m_hif.h"
+#include "driver/source/nmbus.h"
+#include "driver/source/nmasic.h"
 #include "socket/include/socket.h"
 #include "iot/http/http_client.h"
 #include "MQTTClient/Wrapper/mqtt.h"
@@ -23,6 +26,8 @@
 #include "WifiHandlerThread/WifiHandler.h"
 #include "ControlThread/ControlThread.h"
 #include "UiHandlerThread/UiHandlerThread.h"
+#include "I2cDriver/I2cDriver.h"
+#include "Bench/Bench.h"
 /******************************************************************************
 * Defines
 ******************************************************************************/
@@ -37,6 +42,7 @@ QueueHandle_t xQueueWifiState = NULL; ///<Queue to determine the Wifi state from
 QueueHandle_t xQueueGameBuffer = NULL; ///<Queue to send the next play to the cloud
 QueueHandle_t xQueueImuBuffer = NULL; ///<Queue to send IMU data to the cloud
 QueueHandle_t xQueueDistanceBuffer = NULL; ///<Queue to send the distance to the cloud
+QueueHandle_t xQueueBenchBuffer = NULL; ///<Queue of the benchmarks to run on the WINC (Bench.h)
 
 
 /*HTTP DOWNLOAD RELATED DEFINES AND VARIABLES*/
@@ -87,6 +93,9 @@ static unsigned char mqtt_send_buffer[MAIN_MQTT_BUFFER_SIZE];
 static void MQTT_InitRoutine(void);
 static void MQTT_HandleGameMessages(void);
 static void MQTT_HandleImuMessages(void);
+static void MQTT_HandleBenchRequests(void);
+static int32_t WifiBenchChipId(void *context);
+static int32_t WifiBenchPublish(void *context);
 static void HTTP_DownloadFileInit(void);
 static void HTTP_DownloadFileTransaction(void);
 /******************************************************************************
@@ -235,27 +244,27 @@ static bool rename_to_unique(FIL *fp, char *file_path_name, uint8_t max_len)
 static void start_download(void)
 {
 	if (!is_state_set(STORAGE_READY)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: MMC storage not ready.\r\n");
+		LOG_DEBUG("start_download: MMC storage not ready.\r\n");
 		return;
 	}
 
 	if (!is_state_set(WIFI_CONNECTED)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: Wi-Fi is not connected.\r\n");
+		LOG_DEBUG("start_download: Wi-Fi is not connected.\r\n");
 		return;
 	}
 
 	if (is_state_set(GET_REQUESTED)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: request is sent already.\r\n");
+		LOG_DEBUG("start_download: request is sent already.\r\n");
 		return;
 	}
 
 	if (is_state_set(DOWNLOADING)) {
-		LogMessage(LOG_DEBUG_LVL,"start_download: running download already.\r\n");
+		LOG_DEBUG("start_download: running download already.\r\n");
 		return;
 	}
 
 	/* Send the HTTP request. */
-	LogMessage(LOG_DEBUG_LVL,"start_download: sending HTTP request...\r\n");
+	LOG_DEBUG("start_download: sending HTTP request...\r\n");
 	http_client_send_request(&http_client_module_inst, MAIN_HTTP_FILE_URL, HTTP_METHOD_GET, NULL, NULL);
 }
 
@@ -268,7 +277,7 @@ static void store_file_packet(char *data, uint32_t length)
 {
 	FRESULT ret;
 	if ((data == NULL) || (length < 1)) {
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: empty data.\r\n");
+		LOG_DEBUG("store_file_packet: empty data.\r\n");
 		return;
 	}
 
@@ -284,16 +293,16 @@ static void store_file_packet(char *data, uint32_t length)
 			cp++;
 			strcpy(&save_file_name[2], cp);
 		} else {
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file name is invalid. Download canceled.\r\n");
+			LOG_DEBUG("store_file_packet: file name is invalid. Download canceled.\r\n");
 			add_state(CANCELED);
 			return;
 		}
 
 		rename_to_unique(&file_object, save_file_name, MAIN_MAX_FILE_NAME_LENGTH);
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: creating file [%s]\r\n", save_file_name);
+		LOG_DEBUG("store_file_packet: creating file [%s]\r\n", save_file_name);
 		ret = f_open(&file_object, (char const *)save_file_name, FA_CREATE_ALWAYS | FA_WRITE);
 		if (ret != FR_OK) {
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file creation error! ret:%d\r\n", ret);
+			LOG_DEBUG("store_file_packet: file creation error! ret:%d\r\n", ret);
 			return;
 		}
 
@@ -307,15 +316,15 @@ static void store_file_packet(char *data, uint32_t length)
 		if (ret != FR_OK) {
 			f_close(&file_object);
 			add_state(CANCELED);
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file write error, download canceled.\r\n");
+			LOG_DEBUG("store_file_packet: file write error, download canceled.\r\n");
 			return;
 		}
 
 		received_file_size += wsize;
-		LogMessage(LOG_DEBUG_LVL,"store_file_packet: received[%lu], file size[%lu]\r\n", (unsigned long)received_file_size, (unsigned long)http_file_size);
+		LOG_DEBUG_RATELIMITED(WIFI_LOG_PROGRESS_PER_SECOND, "store_file_packet: received[%lu], file size[%lu]\r\n", (unsigned long)received_file_size, (unsigned long)http_file_size);
 		if (received_file_size >= http_file_size) {
 			f_close(&file_object);
-			LogMessage(LOG_DEBUG_LVL,"store_file_packet: file downloaded successfully.\r\n");
+			LOG_DEBUG("store_file_packet: file downloaded successfully.\r\n");
 			port_pin_set_output_level(LED_0_PIN, false);
 			add_state(COMPLETED);
 			return;
@@ -334,16 +343,16 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 {
 	switch (type) {
 	case HTTP_CLIENT_CALLBACK_SOCK_CONNECTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: HTTP client socket connected.\r\n");
+		LOG_DEBUG("http_client_callback: HTTP client socket connected.\r\n");
 		break;
 
 	case HTTP_CLIENT_CALLBACK_REQUESTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: request completed.\r\n");
+		LOG_DEBUG("http_client_callback: request completed.\r\n");
 		add_state(GET_REQUESTED);
 		break;
 
 	case HTTP_CLIENT_CALLBACK_RECV_RESPONSE:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: received response %u data size %u\r\n",
+		LOG_DEBUG("http_client_callback: received response %u data size %u\r\n",
 				(unsigned int)data->recv_response.response_code,
 				(unsigned int)data->recv_response.content_length);
 		if ((unsigned int)data->recv_response.response_code == 200) {
@@ -369,7 +378,7 @@ static void http_client_callback(struct http_client_module *module_inst, int typ
 		break;
 
 	case HTTP_CLIENT_CALLBACK_DISCONNECTED:
-		LogMessage(LOG_DEBUG_LVL,"http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
+		LOG_DEBUG("http_client_callback: disconnection reason:%d\r\n", data->disconnected.reason);
 
 		/* If disconnect reason is equal to -ECONNRESET(-104),
 		 * It means the server has closed the connection (timeout).
@@ -425,7 +434,7 @@ static void socket_cb(SOCKET sock, uint8_t u8Msg, void *pvMsg)
  */
 static void resolve_cb(uint8_t *pu8DomainName, uint32_t u32ServerIP)
 {
-	LogMessage(LOG_DEBUG_LVL,"resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n", pu8DomainName,
+	LOG_DEBUG("resolve_cb: %s IP address is %d.%d.%d.%d\r\n\r\n", pu8DomainName,
 			(int)IPV4_BYTE(u32ServerIP, 0), (int)IPV4_BYTE(u32ServerIP, 1),
 			(int)IPV4_BYTE(u32ServerIP, 2), (int)IPV4_BYTE(u32ServerIP, 3));
 	http_client_socket_resolve_handler(pu8DomainName, u32ServerIP);
@@ -463,10 +472,10 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	{
 		tstrM2mWifiStateChanged *pstrWifiState = (tstrM2mWifiStateChanged *)pvMsg;
 		if (pstrWifiState->u8CurrState == M2M_WIFI_CONNECTED) {
-			LogMessage(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_CONNECTED\r\n");
+			LOG_DEBUG("wifi_cb: M2M_WIFI_CONNECTED\r\n");
 			m2m_wifi_request_dhcp_client();
 		} else if (pstrWifiState->u8CurrState == M2M_WIFI_DISCONNECTED) {
-			LogMessage(LOG_DEBUG_LVL,"wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
+			LOG_DEBUG("wifi_cb: M2M_WIFI_DISCONNECTED\r\n");
 			clear_state(WIFI_CONNECTED);
 			if (is_state_set(DOWNLOADING)) {
 				f_close(&file_object);
@@ -492,7 +501,7 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 	case M2M_WIFI_REQ_DHCP_CONF:
 	{
 		uint8_t *pu8IPAddress = (uint8_t *)pvMsg;
-		LogMessage(LOG_DEBUG_LVL,"wifi_cb: IP address is %u.%u.%u.%u\r\n",
+		LOG_DEBUG("wifi_cb: IP address is %u.%u.%u.%u\r\n",
 				pu8IPAddress[0], pu8IPAddress[1], pu8IPAddress[2], pu8IPAddress[3]);
 		add_state(WIFI_CONNECTED);
 
@@ -506,7 +515,7 @@ static void wifi_cb(uint8_t u8MsgType, void *pvMsg)
 				/* Try to connect to MQTT broker when Wi-Fi was connected. */
 		if (mqtt_connect(&mqtt_inst, main_mqtt_broker))
 		{
-			LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
+			LOG_DEBUG("Error connecting to MQTT Broker!\r\n");
 		}
 		}
 	}
@@ -529,28 +538,28 @@ void init_storage(void)
 	/* Initialize SD/MMC stack. */
 	sd_mmc_init();
 	while (true) {
-		LogMessage(LOG_DEBUG_LVL,"init_storage: please plug an SD/MMC card in slot...\r\n");
+		LOG_DEBUG("init_storage: please plug an SD/MMC card in slot...\r\n");
 
 		/* Wait card present and ready. */
 		do {
 			status = sd_mmc_test_unit_ready(0);
 			if (CTRL_FAIL == status) {
-				LogMessage(LOG_DEBUG_LVL,"init_storage: SD Card install failed.\r\n");
-				LogMessage(LOG_DEBUG_LVL,"init_storage: try unplug and re-plug the card.\r\n");
+				LOG_DEBUG("init_storage: SD Card install failed.\r\n");
+				LOG_DEBUG("init_storage: try unplug and re-plug the card.\r\n");
 				while (CTRL_NO_PRESENT != sd_mmc_check(0)) {
 				}
 			}
 		} while (CTRL_GOOD != status);
 
-		LogMessage(LOG_DEBUG_LVL,"init_storage: mounting SD card...\r\n");
+		LOG_DEBUG("init_storage: mounting SD card...\r\n");
 		memset(&fatfs, 0, sizeof(FATFS));
 		res = f_mount(LUN_ID_SD_MMC_0_MEM, &fatfs);
 		if (FR_INVALID_DRIVE == res) {
-			LogMessage(LOG_DEBUG_LVL,"init_storage: SD card mount failed! (res %d)\r\n", res);
+			LOG_DEBUG("init_storage: SD card mount failed! (res %d)\r\n", res);
 			return;
 		}
 
-		LogMessage(LOG_DEBUG_LVL,"init_storage: SD card mount OK.\r\n");
+		LOG_DEBUG("init_storage: SD card mount OK.\r\n");
 		add_state(STORAGE_READY);
 		return;
 	}
@@ -586,7 +595,7 @@ static void configure_http_client(void)
 
 	ret = http_client_init(&http_client_module_inst, &httpc_conf);
 	if (ret < 0) {
-		LogMessage(LOG_DEBUG_LVL,"configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
+		LOG_DEBUG("configure_http_client: HTTP client initialization failed! (res %d)\r\n", ret);
 		while (1) {
 		} /* Loop forever. */
 	}
@@ -648,7 +657,7 @@ static void socket_resolve_handler(uint8_t *doamin_name, uint32_t server_ip)
 void SubscribeHandlerLedTopic(MessageData *msgData)
 {
 	uint8_t rgb[3] = {0,0,0};
-	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+	LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
 	//Will receive something of the style "rgb(222, 224, 189)"
 	if (strncmp(msgData->message->payload, "rgb(", 4)== 0)
 	{
@@ -661,7 +670,7 @@ void SubscribeHandlerLedTopic(MessageData *msgData)
 		break;
 		p++; /* skip, */
 	}
-	LogMessage(LOG_DEBUG_LVL,"\r\nRGB %d %d %d\r\n", rgb[0], rgb[1], rgb[2]);
+	LOG_DEBUG("\r\nRGB %d %d %d\r\n", rgb[0], rgb[1], rgb[2]);
 	UIChangeColors(rgb[0],rgb[1], rgb[2]);
 	}
 }
@@ -674,9 +683,9 @@ void SubscribeHandlerGameTopic(MessageData *msgData)
 	//Parse input. The start string must be '{"game":['
 	if (strncmp(msgData->message->payload, "{\"game\":[", 9) == 0)
 	{
-		LogMessage(LOG_DEBUG_LVL,"\r\nGame message received!\r\n");
-		LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-		LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
+		LOG_DEBUG("\r\nGame message received!\r\n");
+		LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+		LOG_DEBUG("%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
 
 		int nb = 0;
 		char *p = &msgData->message->payload[9];
@@ -686,22 +695,22 @@ void SubscribeHandlerGameTopic(MessageData *msgData)
 			break;
 			p++; /* skip, */
 		}
-		LogMessage(LOG_DEBUG_LVL,"\r\nParsed Command: ");
+		LOG_DEBUG("\r\nParsed Command: ");
 		for(int i = 0; i < GAME_SIZE; i++)
 		{
-			LogMessage(LOG_DEBUG_LVL,"%d,", game.game[i]);
+			LOG_DEBUG("%d,", game.game[i]);
 		}
 
 		if(pdTRUE == ControlAddGameData(&game))
 		{
-			LogMessage(LOG_DEBUG_LVL,"\r\nSent play to control!\r\n");
+			LOG_DEBUG("\r\nSent play to control!\r\n");
 		}
 
 	}else
 	{
-		LogMessage(LOG_DEBUG_LVL,"\r\nGame message received but not understood!\r\n");
-		LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-		LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
+		LOG_DEBUG("\r\nGame message received but not understood!\r\n");
+		LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+		LOG_DEBUG("%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);
 	}
 
 
@@ -722,12 +731,12 @@ void SubscribeHandlerP2GameOnTopic(MessageData *msgData)
 
 void SubscribeHandlerImuTopic(MessageData *msgData)
 {
-	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+	LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
 }
 
 void SubscribeHandlerDistanceTopic(MessageData *msgData)
 {
-	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+	LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
 }
 
 
@@ -735,9 +744,9 @@ void SubscribeHandler(MessageData *msgData)
 {
 	/* You received publish message which you had subscribed. */
 	/* Print Topic and message */
-	LogMessage(LOG_DEBUG_LVL,"\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
-	LogMessage(LOG_DEBUG_LVL," >> ");
-	LogMessage(LOG_DEBUG_LVL,"%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);	
+	LOG_DEBUG("\r\n %.*s",msgData->topicName->lenstring.len,msgData->topicName->lenstring.data);
+	LOG_DEBUG(" >> ");
+	LOG_DEBUG("%.*s",msgData->message->payloadlen,(char *)msgData->message->payload);	
 
 	//Handle LedData message
 	if(strncmp((char *) msgData->topicName->lenstring.data, LED_TOPIC, msgData->message->payloadlen) == 0)
@@ -778,17 +787,17 @@ static void mqtt_callback(struct mqtt_module *module_inst, int type, union mqtt_
 		 * Or else retry to connect to broker server.
 		 */
 		if (data->sock_connected.result >= 0) {
-			LogMessage(LOG_DEBUG_LVL,"\r\nConnecting to Broker...");
+			LOG_DEBUG("\r\nConnecting to Broker...");
 			if(0 != mqtt_connect_broker(module_inst, 1, CLOUDMQTT_USER_ID, CLOUDMQTT_USER_PASSWORD, CLOUDMQTT_USER_ID, NULL, NULL, 0, 0, 0))
 			{
-				LogMessage(LOG_DEBUG_LVL,"MQTT  Error - NOT Connected to broker\r\n");
+				LOG_DEBUG("MQTT  Error - NOT Connected to broker\r\n");
 			}
 			else
 			{
-				LogMessage(LOG_DEBUG_LVL,"MQTT Connected to broker\r\n");
+				LOG_DEBUG("MQTT Connected to broker\r\n");
 			}
 		} else {
-			LogMessage(LOG_DEBUG_LVL,"Connect fail to server(%s)! retry it automatically.\r\n", main_mqtt_broker);
+			LOG_DEBUG("Connect fail to server(%s)! retry it automatically.\r\n", main_mqtt_broker);
 			mqtt_connect(module_inst, main_mqtt_broker); /* Retry that. */
 		}
 	}
@@ -802,17 +811,17 @@ static void mqtt_callback(struct mqtt_module *module_inst, int type, union mqtt_
 			mqtt_subscribe(module_inst, ANS_SEQ_USR2, 2, SubscribeHandlerP2GameOnTopic);
 			/* Enable USART receiving callback. */
 			
-			LogMessage(LOG_DEBUG_LVL,"MQTT Connected\r\n");
+			LOG_DEBUG("MQTT Connected\r\n");
 		} else {
 			/* Cannot connect for some reason. */
-			LogMessage(LOG_DEBUG_LVL,"MQTT broker decline your access! error code %d\r\n", data->connected.result);
+			LOG_DEBUG("MQTT broker decline your access! error code %d\r\n", data->connected.result);
 		}
 
 		break;
 
 	case MQTT_CALLBACK_DISCONNECTED:
 		/* Stop timer and USART callback. */
-		LogMessage(LOG_DEBUG_LVL,"MQTT disconnected\r\n");
+		LOG_DEBUG("MQTT disconnected\r\n");
 		//usart_disable_callback(&cdc_uart_module, USART_CALLBACK_BUFFER_RECEIVED);
 		break;
 	}
@@ -839,14 +848,14 @@ static void configure_mqtt(void)
 	
 	result = mqtt_init(&mqtt_inst, &mqtt_conf);
 	if (result < 0) {
-		LogMessage(LOG_DEBUG_LVL,"MQTT initialization failed. Error code is (%d)\r\n", result);
+		LOG_DEBUG("MQTT initialization failed. Error code is (%d)\r\n", result);
 		while (1) {
 		}
 	}
 
 	result = mqtt_register_callback(&mqtt_inst, mqtt_callback);
 	if (result < 0) {
-		LogMessage(LOG_DEBUG_LVL,"MQTT register callback failed. Error code is (%d)\r\n", result);
+		LOG_DEBUG("MQTT register callback failed. Error code is (%d)\r\n", result);
 		while (1) {
 		}
 	}
@@ -900,7 +909,7 @@ static void HTTP_DownloadFileInit(void)
 	
 	if(mqtt_disconnect(&mqtt_inst, main_mqtt_broker))
 	{
-		LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
+		LOG_DEBUG("Error connecting to MQTT Broker!\r\n");
 	}
 	while((mqtt_inst.isConnected))
 	{
@@ -954,7 +963,7 @@ static void HTTP_DownloadFileTransaction(void)
 
 	if (res != FR_OK)
 	{
-		LogMessage(LOG_INFO_LVL ,"[FAIL] res %d\r\n", res);
+		LOG_INFO("[FAIL] res %d\r\n", res);
 	}
 	else
 	{
@@ -981,13 +990,13 @@ static void MQTT_InitRoutine(void)
 	{
 		if (mqtt_connect(&mqtt_inst, main_mqtt_broker))
 		{
-			LogMessage(LOG_DEBUG_LVL,"Error connecting to MQTT Broker!\r\n");
+			LOG_DEBUG("Error connecting to MQTT Broker!\r\n");
 		}
 	}
 
 	if(mqtt_inst.isConnected)
 	{
-		LogMessage(LOG_DEBUG_LVL,"Connected to MQTT Broker!\r\n");
+		LOG_DEBUG("Connected to MQTT Broker!\r\n");
 	}
 	wifiStateMachine = WIFI_MQTT_HANDLE;
 }
@@ -1009,6 +1018,7 @@ static void MQTT_HandleTransactions(void)
 	//Check if data has to be sent!
 	MQTT_HandleGameMessages();
 	MQTT_HandleImuMessages();
+	MQTT_HandleBenchRequests();
 
 	//Handle MQTT messages
 	if(mqtt_inst.isConnected)
@@ -1075,10 +1085,64 @@ static void MQTT_HandleGameMessages(void)
 				}
 			}
 		strcat(mqtt_msg, "]}");
-		LogMessage(LOG_DEBUG_LVL,mqtt_msg);LogMessage(LOG_DEBUG_LVL,"\r\n");
+		LOG_DEBUG(mqtt_msg);LOG_DEBUG("\r\n");
 		mqtt_publish(&mqtt_inst, GAME_TOPIC_OUT, mqtt_msg, strlen(mqtt_msg), 1, 0);
 	}
 }
+/**************************************************************************//**
+static void MQTT_HandleBenchRequests(void)
+* @brief	Runs the WINC SPI and MQTT benchmarks asked for by the "bench" CLI command
+* @note		They run here because the WINC driver may only be used from the WiFi task
+
+*****************************************************************************/
+static void MQTT_HandleBenchRequests(void)
+{
+	struct WifiBenchRequest request;
+	struct BenchResult result;
+	if (pdPASS != xQueueReceive( xQueueBenchBuffer , &request, 0 )) return;
+
+	if (request.id == BENCH_WINC_SPI)
+	{
+		uint32_t chipId;
+		hif_chip_wake();
+		BenchRun(WifiBenchChipId, &chipId, request.runs, sizeof(chipId), &result);
+		hif_chip_sleep();
+	}
+	else if (request.id == BENCH_MQTT_PUBACK && mqtt_inst.isConnected)
+	{
+		BenchRun(WifiBenchPublish, NULL, request.runs, 0, &result);
+	}
+	else
+	{
+		memset(&result, 0, sizeof(result));
+		result.error = ERROR_NOT_READY;
+	}
+
+	BenchWifiDone(&result);
+}
+
+/**************************************************************************//**
+static int32_t WifiBenchChipId(void *context)
+* @brief	One SPI register read: the chip ID of the WINC
+* @param[out]	context uint32_t receiving the chip ID
+
+*****************************************************************************/
+static int32_t WifiBenchChipId(void *context)
+{
+	return (nm_read_reg_with_ret(NMI_CHIPID, (uint32 *)context) == M2M_SUCCESS) ? ERROR_NONE : ERROR_IO;
+}
+
+/**************************************************************************//**
+static int32_t WifiBenchPublish(void *context)
+* @brief	One QoS 1 publish. mqtt_publish returns once the broker's PUBACK is in
+
+*****************************************************************************/
+static int32_t WifiBenchPublish(void *context)
+{
+	static const char benchMsg[] = "bench";
+	return (mqtt_publish(&mqtt_inst, BENCH_MQTT_TOPIC, benchMsg, sizeof(benchMsg) - 1, 1, 0) == 0) ? ERROR_NONE : ERROR_IO;
+}
+
 /**
  * \brief Main application function.
  *
@@ -1097,8 +1161,9 @@ void vWifiTask( void *pvParameters )
 	xQueueImuBuffer  = xQueueCreate( 5, sizeof( struct ImuDataPacket ) );
 	xQueueGameBuffer = xQueueCreate( 2, sizeof( struct GameDataPacket ) );
 	xQueueDistanceBuffer = xQueueCreate ( 5, sizeof( uint16_t ) );
+	xQueueBenchBuffer = xQueueCreate ( 1, sizeof( struct WifiBenchRequest ) );
 
-	if(xQueueWifiState == NULL || xQueueImuBuffer == NULL || xQueueGameBuffer == NULL || xQueueDistanceBuffer == NULL)
+	if(xQueueWifiState == NULL || xQueueImuBuffer == NULL || xQueueGameBuffer == NULL || xQueueDistanceBuffer == NULL || xQueueBenchBuffer == NULL)
 	{
 		SerialConsoleWriteString("ERROR Initializing Wifi Data queues!\r\n");
 	}
@@ -1130,12 +1195,12 @@ void vWifiTask( void *pvParameters )
 	param.pfAppWifiCb = wifi_cb;
 	ret = m2m_wifi_init(&param);
 	if (M2M_SUCCESS != ret) {
-		LogMessage(LOG_DEBUG_LVL,"main: m2m_wifi_init call error! (res %d)\r\n", ret);
+		LOG_DEBUG("main: m2m_wifi_init call error! (res %d)\r\n", ret);
 		while (1) {
 				}
 		}
 
-	LogMessage(LOG_DEBUG_LVL,"main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
+	LOG_DEBUG("main: connecting to WiFi AP %s...\r\n", (char *)MAIN_WLAN_SSID);
 	
 	//Re-enable socket for MQTT Transfer
 	socketInit();
@@ -1257,4 +1322,18 @@ int WifiAddGameDataToQueue(struct GameDataPacket *game)
 {
 	int error = xQueueSend(xQueueGameBuffer , game, ( TickType_t ) 10);
 	return error;
-}
\ No newline at end of file
+}
+
+/**************************************************************************//**
+int WifiAddBenchRequest(struct WifiBenchRequest *request)
+* @brief	Asks the WiFi task to run a WINC SPI or MQTT benchmark. The result goes to BenchWifiDone
+* @param[in]	request Benchmark to run
+* @return		Returns pdTrue if the request is queued, pdFalse if the WiFi task is not running or is busy with another
+
+*****************************************************************************/
+int WifiAddBenchRequest(struct WifiBenchRequest *request)
+{
+	if (xQueueBenchBuffer == NULL) return pdFALSE;
+	int error = xQueueSend(xQueueBenchBuffer , request, ( TickType_t ) 10);
+	return error;
+}
@@ -89,7 +89,7 @@ extern "C" {
 */
 
 #define CONF_WINC_DEBUG					(1)
-#define CONF_WINC_PRINTF				LogMessageDebug 
+#define CONF_WINC_PRINTF				LOG_DEBUG //Dropped at build time below LOG_COMPILE_LEVEL
 
 #ifdef __cplusplus
 }
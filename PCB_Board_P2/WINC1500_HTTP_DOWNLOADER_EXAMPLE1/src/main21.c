@@ -29,6 +29,12 @@
 #include "UiHandlerThread\UiHandlerThread.h"
 #include "ControlThread\ControlThread.h"
 #include "thumbstick\thumbstick.h"
+#include "LoggerThread\LoggerThread.h"
+#include "LoggerThread\SdLogSink.h"
+#include "KeypadThread\KeypadThread.h"
+#include "ImuThread\ImuThread.h"
+#include "SensorScheduler\SensorScheduler.h"
+#include "LedAnimation\LedAnimation.h"
 
 
 /******************************************************************************
@@ -55,6 +61,15 @@ static TaskHandle_t daemonTaskHandle    = NULL; //!< Daemon task handle
 static TaskHandle_t wifiTaskHandle    = NULL; //!< Wifi task handle
 static TaskHandle_t uiTaskHandle    = NULL; //!< UI task handle
 static TaskHandle_t controlTaskHandle    = NULL; //!< Control task handle
+#if LOGGER_DEFERRED_MODE
+static TaskHandle_t loggerTaskHandle    = NULL; //!< Logger task handle
+#endif
+static TaskHandle_t keypadTaskHandle    = NULL; //!< Keypad task handle
+static TaskHandle_t sensorTaskHandle    = NULL; //!< Sensor scheduler task handle
+static TaskHandle_t ledAnimTaskHandle    = NULL; //!< LED animation task handle
+#if SD_LOG_SINK_ENABLED
+static TaskHandle_t sdLogSinkTaskHandle    = NULL; //!< SD card log sink task handle
+#endif
 
 char bufferPrint[64]; //Buffer for daemon task
 
@@ -72,6 +87,7 @@ int main(void)
 
 	/* Initialize the UART console. */
 	InitializeSerialConsole();
+	LoggerInitialize();
 
 	//Initialize trace capabilities
 	 vTraceEnable(TRC_START);
@@ -116,31 +132,12 @@ SerialConsoleWriteString("\r\n\r\nInitialize HW...\r\n");
 	{
 		SerialConsoleWriteString("Initialized Seesaw!\r\n");
 	}
-/*
-	uint8_t whoamI = 0;
-	(lsm6ds3_device_id_get(GetImuStruct(), &whoamI));
-	
-	if (whoamI != LSM6DS3_ID){
-		SerialConsoleWriteString("Cannot find IMU!\r\n");
-	}
-	else
-	{
-		SerialConsoleWriteString("IMU found!\r\n");
-	}
 
-	if(InitImu() == 0)
-	{
-		SerialConsoleWriteString("IMU initialized!\r\n");
-	}
-	else
-	{
-		SerialConsoleWriteString("Could not initialize IMU\r\n");
-	}
-*/
+	//Sampled by the sensor task as soon as it starts
+	initialize_thumbstick();
+	InitializeDistanceSensor();
 
 	StartTasks();
-	
-	initialize_thumbstick();
 
 	vTaskSuspend(daemonTaskHandle);
 }
@@ -182,11 +179,49 @@ if(xTaskCreate(vUiHandlerTask, "UI Task", UI_TASK_SIZE, NULL, UI_TASK_PRIORITY,
 snprintf(bufferPrint, 64, "Heap after starting UI Task: %d\r\n", xPortGetFreeHeapSize());
 SerialConsoleWriteString(bufferPrint);
 */
+if(xTaskCreate(vKeypadTask, "Keypad Task", KEYPAD_TASK_SIZE, NULL, KEYPAD_TASK_PRIORITY, &keypadTaskHandle) != pdPASS) {
+	SerialConsoleWriteString("ERR: Keypad task could not be initialized!\r\n");
+}
+snprintf(bufferPrint, 64, "Heap after starting Keypad Task: %d\r\n", xPortGetFreeHeapSize());
+SerialConsoleWriteString(bufferPrint);
+
+
+if(xTaskCreate(vSensorSchedulerTask, "Sensor Task", SENSOR_TASK_SIZE, NULL, SENSOR_TASK_PRIORITY, &sensorTaskHandle) != pdPASS) {
+	SerialConsoleWriteString("ERR: Sensor task could not be initialized!\r\n");
+}
+snprintf(bufferPrint, 64, "Heap after starting Sensor Task: %d\r\n", xPortGetFreeHeapSize());
+SerialConsoleWriteString(bufferPrint);
+
+
+if(xTaskCreate(vLedAnimationTask, "LED Task", LED_ANIM_TASK_SIZE, NULL, LED_ANIM_TASK_PRIORITY, &ledAnimTaskHandle) != pdPASS) {
+	SerialConsoleWriteString("ERR: LED animation task could not be initialized!\r\n");
+}
+snprintf(bufferPrint, 64, "Heap after starting LED Task: %d\r\n", xPortGetFreeHeapSize());
+SerialConsoleWriteString(bufferPrint);
+
+
 if(xTaskCreate(vControlHandlerTask, "Control Task", CONTROL_TASK_SIZE, NULL, CONTROL_TASK_PRIORITY, &controlTaskHandle) != pdPASS) {
 	SerialConsoleWriteString("ERR: Control task could not be initialized!\r\n");
 }
 snprintf(bufferPrint, 64, "Heap after starting Control Task: %d\r\n", xPortGetFreeHeapSize());
 SerialConsoleWriteString(bufferPrint);
+
+
+#if LOGGER_DEFERRED_MODE
+if(xTaskCreate(vLoggerTask, "Logger Task", LOGGER_TASK_SIZE, NULL, LOGGER_TASK_PRIORITY, &loggerTaskHandle) != pdPASS) {
+	SerialConsoleWriteString("ERR: Logger task could not be initialized!\r\n");
+}
+snprintf(bufferPrint, 64, "Heap after starting Logger Task: %d\r\n", xPortGetFreeHeapSize());
+SerialConsoleWriteString(bufferPrint);
+#endif
+
+#if SD_LOG_SINK_ENABLED
+if(xTaskCreate(vSdLogSinkTask, "SD Log Task", SD_LOG_SINK_TASK_SIZE, NULL, SD_LOG_SINK_TASK_PRIORITY, &sdLogSinkTaskHandle) != pdPASS) {
+	SerialConsoleWriteString("ERR: SD log task could not be initialized!\r\n");
+}
+snprintf(bufferPrint, 64, "Heap after starting SD Log Task: %d\r\n", xPortGetFreeHeapSize());
+SerialConsoleWriteString(bufferPrint);
+#endif
 }
 
 
@@ -240,7 +275,7 @@ static void TestA(void)
 
 	if (res != FR_OK)
 	{
-		LogMessage(LOG_INFO_LVL ,"[FAIL] res %d\r\n", res);
+		LOG_INFO("[FAIL] res %d\r\n", res);
 	}
 	else
 	{
@@ -280,7 +315,7 @@ static void TestB(void)
 
 	if (res != FR_OK)
 	{
-		LogMessage(LOG_INFO_LVL ,"[FAIL] res %d\r\n", res);
+		LOG_INFO("[FAIL] res %d\r\n", res);
 	}
 	else
 	{
@@ -0,0 +1,205 @@
+/**************************************************************************//**
+* @file      bench_circular_buffer.c
+* @brief     Host benchmark of the circular_buffer per-byte and range functions on the console ring sizes
+* @details   Writes and reads the same byte stream through the 256-byte RX and 512-byte TX console rings, once with
+*			 circular_buf_put2 / circular_buf_get per byte and once with circular_buf_put2_range /
+*			 circular_buf_get_range, for a few write sizes. Before timing, it checks both ways (and the overwriting
+*			 circular_buf_put / circular_buf_put_range pair) leave the rings with the same data.
+*			 Host numbers only compare the two ways; the ratio on the SAMD21 is what matters.
+* @date      2020-05-04
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "circular_buffer.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define RX_BUFFER_SIZE	256	///<Size of the console RX ring
+#define TX_BUFFER_SIZE	512	///<Size of the console TX ring
+#define BENCH_BYTES		(8u * 1024u * 1024u)	///<Bytes moved through the ring by each measurement
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static uint8_t storageA[TX_BUFFER_SIZE];	///<Storage of the first ring
+static uint8_t storageB[TX_BUFFER_SIZE];	///<Storage of the second ring
+static uint8_t source[TX_BUFFER_SIZE];	///<Data written
+static uint8_t sink[TX_BUFFER_SIZE];	///<Data read back
+static volatile uint8_t checksum;	///<Keeps the compiler from dropping the reads
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static double now_seconds(void)
+* @brief	Monotonic time, in seconds
+*****************************************************************************/
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**************************************************************************//**
+* @fn		static bool same_contents(cbuf_handle_t a, cbuf_handle_t b)
+* @brief	Drains both rings and compares what comes out
+*****************************************************************************/
+static bool same_contents(cbuf_handle_t a, cbuf_handle_t b)
+{
+	uint8_t bufA[TX_BUFFER_SIZE], bufB[TX_BUFFER_SIZE];
+	size_t lenA = circular_buf_get_range(a, bufA, sizeof(bufA));
+	size_t lenB = 0;
+
+	while (lenB < sizeof(bufB) && circular_buf_get(b, &bufB[lenB]) == 0) lenB++;
+	return lenA == lenB && memcmp(bufA, bufB, lenA) == 0;
+}
+
+/**************************************************************************//**
+* @fn		static bool check_equivalence(size_t capacity)
+* @brief	Runs the same random writes through the per-byte and the range functions and compares the rings
+* @details	put2_range rejects a write that does not fit, where a put2 loop would keep its first bytes, so the
+*			per-byte side skips the writes the range side rejected
+* @return	Returns true if every comparison matched
+*****************************************************************************/
+static bool check_equivalence(size_t capacity)
+{
+	cbuf_handle_t a = circular_buf_init(storageA, capacity);
+	cbuf_handle_t b = circular_buf_init(storageB, capacity);
+	bool ok = true;
+
+	srand(516);
+	for (int round = 0; round < 20000 && ok; round++)
+	{
+		size_t len = (size_t)(rand() % (capacity + capacity / 2));
+		if (len > TX_BUFFER_SIZE) len = TX_BUFFER_SIZE;
+		for (size_t i = 0; i < len; i++) source[i] = (uint8_t)rand();
+
+		switch (rand() % 3)
+		{
+		case 0: //Overwriting
+			circular_buf_put_range(a, source, len);
+			for (size_t i = 0; i < len; i++) circular_buf_put(b, source[i]);
+			break;
+		case 1: //Rejecting
+			if (circular_buf_put2_range(a, source, len) == 0)
+			{
+				for (size_t i = 0; i < len; i++) ok &= (circular_buf_put2(b, source[i]) == 0);
+			}
+			else
+			{
+				ok &= (len > capacity - circular_buf_size(b));
+			}
+			break;
+		default: //Partial read
+		{
+			size_t want = (size_t)(rand() % capacity);
+			size_t gotA = circular_buf_get_range(a, sink, want);
+			size_t gotB = 0;
+			while (gotB < want && circular_buf_get(b, &source[gotB]) == 0) gotB++;
+			ok &= (gotA == gotB && memcmp(sink, source, gotA) == 0);
+			break;
+		}
+		}
+		ok &= (circular_buf_size(a) == circular_buf_size(b));
+		if (round % 1000 == 999) ok &= same_contents(a, b);
+	}
+
+	circular_buf_free(a);
+	circular_buf_free(b);
+	return ok;
+}
+
+/**************************************************************************//**
+* @fn		static double bench_per_byte(size_t capacity, size_t chunk)
+* @brief	Moves BENCH_BYTES through a ring chunk bytes at a time, one call per byte
+* @return	Returns the throughput, in MB/s
+*****************************************************************************/
+static double bench_per_byte(size_t capacity, size_t chunk)
+{
+	cbuf_handle_t cbuf = circular_buf_init(storageA, capacity);
+	uint8_t sum = 0;
+	double start = now_seconds();
+
+	for (size_t moved = 0; moved < BENCH_BYTES; moved += chunk)
+	{
+		for (size_t i = 0; i < chunk; i++) circular_buf_put2(cbuf, source[i]);
+		for (size_t i = 0; i < chunk; i++) circular_buf_get(cbuf, &sink[i]);
+		sum += sink[chunk - 1];
+	}
+
+	double elapsed = now_seconds() - start;
+	checksum = sum;
+	circular_buf_free(cbuf);
+	return BENCH_BYTES / elapsed / 1e6;
+}
+
+/**************************************************************************//**
+* @fn		static double bench_range(size_t capacity, size_t chunk)
+* @brief	Moves BENCH_BYTES through a ring chunk bytes at a time, one range call per chunk
+* @return	Returns the throughput, in MB/s
+*****************************************************************************/
+static double bench_range(size_t capacity, size_t chunk)
+{
+	cbuf_handle_t cbuf = circular_buf_init(storageA, capacity);
+	uint8_t sum = 0;
+	double start = now_seconds();
+
+	for (size_t moved = 0; moved < BENCH_BYTES; moved += chunk)
+	{
+		circular_buf_put2_range(cbuf, source, chunk);
+		circular_buf_get_range(cbuf, sink, chunk);
+		sum += sink[chunk - 1];
+	}
+
+	double elapsed = now_seconds() - start;
+	checksum = sum;
+	circular_buf_free(cbuf);
+	return BENCH_BYTES / elapsed / 1e6;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+int main(void)
+{
+	static const size_t capacities[] = {RX_BUFFER_SIZE, TX_BUFFER_SIZE};
+	static const size_t chunks[] = {1, 16, 64, 128, 200};	//128: a full debugBuffer line
+
+	for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+	{
+		if (!check_equivalence(capacities[c]))
+		{
+			printf("FAILED: range and per-byte functions differ on the %u-byte ring\n", (unsigned)capacities[c]);
+			return 1;
+		}
+	}
+	printf("Range and per-byte functions agree on the %u and %u-byte rings\n\n", RX_BUFFER_SIZE, TX_BUFFER_SIZE);
+
+	for (size_t i = 0; i < sizeof(source); i++) source[i] = (uint8_t)i;
+
+	printf("ring  write  per-byte MB/s  range MB/s  speedup\n");
+	for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+	{
+		for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]); k++)
+		{
+			double perByte = bench_per_byte(capacities[c], chunks[k]);
+			double range = bench_range(capacities[c], chunks[k]);
+			printf("%4u  %5u  %13.1f  %10.1f  %6.1fx\n", (unsigned)capacities[c], (unsigned)chunks[k], perByte, range, range / perByte);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,153 @@
+/**************************************************************************//**
+* @file      sim.h
+* @brief     Deterministic host simulation of the FreeRTOS kernel, the sensor I2C bus and its devices
+* @details   Lets the bus driver (I2cDriver.c) and the sensor drivers run unchanged on a PC, to regression test
+*			 and benchmark them for bus traffic.
+*
+*			 Kernel (sim_rtos.c): every task is a thread, but only one runs at a time, the highest priority ready
+*			 one, like on the single core SAMD21. Time is virtual: it only moves when every task is blocked, to the
+*			 next timeout or simulated interrupt. Running code takes no time, the bus takes the time of its bits.
+*			 A run is therefore the same on every PC, and a test waiting for seconds of board time takes none.
+*
+*			 Bus (sim_i2c.c): the ASF job API. A job ends with its callback, run as an interrupt, once its START,
+*			 bytes (9 bits each) and STOP have gone out at the configured SCL frequency. A device is a register
+*			 model with a write and a read handler; an address with no device is not acknowledged.
+*			 Every transfer (START or repeated START to the end of its bytes) is counted per device and bus wide.
+*
+*			 Devices: the NeoTrellis Seesaw (sim_seesaw.c), the LSM6DS3 with its FIFO (sim_lsm6ds3.c), the SHTC3
+*			 (sim_shtc3.c). They NACK what the real parts NACK, so a driver that does not wait long enough fails.
+* @date      2020-05-05
+
+******************************************************************************/
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include "asf.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SIM_TICK_US				1000	///<Length of a tick: configTICK_RATE_HZ is 1000
+#define SIM_MAX_TASKS			8	///<Max number of tasks, the caller of sim_start included
+#define SIM_MAX_INTERRUPTS		8	///<Max number of pending simulated interrupts
+#define SIM_I2C_MAX_DEVICES		4	///<Max number of devices on the simulated bus
+#define SIM_SEESAW_FIFO_SIZE	32	///<Keypad events the Seesaw keeps
+#define SIM_SEESAW_RX_SIZE		32	///<Longest write the Seesaw receives. It drops the bytes after
+#define SIM_SEESAW_PIXEL_BYTES	192	///<Size of the Neopixel buffer of the Seesaw
+#define SIM_SEESAW_READ_DELAY_US	125	///<Time the Seesaw needs from a register write to its read
+#define SIM_SEESAW_FIFO_DELAY_US	1000	///<Same, for the keypad FIFO
+#define SIM_LSM6DS3_FIFO_WORDS	4096	///<8 kB FIFO of the LSM6DS3
+#define SIM_SHTC3_WAKEUP_US		240	///<Max wake-up time of the SHTC3: it NACKs until then
+#define SIM_SHTC3_MEASURE_NM_US	12100	///<Max conversion time, normal mode
+#define SIM_SHTC3_MEASURE_LPM_US	800	///<Max conversion time, low power mode
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///Simulated interrupt handler. Runs between two tasks, like an interrupt that preempts them
+typedef void (*SimInterruptHandler)(void *context);
+
+///Traffic of a device, or of the whole bus
+struct SimI2cCounters {
+	uint32_t transfers;	///<Address phases: a write and its repeated start read are two
+	uint32_t bytesOut;	///<Payload bytes written and acknowledged, address bytes not included
+	uint32_t bytesIn;	///<Payload bytes read
+	uint32_t nacks;	///<Transfers the device did not acknowledge
+	uint32_t aborted;	///<Jobs cancelled by the driver before they ended
+	uint64_t busyUs;	///<Time the bus spent on these transfers
+};
+
+struct SimI2cDevice;
+///Handles the payload of a write. Returns false to NACK the address
+typedef bool (*SimI2cWrite)(struct SimI2cDevice *device, const uint8_t *data, uint16_t len);
+///Fills the payload of a read. Returns false to NACK the address
+typedef bool (*SimI2cRead)(struct SimI2cDevice *device, uint8_t *data, uint16_t len);
+
+///Device on the simulated bus
+struct SimI2cDevice {
+	const char *name;	///<For the reports
+	uint8_t address;	///<7-bit address
+	SimI2cWrite write;	///<Write handler
+	SimI2cRead read;	///<Read handler
+	uint32_t stretchUs;	///<Extra time the device holds SCL low in every transfer. Set it to make jobs time out
+	struct SimI2cCounters counters;	///<Traffic with this device
+};
+
+///NeoTrellis Seesaw: status, Neopixel and keypad modules
+struct SimSeesaw {
+	struct SimI2cDevice device;
+	uint8_t base;	///<Module addressed by the last write, read back by the next read
+	uint8_t function;	///<Register addressed by the last write
+	uint8_t neopixelPin;	///<SEESAW_NEOPIXEL_PIN
+	uint8_t neopixelSpeed;	///<SEESAW_NEOPIXEL_SPEED
+	uint16_t neopixelLength;	///<SEESAW_NEOPIXEL_BUF_LENGTH, in bytes
+	uint8_t pixels[SIM_SEESAW_PIXEL_BYTES];	///<Neopixel buffer
+	uint8_t shown[SIM_SEESAW_PIXEL_BYTES];	///<What the LEDs show: the buffer at the last SHOW
+	uint32_t shows;	///<SHOW commands
+	uint32_t overlongWrites;	///<Writes longer than SIM_SEESAW_RX_SIZE: the end was lost
+	uint64_t writeUs;	///<Start of the last register write
+	uint32_t earlyReads;	///<Reads started before the register was ready: they returned garbage
+	uint8_t keyActive[64];	///<Per Seesaw key number: bit n set when edge n is reported
+	uint8_t events[SIM_SEESAW_FIFO_SIZE];	///<Keypad FIFO: key number << 2 | edge
+	uint8_t eventCount;	///<Events in the FIFO
+	bool keypadInterrupt;	///<SEESAW_KEYPAD_INTENSET
+};
+
+///LSM6DS3: register file, accelerometer and FIFO
+struct SimLsm6ds3 {
+	struct SimI2cDevice device;
+	uint8_t regs[0x80];	///<Registers. The output and status registers are computed when read
+	uint8_t pointer;	///<Register address of the next byte
+	uint16_t fifo[SIM_LSM6DS3_FIFO_WORDS];	///<FIFO words, oldest at fifoHead
+	uint16_t fifoHead;
+	uint16_t fifoCount;
+	uint8_t pattern;	///<Axis of the oldest FIFO word: 0 X, 1 Y, 2 Z
+	bool overrun;	///<A sample overwrote the oldest one (stream mode), or was lost (FIFO mode)
+	uint16_t fifoWord;	///<Word being read through FIFO_DATA_OUT_L and _H
+	uint32_t samples;	///<Accelerometer samples since the last reset. Sample n is X = n, Y = -n, Z = 1 g
+	uint64_t nextSampleUs;	///<Time of the next sample
+};
+
+///SHTC3: sleep state, commands, conversion time and CRC of the results
+struct SimShtc3 {
+	struct SimI2cDevice device;
+	bool awake;
+	uint64_t readyUs;	///<Time the sensor answers again after a wake-up or a measure command
+	uint8_t result[6];	///<Words of the last command, with their CRC
+	uint8_t resultLen;	///<Bytes of result left to read. 0: a read is not acknowledged
+	uint16_t id;	///<ID register
+	uint16_t temperature;	///<Raw temperature the next measurement gives
+	uint16_t humidity;	///<Raw relative humidity the next measurement gives
+	bool badCrc;	///<Corrupts the CRC of the next results
+	uint32_t wakeups;	///<Wake-up commands
+	uint32_t measurements;	///<Measure commands
+};
+
+/******************************************************************************
+* Global Variables
+******************************************************************************/
+extern struct SimSeesaw simSeesaw;
+extern struct SimLsm6ds3 simLsm6ds3;
+extern struct SimShtc3 simShtc3;
+
+/******************************************************************************
+* Global Function Declarations
+******************************************************************************/
+void sim_start(UBaseType_t priority);
+uint64_t sim_now_us(void);
+void sim_interrupt_at(uint64_t atUs, SimInterruptHandler handler, void *context);
+bool sim_interrupt_cancel(SimInterruptHandler handler, void *context);
+
+void sim_i2c_attach(struct SimI2cDevice *device);
+const struct SimI2cCounters *sim_i2c_bus_counters(void);
+void sim_i2c_reset_counters(void);
+bool sim_i2c_bus_owned(void);
+void sim_i2c_report(const char *title);
+
+void sim_seesaw_attach(void);
+void sim_seesaw_key(uint8_t key, bool pressed);
+void sim_lsm6ds3_attach(void);
+void sim_shtc3_attach(void);
+
+#endif /* SIM_H_ */
@@ -0,0 +1,286 @@
+/**************************************************************************//**
+* @file      sim_i2c.c
+* @brief     ASF SERCOM I2C master job API on a simulated bus
+* @details   See sim.h. The device answers the address and handles the payload when the job starts. The job then
+*			 takes the time of its START, address byte, payload bytes and STOP (9 bits a byte with its ACK) at the
+*			 configured SCL frequency, plus the clock stretching of the device, and ends with the callback the ASF
+*			 interrupt handler would call: WRITE_COMPLETE or READ_COMPLETE, or ERROR with STATUS_ERR_BAD_ADDRESS on a NACK.
+*			 Like the ASF, a job ended by a NACK only sends the STOP if the job was to send one: after a NACK in
+*			 i2c_master_write_packet_job_no_stop the bus stays owned until i2c_master_send_stop.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "sim.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SIM_I2C_BITS_PER_BYTE	9	///<8 data bits and the ACK
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static struct SimI2cDevice *simI2cDevices[SIM_I2C_MAX_DEVICES];
+static uint8_t simI2cDeviceCount = 0;
+static struct SimI2cCounters simI2cBus;	///<Traffic of the whole bus, NACKed addresses included
+static uint32_t simI2cSpeedKhz = 100;	///<SCL frequency set by i2c_master_init
+static bool simI2cOwned = false;	///<The bus was not released after the last transfer: the next START is a repeated START
+static uint16_t simI2cJobAddress;	///<Address of the job in progress
+static bool simI2cJobAck;	///<The device of the job in progress acknowledged its address
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static struct SimI2cDevice *sim_i2c_find(uint16_t address)
+{
+	for (uint8_t i = 0; i < simI2cDeviceCount; i++)
+	{
+		if (simI2cDevices[i]->address == address) return simI2cDevices[i];
+	}
+	return NULL;
+}
+
+static void sim_i2c_callback(struct i2c_master_module *const module, enum i2c_master_callback type)
+{
+	uint8_t mask = 1 << type;
+	if ((module->registered_callback & module->enabled_callback & mask) && module->callbacks[type] != NULL) module->callbacks[type](module);
+}
+
+/**************************************************************************//**
+* @fn		static void sim_i2c_job_done(void *context)
+* @brief	End of a job: the callback the SERCOM interrupt handler would call
+* @note		Simulated interrupt
+*****************************************************************************/
+static void sim_i2c_job_done(void *context)
+{
+	struct i2c_master_module *const module = (struct i2c_master_module *)context;
+
+	module->buffer_remaining = 0;
+	simI2cOwned = !module->send_stop;
+	if (!simI2cJobAck)
+	{
+		module->status = STATUS_ERR_BAD_ADDRESS;
+		sim_i2c_callback(module, I2C_MASTER_CALLBACK_ERROR);
+		return;
+	}
+	module->status = STATUS_OK;
+	sim_i2c_callback(module, (module->transfer_direction == I2C_TRANSFER_READ) ? I2C_MASTER_CALLBACK_READ_COMPLETE : I2C_MASTER_CALLBACK_WRITE_COMPLETE);
+}
+
+static void sim_i2c_count(struct SimI2cCounters *counters, bool ack, bool read, uint16_t len, uint64_t us)
+{
+	counters->transfers++;
+	counters->busyUs += us;
+	if (!ack) counters->nacks++;
+	else if (read) counters->bytesIn += len;
+	else counters->bytesOut += len;
+}
+
+/**************************************************************************//**
+* @fn		static enum status_code sim_i2c_start_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet, enum i2c_transfer_direction direction, bool stop)
+* @brief	Starts a job: the device answers the address and handles the payload, and the job ends after the time its bits take
+* @details	A NACKed address ends the job after the address byte
+*****************************************************************************/
+static enum status_code sim_i2c_start_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet, enum i2c_transfer_direction direction, bool stop)
+{
+	struct SimI2cDevice *device = sim_i2c_find(packet->address);
+	bool read = (direction == I2C_TRANSFER_READ);
+	uint16_t len = packet->data_length;
+	uint32_t bits;
+	uint64_t us;
+
+	if (module->buffer_remaining > 0) return STATUS_BUSY;
+	simI2cJobAck = false;
+	if (device != NULL) simI2cJobAck = read ? device->read(device, packet->data, len) : device->write(device, packet->data, len);
+	bits = ((simI2cJobAck ? len : 0) + 1) * SIM_I2C_BITS_PER_BYTE + 1 + ((stop || !simI2cJobAck) ? 1 : 0);
+	us = (bits * 1000UL + simI2cSpeedKhz - 1) / simI2cSpeedKhz;
+	if (device != NULL) us += device->stretchUs;
+	sim_i2c_count(&simI2cBus, simI2cJobAck, read, len, us);
+	if (device != NULL) sim_i2c_count(&device->counters, simI2cJobAck, read, len, us);
+
+	module->buffer = packet->data;
+	module->buffer_length = len;
+	module->buffer_remaining = len ? len : 1;
+	module->transfer_direction = direction;
+	module->send_stop = stop;
+	module->status = STATUS_BUSY;
+	simI2cJobAddress = packet->address;
+	sim_interrupt_at(sim_now_us() + us, sim_i2c_job_done, module);
+	return STATUS_OK;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void sim_i2c_attach(struct SimI2cDevice *device)
+* @brief	Connects a device to the bus. Its counters are cleared
+*****************************************************************************/
+void sim_i2c_attach(struct SimI2cDevice *device)
+{
+	if (sim_i2c_find(device->address) == NULL)
+	{
+		if (simI2cDeviceCount >= SIM_I2C_MAX_DEVICES)
+		{
+			fprintf(stderr, "sim: too many I2C devices, raise SIM_I2C_MAX_DEVICES\n");
+			exit(2);
+		}
+		simI2cDevices[simI2cDeviceCount++] = device;
+	}
+	memset(&device->counters, 0, sizeof(device->counters));
+}
+
+/**************************************************************************//**
+* @fn		const struct SimI2cCounters *sim_i2c_bus_counters(void)
+* @brief	Returns the traffic of the whole bus, transfers to absent devices included
+*****************************************************************************/
+const struct SimI2cCounters *sim_i2c_bus_counters(void)
+{
+	return &simI2cBus;
+}
+
+/**************************************************************************//**
+* @fn		void sim_i2c_reset_counters(void)
+* @brief	Clears the counters of the bus and of every device
+*****************************************************************************/
+void sim_i2c_reset_counters(void)
+{
+	memset(&simI2cBus, 0, sizeof(simI2cBus));
+	for (uint8_t i = 0; i < simI2cDeviceCount; i++) memset(&simI2cDevices[i]->counters, 0, sizeof(simI2cDevices[i]->counters));
+}
+
+/**************************************************************************//**
+* @fn		bool sim_i2c_bus_owned(void)
+* @brief	Tells whether the master still owns the bus: the last transfer ended without a STOP
+*****************************************************************************/
+bool sim_i2c_bus_owned(void)
+{
+	return simI2cOwned;
+}
+
+/**************************************************************************//**
+* @fn		void sim_i2c_report(const char *title)
+* @brief	Prints the traffic of every device and of the bus since the last sim_i2c_reset_counters
+*****************************************************************************/
+void sim_i2c_report(const char *title)
+{
+	printf("  %s, %u kHz:\n", title, (unsigned)simI2cSpeedKhz);
+	printf("    %-8s %9s %9s %9s %6s %8s %10s\n", "device", "transfers", "bytes out", "bytes in", "nacks", "aborted", "bus us");
+	for (uint8_t i = 0; i < simI2cDeviceCount; i++)
+	{
+		const struct SimI2cCounters *c = &simI2cDevices[i]->counters;
+		if (c->transfers == 0 && c->aborted == 0) continue;
+		printf("    %-8s %9u %9u %9u %6u %8u %10llu\n", simI2cDevices[i]->name, (unsigned)c->transfers, (unsigned)c->bytesOut, (unsigned)c->bytesIn,
+			   (unsigned)c->nacks, (unsigned)c->aborted, (unsigned long long)c->busyUs);
+	}
+	printf("    %-8s %9u %9u %9u %6u %8u %10llu\n", "bus", (unsigned)simI2cBus.transfers, (unsigned)simI2cBus.bytesOut, (unsigned)simI2cBus.bytesIn,
+		   (unsigned)simI2cBus.nacks, (unsigned)simI2cBus.aborted, (unsigned long long)simI2cBus.busyUs);
+}
+
+void i2c_master_get_config_defaults(struct i2c_master_config *const config)
+{
+	memset(config, 0, sizeof(*config));
+	config->baud_rate = 100;
+	config->transfer_speed = I2C_MASTER_SPEED_STANDARD_AND_FAST;
+	config->buffer_timeout = 65535;
+	config->unknown_bus_state_timeout = 65535;
+	config->pinmux_pad0 = PINMUX_DEFAULT;
+	config->pinmux_pad1 = PINMUX_DEFAULT;
+}
+
+/**************************************************************************//**
+* @fn		enum status_code i2c_master_init(struct i2c_master_module *const module, Sercom *const hw, const struct i2c_master_config *const config)
+* @brief	Sets the SCL frequency of the bus
+* @return	Returns STATUS_ERR_BAUDRATE_UNAVAILABLE above 400 kHz without Fast-mode Plus, like the SERCOM
+*****************************************************************************/
+enum status_code i2c_master_init(struct i2c_master_module *const module, Sercom *const hw, const struct i2c_master_config *const config)
+{
+	if (config->baud_rate == 0 || config->baud_rate > 1000) return STATUS_ERR_BAUDRATE_UNAVAILABLE;
+	if (config->baud_rate > 400 && config->transfer_speed != I2C_MASTER_SPEED_FAST_MODE_PLUS) return STATUS_ERR_BAUDRATE_UNAVAILABLE;
+	memset(module, 0, sizeof(*module));
+	module->hw = hw;
+	module->buffer_timeout = config->buffer_timeout;
+	module->unknown_bus_state_timeout = config->unknown_bus_state_timeout;
+	simI2cSpeedKhz = config->baud_rate;
+	simI2cOwned = false;
+	return STATUS_OK;
+}
+
+void i2c_master_reset(struct i2c_master_module *const module)
+{
+	i2c_master_cancel_job(module);
+	simI2cOwned = false;
+}
+
+void i2c_master_enable(const struct i2c_master_module *const module)
+{
+}
+
+void i2c_master_send_stop(struct i2c_master_module *const module)
+{
+	simI2cOwned = false;
+}
+
+void i2c_master_register_callback(struct i2c_master_module *const module, i2c_master_callback_t callback, enum i2c_master_callback callback_type)
+{
+	module->callbacks[callback_type] = callback;
+	module->registered_callback |= (1 << callback_type);
+}
+
+void i2c_master_unregister_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type)
+{
+	module->callbacks[callback_type] = NULL;
+	module->registered_callback &= ~(1 << callback_type);
+}
+
+void i2c_master_enable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type)
+{
+	module->enabled_callback |= (1 << callback_type);
+}
+
+void i2c_master_disable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type)
+{
+	module->enabled_callback &= ~(1 << callback_type);
+}
+
+enum status_code i2c_master_read_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return sim_i2c_start_job(module, packet, I2C_TRANSFER_READ, true);
+}
+
+enum status_code i2c_master_write_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return sim_i2c_start_job(module, packet, I2C_TRANSFER_WRITE, true);
+}
+
+enum status_code i2c_master_write_packet_job_no_stop(struct i2c_master_module *const module, struct i2c_master_packet *const packet)
+{
+	return sim_i2c_start_job(module, packet, I2C_TRANSFER_WRITE, false);
+}
+
+/**************************************************************************//**
+* @fn		void i2c_master_cancel_job(struct i2c_master_module *const module)
+* @brief	Drops the job in progress: its callback is not called. The transfer counts as aborted
+*****************************************************************************/
+void i2c_master_cancel_job(struct i2c_master_module *const module)
+{
+	if (module->buffer_remaining == 0) return;
+	if (sim_interrupt_cancel(sim_i2c_job_done, module))
+	{
+		struct SimI2cDevice *device = sim_i2c_find(simI2cJobAddress);
+		simI2cBus.aborted++;
+		if (device != NULL) device->counters.aborted++;
+	}
+	module->buffer_remaining = 0;
+	module->status = STATUS_ABORTED;
+}
+
+enum status_code i2c_master_get_job_status(struct i2c_master_module *const module)
+{
+	return module->status;
+}
@@ -0,0 +1,212 @@
+/**************************************************************************//**
+* @file      sim_lsm6ds3.c
+* @brief     Register model of the LSM6DS3: register file, accelerometer output and FIFO
+* @details   A write sets the register address, then writes the registers from it; a read returns the registers
+*			 from the address of the last write. The address moves on after each byte while CTRL3_C.IF_INC is set,
+*			 and rolls back from FIFO_DATA_OUT_H to FIFO_DATA_OUT_L, so a burst read drains consecutive FIFO words.
+*
+*			 The accelerometer makes a sample every period of CTRL1_XL.ODR_XL: sample n is X = n, Y = -n, Z = 1 g
+*			 (+/-2 g scale), so a reader can tell a lost or repeated sample. In FIFO or stream mode, with the
+*			 accelerometer batched (FIFO_CTRL3.DEC_FIFO_XL), each sample adds its X, Y, Z words to the FIFO. The FIFO
+*			 runs at the accelerometer rate whatever FIFO_CTRL5.ODR_FIFO is, and the gyroscope is never batched.
+*			 A full FIFO stops in FIFO mode, and drops its oldest sample in stream mode; both set FIFO_OVER_RUN
+*			 until the FIFO is emptied by bypass mode.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "sim.h"
+#include "IMU/lsm6ds_reg.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SIM_LSM6DS3_CTRL3_C_DEFAULT	0x04	///<IF_INC set
+#define SIM_LSM6DS3_1G				16384	///<1 g at +/-2 g full scale (0.061 mg/LSB)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct SimLsm6ds3 simLsm6ds3;
+
+///Output data rates of CTRL1_XL.ODR_XL, in mHz. 0: power down
+static const uint32_t simLsm6ds3OdrMilliHz[16] = {0, 12500, 26000, 52000, 104000, 208000, 416000, 833000, 1660000, 3330000, 6660000};
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static void sim_lsm6ds3_fifo_clear(void)
+{
+	simLsm6ds3.fifoHead = 0;
+	simLsm6ds3.fifoCount = 0;
+	simLsm6ds3.pattern = 0;
+	simLsm6ds3.overrun = false;
+}
+
+static void sim_lsm6ds3_reset(void)
+{
+	memset(simLsm6ds3.regs, 0, sizeof(simLsm6ds3.regs));
+	simLsm6ds3.regs[LSM6DS3_WHO_AM_I] = LSM6DS3_ID;
+	simLsm6ds3.regs[LSM6DS3_CTRL3_C] = SIM_LSM6DS3_CTRL3_C_DEFAULT;
+	simLsm6ds3.pointer = 0;
+	simLsm6ds3.samples = 0;
+	simLsm6ds3.nextSampleUs = 0;
+	sim_lsm6ds3_fifo_clear();
+}
+
+static uint32_t sim_lsm6ds3_period_us(void)
+{
+	uint32_t milliHz = simLsm6ds3OdrMilliHz[simLsm6ds3.regs[LSM6DS3_CTRL1_XL] >> 4];
+	return milliHz ? (uint32_t)(1000000000ULL / milliHz) : 0;
+}
+
+static void sim_lsm6ds3_fifo_push(uint16_t word)
+{
+	simLsm6ds3.fifo[(simLsm6ds3.fifoHead + simLsm6ds3.fifoCount) % SIM_LSM6DS3_FIFO_WORDS] = word;
+	simLsm6ds3.fifoCount++;
+}
+
+/**************************************************************************//**
+* @fn		static void sim_lsm6ds3_sample(void)
+* @brief	Makes the next accelerometer sample: output registers, then the FIFO
+*****************************************************************************/
+static void sim_lsm6ds3_sample(void)
+{
+	uint8_t mode = simLsm6ds3.regs[LSM6DS3_FIFO_CTRL5] & 0x07;
+	int16_t xyz[3] = {(int16_t)simLsm6ds3.samples, (int16_t)-simLsm6ds3.samples, SIM_LSM6DS3_1G};
+
+	for (uint8_t axis = 0; axis < 3; axis++)
+	{
+		simLsm6ds3.regs[LSM6DS3_OUTX_L_XL + 2 * axis] = (uint8_t)xyz[axis];
+		simLsm6ds3.regs[LSM6DS3_OUTX_L_XL + 2 * axis + 1] = (uint8_t)((uint16_t)xyz[axis] >> 8);
+	}
+	simLsm6ds3.samples++;
+	if (mode == LSM6DS3_BYPASS_MODE || (simLsm6ds3.regs[LSM6DS3_FIFO_CTRL3] & 0x07) == 0) return;
+	if (simLsm6ds3.fifoCount + 3 > SIM_LSM6DS3_FIFO_WORDS - SIM_LSM6DS3_FIFO_WORDS % 3)
+	{
+		simLsm6ds3.overrun = true;
+		if (mode != LSM6DS3_STREAM_MODE) return;
+		simLsm6ds3.fifoHead = (simLsm6ds3.fifoHead + 3) % SIM_LSM6DS3_FIFO_WORDS;
+		simLsm6ds3.fifoCount -= 3;
+	}
+	for (uint8_t axis = 0; axis < 3; axis++) sim_lsm6ds3_fifo_push((uint16_t)xyz[axis]);
+}
+
+/**************************************************************************//**
+* @fn		static void sim_lsm6ds3_update(void)
+* @brief	Makes the samples due by now
+*****************************************************************************/
+static void sim_lsm6ds3_update(void)
+{
+	uint32_t period = sim_lsm6ds3_period_us();
+	if (period == 0) return;
+	while (simLsm6ds3.nextSampleUs <= sim_now_us())
+	{
+		sim_lsm6ds3_sample();
+		simLsm6ds3.nextSampleUs += period;
+	}
+}
+
+static uint16_t sim_lsm6ds3_fifo_pop(void)
+{
+	uint16_t word = 0;
+	if (simLsm6ds3.fifoCount == 0) return word;
+	word = simLsm6ds3.fifo[simLsm6ds3.fifoHead];
+	simLsm6ds3.fifoHead = (simLsm6ds3.fifoHead + 1) % SIM_LSM6DS3_FIFO_WORDS;
+	simLsm6ds3.fifoCount--;
+	simLsm6ds3.pattern = (simLsm6ds3.pattern + 1) % 3;
+	return word;
+}
+
+static uint8_t sim_lsm6ds3_read_reg(uint8_t reg)
+{
+	uint16_t watermark = simLsm6ds3.regs[LSM6DS3_FIFO_CTRL1] | ((uint16_t)(simLsm6ds3.regs[LSM6DS3_FIFO_CTRL2] & 0x0F) << 8);
+	switch (reg)
+	{
+		case LSM6DS3_FIFO_STATUS1:
+			return (uint8_t)simLsm6ds3.fifoCount;
+		case LSM6DS3_FIFO_STATUS2:
+			return (uint8_t)(((simLsm6ds3.fifoCount >> 8) & 0x0F)
+				| ((simLsm6ds3.fifoCount == 0) ? 0x10 : 0)
+				| ((simLsm6ds3.fifoCount + 3 > SIM_LSM6DS3_FIFO_WORDS - SIM_LSM6DS3_FIFO_WORDS % 3) ? 0x20 : 0)
+				| (simLsm6ds3.overrun ? 0x40 : 0)
+				| ((watermark != 0 && simLsm6ds3.fifoCount >= watermark) ? 0x80 : 0));
+		case LSM6DS3_FIFO_STATUS3:
+			return simLsm6ds3.pattern;
+		case LSM6DS3_FIFO_STATUS4:
+			return 0;
+		case LSM6DS3_FIFO_DATA_OUT_L:
+			simLsm6ds3.fifoWord = sim_lsm6ds3_fifo_pop();
+			return (uint8_t)simLsm6ds3.fifoWord;
+		case LSM6DS3_FIFO_DATA_OUT_H:
+			return (uint8_t)(simLsm6ds3.fifoWord >> 8);
+		default:
+			return simLsm6ds3.regs[reg & 0x7F];
+	}
+}
+
+static void sim_lsm6ds3_write_reg(uint8_t reg, uint8_t value)
+{
+	reg &= 0x7F;
+	if (reg == LSM6DS3_WHO_AM_I || (reg >= LSM6DS3_OUT_TEMP_L - 2 && reg <= LSM6DS3_FIFO_DATA_OUT_H)) return; //Read only
+	if (reg == LSM6DS3_CTRL3_C && (value & 0x81))
+	{
+		sim_lsm6ds3_reset(); //SW_RESET or BOOT. Both bits clear themselves
+		return;
+	}
+	simLsm6ds3.regs[reg] = value;
+	if (reg == LSM6DS3_CTRL1_XL) simLsm6ds3.nextSampleUs = sim_now_us() + sim_lsm6ds3_period_us();
+	if (reg == LSM6DS3_FIFO_CTRL5 && (value & 0x07) == LSM6DS3_BYPASS_MODE) sim_lsm6ds3_fifo_clear();
+}
+
+static void sim_lsm6ds3_next(void)
+{
+	if (simLsm6ds3.pointer == LSM6DS3_FIFO_DATA_OUT_H) simLsm6ds3.pointer = LSM6DS3_FIFO_DATA_OUT_L;
+	else if (simLsm6ds3.regs[LSM6DS3_CTRL3_C] & 0x04) simLsm6ds3.pointer = (simLsm6ds3.pointer + 1) & 0x7F;
+}
+
+static bool sim_lsm6ds3_write(struct SimI2cDevice *device, const uint8_t *data, uint16_t len)
+{
+	sim_lsm6ds3_update();
+	if (len == 0) return true;
+	simLsm6ds3.pointer = data[0] & 0x7F;
+	for (uint16_t i = 1; i < len; i++)
+	{
+		sim_lsm6ds3_write_reg(simLsm6ds3.pointer, data[i]);
+		sim_lsm6ds3_next();
+	}
+	return true;
+}
+
+static bool sim_lsm6ds3_read(struct SimI2cDevice *device, uint8_t *data, uint16_t len)
+{
+	sim_lsm6ds3_update();
+	for (uint16_t i = 0; i < len; i++)
+	{
+		data[i] = sim_lsm6ds3_read_reg(simLsm6ds3.pointer);
+		sim_lsm6ds3_next();
+	}
+	return true;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void sim_lsm6ds3_attach(void)
+* @brief	Connects an LSM6DS3, just powered up, at LSM6DS3_I2C_ADD_L
+*****************************************************************************/
+void sim_lsm6ds3_attach(void)
+{
+	simLsm6ds3.device.name = "lsm6ds3";
+	simLsm6ds3.device.address = LSM6DS3_I2C_ADD_L >> 1;
+	simLsm6ds3.device.write = sim_lsm6ds3_write;
+	simLsm6ds3.device.read = sim_lsm6ds3_read;
+	simLsm6ds3.device.stretchUs = 0;
+	sim_lsm6ds3_reset();
+	sim_i2c_attach(&simLsm6ds3.device);
+}
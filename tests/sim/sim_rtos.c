@@ -0,0 +1,497 @@
+/**************************************************************************//**
+* @file      sim_rtos.c
+* @brief     Host simulation of the FreeRTOS kernel: tasks, delays, notifications, queues and semaphores
+* @details   See sim.h. Every task is a thread that only runs while it holds simLock and is simCurrent: a task
+*			 blocks by handing both to the next task (sim_schedule) and waiting on its own condition variable.
+*			 Interrupts are callbacks due at a virtual time; they run at the next scheduling point at or after it.
+*			 Waiters are all woken when an object changes and retry, the way xQueueReceive loops on the target.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <pthread.h>
+#include "sim.h"
+#include "RuntimeStats/RuntimeStats.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SIM_FOREVER		UINT64_MAX	///<Wake-up time of a task with no timeout
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///A task and its thread
+struct SimTask {
+	char name[configMAX_TASK_NAME_LEN];
+	UBaseType_t priority;
+	TaskFunction_t function;
+	void *parameters;
+	pthread_t thread;
+	pthread_cond_t turn;	///<Signaled when the task becomes simCurrent
+	bool ready;	///<Not blocked
+	uint64_t readySeq;	///<Order the ready tasks of a priority run in
+	const void *waitObject;	///<Object the task is blocked on, NULL for a delay
+	uint64_t wakeUs;	///<Timeout, SIM_FOREVER if none
+	bool timedOut;	///<The last block ended on its timeout
+	uint32_t notifyValue;	///<Notification value (xTaskNotifyGive / ulTaskNotifyTake)
+};
+
+///Queue, or semaphore (queue of items of size 0)
+struct SimQueue {
+	uint8_t *items;
+	UBaseType_t length;
+	UBaseType_t itemSize;
+	UBaseType_t count;	///<Items in the queue
+	UBaseType_t head;	///<Index of the oldest item
+};
+
+///Pending simulated interrupt
+struct SimInterrupt {
+	uint64_t atUs;
+	uint64_t seq;	///<Interrupts due at the same time run in the order they were raised
+	SimInterruptHandler handler;	///<NULL for a free slot
+	void *context;
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int hostCriticalNesting = 0;	///<See asf.h. While not 0, a task does not lose the CPU to a task it wakes
+static pthread_mutex_t simLock = PTHREAD_MUTEX_INITIALIZER;	///<Held by the running task
+static struct SimTask simTasks[SIM_MAX_TASKS];
+static uint8_t simTaskCount = 0;
+static struct SimTask *simCurrent = NULL;	///<Running task
+static struct SimInterrupt simInterrupts[SIM_MAX_INTERRUPTS];
+static uint64_t simNowUs = 0;	///<Virtual time
+static uint64_t simSeq = 0;	///<Source of readySeq and SimInterrupt.seq
+static int simSuspended = 0;	///<vTaskSuspendAll nesting
+static bool simInInterrupt = false;	///<An interrupt handler is running
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void sim_fail(const char *why)
+* @brief	Stops the test with the state of every task, e.g. when they are all blocked forever
+*****************************************************************************/
+static void sim_fail(const char *why)
+{
+	fprintf(stderr, "sim: %s at %llu us\n", why, (unsigned long long)simNowUs);
+	for (uint8_t i = 0; i < simTaskCount; i++)
+	{
+		struct SimTask *task = &simTasks[i];
+		fprintf(stderr, "  %-8s prio %lu %s%s\n", task->name, (unsigned long)task->priority, task->ready ? "ready" : "blocked",
+				(!task->ready && task->wakeUs == SIM_FOREVER) ? " forever" : "");
+	}
+	exit(2);
+}
+
+static void sim_make_ready(struct SimTask *task, bool timedOut)
+{
+	task->ready = true;
+	task->readySeq = ++simSeq;
+	task->waitObject = NULL;
+	task->wakeUs = SIM_FOREVER;
+	task->timedOut = timedOut;
+}
+
+/**************************************************************************//**
+* @fn		static struct SimTask *sim_pick(void)
+* @brief	Returns the highest priority ready task, the one ready first among equals. NULL if none
+*****************************************************************************/
+static struct SimTask *sim_pick(void)
+{
+	struct SimTask *best = NULL;
+	for (uint8_t i = 0; i < simTaskCount; i++)
+	{
+		struct SimTask *task = &simTasks[i];
+		if (!task->ready) continue;
+		if (best == NULL || task->priority > best->priority || (task->priority == best->priority && task->readySeq < best->readySeq)) best = task;
+	}
+	return best;
+}
+
+/**************************************************************************//**
+* @fn		static void sim_run_due(void)
+* @brief	Runs the interrupts due by now, in order, then wakes the tasks whose timeout is over
+*****************************************************************************/
+static void sim_run_due(void)
+{
+	for (;;)
+	{
+		struct SimInterrupt *next = NULL;
+		for (uint8_t i = 0; i < SIM_MAX_INTERRUPTS; i++)
+		{
+			struct SimInterrupt *irq = &simInterrupts[i];
+			if (irq->handler == NULL || irq->atUs > simNowUs) continue;
+			if (next == NULL || irq->atUs < next->atUs || (irq->atUs == next->atUs && irq->seq < next->seq)) next = irq;
+		}
+		if (next == NULL) break;
+		struct SimInterrupt irq = *next;
+		next->handler = NULL;
+		simInInterrupt = true;
+		irq.handler(irq.context);
+		simInInterrupt = false;
+	}
+	for (uint8_t i = 0; i < simTaskCount; i++)
+	{
+		struct SimTask *task = &simTasks[i];
+		if (!task->ready && task->wakeUs <= simNowUs) sim_make_ready(task, true);
+	}
+}
+
+/**************************************************************************//**
+* @fn		static void sim_schedule(void)
+* @brief	Hands the CPU to the highest priority ready task, the caller included, moving the time on while none is
+* @details	Returns when the caller runs again
+*****************************************************************************/
+static void sim_schedule(void)
+{
+	struct SimTask *self = simCurrent;
+	struct SimTask *next;
+
+	for (;;)
+	{
+		sim_run_due();
+		next = sim_pick();
+		if (next != NULL) break;
+		uint64_t wake = SIM_FOREVER;
+		for (uint8_t i = 0; i < SIM_MAX_INTERRUPTS; i++)
+		{
+			if (simInterrupts[i].handler != NULL && simInterrupts[i].atUs < wake) wake = simInterrupts[i].atUs;
+		}
+		for (uint8_t i = 0; i < simTaskCount; i++)
+		{
+			if (simTasks[i].wakeUs < wake) wake = simTasks[i].wakeUs;
+		}
+		if (wake == SIM_FOREVER) sim_fail("deadlock: every task is blocked forever");
+		simNowUs = wake;
+	}
+	if (next == self) return;
+	simCurrent = next;
+	pthread_cond_signal(&next->turn);
+	while (simCurrent != self) pthread_cond_wait(&self->turn, &simLock);
+}
+
+/**************************************************************************//**
+* @fn		static void sim_preempt(void)
+* @brief	Gives the CPU to a ready task of higher priority than the running one, like the end of a kernel call
+* @details	Deferred inside an interrupt, a critical section or with the scheduler suspended
+*****************************************************************************/
+static void sim_preempt(void)
+{
+	struct SimTask *best;
+	if (simInInterrupt || simSuspended != 0 || hostCriticalNesting != 0) return;
+	best = sim_pick();
+	if (best != NULL && best->priority > simCurrent->priority) sim_schedule();
+}
+
+/**************************************************************************//**
+* @fn		static bool sim_wake(const void *object)
+* @brief	Readies every task blocked on object. They check it again when they run
+* @return	Returns true if a woken task has a higher priority than the running one
+*****************************************************************************/
+static bool sim_wake(const void *object)
+{
+	bool higher = false;
+	for (uint8_t i = 0; i < simTaskCount; i++)
+	{
+		struct SimTask *task = &simTasks[i];
+		if (task->ready || task->waitObject != object) continue;
+		sim_make_ready(task, false);
+		if (task->priority > simCurrent->priority) higher = true;
+	}
+	return higher;
+}
+
+/**************************************************************************//**
+* @fn		static uint64_t sim_deadline(TickType_t ticks)
+* @brief	Returns the time a wait of ticks ends at: on a tick boundary, like the tick interrupt would wake the task
+*****************************************************************************/
+static uint64_t sim_deadline(TickType_t ticks)
+{
+	if (ticks == portMAX_DELAY) return SIM_FOREVER;
+	return (simNowUs / SIM_TICK_US + ticks) * SIM_TICK_US;
+}
+
+/**************************************************************************//**
+* @fn		static bool sim_block(const void *object, uint64_t deadline)
+* @brief	Blocks the running task on object until it is woken or deadline
+* @return	Returns false if the deadline passed
+*****************************************************************************/
+static bool sim_block(const void *object, uint64_t deadline)
+{
+	struct SimTask *self = simCurrent;
+	if (deadline <= simNowUs) return false;
+	if (simInInterrupt || simSuspended != 0) sim_fail("blocking call from an interrupt or with the scheduler suspended");
+	self->ready = false;
+	self->waitObject = object;
+	self->wakeUs = deadline;
+	sim_schedule();
+	return !self->timedOut;
+}
+
+static void *sim_task_entry(void *arg)
+{
+	struct SimTask *task = (struct SimTask *)arg;
+	pthread_mutex_lock(&simLock);
+	while (simCurrent != task) pthread_cond_wait(&task->turn, &simLock);
+	task->function(task->parameters);
+	sim_fail("a task returned");
+	return NULL;
+}
+
+static struct SimTask *sim_new_task(const char *name, UBaseType_t priority)
+{
+	struct SimTask *task;
+	if (simTaskCount >= SIM_MAX_TASKS) sim_fail("too many tasks, raise SIM_MAX_TASKS");
+	task = &simTasks[simTaskCount++];
+	memset(task, 0, sizeof(*task));
+	snprintf(task->name, sizeof(task->name), "%s", name);
+	task->priority = priority;
+	pthread_cond_init(&task->turn, NULL);
+	sim_make_ready(task, false);
+	return task;
+}
+
+static struct SimQueue *sim_new_queue(UBaseType_t length, UBaseType_t itemSize, UBaseType_t count)
+{
+	struct SimQueue *queue = calloc(1, sizeof(struct SimQueue));
+	if (queue == NULL) return NULL;
+	queue->items = calloc(length, itemSize ? itemSize : 1);
+	queue->length = length;
+	queue->itemSize = itemSize;
+	queue->count = count;
+	return queue;
+}
+
+/**************************************************************************//**
+* @fn		static bool sim_queue_put(struct SimQueue *queue, const void *item, bool *higherPriorityTaskWoken)
+* @brief	Adds an item at the back of the queue and wakes its waiters
+* @param[out]	higherPriorityTaskWoken Set to true if a woken task has a higher priority than the running one
+* @return	Returns false if the queue is full
+*****************************************************************************/
+static bool sim_queue_put(struct SimQueue *queue, const void *item, bool *higherPriorityTaskWoken)
+{
+	if (queue->count >= queue->length) return false;
+	if (queue->itemSize != 0 && item != NULL)
+	{
+		memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->itemSize], item, queue->itemSize);
+	}
+	queue->count++;
+	*higherPriorityTaskWoken = sim_wake(queue);
+	return true;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void sim_start(UBaseType_t priority)
+* @brief	Makes the calling thread the running task, with the given priority. Call once, before any kernel call
+*****************************************************************************/
+void sim_start(UBaseType_t priority)
+{
+	struct SimTask *task;
+	pthread_mutex_lock(&simLock);
+	task = sim_new_task("main", priority);
+	task->thread = pthread_self();
+	simCurrent = task;
+}
+
+/**************************************************************************//**
+* @fn		uint64_t sim_now_us(void)
+* @brief	Returns the virtual time since sim_start, in us
+*****************************************************************************/
+uint64_t sim_now_us(void)
+{
+	return simNowUs;
+}
+
+/**************************************************************************//**
+* @fn		void sim_interrupt_at(uint64_t atUs, SimInterruptHandler handler, void *context)
+* @brief	Raises an interrupt at the given time. Its handler runs at the first scheduling point at or after it
+*****************************************************************************/
+void sim_interrupt_at(uint64_t atUs, SimInterruptHandler handler, void *context)
+{
+	for (uint8_t i = 0; i < SIM_MAX_INTERRUPTS; i++)
+	{
+		if (simInterrupts[i].handler != NULL) continue;
+		simInterrupts[i].atUs = atUs;
+		simInterrupts[i].seq = ++simSeq;
+		simInterrupts[i].handler = handler;
+		simInterrupts[i].context = context;
+		return;
+	}
+	sim_fail("too many pending interrupts, raise SIM_MAX_INTERRUPTS");
+}
+
+/**************************************************************************//**
+* @fn		bool sim_interrupt_cancel(SimInterruptHandler handler, void *context)
+* @brief	Drops the pending interrupts with this handler and context
+* @return	Returns true if there was one
+*****************************************************************************/
+bool sim_interrupt_cancel(SimInterruptHandler handler, void *context)
+{
+	bool found = false;
+	for (uint8_t i = 0; i < SIM_MAX_INTERRUPTS; i++)
+	{
+		if (simInterrupts[i].handler != handler || simInterrupts[i].context != context) continue;
+		simInterrupts[i].handler = NULL;
+		found = true;
+	}
+	return found;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint16_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *handle)
+{
+	struct SimTask *task = sim_new_task(name, priority);
+	task->function = function;
+	task->parameters = parameters;
+	if (handle != NULL) *handle = task;
+	if (pthread_create(&task->thread, NULL, sim_task_entry, task) != 0) sim_fail("pthread_create failed");
+	sim_preempt();
+	return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	if (ticks == 0)
+	{
+		sim_make_ready(simCurrent, false); //Behind the other ready tasks of its priority
+		sim_schedule();
+		return;
+	}
+	sim_block(NULL, sim_deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return (TickType_t)(simNowUs / SIM_TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return simCurrent;
+}
+
+void vTaskSuspendAll(void)
+{
+	simSuspended++;
+}
+
+BaseType_t xTaskResumeAll(void)
+{
+	simSuspended--;
+	sim_preempt();
+	return pdFALSE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+	struct SimTask *task = (struct SimTask *)handle;
+	task->notifyValue++;
+	sim_wake(&task->notifyValue);
+	sim_preempt();
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+	struct SimTask *self = simCurrent;
+	uint64_t deadline = sim_deadline(ticksToWait);
+	uint32_t value;
+	while (self->notifyValue == 0)
+	{
+		if (!sim_block(&self->notifyValue, deadline)) return 0;
+	}
+	value = self->notifyValue;
+	self->notifyValue = clearCountOnExit ? 0 : value - 1;
+	return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+	return sim_new_queue(length, itemSize, 0);
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticksToWait)
+{
+	struct SimQueue *queue = (struct SimQueue *)handle;
+	uint64_t deadline = sim_deadline(ticksToWait);
+	bool woken;
+	while (!sim_queue_put(queue, item, &woken))
+	{
+		if (!sim_block(queue, deadline)) return pdFAIL;
+	}
+	sim_preempt();
+	return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticksToWait)
+{
+	struct SimQueue *queue = (struct SimQueue *)handle;
+	uint64_t deadline = sim_deadline(ticksToWait);
+	while (queue->count == 0)
+	{
+		if (!sim_block(queue, deadline)) return pdFAIL;
+	}
+	if (queue->itemSize != 0) memcpy(item, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	sim_wake(queue); //Senders waiting for room
+	sim_preempt();
+	return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+	return sim_new_queue(1, 0, 0);
+}
+
+/**************************************************************************//**
+* @fn		SemaphoreHandle_t xSemaphoreCreateMutex(void)
+* @brief	Creates a mutex: a binary semaphore given at creation. No priority inheritance
+*****************************************************************************/
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	return sim_new_queue(1, 0, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+	return xQueueReceive(semaphore, NULL, ticksToWait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	return xQueueSend(semaphore, NULL, 0);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken)
+{
+	bool woken = false;
+	if (!sim_queue_put((struct SimQueue *)semaphore, NULL, &woken)) return pdFAIL;
+	if (woken && higherPriorityTaskWoken != NULL) *higherPriorityTaskWoken = pdTRUE;
+	return pdPASS;
+}
+
+/**************************************************************************//**
+* @fn		uint32_t RuntimeStatsGetCounter(void)
+* @brief	Run time statistics counter of the board (750 kHz), taken from the virtual time
+*****************************************************************************/
+uint32_t RuntimeStatsGetCounter(void)
+{
+	return (uint32_t)(simNowUs * 3 / 4);
+}
+
+uint32_t RuntimeStatsCountsToUs(uint32_t counts)
+{
+	return (uint32_t)(((uint64_t)counts * 4) / 3);
+}
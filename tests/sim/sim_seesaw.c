@@ -0,0 +1,168 @@
+/**************************************************************************//**
+* @file      sim_seesaw.c
+* @brief     Register model of the NeoTrellis Seesaw: status, Neopixel and keypad modules
+* @details   A write starts with the module and the register (base, function), followed by their data. A read
+*			 returns the register of the last write. Like the Seesaw firmware, the keypad FIFO only gets the edges
+*			 enabled for a key, reads past its last event return SEESAW_KEYPAD_FIFO_EMPTY, and a write longer
+*			 than its receive buffer loses its end. A read started less than SIM_SEESAW_READ_DELAY_US (keypad FIFO:
+*			 SIM_SEESAW_FIFO_DELAY_US) after the start of the register write returns garbage, as the firmware has not
+*			 prepared the register yet. Timing from the start of the write makes the model lenient by the write itself.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "sim.h"
+#include "SeesawDriver/Seesaw.h"
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct SimSeesaw simSeesaw;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static void sim_seesaw_reset(void)
+{
+	struct SimI2cDevice device = simSeesaw.device;
+	memset(&simSeesaw, 0, sizeof(simSeesaw));
+	simSeesaw.device = device;
+}
+
+static void sim_seesaw_neopixel(uint8_t function, const uint8_t *data, uint16_t len)
+{
+	switch (function)
+	{
+		case SEESAW_NEOPIXEL_PIN:
+			if (len >= 1) simSeesaw.neopixelPin = data[0];
+			break;
+		case SEESAW_NEOPIXEL_SPEED:
+			if (len >= 1) simSeesaw.neopixelSpeed = data[0];
+			break;
+		case SEESAW_NEOPIXEL_BUF_LENGTH:
+			if (len >= 2) simSeesaw.neopixelLength = ((uint16_t)data[0] << 8) | data[1];
+			if (simSeesaw.neopixelLength > SIM_SEESAW_PIXEL_BYTES) simSeesaw.neopixelLength = SIM_SEESAW_PIXEL_BYTES;
+			break;
+		case SEESAW_NEOPIXEL_BUF:
+			if (len >= 2)
+			{
+				uint16_t offset = ((uint16_t)data[0] << 8) | data[1];
+				for (uint16_t i = 2; i < len && offset < simSeesaw.neopixelLength; i++) simSeesaw.pixels[offset++] = data[i];
+			}
+			break;
+		case SEESAW_NEOPIXEL_SHOW:
+			memcpy(simSeesaw.shown, simSeesaw.pixels, sizeof(simSeesaw.shown));
+			simSeesaw.shows++;
+			break;
+	}
+}
+
+static void sim_seesaw_keypad(uint8_t function, const uint8_t *data, uint16_t len)
+{
+	switch (function)
+	{
+		case SEESAW_KEYPAD_EVENT:
+			if (len >= 2 && data[0] < sizeof(simSeesaw.keyActive))
+			{
+				union keyState state;
+				state.reg = data[1];
+				if (state.bit.STATE) simSeesaw.keyActive[data[0]] |= state.bit.ACTIVE;
+				else simSeesaw.keyActive[data[0]] &= ~state.bit.ACTIVE;
+			}
+			break;
+		case SEESAW_KEYPAD_INTENSET:
+			if (len >= 1 && (data[0] & 0x01)) simSeesaw.keypadInterrupt = true;
+			break;
+		case SEESAW_KEYPAD_INTENCLR:
+			if (len >= 1 && (data[0] & 0x01)) simSeesaw.keypadInterrupt = false;
+			break;
+	}
+}
+
+static bool sim_seesaw_write(struct SimI2cDevice *device, const uint8_t *data, uint16_t len)
+{
+	if (len > SIM_SEESAW_RX_SIZE)
+	{
+		simSeesaw.overlongWrites++;
+		len = SIM_SEESAW_RX_SIZE;
+	}
+	if (len < 2) return true;
+	simSeesaw.base = data[0];
+	simSeesaw.function = data[1];
+	simSeesaw.writeUs = sim_now_us();
+	if (simSeesaw.base == SEESAW_STATUS_BASE && simSeesaw.function == SEESAW_STATUS_SWRST) sim_seesaw_reset();
+	else if (simSeesaw.base == SEESAW_NEOPIXEL_BASE) sim_seesaw_neopixel(simSeesaw.function, &data[2], len - 2);
+	else if (simSeesaw.base == SEESAW_KEYPAD_BASE) sim_seesaw_keypad(simSeesaw.function, &data[2], len - 2);
+	return true;
+}
+
+static bool sim_seesaw_read(struct SimI2cDevice *device, uint8_t *data, uint16_t len)
+{
+	bool fifo = simSeesaw.base == SEESAW_KEYPAD_BASE && simSeesaw.function == SEESAW_KEYPAD_FIFO;
+
+	memset(data, 0, len);
+	if (len == 0) return true;
+	if (sim_now_us() < simSeesaw.writeUs + (fifo ? SIM_SEESAW_FIFO_DELAY_US : SIM_SEESAW_READ_DELAY_US))
+	{
+		simSeesaw.earlyReads++;
+		memset(data, 0xA5, len);
+		return true;
+	}
+	if (simSeesaw.base == SEESAW_STATUS_BASE && simSeesaw.function == SEESAW_STATUS_HW_ID)
+	{
+		data[0] = SEESAW_HW_ID_CODE;
+	}
+	else if (simSeesaw.base == SEESAW_KEYPAD_BASE && simSeesaw.function == SEESAW_KEYPAD_COUNT)
+	{
+		data[0] = simSeesaw.eventCount;
+	}
+	else if (fifo)
+	{
+		uint8_t count = (len < simSeesaw.eventCount) ? len : simSeesaw.eventCount;
+		memcpy(data, simSeesaw.events, count);
+		memset(&data[count], SEESAW_KEYPAD_FIFO_EMPTY, len - count);
+		simSeesaw.eventCount -= count;
+		memmove(simSeesaw.events, &simSeesaw.events[count], simSeesaw.eventCount);
+	}
+	return true;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void sim_seesaw_attach(void)
+* @brief	Connects a Seesaw, just powered up, at NEO_TRELLIS_ADDR
+*****************************************************************************/
+void sim_seesaw_attach(void)
+{
+	simSeesaw.device.name = "seesaw";
+	simSeesaw.device.address = NEO_TRELLIS_ADDR;
+	simSeesaw.device.write = sim_seesaw_write;
+	simSeesaw.device.read = sim_seesaw_read;
+	simSeesaw.device.stretchUs = 0;
+	sim_seesaw_reset();
+	sim_i2c_attach(&simSeesaw.device);
+}
+
+/**************************************************************************//**
+* @fn		void sim_seesaw_key(uint8_t key, bool pressed)
+* @brief	Presses or releases a key of the pad
+* @param[in]	key Seesaw key number (NEO_TRELLIS_KEY)
+* @note		The event is lost if its edge is not enabled or the FIFO is full, like on the Seesaw
+*****************************************************************************/
+void sim_seesaw_key(uint8_t key, bool pressed)
+{
+	uint8_t edge = pressed ? SEESAW_KEYPAD_EDGE_RISING : SEESAW_KEYPAD_EDGE_FALLING;
+	union keyEventRaw event;
+
+	if (key >= sizeof(simSeesaw.keyActive) || !(simSeesaw.keyActive[key] & (1 << edge))) return;
+	if (simSeesaw.eventCount >= SIM_SEESAW_FIFO_SIZE) return;
+	event.bit.NUM = key;
+	event.bit.EDGE = edge;
+	simSeesaw.events[simSeesaw.eventCount++] = event.reg;
+}
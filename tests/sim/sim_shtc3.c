@@ -0,0 +1,116 @@
+/**************************************************************************//**
+* @file      sim_shtc3.c
+* @brief     Model of the SHTC3: sleep, wake-up time, commands, conversion time and CRC of the results
+* @details   Asleep, the SHTC3 only acknowledges the wake-up command; after it, it acknowledges nothing for its
+*			 wake-up time. During a conversion (no clock stretching) it does not acknowledge a read. A read returns
+*			 the words of the last READ_ID or measure command, each followed by its CRC-8, temperature first.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "sim.h"
+#include "I2cDriver/shtc3.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define SIM_SHTC3_ID	0x0887	///<ID register of the part on the board
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+struct SimShtc3 simShtc3;
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static uint8_t sim_shtc3_crc8(uint16_t word)
+{
+	uint8_t crc = 0xFF;
+
+	crc ^= (uint8_t)(word >> 8);
+	for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+	crc ^= (uint8_t)word;
+	for (uint8_t bit = 0; bit < 8; bit++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+	return crc;
+}
+
+static void sim_shtc3_result(uint8_t index, uint16_t word)
+{
+	simShtc3.result[3 * index] = (uint8_t)(word >> 8);
+	simShtc3.result[3 * index + 1] = (uint8_t)word;
+	simShtc3.result[3 * index + 2] = sim_shtc3_crc8(word) ^ (simShtc3.badCrc ? 0x01 : 0x00);
+	simShtc3.resultLen = 3 * (index + 1);
+}
+
+static bool sim_shtc3_write(struct SimI2cDevice *device, const uint8_t *data, uint16_t len)
+{
+	uint16_t command;
+
+	if (len != 2) return simShtc3.awake && sim_now_us() >= simShtc3.readyUs && len == 0;
+	command = ((uint16_t)data[0] << 8) | data[1];
+	if (command == SHTC3_CMD_WAKEUP)
+	{
+		simShtc3.wakeups++;
+		if (!simShtc3.awake) simShtc3.readyUs = sim_now_us() + SIM_SHTC3_WAKEUP_US;
+		simShtc3.awake = true;
+		return true;
+	}
+	if (!simShtc3.awake || sim_now_us() < simShtc3.readyUs) return false;
+
+	switch (command)
+	{
+		case SHTC3_CMD_SLEEP:
+			simShtc3.awake = false;
+			simShtc3.resultLen = 0;
+			return true;
+		case SHTC3_CMD_SOFT_RESET:
+			simShtc3.resultLen = 0;
+			simShtc3.readyUs = sim_now_us() + SIM_SHTC3_WAKEUP_US;
+			return true;
+		case SHTC3_CMD_READ_ID:
+			sim_shtc3_result(0, simShtc3.id);
+			return true;
+		case SHTC3_CMD_MEASURE_NM:
+		case SHTC3_CMD_MEASURE_LPM:
+			simShtc3.measurements++;
+			simShtc3.resultLen = 0;
+			sim_shtc3_result(0, simShtc3.temperature);
+			sim_shtc3_result(1, simShtc3.humidity);
+			simShtc3.readyUs = sim_now_us() + ((command == SHTC3_CMD_MEASURE_NM) ? SIM_SHTC3_MEASURE_NM_US : SIM_SHTC3_MEASURE_LPM_US);
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool sim_shtc3_read(struct SimI2cDevice *device, uint8_t *data, uint16_t len)
+{
+	if (!simShtc3.awake || sim_now_us() < simShtc3.readyUs || simShtc3.resultLen == 0) return false;
+	memset(data, 0xFF, len);
+	memcpy(data, simShtc3.result, (len < simShtc3.resultLen) ? len : simShtc3.resultLen);
+	simShtc3.resultLen = 0;
+	return true;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		void sim_shtc3_attach(void)
+* @brief	Connects an SHTC3, asleep, at SHTC3_ADDRESS
+* @note		Set simShtc3.temperature and .humidity to the raw values the next measurement gives
+*****************************************************************************/
+void sim_shtc3_attach(void)
+{
+	struct SimI2cDevice device = {"shtc3", SHTC3_ADDRESS, sim_shtc3_write, sim_shtc3_read, 0, {0}};
+
+	memset(&simShtc3, 0, sizeof(simShtc3));
+	simShtc3.device = device;
+	simShtc3.id = SIM_SHTC3_ID;
+	sim_i2c_attach(&simShtc3.device);
+}
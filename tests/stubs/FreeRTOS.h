@@ -0,0 +1,8 @@
+/**************************************************************************//**
+* @file      FreeRTOS.h
+* @brief     Host stand-in for the FreeRTOS header of the same name. Everything is declared by asf.h
+* @date      2020-05-05
+
+******************************************************************************/
+
+#include "asf.h"
@@ -0,0 +1,93 @@
+/**************************************************************************//**
+* @file      asf.h
+* @brief     Host stand-in for the ASF and FreeRTOS headers of the firmware
+* @details   Declares the small part of the ASF and FreeRTOS API the modules under test use. The functions are
+*			 defined by each test (or its simulation), so a test controls time, notifications and the hardware.
+*			 Types and constants match the SAMD21 build where the modules depend on them.
+*			 sim/sim_rtos.c defines the whole kernel part, sim/sim_i2c.c the I2C master driver (i2c_master.h).
+* @date      2020-05-04
+
+******************************************************************************/
+
+#ifndef HOST_ASF_H_
+#define HOST_ASF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/******************************************************************************
+* SAMD21
+******************************************************************************/
+#define HMCRAMC0_ADDR	0x20000000u	///<Start of the RAM. Format strings below it are in flash
+
+/******************************************************************************
+* FreeRTOS
+******************************************************************************/
+typedef void * TaskHandle_t;
+typedef void * QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+///Task states, as reported by eTaskGetState
+typedef enum {
+	eRunning = 0,
+	eReady,
+	eBlocked,
+	eSuspended,
+	eDeleted,
+	eInvalid
+} eTaskState;
+
+#define pdFALSE				0
+#define pdTRUE				1
+#define pdPASS				1
+#define pdFAIL				0
+#define portMAX_DELAY		((TickType_t)0xFFFFFFFFu)
+#define configTICK_RATE_HZ	1000
+#define configMAX_PRIORITIES	5
+#define configMAX_TASK_NAME_LEN	8
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))
+
+///The tests run single threaded: critical sections only count, so a test can check they are balanced
+extern int hostCriticalNesting;
+#define taskENTER_CRITICAL()	(hostCriticalNesting++)
+#define taskEXIT_CRITICAL()		(hostCriticalNesting--)
+
+///The simulation runs every interrupt to completion before it picks the next task: there is nothing to yield to
+#define portYIELD_FROM_ISR(higherPriorityTaskWoken)	((void)(higherPriorityTaskWoken))
+
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint16_t stackDepth, void *parameters, UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticksToWait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticksToWait);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higherPriorityTaskWoken);
+
+///Declared in config/FreeRTOSConfig.h on the boards
+uint32_t RuntimeStatsGetCounter(void);
+
+/******************************************************************************
+* ASF
+******************************************************************************/
+#include "i2c_master_interrupt.h"
+
+#endif /* HOST_ASF_H_ */
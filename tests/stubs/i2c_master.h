@@ -0,0 +1,103 @@
+/**************************************************************************//**
+* @file      i2c_master.h
+* @brief     Host stand-in for the ASF SERCOM I2C master driver, callback mode (sam0/drivers/sercom/i2c/i2c_master.h)
+* @details   Same types, fields and names as the ASF, as far as the firmware uses them. The jobs run on the simulated
+*			 bus of sim/sim_i2c.c: each one ends, after the time the bytes take on the wire, with the callback the
+*			 SERCOM interrupt would call.
+* @date      2020-05-05
+
+******************************************************************************/
+
+#ifndef HOST_I2C_MASTER_H_
+#define HOST_I2C_MASTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "status_codes.h"
+
+/******************************************************************************
+* SAMD21
+******************************************************************************/
+typedef struct SercomHost Sercom;	///<Opaque: the simulated bus has no registers
+#define SERCOM0		((Sercom *)0x42000800UL)
+
+#define PINMUX_DEFAULT				0
+#define PINMUX_PA08C_SERCOM0_PAD0	((8UL << 16) | 2)
+#define PINMUX_PA09C_SERCOM0_PAD1	((9UL << 16) | 2)
+
+/******************************************************************************
+* Driver
+******************************************************************************/
+///Transfer speed modes
+enum i2c_master_transfer_speed {
+	I2C_MASTER_SPEED_STANDARD_AND_FAST = 0,
+	I2C_MASTER_SPEED_FAST_MODE_PLUS = 1UL << 24,
+	I2C_MASTER_SPEED_HIGH_SPEED = 2UL << 24,
+};
+
+///Direction of a transfer
+enum i2c_transfer_direction {
+	I2C_TRANSFER_WRITE = 0,
+	I2C_TRANSFER_READ  = 1,
+};
+
+///Callbacks of the job API
+enum i2c_master_callback {
+	I2C_MASTER_CALLBACK_WRITE_COMPLETE = 0,
+	I2C_MASTER_CALLBACK_READ_COMPLETE  = 1,
+	I2C_MASTER_CALLBACK_ERROR          = 2,
+	_I2C_MASTER_CALLBACK_N             = 3,
+};
+
+struct i2c_master_module;
+typedef void (*i2c_master_callback_t)(struct i2c_master_module *const module);
+
+///Packet of a read or write job
+struct i2c_master_packet {
+	uint16_t address;	///<7-bit address of the slave
+	uint16_t data_length;	///<Bytes to read or write
+	uint8_t *data;	///<Data to write, or where to put the data read
+	bool ten_bit_address;
+	bool high_speed;
+	uint8_t hs_master_code;
+};
+
+///Software instance of the driver
+struct i2c_master_module {
+	Sercom *hw;
+	volatile bool locked;
+	uint16_t unknown_bus_state_timeout;
+	uint16_t buffer_timeout;
+	bool send_stop;	///<The job in progress ends with a STOP. False for i2c_master_write_packet_job_no_stop
+	bool send_nack;
+	volatile i2c_master_callback_t callbacks[_I2C_MASTER_CALLBACK_N];
+	volatile uint8_t registered_callback;
+	volatile uint8_t enabled_callback;
+	volatile uint16_t buffer_length;
+	volatile uint16_t buffer_remaining;	///<Not 0 while a job is in progress
+	volatile uint8_t *buffer;
+	volatile enum i2c_transfer_direction transfer_direction;
+	volatile enum status_code status;	///<STATUS_BUSY while a job is in progress, then its result
+};
+
+///Configuration of the driver
+struct i2c_master_config {
+	uint32_t baud_rate;	///<SCL frequency, in kHz
+	uint32_t baud_rate_high_speed;
+	enum i2c_master_transfer_speed transfer_speed;
+	bool run_in_standby;
+	uint16_t buffer_timeout;
+	uint16_t unknown_bus_state_timeout;
+	uint32_t pinmux_pad0;
+	uint32_t pinmux_pad1;
+	bool scl_low_timeout;
+	bool inactive_timeout;
+};
+
+void i2c_master_get_config_defaults(struct i2c_master_config *const config);
+enum status_code i2c_master_init(struct i2c_master_module *const module, Sercom *const hw, const struct i2c_master_config *const config);
+void i2c_master_reset(struct i2c_master_module *const module);
+void i2c_master_enable(const struct i2c_master_module *const module);
+void i2c_master_send_stop(struct i2c_master_module *const module);
+
+#endif /* HOST_I2C_MASTER_H_ */
@@ -0,0 +1,24 @@
+/**************************************************************************//**
+* @file      i2c_master_interrupt.h
+* @brief     Host stand-in for the job API of the ASF SERCOM I2C master driver (sam0/drivers/sercom/i2c/i2c_master_interrupt.h)
+* @details   Defined by sim/sim_i2c.c
+* @date      2020-05-05
+
+******************************************************************************/
+
+#ifndef HOST_I2C_MASTER_INTERRUPT_H_
+#define HOST_I2C_MASTER_INTERRUPT_H_
+
+#include "i2c_master.h"
+
+void i2c_master_register_callback(struct i2c_master_module *const module, i2c_master_callback_t callback, enum i2c_master_callback callback_type);
+void i2c_master_unregister_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type);
+void i2c_master_enable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type);
+void i2c_master_disable_callback(struct i2c_master_module *const module, enum i2c_master_callback callback_type);
+enum status_code i2c_master_read_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+enum status_code i2c_master_write_packet_job(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+enum status_code i2c_master_write_packet_job_no_stop(struct i2c_master_module *const module, struct i2c_master_packet *const packet);
+void i2c_master_cancel_job(struct i2c_master_module *const module);
+enum status_code i2c_master_get_job_status(struct i2c_master_module *const module);
+
+#endif /* HOST_I2C_MASTER_INTERRUPT_H_ */
@@ -0,0 +1,58 @@
+/**************************************************************************//**
+* @file      status_codes.h
+* @brief     Host stand-in for the ASF status codes (sam0/utils/status_codes.h)
+* @details   Same values as the ASF, so errors passed through by the modules compare the same on the host.
+* @date      2020-05-05
+
+******************************************************************************/
+
+#ifndef HOST_STATUS_CODES_H_
+#define HOST_STATUS_CODES_H_
+
+///Status of the ASF drivers
+enum status_code {
+	STATUS_OK                         = 0x00,
+	STATUS_VALID_DATA                 = 0x01,
+	STATUS_NO_CHANGE                  = 0x02,
+	STATUS_ABORTED                    = 0x04,
+	STATUS_BUSY                       = 0x05,
+	STATUS_SUSPEND                    = 0x06,
+
+	STATUS_ERR_IO                     = 0x10,
+	STATUS_ERR_REQ_FLUSHED            = 0x11,
+	STATUS_ERR_TIMEOUT                = 0x12,
+	STATUS_ERR_BAD_DATA               = 0x13,
+	STATUS_ERR_NOT_FOUND              = 0x14,
+	STATUS_ERR_UNSUPPORTED_DEV        = 0x15,
+	STATUS_ERR_NO_MEMORY              = 0x16,
+	STATUS_ERR_INVALID_ARG            = 0x17,
+	STATUS_ERR_BAD_ADDRESS            = 0x18,
+	STATUS_ERR_BAD_FORMAT             = 0x1A,
+	STATUS_ERR_BAD_FRQ                = 0x1B,
+	STATUS_ERR_DENIED                 = 0x1c,
+	STATUS_ERR_ALREADY_INITIALIZED    = 0x1d,
+	STATUS_ERR_OVERFLOW               = 0x1e,
+	STATUS_ERR_NOT_INITIALIZED        = 0x1f,
+
+	STATUS_ERR_BAUDRATE_UNAVAILABLE   = 0x40,
+	STATUS_ERR_PACKET_COLLISION       = 0x41,
+	STATUS_ERR_PROTOCOL               = 0x42,
+};
+typedef enum status_code status_code_genare_t;
+
+///Status codes of the wireless stack, some of which the firmware uses too
+enum status_code_wireless {
+	ERR_IO_ERROR            =  -1,
+	ERR_FLUSHED             =  -2,
+	ERR_TIMEOUT             =  -3,
+	ERR_BAD_DATA            =  -4,
+	ERR_PROTOCOL            =  -5,
+	ERR_UNSUPPORTED_DEV     =  -6,
+	ERR_NO_MEMORY           =  -7,
+	ERR_INVALID_ARG         =  -8,
+	ERR_BAD_ADDRESS         =  -9,
+	ERR_BUSY                =  -10,
+	ERR_BAD_FORMAT          =  -11,
+};
+
+#endif /* HOST_STATUS_CODES_H_ */
@@ -0,0 +1,271 @@
+/**************************************************************************//**
+* @file      test_circular_buffer.c
+* @brief     Host test of the circular_buffer span functions used by the console DMA transmitter
+* @details   SerialConsoleStartTxJob sends the span returned by circular_buf_peek_span and consumes it at once;
+*			 the completion interrupt then starts the next span. These tests replay that sequence on the host
+*			 and check where the spans split: at the wrap, on a full ring and when a span ends at the capacity.
+* @date      2020-05-04
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "circular_buffer.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TX_BUFFER_SIZE	512	///<Same as the console TX ring
+#define CAPACITY		16	///<Small ring for the hand-written cases
+
+///Records a failure without stopping, so one run lists every broken case
+#define CHECK(cond)	do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static int failures = 0;	///<Number of failed checks
+static uint8_t storage[TX_BUFFER_SIZE];	///<Storage of the ring under test
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static size_t tx_job(cbuf_handle_t cbuf, uint8_t **span)
+* @brief	Does what SerialConsoleStartTxJob does with the ring: takes the span at the tail and claims it
+* @return	Returns the length of the span. 0 if the ring is empty
+*****************************************************************************/
+static size_t tx_job(cbuf_handle_t cbuf, uint8_t **span)
+{
+	size_t len = circular_buf_peek_span(cbuf, span);
+	circular_buf_consume(cbuf, len);
+	return len;
+}
+
+/**************************************************************************//**
+* @fn		static void fill(uint8_t *data, size_t len, uint8_t first)
+* @brief	Fills data with a counting pattern, so misplaced bytes are easy to spot
+*****************************************************************************/
+static void fill(uint8_t *data, size_t len, uint8_t first)
+{
+	for (size_t i = 0; i < len; i++) data[i] = (uint8_t)(first + i);
+}
+
+/**************************************************************************//**
+* @fn		static cbuf_handle_t ring_at(size_t capacity, size_t tailOffset)
+* @brief	Creates an empty ring whose head and tail sit at tailOffset in the storage
+*****************************************************************************/
+static cbuf_handle_t ring_at(size_t capacity, size_t tailOffset)
+{
+	uint8_t scratch[TX_BUFFER_SIZE];
+	cbuf_handle_t cbuf = circular_buf_init(storage, capacity);
+
+	circular_buf_put2_range(cbuf, scratch, tailOffset);
+	circular_buf_get_range(cbuf, scratch, tailOffset);
+	return cbuf;
+}
+
+static void test_empty(void)
+{
+	uint8_t *span = NULL;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 5);
+
+	CHECK(circular_buf_peek_span(cbuf, &span) == 0);
+	CHECK(span == NULL);	//Untouched when there is nothing to send
+	CHECK(tx_job(cbuf, &span) == 0);
+	CHECK(circular_buf_empty(cbuf));
+	circular_buf_free(cbuf);
+}
+
+static void test_no_wrap(void)
+{
+	uint8_t data[CAPACITY], *span;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 3);
+
+	fill(data, 10, 'a');
+	CHECK(circular_buf_put2_range(cbuf, data, 10) == 0);
+	CHECK(tx_job(cbuf, &span) == 10);	//One job for the whole string
+	CHECK(span == &storage[3]);
+	CHECK(memcmp(span, data, 10) == 0);
+	CHECK(circular_buf_empty(cbuf));
+	circular_buf_free(cbuf);
+}
+
+static void test_wrap(void)
+{
+	uint8_t data[CAPACITY], *span;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 12);
+
+	fill(data, 9, 'a');
+	CHECK(circular_buf_put2_range(cbuf, data, 9) == 0);
+
+	CHECK(tx_job(cbuf, &span) == 4);	//Stops at the end of the storage
+	CHECK(span == &storage[12]);
+	CHECK(memcmp(span, data, 4) == 0);
+	CHECK(circular_buf_size(cbuf) == 5);
+
+	CHECK(tx_job(cbuf, &span) == 5);	//Completion interrupt picks up the wrapped part
+	CHECK(span == &storage[0]);
+	CHECK(memcmp(span, &data[4], 5) == 0);
+	CHECK(tx_job(cbuf, &span) == 0);
+	circular_buf_free(cbuf);
+}
+
+static void test_exactly_full(void)
+{
+	uint8_t data[CAPACITY], *span;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 0);
+
+	fill(data, CAPACITY, 'A');
+	CHECK(circular_buf_put2_range(cbuf, data, CAPACITY) == 0);
+	CHECK(circular_buf_full(cbuf));
+	CHECK(circular_buf_put2(cbuf, 'x') == -1);
+	CHECK(tx_job(cbuf, &span) == CAPACITY);	//Full and aligned: the whole ring in one job
+	CHECK(span == &storage[0]);
+	CHECK(memcmp(span, data, CAPACITY) == 0);
+	CHECK(circular_buf_empty(cbuf));
+	circular_buf_free(cbuf);
+
+	//Full with the tail in the middle: head == tail in the storage, which must not read as empty
+	cbuf = ring_at(CAPACITY, 7);
+	CHECK(circular_buf_put2_range(cbuf, data, CAPACITY) == 0);
+	CHECK(circular_buf_full(cbuf));
+	CHECK(!circular_buf_empty(cbuf));
+	CHECK(tx_job(cbuf, &span) == CAPACITY - 7);
+	CHECK(span == &storage[7]);
+	CHECK(memcmp(span, data, CAPACITY - 7) == 0);
+	CHECK(tx_job(cbuf, &span) == 7);
+	CHECK(span == &storage[0]);
+	CHECK(memcmp(span, &data[CAPACITY - 7], 7) == 0);
+	CHECK(circular_buf_empty(cbuf));
+	circular_buf_free(cbuf);
+}
+
+static void test_span_ends_at_capacity(void)
+{
+	uint8_t data[CAPACITY], *span;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 10);
+
+	fill(data, 6, '0');
+	CHECK(circular_buf_put2_range(cbuf, data, 6) == 0);	//Head lands exactly on the end of the storage
+	CHECK(circular_buf_peek_span(cbuf, &span) == 6);
+	CHECK(tx_job(cbuf, &span) == 6);
+	CHECK(span == &storage[10]);
+	CHECK(memcmp(span, data, 6) == 0);
+	CHECK(tx_job(cbuf, &span) == 0);	//No empty second job
+	CHECK(circular_buf_empty(cbuf));
+
+	//The next write starts at the beginning of the storage
+	CHECK(circular_buf_put2_range(cbuf, data, 3) == 0);
+	CHECK(tx_job(cbuf, &span) == 3);
+	CHECK(span == &storage[0]);
+	circular_buf_free(cbuf);
+}
+
+static void test_write_during_job(void)
+{
+	uint8_t data[CAPACITY], *span;
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 0);
+
+	fill(data, CAPACITY, 'a');
+	CHECK(circular_buf_put2_range(cbuf, data, 8) == 0);
+	CHECK(tx_job(cbuf, &span) == 8);
+	//The span in flight is off the ring, writers account for it with txJobLength
+	CHECK(circular_buf_size(cbuf) == 0);
+	CHECK(circular_buf_put2_range(cbuf, &data[8], 8) == 0);
+	CHECK(memcmp(&storage[0], data, 8) == 0);	//Bytes being sent were not overwritten
+	CHECK(tx_job(cbuf, &span) == 8);
+	CHECK(span == &storage[8]);
+	circular_buf_free(cbuf);
+}
+
+static void test_drop_line(void)
+{
+	cbuf_handle_t cbuf = ring_at(CAPACITY, 11);
+	bool lineEnd = false;
+	uint8_t *span;
+
+	CHECK(circular_buf_put2_range(cbuf, (const uint8_t *)"ab\ncdefgh\nij", 12) == 0);	//Wraps after "ab\ncd"
+	CHECK(circular_buf_drop_line(cbuf, CAPACITY, &lineEnd) == 3);
+	CHECK(lineEnd);
+	CHECK(circular_buf_drop_line(cbuf, 4, &lineEnd) == 4);	//Bounded scan across the wrap: "cdef"
+	CHECK(!lineEnd);
+	CHECK(circular_buf_drop_line(cbuf, 4, &lineEnd) == 3);	//Rest of the line: "gh\n"
+	CHECK(lineEnd);
+	CHECK(circular_buf_drop_line(cbuf, CAPACITY, NULL) == 2);	//No newline left: drops everything
+	CHECK(circular_buf_empty(cbuf));
+	CHECK(circular_buf_drop_line(cbuf, CAPACITY, &lineEnd) == 0);
+	CHECK(!lineEnd);
+	CHECK(tx_job(cbuf, &span) == 0);
+	circular_buf_free(cbuf);
+}
+
+/**************************************************************************//**
+* @fn		static void test_console_stream(void)
+* @brief	Streams random writes through a ring of the console size, sending spans the way the DMA path does
+* @details	Checks the bytes come out in order, no span crosses the end of the storage and a ring
+*			never needs more than two jobs to drain. Runs over many laps of the head and tail indexes.
+*****************************************************************************/
+static void test_console_stream(void)
+{
+	uint8_t data[TX_BUFFER_SIZE], *span;
+	cbuf_handle_t cbuf = circular_buf_init(storage, TX_BUFFER_SIZE);
+	uint8_t nextIn = 0, nextOut = 0;
+	uint32_t jobs = 0, bytes = 0;
+	int badSpans = 0, badBytes = 0;
+
+	srand(516);
+	for (int round = 0; round < 20000; round++)
+	{
+		size_t len = (size_t)(rand() % 160);
+		fill(data, len, nextIn);
+		if (circular_buf_put2_range(cbuf, data, len) == 0) nextIn = (uint8_t)(nextIn + len);
+
+		bool drain = (rand() % 3) != 0;	//Sometimes the transmitter falls behind
+		int jobsThisDrain = 0;
+		while (drain && (len = tx_job(cbuf, &span)) > 0)
+		{
+			if (span < storage || span + len > storage + TX_BUFFER_SIZE) badSpans++;
+			for (size_t i = 0; i < len; i++)
+			{
+				if (span[i] != nextOut++) badBytes++;
+			}
+			jobs++;
+			bytes += len;
+			jobsThisDrain++;
+		}
+		if (jobsThisDrain > 2) badSpans++;
+	}
+	CHECK(badSpans == 0);
+	CHECK(badBytes == 0);
+	CHECK(jobs > 0);
+	printf("  %u bytes in %u jobs, %.1f bytes per interrupt\n", (unsigned)bytes, (unsigned)jobs, (double)bytes / jobs);
+	circular_buf_free(cbuf);
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+int main(void)
+{
+	test_empty();
+	test_no_wrap();
+	test_wrap();
+	test_exactly_full();
+	test_span_ends_at_capacity();
+	test_write_during_job();
+	test_drop_line();
+	test_console_stream();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
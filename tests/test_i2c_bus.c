@@ -0,0 +1,344 @@
+/**************************************************************************//**
+* @file      test_i2c_bus.c
+* @brief     Host test and traffic benchmark of the sensor bus driver and of the Seesaw, SHTC3 and IMU drivers
+* @details   Runs the unchanged I2cDriver.c, shtc3.c, SeesawDriver.c, lsm6ds_reg.c and ImuThread.c on the simulated
+*			 kernel and bus of sim/ (see sim.h), with the three devices attached. The test thread stands for the
+*			 board threads: it makes the driver calls, and checks what reached the device models and what the driver
+*			 reports. Time is virtual, so the timings checked are the ones of the bus at its configured speed.
+*
+*			 The traffic of every scenario is printed per device: it is the benchmark of the bus for `make check`.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "sim.h"
+#include "I2cDriver/I2cDriver.h"
+#include "I2cDriver/shtc3.h"
+#include "SeesawDriver/Seesaw.h"
+#include "IMU/lsm6ds_reg.h"
+#include "ImuThread/ImuThread.h"
+#include "SensorScheduler/SensorScheduler.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define TEST_TASK_PRIORITY	1	///<Below the bus thread, like the board threads
+#define TEST_IMU_SAMPLES	512	///<Samples SensorPublish keeps
+#define TEST_SHTC3_T_RAW	0x6666	///<Raw temperature of the simulated SHTC3: 25.00 C
+#define TEST_SHTC3_RH_RAW	0x8000	///<Raw humidity: 50.00 %
+#define TEST_ABSENT_ADDRESS	0x55	///<No device there
+
+///Records a failure without stopping, so one run lists every broken case
+#define CHECK(cond)	do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+static int failures = 0;	///<Number of failed checks
+static struct SensorSample imuSamples[TEST_IMU_SAMPLES];	///<What ImuService published
+static uint16_t imuSampleCount = 0;
+static bool shtc3Done = false;	///<The measurement of test_held_request ended
+static struct Shtc3Measurement shtc3Result;
+static uint64_t heldDoneUs = 0;	///<Time the held request of test_held_request ended. 0 while it runs
+
+/******************************************************************************
+* Stubs
+******************************************************************************/
+void SerialConsoleWriteString(const char *string) {}
+
+void SensorPublish(enum eSensorSource source, const struct SensorSample *sample)
+{
+	if (source == SENSOR_IMU && imuSampleCount < TEST_IMU_SAMPLES) imuSamples[imuSampleCount++] = *sample;
+}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+static const struct I2cDeviceStats *driver_stats(uint8_t address)
+{
+	const struct I2cDeviceStats *stats;
+	uint8_t count = I2cGetStats(&stats);
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (stats[i].address == address) return &stats[i];
+	}
+	return NULL;
+}
+
+static void on_measurement(const struct Shtc3Measurement *measurement, void *context)
+{
+	shtc3Result = *measurement;
+	shtc3Done = true;
+}
+
+static void on_held_request(struct I2cRequest *request)
+{
+	heldDoneUs = sim_now_us();
+}
+
+///Starts the counts of the simulated bus and of the driver statistics together
+static void reset_counters(void)
+{
+	sim_i2c_reset_counters();
+	I2cResetStats();
+}
+
+///Checks that the samples published since first are one contiguous run of the simulated accelerometer
+static bool imu_contiguous(uint16_t first)
+{
+	for (uint16_t i = first; i < imuSampleCount; i++)
+	{
+		if (imuSamples[i].value[1] != -imuSamples[i].value[0] || imuSamples[i].value[2] != 16384) return false;
+		if (i > first && imuSamples[i].value[0] != imuSamples[i - 1].value[0] + 1) return false;
+	}
+	return true;
+}
+
+static void test_init(void)
+{
+	CHECK(I2cInitializeDriver() == STATUS_OK);
+	CHECK(I2cGetBusSpeedKhz() == I2C_SPEED_FAST_KHZ);	//The Seesaw and the IMU stop at Fast-mode
+}
+
+static void test_seesaw(void)
+{
+	uint8_t expected[NEO_TRELLIS_FRAME_BYTES];
+	uint8_t fifo[4];
+	const struct SimI2cCounters *bus = sim_i2c_bus_counters();
+	const struct I2cDeviceStats *stats;
+
+	CHECK(InitializeSeesaw() == ERROR_NONE);
+	CHECK(simSeesaw.neopixelPin == NEO_TRELLIS_NEOPIX_PIN);
+	CHECK(simSeesaw.neopixelLength == NEO_TRELLIS_FRAME_BYTES);
+	CHECK(simSeesaw.keypadInterrupt);
+	CHECK(simSeesaw.keyActive[NEO_TRELLIS_KEY(0)] == ((1 << SEESAW_KEYPAD_EDGE_RISING) | (1 << SEESAW_KEYPAD_EDGE_FALLING)));
+	CHECK(simSeesaw.keyActive[NEO_TRELLIS_KEY(15)] == ((1 << SEESAW_KEYPAD_EDGE_RISING) | (1 << SEESAW_KEYPAD_EDGE_FALLING)));
+	sim_i2c_report("Seesaw initialization");
+
+	//Full pad: 48 pixel bytes in two writes of at most SEESAW_NEOPIXEL_MAX_WRITE, then SHOW
+	reset_counters();
+	SeesawFrameFill(10, 20, 30);
+	CHECK(SeesawFrameFlush() == ERROR_NONE);
+	CHECK(bus->transfers == 3);
+	CHECK(bus->bytesOut == (4 + 28) + (4 + 20) + 2);
+	CHECK(simSeesaw.overlongWrites == 0);
+	for (uint8_t key = 0; key < NEO_TRELLIS_NUM_KEYS; key++)
+	{
+		expected[3 * key] = 20;
+		expected[3 * key + 1] = 10;
+		expected[3 * key + 2] = 30;
+	}
+	CHECK(memcmp(simSeesaw.shown, expected, sizeof(expected)) == 0);
+	sim_i2c_report("Seesaw full frame");
+
+	//Nothing changed: no traffic
+	reset_counters();
+	CHECK(SeesawFrameFlush() == ERROR_NONE);
+	CHECK(bus->transfers == 0);
+
+	//One key: its 3 bytes, then SHOW
+	SeesawFrameSetLed(5, 1, 2, 3);
+	CHECK(SeesawFrameFlush() == ERROR_NONE);
+	CHECK(bus->transfers == 2);
+	CHECK(bus->bytesOut == (4 + 3) + 2);
+	CHECK(simSeesaw.shown[15] == 2 && simSeesaw.shown[16] == 1 && simSeesaw.shown[17] == 3);
+	sim_i2c_report("Seesaw one key");
+
+	//Keypad FIFO in one read: the events, then SEESAW_KEYPAD_FIFO_EMPTY
+	sim_seesaw_key(NEO_TRELLIS_KEY(6), true);
+	sim_seesaw_key(NEO_TRELLIS_KEY(6), false);
+	CHECK(SeesawGetKeypadCount() == 2);
+	CHECK(SeesawReadKeypadFifo(fifo, sizeof(fifo)) == ERROR_NONE);
+	CHECK(fifo[0] == ((NEO_TRELLIS_KEY(6) << 2) | SEESAW_KEYPAD_EDGE_RISING));
+	CHECK(fifo[1] == ((NEO_TRELLIS_KEY(6) << 2) | SEESAW_KEYPAD_EDGE_FALLING));
+	CHECK(fifo[2] == SEESAW_KEYPAD_FIFO_EMPTY && fifo[3] == SEESAW_KEYPAD_FIFO_EMPTY);
+	CHECK(simSeesaw.earlyReads == 0);	//Write, STOP, delay, read: never a repeated start
+
+	//The driver statistics count what the device received
+	stats = driver_stats(NEO_TRELLIS_ADDR);
+	CHECK(stats != NULL);
+	if (stats != NULL)
+	{
+		CHECK(stats->bytesOut == simSeesaw.device.counters.bytesOut);
+		CHECK(stats->bytesIn == simSeesaw.device.counters.bytesIn);
+		CHECK(stats->aborted == 0 && stats->timeouts == 0 && stats->errors == 0);
+	}
+}
+
+///Simulated interrupt notifying the task in context
+static void give_notification(void *context)
+{
+	xTaskNotifyGive((TaskHandle_t)context);
+}
+
+static void test_shtc3(void)
+{
+	int16_t temperature = 0;
+	uint16_t humidity = 0;
+
+	simShtc3.temperature = TEST_SHTC3_T_RAW;
+	simShtc3.humidity = TEST_SHTC3_RH_RAW;
+	reset_counters();
+	CHECK(SHTC3_Init() == ERROR_NONE);
+	CHECK(!simShtc3.awake);
+	CHECK(SHTC3_Measure(&temperature, &humidity) == ERROR_NONE);
+	CHECK(temperature == SHTC3_ConvertTemperature(TEST_SHTC3_T_RAW));
+	CHECK(temperature == 2500);
+	CHECK(humidity == 5000);
+	CHECK(!simShtc3.awake);
+	CHECK(simShtc3.device.counters.nacks == 0);	//Wake-up and conversion times kept
+	sim_i2c_report("SHTC3 ID and measurement");
+
+	//A notification for another reason during the conversion, like the console RX wake-up of the CLI thread
+	simShtc3.temperature = TEST_SHTC3_T_RAW + 1000;
+	sim_interrupt_at(sim_now_us() + 2 * SIM_TICK_US, give_notification, xTaskGetCurrentTaskHandle());
+	CHECK(SHTC3_Measure(&temperature, &humidity) == ERROR_NONE);
+	CHECK(temperature == SHTC3_ConvertTemperature(TEST_SHTC3_T_RAW + 1000));	//Not the previous result
+	CHECK(humidity == 5000);
+	CHECK(ulTaskNotifyTake(pdTRUE, 0) == 1);	//Given back
+
+	simShtc3.badCrc = true;
+	CHECK(SHTC3_Measure(&temperature, &humidity) == ERROR_BAD_DATA);
+	CHECK(!simShtc3.awake);
+	simShtc3.badCrc = false;
+}
+
+///Checks that the samples published since first, from a single drain, are timestamped one ODR period apart, to the tick
+static bool imu_timestamps_exact(uint16_t first)
+{
+	for (uint16_t i = first + 1; i < imuSampleCount; i++)
+	{
+		int32_t expected = (int32_t)(((uint32_t)(i - first) * 1000UL + ImuGetOdrHz() / 2) / ImuGetOdrHz());
+		int32_t actual = (int32_t)(imuSamples[i].timestamp - imuSamples[first].timestamp);
+		if (actual < expected - 1 || actual > expected + 1) return false;
+	}
+	return true;
+}
+
+static void test_imu(void)
+{
+	uint16_t first;
+
+	reset_counters();
+	CHECK(ImuInitialize() == ERROR_NONE);
+	CHECK((simLsm6ds3.regs[LSM6DS3_CTRL1_XL] >> 4) == IMU_ODR_104HZ);
+	CHECK((simLsm6ds3.regs[LSM6DS3_FIFO_CTRL5] & 0x07) == LSM6DS3_STREAM_MODE);
+	CHECK(simLsm6ds3.regs[LSM6DS3_FIFO_CTRL1] == IMU_FIFO_WATERMARK * 3);
+	CHECK(ImuGetServicePeriodMs() == 153);
+	sim_i2c_report("IMU initialization");
+
+	//One service period: about a watermark of samples, in order
+	reset_counters();
+	vTaskDelay(ImuGetServicePeriodMs());
+	CHECK(ImuService() == ERROR_NONE);
+	CHECK(imuSampleCount >= IMU_FIFO_WATERMARK - 1 && imuSampleCount <= IMU_FIFO_WATERMARK + 1);
+	CHECK(imu_contiguous(0));
+	CHECK(imu_timestamps_exact(0));	//104 Hz: 9.6 ms apart, not 9
+	CHECK(sim_i2c_bus_counters()->transfers == 4);	//Status, then one burst: each a write and a repeated start read
+	sim_i2c_report("IMU one FIFO drain");
+
+	vTaskDelay(ImuGetServicePeriodMs());
+	CHECK(ImuService() == ERROR_NONE);
+	CHECK(imu_contiguous(0));
+	CHECK(ImuGetOverruns() == 0);
+
+	//The FIFO overflows: the drain restarts it, then the samples are contiguous again
+	vTaskDelay(15000);
+	CHECK(ImuService() == ERROR_NONE);
+	CHECK(ImuGetOverruns() == 1);
+	CHECK(!simLsm6ds3.overrun);
+	first = imuSampleCount;
+	vTaskDelay(ImuGetServicePeriodMs());
+	CHECK(ImuService() == ERROR_NONE);
+	CHECK(imuSampleCount > first);
+	CHECK(imu_contiguous(first));
+}
+
+///A request for the SHTC3 submitted during its conversion is held until the result is read; the bus serves the others
+static void test_held_request(void)
+{
+	static const uint8_t readId[] = {SHTC3_CMD_READ_ID >> 8, SHTC3_CMD_READ_ID & 0xFF};
+	uint8_t id[3];
+	uint8_t fifo[4];
+	I2C_Data data = {SHTC3_ADDRESS, readId, id, sizeof(id), sizeof(readId)};
+	struct I2cRequest request = {0};
+
+	reset_counters();
+	CHECK(SHTC3_StartMeasurement(SHTC3_MODE_NORMAL, on_measurement, NULL) == ERROR_NONE);
+	vTaskDelay(SHTC3_WAKEUP_TICKS + 2);	//Measure command sent, read parked
+	CHECK(simShtc3.measurements == 4);	//After the three of test_shtc3
+
+	request.data = &data;
+	request.timeout = SHTC3_TIMEOUT_TICKS;
+	request.callback = on_held_request;
+	CHECK(I2cSubmit(&request, 0) == ERROR_NONE);
+
+	CHECK(SeesawReadKeypadFifo(fifo, sizeof(fifo)) == ERROR_NONE);
+	CHECK(SeesawReadKeypadFifo(fifo, sizeof(fifo)) == ERROR_NONE);
+	CHECK(!shtc3Done && heldDoneUs == 0);	//The Seesaw went first
+
+	while (!request.done || !shtc3Done) vTaskDelay(1);
+	CHECK(heldDoneUs >= simShtc3.readyUs);	//Not before the end of the conversion
+	CHECK(shtc3Result.error == ERROR_NONE);
+	CHECK(request.error == ERROR_NONE);
+	CHECK(SHTC3_Crc8(id, 2) == id[2] && (((id[0] << 8) | id[1]) & SHTC3_ID_MASK) == SHTC3_ID_VALUE);
+	CHECK(!simShtc3.awake);
+	CHECK(simShtc3.device.counters.nacks == 0);
+	sim_i2c_report("SHTC3 measurement with a held request and Seesaw reads");
+}
+
+static void test_errors(void)
+{
+	static const uint8_t reg[] = {0x00, 0x01};
+	uint8_t in[1];
+	I2C_Data data = {TEST_ABSENT_ADDRESS, reg, in, sizeof(in), sizeof(reg)};
+	const struct I2cDeviceStats *stats;
+
+	//NACK of the write of a combined transfer: the driver releases the bus
+	reset_counters();
+	CHECK(I2cGetBusResets() == 0);
+	CHECK(I2cReadDataWait(&data, 0, 100) == ERROR_ABORTED);
+	CHECK(!sim_i2c_bus_owned());
+	CHECK(I2cGetBusResets() == 1);
+	CHECK(sim_i2c_bus_counters()->nacks == 1);
+	stats = driver_stats(TEST_ABSENT_ADDRESS);
+	CHECK(stats != NULL && stats->aborted == 1);
+
+	//A device holding SCL past the timeout: the job is cancelled, then the bus works again
+	simSeesaw.device.stretchUs = 200000;
+	CHECK(SeesawReadKeypadFifo(in, sizeof(in)) == ERROR_TIMEOUT);
+	CHECK(I2cGetBusResets() == 2);
+	CHECK(sim_i2c_bus_counters()->aborted == 1);
+	stats = driver_stats(NEO_TRELLIS_ADDR);
+	CHECK(stats != NULL && stats->timeouts == 1);
+	simSeesaw.device.stretchUs = 0;
+	CHECK(SeesawReadKeypadFifo(in, sizeof(in)) == ERROR_NONE);
+	CHECK(!sim_i2c_bus_owned());
+	sim_i2c_report("Absent device, then a timeout");
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	sim_start(TEST_TASK_PRIORITY);
+	sim_seesaw_attach();
+	sim_lsm6ds3_attach();
+	sim_shtc3_attach();
+
+	test_init();
+	test_seesaw();
+	test_shtc3();
+	test_imu();
+	test_held_request();
+	test_errors();
+
+	CHECK(hostCriticalNesting == 0);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
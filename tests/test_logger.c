@@ -0,0 +1,225 @@
+/**************************************************************************//**
+* @file      test_logger.c
+* @brief     Host test of the deferred logging records and of the formatting done by the logger task
+* @details   Logs a set of messages the way LogMessageV does in deferred mode, runs the logger task until the
+*			 ring is empty and compares its output with vsnprintf of the same messages.
+*
+*			 Built twice. With LOGGER_BINARY_OUTPUT 0 the logger task formats the records and the comparison is
+*			 done here. With LOGGER_BINARY_OUTPUT 1 the raw stream, with console text between the records, is
+*			 written to argv[1] and the expected text to argv[2], and the Makefile checks tools/log_decoder.py
+*			 turns one into the other using this executable as the ELF.
+*
+*			 long and pointers are 64 bits on the host, so the messages only use the types that have the same
+*			 size as on the SAMD21.
+* @date      2020-05-04
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <setjmp.h>
+#include "LoggerThread/LoggerThread.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define OUTPUT_SIZE		8192	///<Room for everything the test logs
+
+///Records a failure without stopping, so one run lists every broken case
+#define CHECK(cond)	do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int hostCriticalNesting = 0;	///<See asf.h
+static int failures = 0;	///<Number of failed checks
+static TickType_t ticks = 0;	///<Tick count returned to the logger
+static uint32_t notifications = 0;	///<Notifications given to the logger task and not taken yet
+static uint32_t notificationsGiven = 0;	///<Notifications given to the logger task in total
+static jmp_buf taskExit;	///<Leaves the logger task once it waits with an empty ring
+static char output[OUTPUT_SIZE];	///<What the logger task sent to the console
+static size_t outputLen = 0;
+static char expected[OUTPUT_SIZE];	///<What vsnprintf makes of the same messages
+static size_t expectedLen = 0;
+
+/******************************************************************************
+* Stubs
+******************************************************************************/
+TickType_t xTaskGetTickCount(void) { return ticks; }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return &ticks; }
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	notifications++;
+	notificationsGiven++;
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+	CHECK(ticksToWait == portMAX_DELAY);	//Blocks instead of polling
+	if (notifications == 0) longjmp(taskExit, 1);	//Would block forever: the ring is drained
+	uint32_t count = notifications;
+	notifications = clearCountOnExit ? 0 : notifications - 1;
+	return count;
+}
+
+void SerialConsoleWriteBuffer(const uint8_t *data, size_t len)
+{
+	if (outputLen + len > OUTPUT_SIZE) len = OUTPUT_SIZE - outputLen;
+	memcpy(&output[outputLen], data, len);
+	outputLen += len;
+}
+
+void SerialConsoleWriteString(const char *string)
+{
+	SerialConsoleWriteBuffer((const uint8_t *)string, strlen(string));
+}
+
+void SdLogSinkWrite(const uint8_t *data, size_t len) {}
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+
+/**************************************************************************//**
+* @fn		static void log_message(enum eDebugLogLevels level, const char *format, ...)
+* @brief	Deferred branch of LogMessageV, plus the expected text
+*****************************************************************************/
+static void log_message(enum eDebugLogLevels level, const char *format, ...)
+{
+	char debugBuffer[128];
+	va_list ap;
+
+	va_start(ap, format);
+	vsnprintf(&expected[expectedLen], OUTPUT_SIZE - expectedLen, format, ap);
+	expectedLen += strlen(&expected[expectedLen]);
+	va_end(ap);
+
+	va_start(ap, format);
+	if (!LoggerDeferMessage(level, format, ap))
+	{
+		vsnprintf(debugBuffer, 127, format, ap);
+		CHECK(LoggerDeferText(level, debugBuffer));
+	}
+	va_end(ap);
+	ticks += 7;
+}
+
+static void run_logger_task(void);
+
+/**************************************************************************//**
+* @fn		static void console_text(const char *text)
+* @brief	Text written straight to the console between two records, e.g. a CLI reply
+* @details	Direct text passes the records still in the ring, so the logger task catches up first
+*****************************************************************************/
+static void console_text(const char *text)
+{
+	run_logger_task();
+	SerialConsoleWriteString(text);
+	memcpy(&expected[expectedLen], text, strlen(text));
+	expectedLen += strlen(text);
+}
+
+/**************************************************************************//**
+* @fn		static void run_logger_task(void)
+* @brief	Runs the logger task until it waits for a notification with nothing left in the ring
+*****************************************************************************/
+static void run_logger_task(void)
+{
+	if (setjmp(taskExit) == 0) vLoggerTask(NULL);
+}
+
+/**************************************************************************//**
+* @fn		static void log_batch(void)
+* @brief	Logs messages covering every argument type the board defers, and the ones it formats in the caller
+*****************************************************************************/
+static void log_batch(void)
+{
+	char longText[125];
+
+	memset(longText, '.', sizeof(longText) - 1);
+	longText[sizeof(longText) - 1] = '\0';
+
+	log_message(LOG_INFO_LVL, "Plain text\r\n");
+	log_message(LOG_DEBUG_LVL, "int %d %i, negative %d, unsigned %u\r\n", 42, -7, -2147483647 - 1, 4000000000u);
+	log_message(LOG_INFO_LVL, "hex %x %X %08x %#x %#o %o, char '%c', percent 100%%\r\n", 0xBEEFu, 0xC0FFEEu, 0x1Au, 255u, 8u, 0u, 'Z');
+	log_message(LOG_WARNING_LVL, "widths [%5d] [%-5d] [%+d] [% d] [%05d] [%.3d]\r\n", 12, 34, 56, 78, -9, 7);
+	log_message(LOG_INFO_LVL, "stars [%*d] [%-*d] [%.*d] [%*.*d]\r\n", 6, 1, 6, 2, 4, 3, 8, 5, 4);
+	log_message(LOG_ERROR_LVL, "64-bit %lld %llu %llx\r\n", -1234567890123LL, 18446744073709551615ULL, 0x123456789ABCDEFULL);
+	log_message(LOG_INFO_LVL, "double %f %.2f %e %g %10.3f %-8.1f|\r\n", 3.14159, -2.5, 12345.678, 0.0001, 1.0 / 3, 9.99);
+	log_message(LOG_DEBUG_LVL, "short %hd %hu %hhd %hhu\r\n", -3, 65535, -4, 250);
+	console_text("CLI reply between two records\r\n");
+	log_message(LOG_FATAL_LVL, "string %s is formatted in the caller\r\n", "argument");
+	log_message(LOG_INFO_LVL, "nine words %d %d %d %d %d %d %d %d %d\r\n", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+	log_message(LOG_INFO_LVL, "eight words %d %d %d %d %d %d %d %d\r\n", 1, 2, 3, 4, 5, 6, 7, 8);
+	log_message(LOG_INFO_LVL, "%s\r\n", longText);	//The longest line LogMessage formats: 126 characters
+	log_message(LOG_INFO_LVL, "no newline, ");
+	log_message(LOG_INFO_LVL, "then %s\r\n", "the rest");
+}
+
+/**************************************************************************//**
+* @fn		static bool write_file(const char *path, const char *data, size_t len)
+* @brief	Writes a buffer to a file
+*****************************************************************************/
+static bool write_file(const char *path, const char *data, size_t len)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) return false;
+	bool ok = fwrite(data, 1, len, file) == len;
+	return (fclose(file) == 0) && ok;
+}
+
+/******************************************************************************
+* Global Functions
+******************************************************************************/
+int main(int argc, char **argv)
+{
+	LoggerInitialize();
+	run_logger_task();	//Starts waiting on an empty ring
+	log_batch();
+	CHECK(hostCriticalNesting == 0);
+	CHECK(LoggerGetDroppedRecords() == 0);
+	CHECK(notificationsGiven == 14);	//One per record
+	run_logger_task();
+	CHECK(notifications == 0);
+
+#if LOGGER_BINARY_OUTPUT
+	if (argc < 3 || !write_file(argv[1], output, outputLen) || !write_file(argv[2], expected, expectedLen))
+	{
+		printf("usage: %s capture expected\n", argv[0]);
+		return 1;
+	}
+	printf("  %u bytes of records and text for the decoder\n", (unsigned)outputLen);
+#else
+	CHECK(outputLen == expectedLen);
+	CHECK(memcmp(output, expected, expectedLen) == 0);
+	if (outputLen != expectedLen || memcmp(output, expected, expectedLen) != 0)
+	{
+		write_file("logger_output.txt", output, outputLen);
+		write_file("logger_expected.txt", expected, expectedLen);
+		printf("  differences: see logger_output.txt and logger_expected.txt\n");
+	}
+
+	//A full ring drops whole records and counts them
+	outputLen = expectedLen = 0;
+	notificationsGiven = notifications = 0;
+	for (int i = 0; i < 100; i++) log_message(LOG_INFO_LVL, "record %d of a burst\r\n", i);
+	CHECK(hostCriticalNesting == 0);
+	CHECK(LoggerGetDroppedRecords() > 0);
+	CHECK(notificationsGiven + LoggerGetDroppedRecords() == 100);
+	run_logger_task();
+	//The first records that fit come out whole, in order
+	expectedLen = 0;
+	for (uint32_t i = 0; i < notificationsGiven; i++)
+	{
+		expectedLen += sprintf(&expected[expectedLen], "record %u of a burst\r\n", (unsigned)i);
+	}
+	CHECK(outputLen == expectedLen);
+	CHECK(memcmp(output, expected, expectedLen) == 0);
+#endif
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+/**************************************************************************//**
+* @file      test_lsm6ds3_convert.c
+* @brief     Host test of the fixed-point LSM6DS3 unit conversions against the float ones
+* @details   Every raw value of every full scale goes through the _int, the _q8 and the block converters of
+*			 lsm6ds_reg.c. The results must be within one LSB of their format (1 unit for _int and the blocks,
+*			 1/256 unit for _q8) of the float function of the same scale.
+*
+*			 The float reference is single precision: at the ends of the gyroscope scales its own rounding step is
+*			 several Q8 LSB. Its last bit is therefore added to the tolerance, which otherwise would measure float_t.
+* @date      2020-05-05
+
+******************************************************************************/
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "I2cDriver/I2cDriver.h"
+#include "IMU/lsm6ds_reg.h"
+
+/******************************************************************************
+* Defines
+******************************************************************************/
+#define RAW_VALUES		65536	///<Every int16_t
+#define BLOCK_VALUES	(RAW_VALUES / 2)	///<Values per block conversion: len is a uint16_t
+
+///Records a failure without stopping, so one run lists every broken case
+#define CHECK(cond)	do { if (!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/******************************************************************************
+* Structures and Enumerations
+******************************************************************************/
+///A full scale and its three conversions
+struct Conversion {
+	const char *name;
+	float_t (*reference)(int16_t lsb);
+	int32_t (*q8)(int16_t lsb);
+	int32_t (*rounded)(int16_t lsb);
+};
+
+/******************************************************************************
+* Variables
+******************************************************************************/
+int hostCriticalNesting = 0;	///<See asf.h
+static int failures = 0;	///<Number of failed checks
+static int16_t raw[RAW_VALUES];	///<-32768 to 32767
+static int16_t mg[RAW_VALUES];
+static int32_t mdps[RAW_VALUES];
+
+static const struct Conversion conversions[] = {
+	{"fs2g mg", lsm6ds3_from_fs2g_to_mg, lsm6ds3_from_fs2g_to_mg_q8, lsm6ds3_from_fs2g_to_mg_int},
+	{"fs4g mg", lsm6ds3_from_fs4g_to_mg, lsm6ds3_from_fs4g_to_mg_q8, lsm6ds3_from_fs4g_to_mg_int},
+	{"fs8g mg", lsm6ds3_from_fs8g_to_mg, lsm6ds3_from_fs8g_to_mg_q8, lsm6ds3_from_fs8g_to_mg_int},
+	{"fs16g mg", lsm6ds3_from_fs16g_to_mg, lsm6ds3_from_fs16g_to_mg_q8, lsm6ds3_from_fs16g_to_mg_int},
+	{"fs125dps mdps", lsm6ds3_from_fs125dps_to_mdps, lsm6ds3_from_fs125dps_to_mdps_q8, lsm6ds3_from_fs125dps_to_mdps_int},
+	{"fs250dps mdps", lsm6ds3_from_fs250dps_to_mdps, lsm6ds3_from_fs250dps_to_mdps_q8, lsm6ds3_from_fs250dps_to_mdps_int},
+	{"fs500dps mdps", lsm6ds3_from_fs500dps_to_mdps, lsm6ds3_from_fs500dps_to_mdps_q8, lsm6ds3_from_fs500dps_to_mdps_int},
+	{"fs1000dps mdps", lsm6ds3_from_fs1000dps_to_mdps, lsm6ds3_from_fs1000dps_to_mdps_q8, lsm6ds3_from_fs1000dps_to_mdps_int},
+	{"fs2000dps mdps", lsm6ds3_from_fs2000dps_to_mdps, lsm6ds3_from_fs2000dps_to_mdps_q8, lsm6ds3_from_fs2000dps_to_mdps_int},
+	{"celsius", lsm6ds3_from_lsb_to_celsius, lsm6ds3_from_lsb_to_celsius_q8, lsm6ds3_from_lsb_to_celsius_int},
+};
+
+///Accelerometer full scales, in the order of conversions[]
+static const lsm6ds3_xl_fs_t xlScales[] = {LSM6DS3_2g, LSM6DS3_4g, LSM6DS3_8g, LSM6DS3_16g};
+///Gyroscope full scales, in the order of conversions[] after the accelerometer ones
+static const lsm6ds3_fs_g_t gyScales[] = {LSM6DS3_125dps, LSM6DS3_250dps, LSM6DS3_500dps, LSM6DS3_1000dps, LSM6DS3_2000dps};
+
+/******************************************************************************
+* Stubs
+******************************************************************************/
+//Bus access of lsm6ds_reg.c, not used by the conversions
+int32_t I2cWriteDataWait(I2C_Data *data, const TickType_t xMaxBlockTime) { return ERROR_IO; }
+int32_t I2cReadDataWait(I2C_Data *data, const TickType_t delay, const TickType_t xMaxBlockTime) { return ERROR_IO; }
+
+/******************************************************************************
+* Local Functions
+******************************************************************************/
+///Rounding step of the float reference at value
+static double reference_ulp(float_t value)
+{
+	return nextafterf(fabsf(value), INFINITY) - fabsf(value);
+}
+
+///Checks the _q8 and _int functions of a scale on every raw value and prints their largest errors, in LSB of each format
+static void test_conversion(const struct Conversion *conversion)
+{
+	double worstQ8 = 0;
+	double worstInt = 0;
+
+	for (int32_t i = 0; i < RAW_VALUES; i++)
+	{
+		float_t reference = conversion->reference(raw[i]);
+		double slack = reference_ulp(reference);
+		double errorQ8 = fabs(conversion->q8(raw[i]) / 256.0 - reference) - slack;
+		double errorInt = fabs(conversion->rounded(raw[i]) - (double)reference) - slack;
+
+		if (errorQ8 * 256 > worstQ8) worstQ8 = errorQ8 * 256;
+		if (errorInt > worstInt) worstInt = errorInt;
+	}
+	printf("  %-15s max error q8 %.3f LSB, int %.3f LSB\n", conversion->name, worstQ8, worstInt);
+	CHECK(worstQ8 <= 1.0);
+	CHECK(worstInt <= 1.0);
+}
+
+///The block converters give the _int results of their scale, in place too
+static void test_blocks(void)
+{
+	for (uint8_t s = 0; s < sizeof(xlScales) / sizeof(xlScales[0]); s++)
+	{
+		bool same = true;
+		CHECK(lsm6ds3_xl_block_to_mg(xlScales[s], raw, mg, BLOCK_VALUES) == 0);
+		CHECK(lsm6ds3_xl_block_to_mg(xlScales[s], &raw[BLOCK_VALUES], &mg[BLOCK_VALUES], BLOCK_VALUES) == 0);
+		for (int32_t i = 0; i < RAW_VALUES; i++) same &= (mg[i] == conversions[s].rounded(raw[i]));
+		CHECK(same);
+
+		memcpy(mg, raw, sizeof(mg));
+		CHECK(lsm6ds3_xl_block_to_mg(xlScales[s], mg, mg, BLOCK_VALUES) == 0);
+		CHECK(lsm6ds3_xl_block_to_mg(xlScales[s], &mg[BLOCK_VALUES], &mg[BLOCK_VALUES], BLOCK_VALUES) == 0);
+		same = true;
+		for (int32_t i = 0; i < RAW_VALUES; i++) same &= (mg[i] == conversions[s].rounded(raw[i]));
+		CHECK(same);
+	}
+
+	for (uint8_t s = 0; s < sizeof(gyScales) / sizeof(gyScales[0]); s++)
+	{
+		bool same = true;
+		const struct Conversion *conversion = &conversions[sizeof(xlScales) / sizeof(xlScales[0]) + s];
+		CHECK(lsm6ds3_gy_block_to_mdps(gyScales[s], raw, mdps, BLOCK_VALUES) == 0);
+		CHECK(lsm6ds3_gy_block_to_mdps(gyScales[s], &raw[BLOCK_VALUES], &mdps[BLOCK_VALUES], BLOCK_VALUES) == 0);
+		for (int32_t i = 0; i < RAW_VALUES; i++) same &= (mdps[i] == conversion->rounded(raw[i]));
+		CHECK(same);
+	}
+
+	//Unknown full scale: nothing written
+	mg[0] = 0x1234;
+	CHECK(lsm6ds3_xl_block_to_mg((lsm6ds3_xl_fs_t)4, raw, mg, 1) == -1);
+	CHECK(mg[0] == 0x1234);
+	CHECK(lsm6ds3_gy_block_to_mdps((lsm6ds3_fs_g_t)3, raw, mdps, 1) == -1);
+	CHECK(lsm6ds3_xl_block_to_mg(LSM6DS3_2g, raw, mg, 0) == 0);
+}
+
+/******************************************************************************
+* Main
+******************************************************************************/
+int main(void)
+{
+	for (int32_t i = 0; i < RAW_VALUES; i++) raw[i] = (int16_t)(i - 32768);
+
+	for (uint8_t c = 0; c < sizeof(conversions) / sizeof(conversions[0]); c++) test_conversion(&conversions[c]);
+	test_blocks();
+
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
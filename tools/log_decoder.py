@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""Decodes the binary log stream of the firmware (LOGGER_BINARY_OUTPUT 1) back into text.
+
+The logger task sends each deferred LogMessage as a record (see LoggerThread.h):
+    struct LogRecordHeader    uint32 format, uint32 timestamp, uint8 sync (0xA5), uint8 level, uint8 nWords, uint8 reserved
+    nWords 32-bit words       the raw arguments, or the text of a text record (format 0)
+The format field is the flash address of the format string. It is looked up in the ELF of the firmware that
+produced the stream, which has to be the exact build running on the board.
+
+Bytes that are not part of a record (CLI replies, text written with SerialConsoleWriteString) are passed through,
+so the decoder can sit on the whole console output.
+
+Usage:
+    log_decoder.py firmware.elf [capture.bin]     decodes a capture, or stdin (e.g. a serial port) if none
+    log_decoder.py -t firmware.elf capture.bin    prefixes each record with its timestamp and level
+"""
+
+import argparse
+import struct
+import sys
+
+RECORD_SYNC = 0xA5  # LOGGER_RECORD_SYNC
+TEXT_RECORD = 0  # LOGGER_TEXT_RECORD
+RECORD_WORDS = 32  # LOGGER_RECORD_WORDS
+HEADER = struct.Struct("<IIBBBB")
+LEVELS = ["INFO", "DEBUG", "WARNING", "ERROR", "FATAL"]  # enum eDebugLogLevels
+
+
+class Elf:
+    """Read-only memory image of the allocated sections of an ELF file."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is64 = data[4] == 2
+        endian = "<" if data[5] == 1 else ">"
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x3A)
+            section = struct.Struct(endian + "IIQQQQIIQQ")
+        else:
+            shoff, = struct.unpack_from(endian + "I", data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", data, 0x2E)
+            section = struct.Struct(endian + "IIIIIIIIII")
+
+        self.sections = []
+        for index in range(shnum):
+            fields = section.unpack_from(data, shoff + index * shentsize)
+            sh_type, sh_flags, sh_addr, sh_offset, sh_size = fields[1], fields[2], fields[3], fields[4], fields[5]
+            SHF_ALLOC, SHT_NOBITS = 0x2, 8
+            if sh_flags & SHF_ALLOC and sh_type != SHT_NOBITS and sh_size > 0:
+                self.sections.append((sh_addr, data[sh_offset:sh_offset + sh_size]))
+
+    def string(self, address):
+        """Returns the NUL terminated string at address, or None if address is not in a loaded section."""
+        for start, contents in self.sections:
+            if start <= address < start + len(contents):
+                end = contents.find(b"\0", address - start)
+                if end < 0:
+                    return None
+                return contents[address - start:end].decode("latin-1")
+        return None
+
+
+class Words:
+    """Argument words of a record, consumed in order the way LoggerDeferMessage stored them."""
+
+    def __init__(self, words):
+        self.words = words
+        self.index = 0
+
+    def word(self):
+        value = self.words[self.index] if self.index < len(self.words) else 0
+        self.index += 1
+        return value
+
+    def double_word(self):
+        low = self.word()
+        high = self.word()
+        return low | (high << 32)
+
+
+def signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def format_record(fmt, words):
+    """Formats a record the way LoggerFormatRecord does on the board."""
+    args = Words(words)
+    out = []
+    i = 0
+    while True:
+        percent = fmt.find("%", i)
+        if percent < 0:
+            out.append(fmt[i:])
+            break
+        out.append(fmt[i:percent])
+        p = percent + 1
+
+        flags = ""
+        while p < len(fmt) and fmt[p] in "-+ #0":
+            flags += fmt[p]
+            p += 1
+        width = ""
+        if p < len(fmt) and fmt[p] == "*":
+            star = signed(args.word(), 32)
+            if star < 0:
+                flags += "-"
+            width = str(abs(star))
+            p += 1
+        while p < len(fmt) and fmt[p].isdigit():
+            width += fmt[p]
+            p += 1
+        precision = ""
+        if p < len(fmt) and fmt[p] == ".":
+            p += 1
+            if p < len(fmt) and fmt[p] == "*":
+                star = signed(args.word(), 32)
+                precision = "." + str(star) if star >= 0 else ""
+                p += 1
+            else:
+                digits = ""
+                while p < len(fmt) and fmt[p].isdigit():
+                    digits += fmt[p]
+                    p += 1
+                precision = "." + (digits or "0")
+        length = ""
+        while p < len(fmt) and fmt[p] in "hljztL":
+            length += fmt[p]
+            p += 1
+        if p >= len(fmt):
+            out.append(fmt[percent:])
+            break
+        conversion = fmt[p]
+        p += 1
+        spec = "%" + flags + width + precision
+
+        wide = "ll" in length or "j" in length
+        bits = 64 if wide else 8 if length == "hh" else 16 if length == "h" else 32
+        if conversion == "%":
+            out.append("%")
+        elif conversion in "di":
+            value = args.double_word() if wide else args.word()
+            out.append((spec + "d") % signed(value & ((1 << bits) - 1), bits))
+        elif conversion in "uoxX":
+            value = (args.double_word() if wide else args.word()) & ((1 << bits) - 1)
+            if "#" in flags and conversion != "u":
+                # C prefixes 0 and 0x only for non-zero values, Python always and with 0o for octal
+                digits = ("%" + precision + conversion) % value
+                if value != 0:
+                    digits = ("0" if conversion == "o" else "0" + conversion) + digits
+                out.append(("%" + flags.replace("#", "").replace("0", "") + width + "s") % digits)
+            else:
+                out.append((spec + ("d" if conversion == "u" else conversion)) % value)
+        elif conversion == "c":
+            out.append((spec + "c") % (args.word() & 0xFF))
+        elif conversion == "p":
+            out.append(("%" + flags.replace("#", "").replace("0", "") + width + "s") % ("0x%x" % args.word()))
+        elif conversion in "fFeEgGaA":
+            value = struct.unpack("<d", struct.pack("<Q", args.double_word()))[0]
+            if conversion in "aA":
+                text = value.hex()
+                out.append(text.upper() if conversion == "A" else text)
+            else:
+                out.append((spec + conversion) % value)
+        else:
+            out.append(fmt[percent:p])  # Never deferred by the board
+        i = p
+    return "".join(out)
+
+
+def decode(elf, stream, out, timestamps):
+    """Decodes stream (a binary file object) into out, passing through the bytes outside the records."""
+    pending = b""
+    eof = False
+    while not eof or pending:
+        if not eof:
+            chunk = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+            if chunk:
+                pending += chunk
+            else:
+                eof = True
+
+        i = 0
+        text = []
+        while i < len(pending):
+            if len(pending) - i < HEADER.size:
+                if not eof:
+                    break  # Could be the start of a header
+                text.append(pending[i:])
+                i = len(pending)
+                break
+            fmt_addr, timestamp, sync, level, n_words, reserved = HEADER.unpack_from(pending, i)
+            fmt = None
+            if sync == RECORD_SYNC and reserved == 0 and level < len(LEVELS) and n_words <= RECORD_WORDS:
+                fmt = "" if fmt_addr == TEXT_RECORD else elf.string(fmt_addr)
+            if fmt is None:
+                text.append(pending[i:i + 1])
+                i += 1
+                continue
+            end = i + HEADER.size + 4 * n_words
+            if end > len(pending):
+                if not eof:
+                    break
+                text.append(pending[i:i + 1])
+                i += 1
+                continue
+
+            raw = pending[i + HEADER.size:end]
+            if fmt_addr == TEXT_RECORD:
+                message = raw.split(b"\0", 1)[0].decode("latin-1")
+            else:
+                message = format_record(fmt, list(struct.unpack("<%dI" % n_words, raw)))
+            if timestamps:
+                message = "[%10u] %-7s %s" % (timestamp, LEVELS[level], message)
+            text.append(message.encode("latin-1"))
+            i = end
+
+        out.write(b"".join(text))
+        out.flush()
+        pending = pending[i:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decodes the binary log stream of the firmware")
+    parser.add_argument("elf", help="ELF of the firmware that produced the stream")
+    parser.add_argument("capture", nargs="?", help="Captured stream. Reads stdin if omitted")
+    parser.add_argument("-t", "--timestamps", action="store_true", help="Prefix records with their tick and level")
+    options = parser.parse_args()
+
+    elf = Elf(options.elf)
+    stream = open(options.capture, "rb") if options.capture else sys.stdin.buffer
+    try:
+        decode(elf, stream, sys.stdout.buffer, options.timestamps)
+    finally:
+        if options.capture:
+            stream.close()
+
+
+if __name__ == "__main__":
+    main()